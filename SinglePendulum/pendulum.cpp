@@ -5,8 +5,7 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_odeiv.h>
+#include "DormandPrince.h"
 
 const int columnWidth = 20;	// Width of output columns
 const int precision = 10;	// Decimal places to output
@@ -19,7 +18,7 @@ const double wd = 1;		// Angular frequency of driving force
 const double b = 0.5;		// Damping coefficient
 const int dimension = 2;	// Dimension of system 
 
-int PrimeFuncGSL(double t, const double y[], double dydt[], void* params);	// The derivative of theta and w
+void PrimeFunc(double t, const double y[], double dydt[]);	// The derivative of theta and w
 
 int main()
 {
@@ -29,35 +28,35 @@ int main()
 	double y[dimension] = {1, 0};	// Array of [theta, w]
 	double t = 0;			// Time
 	double tFinal = 60;		// Time to end simulation
-	double stepSize = 0.1;		// Initial step size for RK4
+	double stepSize = 0.1;		// Initial step size
 
-	gsl_odeiv_system GSLsystem = {PrimeFuncGSL, NULL, dimension, NULL};			// The GSL system
-	gsl_odeiv_step* StepFunc = gsl_odeiv_step_alloc(gsl_odeiv_step_rkf45, dimension);	// The GSL stepping function
-	gsl_odeiv_control* control = gsl_odeiv_control_standard_new(epsAbs, epsRel, 1, 0);	// The control function for adaptive step sizing
-	gsl_odeiv_evolve* evolve = gsl_odeiv_evolve_alloc(dimension);				// The workspace to evolve the system with adaptive step sizing
+	DormandPrince<dimension> solver(epsAbs, epsRel, stepSize);	// Adaptive step Dormand-Prince solver
+	solver.reset(t, y);
 	
 	// Main loop
 	while (t < tFinal)
 	{
 		// Check for Runge-Kutta success
-		if (gsl_odeiv_evolve_apply(evolve, control, StepFunc, &GSLsystem, &t, tFinal, &stepSize, y) != GSL_SUCCESS)
+		if (!solver.step(PrimeFunc, tFinal))
 		{
 			break;
 		}
+		t = solver.getTime();
+		y[0] = solver.getState()[0];
+		y[1] = solver.getState()[1];
 
 		// Output data
 		std::cout << std::setprecision(precision)
 			  << std::setw(columnWidth) << t
 			  << std::setw(columnWidth) << y[0] 
-			  << std::setw(columnWidth) << evolve->yerr[0] 
+			  << std::setw(columnWidth) << solver.getError(0) 
 			  << std::endl;
 	}
 }
 
 // Derivatives of theta and w
-int PrimeFuncGSL(double t, const double y[], double dydt[], void* params)
+void PrimeFunc(double t, const double y[], double dydt[])
 {
 	dydt[0] = y[1];
 	dydt[1] = -(g / l) * sin(y[0]) + (A * cos(wd * t) - b * y[1]) / (m * l * l);
-	return GSL_SUCCESS;
 }
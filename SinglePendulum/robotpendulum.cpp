@@ -1,12 +1,17 @@
 /* Damped pendulum, with shifting centre of mass to simulate robot
+ * Usage: robotpendulum [verlet|yoshida step]
+ * With no arguments the adaptive Dormand-Prince solver is used; otherwise fixed symplectic steps of the given size
  */
 
+#include <climits>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <cmath>
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_odeiv.h>
+#include <cstdlib>
+#include <cstring>
+#include "DormandPrince.h"
+#include "Symplectic.h"
 
 const int columnWidth = 20;	// Width of output columns
 const int precision = 10;	// Decimal places to output
@@ -21,9 +26,17 @@ const double range = 0.045;	// Half range of robot movement in m
 const double height = 0.34;	// Height of CoM of robot from feet in m
 const int dimension = 2;	// Dimension of system 
 
-int PrimeFuncGSL(double t, const double y[], double dydt[], void* params);	// The derivative of theta and w
+void PrimeFunc(double t, const double y[], double dydt[]);	// The derivative of theta and w
 
-int main()
+// The same equation of motion split into gravity, damping and the robot's force, for the symplectic steps
+struct RobotSwing
+{
+	double acceleration(double t, double theta);
+	double damping() { return b / (m * l * l); }
+	double drive(double t);
+};
+
+int main(int argc, char* argv[])
 {
 	double epsAbs = 1e-12;		// Maximum desired absolute error
 	double epsRel = 0;		// Maximum desired relative error
@@ -31,23 +44,63 @@ int main()
 	double y[dimension] = {0, 0};	// Array of [theta, w]
 	double t = 0;			// Time
 	double tFinal = 240;		// Time to end simulation
-	double stepSize = 0.1;		// Initial step size for RK4
+	double stepSize = 0.1;		// Initial step size
 
 	double maxTheta = 0;		// Maximum angle reached
 
-	gsl_odeiv_system GSLsystem = {PrimeFuncGSL, NULL, dimension, NULL};			// The GSL system
-	gsl_odeiv_step* StepFunc = gsl_odeiv_step_alloc(gsl_odeiv_step_rkf45, dimension);	// The GSL stepping function
-	gsl_odeiv_control* control = gsl_odeiv_control_standard_new(epsAbs, epsRel, 1, 0);	// The control function for adaptive step sizing
-	gsl_odeiv_evolve* evolve = gsl_odeiv_evolve_alloc(dimension);				// The workspace to evolve the system with adaptive step sizing
+	// a method that is not one of the two, or a step that is not a positive number, is an error rather than a guess
+	bool verlet = argc == 3 && std::strcmp(argv[1], "verlet") == 0;
+	bool yoshida = argc == 3 && std::strcmp(argv[1], "yoshida") == 0;
+	char* end = 0;
+	double h = argc == 3 ? std::strtod(argv[2], &end) : 0;
+	if (argc != 1 && (!(verlet || yoshida) || end == argv[2] || *end != '\0' || !(h > 0) || tFinal / h >= INT_MAX))
+	{
+		std::cerr << "Usage: " << argv[0] << " [verlet|yoshida step]" << std::endl;
+		return 1;
+	}
+
+	if (argc == 3)
+	{
+		Symplectic symplectic(yoshida ? Symplectic::YOSHIDA4 : Symplectic::VERLET);
+		RobotSwing swing;
+		int steps = static_cast<int>(tFinal / h + 0.5);
+
+		for (int i = 1; i <= steps; ++i)
+		{
+			symplectic.step(swing, t, y[0], y[1], h);
+			t = i * h;	// Avoid accumulating rounding in t
+
+			if (y[0] > maxTheta)
+			{
+				maxTheta = y[0];
+			}
+
+			std::cout << std::setprecision(precision)
+				  << std::setw(columnWidth) << t
+				  << std::setw(columnWidth) << y[0]
+				  << std::setw(columnWidth) << 0
+				  << std::setw(columnWidth) << y[1]
+				  << std::setw(columnWidth) << 0
+				  << std::endl;
+		}
+		std::cerr << maxTheta << std::endl;
+		return 0;
+	}
+
+	DormandPrince<dimension> solver(epsAbs, epsRel, stepSize);	// Adaptive step Dormand-Prince solver
+	solver.reset(t, y);
 	
 	// Main loop
 	while (t < tFinal)
 	{
 		// Check for Runge-Kutta success
-		if (gsl_odeiv_evolve_apply(evolve, control, StepFunc, &GSLsystem, &t, tFinal, &stepSize, y) != GSL_SUCCESS)
+		if (!solver.step(PrimeFunc, tFinal))
 		{
 			break;
 		}
+		t = solver.getTime();
+		y[0] = solver.getState()[0];
+		y[1] = solver.getState()[1];
 	
 		// Record maximum angle reached
 		if (y[0] > maxTheta)
@@ -59,21 +112,33 @@ int main()
 		std::cout << std::setprecision(precision)
 			  << std::setw(columnWidth) << t
 			  << std::setw(columnWidth) << y[0] 
-			  << std::setw(columnWidth) << evolve->yerr[0] 
+			  << std::setw(columnWidth) << solver.getError(0) 
 			  << std::setw(columnWidth) << y[1] 
-			  << std::setw(columnWidth) << evolve->yerr[1] 
+			  << std::setw(columnWidth) << solver.getError(1) 
 			  << std::endl;
 	}
 	std::cerr << maxTheta << std::endl;
 }
 
 // Derivatives of theta and w
-int PrimeFuncGSL(double t, const double y[], double dydt[], void* params)
+void PrimeFunc(double t, const double y[], double dydt[])
 {
 	double theta = (mp * y[0] + m * (y[0] + (range / (l - height)) * cos(wr * t))) / (mp + m);	// Theta of centre of mass
 	double f = - (m * m * wr * wr * range / ((l - height) * (mp + m))) * cos(wr * t);		// Approximate force exered by robot on swing
 
 	dydt[0] = y[1];
 	dydt[1] = - (g / l) * sin(theta) + (f - b * y[1]) / (m * l * l); 
-	return GSL_SUCCESS;
+}
+
+// Gravity on the combined centre of mass
+double RobotSwing::acceleration(double t, double theta)
+{
+	double thetaCoM = (mp * theta + m * (theta + (range / (l - height)) * cos(wr * t))) / (mp + m);
+	return - (g / l) * sin(thetaCoM);
+}
+
+// Approximate force exerted by robot on swing
+double RobotSwing::drive(double t)
+{
+	return - (m * m * wr * wr * range / ((l - height) * (mp + m))) * cos(wr * t) / (m * l * l);
 }
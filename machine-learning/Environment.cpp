@@ -30,8 +30,7 @@ void Environment::propagate() // Calculate successive values of theta and thetad
 
 	for (int i = 0; i < N; ++i) // Calculate theta and thetadot at time t+dt
 	{
-		theta = rk4theta(h); 			// Calculate the value of theta at time t+h
-		thetadot = rk4thetadot(h);		// Calculate the value of thetadot at time t+h
+		rk4step(h);			// Calculate the values of theta and thetadot at time t+h
 	}
 
 	time += dt;	 // Propogate time
@@ -60,26 +59,24 @@ void Environment::resetPendulum()
 	time = 0;
 }
 
-double Environment::rk4theta(double h)
+// theta and thetadot are solved together, each stage using both halves of the previous stage
+void Environment::rk4step(double h)
 {
-	double k1 = h * thetadot;
-	double k2 = h * (thetadot + 0.5 * k1);
-	double k3 = h * (thetadot + 0.5 * k2);
-	double k4 = h * (thetadot + k3);
+	double k1theta = thetadot;
+	double k1thetadot = thetadotdot(theta, thetadot);
+	double k2theta = thetadot + 0.5 * h * k1thetadot;
+	double k2thetadot = thetadotdot(theta + 0.5 * h * k1theta, k2theta);
+	double k3theta = thetadot + 0.5 * h * k2thetadot;
+	double k3thetadot = thetadotdot(theta + 0.5 * h * k2theta, k3theta);
+	double k4theta = thetadot + h * k3thetadot;
+	double k4thetadot = thetadotdot(theta + h * k3theta, k4theta);
 
-	theta += k1 / 6 + k2 / 3 + k3 / 3 + k4 / 6;
-
-	return theta;
+	theta += h * (k1theta + 2 * k2theta + 2 * k3theta + k4theta) / 6;
+	thetadot += h * (k1thetadot + 2 * k2thetadot + 2 * k3thetadot + k4thetadot) / 6;
 }
-double Environment::rk4thetadot(double h)
+
+double Environment::thetadotdot(double _theta, double _thetadot)
 {
 	double g = 9.81;
-	double k1 = h * (torque - gamma * thetadot - mass * g * l * sin(theta)) / (mass * l * l);
-	double k2 = h * (torque - gamma * (thetadot + 0.5 * k1) - mass * g * l * sin(theta)) / (mass * l * l);
-	double k3 = h * (torque - gamma * (thetadot + 0.5 * k2) - mass * g * l * sin(theta)) / (mass * l * l);
-	double k4 = h * (torque - gamma * (thetadot + k3) - mass * g * l * sin(theta)) / (mass * l * l);
-
-	thetadot += k1 / 6 + k2 / 3 + k3 / 3 + k4 / 6;
-
-	return thetadot;
+	return (torque - gamma * _thetadot - mass * g * l * sin(_theta)) / (mass * l * l);
 }
@@ -21,8 +21,8 @@ class Environment
 	private:
 		
 		//Runge-Kutta 4 method for solving the equation of motion for a driven pendulum
-		double rk4theta(double h); //RK4 solve for theta
-		double rk4thetadot(double h); //RK4 solve for thetadot
+		void rk4step(double h); //Advance theta and thetadot together by one RK4 step of size h
+		double thetadotdot(double _theta, double _thetadot); //Angular acceleration at the given state
 		
 		
 		const double maxtorque; //Set a maximum torque in order to keep the pendulum 'undertorqued' (N m)
@@ -9,6 +9,7 @@
 #include "PriorityQueue.h"
 #include "State.h"
 #include "Environment.h"
+#include "../pendulum/ConvergenceMonitor.h"
 
 //function to calculate a temperature for the select action function as a function of time
 double temperature(unsigned long t);
@@ -16,8 +17,8 @@ double temperature(unsigned long t);
 //function to select next action
 float selectAction(PriorityQueue<float, double>& a_queue, unsigned long iterations);
 
-//function to update a q value
-void updateQ(StateSpace & space, float  action, State & new_state, State & old_state, double alpha, double gamma);
+//function to update a q value, reporting the update to the convergence monitor
+void updateQ(StateSpace & space, float  action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor);
 
 int main()
 {
@@ -57,7 +58,7 @@ int main()
 	}
 	
 	//create the state space
-	StateSpace space(initiator_queue, angle_bins, velocity_bins, torque_bins, max_angle, max_velocity, max_torque);
+	StateSpace space(initiator_queue, angle_bins, velocity_bins, torque_bins, max_angle, max_velocity, max_torque, Discretiser::WRAP);
 	
 	//state objects
 	State current_state(0, 0, 0);
@@ -68,9 +69,14 @@ int main()
 	
 //	file << "Trialno" << "	" << "Time" << "		" << "Theta" << "	" << "Thetadot" << "		" << "Torque" << std::endl;
 	
+	//stop once the policy has settled: windows of 1000 updates, stable when max |dQ| < 1e-3
+	//and < 1% of visited cells change their best action, with a flat return over the last 20 trials
+	ConvergenceMonitor monitor(1000UL, 1e-3, 0.01, 3);
+	monitor.setRewardTrend(20, 1e-3);
+	
 	double trialno = 1;
 	unsigned long i=0;
-	while (true)
+	while (!monitor.converged())
 	{
 		current_state.theta = env->getTheta();
 		current_state.theta_dot = env->getThetadot();
@@ -78,12 +84,14 @@ int main()
 		
 		std::cout << "State Read" << std::endl;
 		
-		updateQ(space, chosen_action, old_state, current_state, alpha, gamma);
+		updateQ(space, chosen_action, old_state, current_state, alpha, gamma, monitor);
+		if (monitor.getUpdates() % 1000UL == 0UL) std::cout << monitor << std::endl;
 
 		if (std::abs(current_state.theta_dot) > 5)
 		{
 			env->resetPendulum();
 			std::cout<<"->unsuccessful trial\n";
+			monitor.endEpisode();
 			trialno++;
 			i = 0;
 			continue;
@@ -102,6 +110,8 @@ int main()
 		++i;
 	}
 
+	std::cout << "Converged after " << monitor.getUpdates() << " updates: " << monitor << std::endl;
+	
 //	file.close();
 	
 	delete env;
@@ -159,10 +169,14 @@ float selectAction(PriorityQueue<float, double>& a_queue, unsigned long iteratio
 	return -10; //note that this line should never be reached	
 }
 
-void updateQ(StateSpace & space, float action, State & new_state, State & old_state, double alpha, double gamma)
+void updateQ(StateSpace & space, float action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor)
 {
+	//queue of the state being updated, and its best action before the update
+	PriorityQueue<float, double>& queue = space[old_state];
+	float oldBest = queue.peekFront().first;
+	
 	//oldQ value reference
-	double oldQ = space[old_state].search(action).second;
+	double oldQ = queue.search(action).second;
 	
 	//reward given to current state 
 	double R = new_state.getReward();
@@ -173,7 +187,10 @@ void updateQ(StateSpace & space, float action, State & new_state, State & old_st
 	//new Q value determined by Q learning algorithm
 	double newQ = oldQ + alpha * (R + (gamma * maxQ) - oldQ);
 	
-	space[old_state].changePriority(action, newQ);
+	queue.changePriority(action, newQ);
+	
+	monitor.recordUpdate(space.cell(old_state), oldQ, newQ, queue.peekFront().first != oldBest);
+	monitor.recordReward(R);
 	
 	std::cout << "Q Updated to "<< newQ << std::endl;
 }
@@ -0,0 +1,244 @@
+/*
+* CompoundSwing.cpp
+* Robotics 2016
+*
+*/
+
+#include "CompoundSwing.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	const double g = 9.81;
+	const double pi = 3.14159265358979323846;
+
+	// Left leg joint angles of MovementTools' sitForward and sitBackward postures
+	const double hipForward = -1.0845;
+	const double kneeForward = 1.54163;
+	const double hipBackward = -0.601286;
+	const double kneeBackward = -0.090548;
+
+	// Knee limits MovementTools::humanPosition clips to
+	const double minLegs = -0.09;
+	const double maxLegs = 1.52;
+
+	double clip(double x, double lo, double hi)
+	{
+		return std::max(lo, std::min(x, hi));
+	}
+
+	// Solve the symmetric positive definite system A x = b by Cholesky decomposition, all on the stack
+	void solve3(const double A[3][3], const double b[3], double x[3])
+	{
+		double L00 = std::sqrt(A[0][0]);
+		double L10 = A[1][0] / L00;
+		double L20 = A[2][0] / L00;
+		double L11 = std::sqrt(A[1][1] - L10 * L10);
+		double L21 = (A[2][1] - L20 * L10) / L11;
+		double L22 = std::sqrt(A[2][2] - L20 * L20 - L21 * L21);
+
+		double z0 = b[0] / L00;
+		double z1 = (b[1] - L10 * z0) / L11;
+		double z2 = (b[2] - L20 * z0 - L21 * z1) / L22;
+
+		x[2] = z2 / L22;
+		x[1] = (z1 - L21 * x[2]) / L11;
+		x[0] = (z0 - L10 * x[1] - L20 * x[2]) / L00;
+	}
+}
+
+//defaults are the NAO (5.2 kg in all, as robotpendulum.cpp) on the 20 kg, 1.9 m swing
+CompoundParameters::CompoundParameters() :
+	swingMass(20),
+	length(1.9),
+	damping(0.05),
+	upperMass(2.4),
+	upperCOM(0.2),
+	upperInertia(0.02),
+	lowerMass(2.8),
+	lowerCOM(0.15),
+	lowerInertia(0.02),
+	servoFrequency(30),
+	servoDamping(1)
+{}
+
+compoundSwing::compoundSwing(double _theta, double _thetadot, double _posture, double _time, double _deltatime, const CompoundParameters& _parameters)
+	: dt(_deltatime), parameters(_parameters), time(_time),
+	start(clip(_posture, -1, 1)), target(start), startTime(_time), motionTime(0.7),
+	minAngle(0), maxAngle(pi / 180), forwards(false),
+	controller(POSTURE), verbose(true), h(0.02)
+{
+	state[0] = _theta;
+	state[3] = _thetadot;
+	double q[2], qdot[2];
+	desired(time, state, q, qdot);
+	state[1] = q[0];
+	state[2] = q[1];
+	state[4] = 0;
+	state[5] = 0;
+}
+
+void compoundSwing::propagate() // Calculate successive values of the state
+{
+	if (verbose) std::cout << "Progagating" << std::endl;
+
+	int N = std::max(1, static_cast<int>(std::ceil(dt / h)));
+	double t0 = time;
+	for (int i = 0; i < N; ++i)
+	{
+		double previous = state[3];
+		rk4step(dt / N);
+		time = t0 + dt * (i + 1) / N;
+
+		// as humanswing: at each change of direction, widen the range of the swing
+		if ((state[3] < 0) != (previous < 0))
+		{
+			forwards = state[3] < 0;
+			if (state[0] < minAngle) minAngle = state[0];
+			else if (state[0] > maxAngle) maxAngle = state[0];
+		}
+	}
+
+	if (verbose) std::cout << "\tTheta: " << state[0] << ", Thetadot: " << state[3] << ", Hip: " << state[1] << ", Knee: " << state[2] << "\n";
+}
+
+// A new posture interrupts any transition in progress and starts from where the last one was heading to by now
+void compoundSwing::setTorque(double _T)
+{
+	if (verbose) std::cout << "Setting posture to " << _T << std::endl;
+	double next = clip(_T, -1, 1);
+	if (next == target) return;
+	double u = clip((time - startTime) / motionTime, 0, 1);
+	start = start + (target - start) * u * u * (3 - 2 * u);
+	target = next;
+	startTime = time;
+}
+
+double compoundSwing::getUpperCOMAngle()
+{
+	return 1.5 * pi + state[1];
+}
+
+double compoundSwing::getLowerCOMAngle()
+{
+	return 0.5 * pi - 0.5 * state[2];
+}
+
+void compoundSwing::resetPendulum()
+{
+	start = target;
+	startTime = 0;
+	time = 0;
+	minAngle = 0;
+	maxAngle = pi / 180;
+	double q[2], qdot[2];
+	state[0] = 0;
+	state[3] = 0;
+	desired(time, state, q, qdot);
+	state[1] = q[0];
+	state[2] = q[1];
+	state[4] = 0;
+	state[5] = 0;
+}
+
+void compoundSwing::desired(double _t, const double y[6], double q[2], double qdot[2])
+{
+	// smoothstep 3u^2 - 2u^3 from start to target, then from sitBackward (-1) to sitForward (+1)
+	double u = clip((_t - startTime) / motionTime, 0, 1);
+	double p = start + (target - start) * u * u * (3 - 2 * u);
+	double pdot = u > 0 && u < 1 ? (target - start) * 6 * u * (1 - u) / motionTime : 0;
+	double s = 0.5 * (p + 1);
+	q[0] = hipBackward + (hipForward - hipBackward) * s;
+	qdot[0] = 0.5 * (hipForward - hipBackward) * pdot;
+
+	if (controller == HUMAN)
+	{
+		// MovementTools::humanPosition of the progress through the swing, as humanswing calls it.
+		// Only the knees follow it, as on the robot, where the body is left out while the right arm is broken
+		double t = clip(std::abs(y[0] - minAngle) / std::abs(maxAngle - minAngle), 0, 1);
+		double legs = forwards
+			? t * (t * (t * (t * (10.7608) - 19.1384) + 14.255) - 5.12733) + 0.640052
+			: t * (t * (t * (t * (-18.9054) + 40.952) - 32.3375) + 11.0356) + 0.641814;
+		q[1] = clip(legs, minLegs, maxLegs);
+		qdot[1] = 0;
+		return;
+	}
+
+	q[1] = kneeBackward + (kneeForward - kneeBackward) * s;
+	qdot[1] = 0.5 * (kneeForward - kneeBackward) * pdot;
+}
+
+// Lagrange's equations in the absolute angles of the three bodies, phi = (theta, theta + 3pi/2 + hip, theta + pi/2 - knee/2),
+// taken over to the joint coordinates (theta, hip, knee) with the constant Jacobian T of phi
+void compoundSwing::derivative(double _t, const double y[6], double dydt[6])
+{
+	const CompoundParameters& p = parameters;
+	const double L = p.length;
+	const double m[2] = { p.upperMass, p.lowerMass };
+	const double r[2] = { p.upperCOM, p.lowerCOM };
+	const double I[2] = { p.upperInertia, p.lowerInertia };
+
+	// angles of the two bodies from the swing, and absolute rates
+	const double q[2] = { 1.5 * pi + y[1], 0.5 * pi - 0.5 * y[2] };
+	const double w0 = y[3];
+	const double w[2] = { y[3] + y[4], y[3] - 0.5 * y[5] };
+
+	// mass matrix and forces (gravity, centripetal and Coriolis) in the absolute angles
+	double A[3][3] = { { (p.swingMass + m[0] + m[1]) * L * L, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+	double F[3] = { -g * (p.swingMass + m[0] + m[1]) * L * std::sin(y[0]), 0, 0 };
+	for (int k = 0; k < 2; ++k)
+	{
+		double c = std::cos(q[k]), s = std::sin(q[k]);
+		double mLr = m[k] * L * r[k];
+		A[0][k + 1] = A[k + 1][0] = mLr * c;
+		A[k + 1][k + 1] = m[k] * r[k] * r[k] + I[k];
+		F[0] += mLr * s * w[k] * w[k];
+		F[k + 1] = -mLr * s * w0 * w0 - g * m[k] * r[k] * std::sin(y[0] + q[k]);
+	}
+
+	// M = T^T A T and f = T^T F, with T = [1 0 0; 1 1 0; 1 0 -1/2]
+	const double T[3][3] = { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 0, -0.5 } };
+	double M[3][3], f[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		f[i] = 0;
+		for (int a = 0; a < 3; ++a) f[i] += T[a][i] * F[a];
+		for (int j = 0; j < 3; ++j)
+		{
+			double sum = 0;
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < 3; ++b) sum += T[a][i] * A[a][b] * T[b][j];
+			M[i][j] = sum;
+		}
+	}
+
+	// friction at the pivot, and servo torques scaled by each joint's inertia to give the same tracking response
+	double qd[2], qddot[2];
+	desired(_t, y, qd, qddot);
+	const double wn = p.servoFrequency;
+	f[0] -= p.damping * y[3];
+	for (int k = 0; k < 2; ++k)
+	{
+		f[k + 1] += M[k + 1][k + 1] * (wn * wn * (qd[k] - y[k + 1]) + 2 * p.servoDamping * wn * (qddot[k] - y[k + 4]));
+	}
+
+	dydt[0] = y[3];
+	dydt[1] = y[4];
+	dydt[2] = y[5];
+	solve3(M, f, dydt + 3);
+}
+
+void compoundSwing::rk4step(double _h)
+{
+	double k1[6], k2[6], k3[6], k4[6], tmp[6];
+	derivative(time, state, k1);
+	for (int i = 0; i < 6; ++i) tmp[i] = state[i] + 0.5 * _h * k1[i];
+	derivative(time + 0.5 * _h, tmp, k2);
+	for (int i = 0; i < 6; ++i) tmp[i] = state[i] + 0.5 * _h * k2[i];
+	derivative(time + 0.5 * _h, tmp, k3);
+	for (int i = 0; i < 6; ++i) tmp[i] = state[i] + _h * k3[i];
+	derivative(time + _h, tmp, k4);
+	for (int i = 0; i < 6; ++i) state[i] += _h * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]) / 6;
+}
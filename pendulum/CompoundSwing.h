@@ -0,0 +1,109 @@
+/*
+* CompoundSwing.h
+* Robotics 2016
+* Simulate the robot on the swing as three rigid bodies rather than a point mass: the swing, the robot's upper body
+* (torso, head and arms) and its lower body (legs), as BodyInfo::getSittingCOMAngles splits it.
+* The upper body turns about the hip with the hip pitch and the lower body's centre of mass turns through half the
+* knee pitch (the thighs stay on the seat), using the NAO's joint angles so postures can be copied from MovementTools.
+* The joints follow prescribed trajectories through PD control and their reaction drives the swing.
+*
+* The state (theta, hip, knee and their rates) is advanced with fixed RK4 steps; each evaluation builds the 3x3 mass
+* matrix on the stack and solves it directly.
+*
+* The interface matches 'environment'. With the POSTURE controller the "torque" is the posture to move to, as in
+* swingEnvironment: -1 for sitBackward, +1 for sitForward, anything between for a lerpSwing part way, reached over
+* motionTime with a smoothstep. With the HUMAN controller the joints follow MovementTools::humanPosition as
+* humanswing drives it, from the progress through the current swing.
+*/
+
+#ifndef COMPOUNDSWING_H_
+#define COMPOUNDSWING_H_
+
+struct CompoundParameters
+{
+	//swing, its mass taken to be at the seat
+	double swingMass;
+	double length;
+	double damping;		// Friction torque per unit angular velocity at the pivot
+
+	//robot, distances of each centre of mass from the hip and inertias about the centres of mass
+	double upperMass;
+	double upperCOM;
+	double upperInertia;
+	double lowerMass;
+	double lowerCOM;
+	double lowerInertia;
+
+	//joint servos, as a natural frequency and damping ratio of the tracking error
+	double servoFrequency;
+	double servoDamping;
+
+	CompoundParameters();
+};
+
+class compoundSwing
+{
+public:
+
+	enum Controller
+	{
+		POSTURE,	// Smoothstep transitions between sitBackward and sitForward, chosen by setTorque
+		HUMAN		// MovementTools::humanPosition of the progress through the swing
+	};
+
+	explicit compoundSwing(double _theta, double _thetadot, double _posture, double _time, double _deltatime, const CompoundParameters& _parameters = CompoundParameters());
+
+	void propagate(); // Propogate the swing and the robot through time
+
+	double getTheta() { return state[0]; };
+	double getThetadot() { return state[3]; };
+	double getTorque() { return target; };	// Posture the robot is moving to (or is in)
+	double getTime() { return time; };
+
+	double getHipPitch() { return state[1]; };
+	double getKneePitch() { return state[2]; };
+	double getUpperCOMAngle();	// Angle of the upper body's centre of mass from the seat, as getSittingCOMAngles
+	double getLowerCOMAngle();
+
+	void setTorque(double _T);	// Start moving to the posture _T, clamped to [-1, 1]
+	void setController(Controller _controller) { controller = _controller; };
+
+	void setVerbose(bool _verbose) { verbose = _verbose; };
+	void setMotionTime(double _motionTime) { motionTime = _motionTime; };	// Time a full posture transition takes
+	void setStepSize(double _h) { h = _h; };	// Largest RK4 step used within a propagate (0.02 s by default)
+
+	void resetPendulum();	// Reset to theta=0, thetadot=0, time=0 with the robot still and in its current posture
+
+private:
+
+	// Joint angles wanted at time _t, and their rates
+	void desired(double _t, const double y[6], double q[2], double qdot[2]);
+
+	// Rates of the state y = [theta, hip, knee, thetadot, hipdot, kneedot]
+	void derivative(double _t, const double y[6], double dydt[6]);
+
+	void rk4step(double _h);
+
+	const double dt;	// The time interval the swing will be propogated over
+	const CompoundParameters parameters;
+
+	double state[6];
+	double time;
+
+	// Current posture transition, from start to target over [startTime, startTime + motionTime]
+	double start;
+	double target;
+	double startTime;
+	double motionTime;
+
+	// Extremes of the last swing and direction, for the HUMAN controller as in humanswing
+	double minAngle;
+	double maxAngle;
+	bool forwards;
+
+	Controller controller;
+	bool verbose;	// Print progress to std::cout in propagate and setTorque
+	double h;
+};
+
+#endif /* COMPOUNDSWING_H_ */
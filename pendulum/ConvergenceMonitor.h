@@ -0,0 +1,336 @@
+/**
+ * @file ConvergenceMonitor.h
+ *
+ * @brief Contains ConvergenceMonitor class, used by the training loops to stop once the policy has settled.
+ *
+ * @author Machine Learning Team 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef CONVERGENCE_MONITOR_H
+#define CONVERGENCE_MONITOR_H
+
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+/**
+ * @class ConvergenceMonitor
+ *
+ * @brief Tracks how much a Q-learning run is still changing its policy, and decides when it has converged.
+ *
+ * Every Q-value update is reported through recordUpdate(). Updates are grouped into windows of a fixed
+ * number of updates, and for each window the monitor records the maximum and mean of \f$|\Delta Q|\f$
+ * and the fraction of the visited cells whose best action (the front of the cell's queue) changed. A
+ * running mean of \f$|\Delta Q|\f$ is also kept as an exponential moving average.
+ *
+ * Rewards are accumulated with recordReward() into an episode return, which is stored when endEpisode()
+ * is called. The trend of the returns over the last few episodes is the slope of a least squares fit.
+ *
+ * The run is considered converged once a number of consecutive windows (the patience) have all had a
+ * maximum \f$|\Delta Q|\f$ and an argmax-change fraction below their tolerances, and - when episodes are
+ * being recorded - the reward trend is flat to within its tolerance.
+ *
+ * Cells are told apart by their index in the state space. Each cell's last visit and last change of best
+ * action are marked with the number of the window they fell in, so counting the cells of a window takes no
+ * search, and a new window is started by moving on to the next number. All per-update work is constant time
+ * and nothing is allocated once every cell has been seen, so the cost is negligible beside a PriorityQueue search.
+ *
+ * \code{.cpp}
+ *	ConvergenceMonitor monitor(200, 1e-3, 0.01, 3);
+ *	while (!monitor.converged()) {
+ *		// ...
+ *		int oldBest = queue.peekFront().first;
+ *		queue.changePriority(action, newQ);
+ *		monitor.recordUpdate(space.cell(state), oldQ, newQ, queue.peekFront().first != oldBest);
+ *		monitor.recordReward(R);
+ *	}
+ * \endcode
+ *
+ * @author Machine Learning Team 2015-2016
+ * @date March, 2016
+ */
+class ConvergenceMonitor {
+
+public:
+	/**
+	 * @brief Constructor with window length and tolerances.
+	 *
+	 * @param _window Number of updates in each measurement window
+	 * @param _delta_tolerance A window is stable if its maximum |dQ| is below this value
+	 * @param _argmax_tolerance A window is stable if the fraction of visited cells whose best action changed is below this value
+	 * @param _patience Number of consecutive stable windows required for convergence
+	 */
+	explicit ConvergenceMonitor(unsigned long _window = 100UL, double _delta_tolerance = 1e-3, double _argmax_tolerance = 0.01, unsigned int _patience = 3) :
+		window(_window),
+		delta_tolerance(_delta_tolerance),
+		argmax_tolerance(_argmax_tolerance),
+		patience(_patience),
+		trend_episodes(20),
+		trend_tolerance(1e-3),
+		smoothing(0.01),
+		epoch(0UL) {
+		reset();
+	}
+
+	/**
+	 * @brief Clears all counters and recorded episodes.
+	 */
+	void reset() {
+		updates = 0UL;
+		windows = 0UL;
+		stable_windows = 0U;
+		window_updates = 0UL;
+		window_sum = 0.0;
+		window_max = 0.0;
+		last_max = 0.0;
+		last_mean = 0.0;
+		last_fraction = 0.0;
+		running_mean = 0.0;
+		episode_return = 0.0;
+		episodes = 0UL;
+		returns.clear();
+		startWindow();
+	}
+
+	/**
+	 * @brief Records a single Q-value update.
+	 *
+	 * @param cell Index of the state-space cell that was updated (StateSpace::cell)
+	 * @param oldQ Q-value before the update
+	 * @param newQ Q-value after the update
+	 * @param argmax_changed Whether the best action of the cell changed as a result of the update
+	 */
+	void recordUpdate(std::size_t cell, double oldQ, double newQ, bool argmax_changed) {
+		double delta = std::abs(newQ - oldQ);
+
+		++updates;
+		++window_updates;
+		window_sum += delta;
+		if (delta > window_max)
+			window_max = delta;
+		running_mean += smoothing * (delta - running_mean);
+
+		// grown only the first time a cell beyond the last seen is updated
+		if (cell >= visited.size()) {
+			visited.resize(cell + 1, 0UL);
+			changed.resize(cell + 1, 0UL);
+		}
+		if (visited[cell] != epoch) {
+			visited[cell] = epoch;
+			++visited_cells;
+		}
+		if (argmax_changed && changed[cell] != epoch) {
+			changed[cell] = epoch;
+			++changed_cells;
+		}
+
+		if (window_updates >= window)
+			closeWindow();
+	}
+
+	/**
+	 * @brief Adds a reward to the return of the current episode.
+	 *
+	 * @param reward Reward received at this step
+	 */
+	void recordReward(double reward) {
+		episode_return += reward;
+	}
+
+	/**
+	 * @brief Stores the return of the current episode and starts a new one.
+	 */
+	void endEpisode() {
+		returns.push_back(episode_return);
+		while (returns.size() > trend_episodes)
+			returns.pop_front();
+		episode_return = 0.0;
+		++episodes;
+	}
+
+	/**
+	 * @brief Sets the number of episodes used for the reward trend, and the largest slope (in return per episode,
+	 *		  relative to the mean return) that still counts as flat. A negative tolerance disables the check.
+	 *
+	 * @param _episodes Number of most recent episodes to fit
+	 * @param _tolerance Relative slope tolerance
+	 */
+	void setRewardTrend(std::size_t _episodes, double _tolerance) {
+		trend_episodes = _episodes < 2 ? 2 : _episodes;
+		trend_tolerance = _tolerance;
+	}
+
+	/**
+	 * @brief Determines whether the run has converged.
+	 *
+	 * @return True once the last 'patience' windows were stable and the reward trend (if any) is flat
+	 */
+	bool converged() const {
+		if (stable_windows < patience)
+			return false;
+		// the reward trend is only used once enough episodes have been seen
+		if (trend_tolerance < 0.0 || returns.size() < trend_episodes)
+			return true;
+		double scale = std::abs(getMeanReturn());
+		return std::abs(getRewardTrend()) <= trend_tolerance * (scale > 1.0 ? scale : 1.0);
+	}
+
+	/** @brief Total number of updates recorded. */
+	unsigned long getUpdates() const { return updates; }
+
+	/** @brief Number of completed windows. */
+	unsigned long getWindows() const { return windows; }
+
+	/** @brief Number of consecutive stable windows up to the last completed one. */
+	unsigned int getStableWindows() const { return stable_windows; }
+
+	/** @brief Maximum |dQ| over the last completed window. */
+	double getWindowMaxDelta() const { return last_max; }
+
+	/** @brief Mean |dQ| over the last completed window. */
+	double getWindowMeanDelta() const { return last_mean; }
+
+	/** @brief Fraction of cells visited in the last completed window whose best action changed. */
+	double getArgmaxChangeFraction() const { return last_fraction; }
+
+	/** @brief Exponential moving average of |dQ| over all updates. */
+	double getRunningMeanDelta() const { return running_mean; }
+
+	/** @brief Number of completed episodes. */
+	unsigned long getEpisodes() const { return episodes; }
+
+	/** @brief Return of the episode in progress. */
+	double getEpisodeReturn() const { return episode_return; }
+
+	/** @brief Return of the last completed episode (zero if there are none). */
+	double getLastReturn() const { return returns.empty() ? 0.0 : returns.back(); }
+
+	/** @brief Mean return over the episodes used for the trend. */
+	double getMeanReturn() const {
+		if (returns.empty())
+			return 0.0;
+		double sum = 0.0;
+		for (std::deque<double>::const_iterator iter = returns.begin(); iter != returns.end(); ++iter)
+			sum += *iter;
+		return sum / returns.size();
+	}
+
+	/**
+	 * @brief Slope of a least squares line through the most recent episode returns.
+	 *
+	 * @return Change in return per episode, zero if fewer than two episodes have been recorded
+	 */
+	double getRewardTrend() const {
+		std::size_t n = returns.size();
+		if (n < 2)
+			return 0.0;
+		double xmean = 0.5 * (n - 1);
+		double ymean = getMeanReturn();
+		double sxy = 0.0;
+		double sxx = 0.0;
+		for (std::size_t i = 0; i < n; ++i) {
+			double dx = i - xmean;
+			sxy += dx * (returns[i] - ymean);
+			sxx += dx * dx;
+		}
+		return sxy / sxx;
+	}
+
+	/**
+	 * @brief Writes a one line summary of the counters to a stream.
+	 *
+	 * @param stream Stream to write to
+	 * @return Reference to the stream
+	 */
+	std::ostream& print(std::ostream& stream) const {
+		stream << "updates " << updates
+			<< "\twindow max|dQ| " << last_max
+			<< "\tmean|dQ| " << last_mean
+			<< "\targmax changed " << last_fraction
+			<< "\tstable " << stable_windows << "/" << patience;
+		if (episodes)
+			stream << "\tepisodes " << episodes << "\treturn trend " << getRewardTrend();
+		return stream;
+	}
+
+private:
+	/**
+	 * @brief Finishes the current window, updating the last-window counters and the stable window count.
+	 */
+	void closeWindow() {
+		last_max = window_max;
+		last_mean = window_sum / window_updates;
+		last_fraction = visited_cells == 0UL ? 0.0 : static_cast<double>(changed_cells) / visited_cells;
+
+		if (last_max < delta_tolerance && last_fraction < argmax_tolerance)
+			++stable_windows;
+		else
+			stable_windows = 0U;
+
+		++windows;
+		window_updates = 0UL;
+		window_sum = 0.0;
+		window_max = 0.0;
+		startWindow();
+	}
+
+	/**
+	 * @brief Starts counting visited and changed cells afresh; marks from earlier windows no longer match.
+	 */
+	void startWindow() {
+		++epoch;
+		visited_cells = 0UL;
+		changed_cells = 0UL;
+	}
+
+	// settings
+	unsigned long window;
+	double delta_tolerance;
+	double argmax_tolerance;
+	unsigned int patience;
+	std::size_t trend_episodes;
+	double trend_tolerance;
+	double smoothing;
+
+	// update counters
+	unsigned long updates;
+	unsigned long windows;
+	unsigned int stable_windows;
+
+	// current window
+	unsigned long window_updates;
+	double window_sum;
+	double window_max;
+	unsigned long epoch;			// number of the current window, never reused
+	std::vector<unsigned long> visited;	// per cell, the epoch of its last update
+	std::vector<unsigned long> changed;	// per cell, the epoch of its last change of best action
+	unsigned long visited_cells;
+	unsigned long changed_cells;
+
+	// last completed window
+	double last_max;
+	double last_mean;
+	double last_fraction;
+	double running_mean;
+
+	// episodes
+	double episode_return;
+	unsigned long episodes;
+	std::deque<double> returns;
+};
+
+/**
+ * @brief Overloaded stream insertion operator, writes the monitor summary.
+ *
+ * @param stream std::ostream reference to send the summary to
+ * @param monitor Monitor to summarise
+ * @return Reference to the stream
+ */
+inline std::ostream& operator<<(std::ostream& stream, const ConvergenceMonitor& monitor) {
+	return monitor.print(stream);
+}
+
+#endif
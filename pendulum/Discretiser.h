@@ -0,0 +1,187 @@
+/**
+ * @file Discretiser.h
+ *
+ * @brief Contains Discretiser class, used by the state spaces to turn continuous state variables into bin indices.
+ *
+ * @author Machine Learning Team 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef DISCRETISER_H
+#define DISCRETISER_H
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @class Discretiser
+ *
+ * @brief Maps a continuous variable in \f$[-max, max]\f$ onto a fixed number of bins without branching or throwing.
+ *
+ * All the scaling is worked out once in the constructor, so discretising a value is one multiply-add, a clamp and a
+ * truncation. Values outside the range never cause an error; what happens to them depends on the mode:
+ *
+ * - CLAMP: bin centres run evenly from -max (bin 0) to +max (last bin), \f$round(0.5(bins-1)(1+x/max))\f$, and
+ *   out-of-range values go to the end bins. This is not the layout of the state spaces before the Discretiser (the
+ *   pendulum space truncated its coefficient, the learners now WRAP the angle, and values out of range threw), so
+ *   Q tables saved by those state spaces cannot be loaded into these and must be learnt again.
+ * - WRAP: the range is one period (e.g. \f$[-\pi, \pi)\f$ for an angle) split into equal bins, and values outside
+ *   it are wrapped back in.
+ * - SATURATE: the interior bins split \f$[-max, max)\f$ evenly, and the first and last bins are kept for values
+ *   below and above the range, so that out-of-range states are not confused with states near the limits.
+ *
+ * NaN is always put in bin 0.
+ *
+ * discretise() does the same for a whole array of values, two at a time with SSE2 when it is available.
+ *
+ * \code{.cpp}
+ *	Discretiser angle(100, M_PI, Discretiser::WRAP);
+ *	int bin = angle(theta);
+ * \endcode
+ *
+ * @author Machine Learning Team 2015-2016
+ * @date March, 2016
+ */
+class Discretiser {
+
+public:
+	/**
+	 * @enum Mode
+	 *
+	 * @brief What to do with values outside \f$[-max, max]\f$.
+	 */
+	enum Mode { CLAMP, WRAP, SATURATE };
+
+	/**
+	 * @brief Constructor with number of bins, limit and out-of-range mode.
+	 *
+	 * @param _bins Number of bins (at least 1, or 3 for SATURATE)
+	 * @param _max Largest absolute value of the range (greater than zero)
+	 * @param _mode Treatment of out-of-range values
+	 * @throw Throws std::invalid_argument if the bins or limit are unusable
+	 */
+	Discretiser(int _bins, double _max, Mode _mode = CLAMP) :
+		bins(_bins),
+		range_max(_max),
+		mode(_mode),
+		last(_bins - 1),
+		scale(0.0),
+		offset(0.0) {
+		if (bins < (mode == SATURATE ? 3 : 1) || !(range_max > 0.0))
+			throw std::invalid_argument("discretiser needs a positive limit and enough bins");
+
+		switch (mode) {
+		case CLAMP:
+			// round(0.5*(bins-1)*(1 + x/max)), as a truncation of a shifted value
+			scale = 0.5 * (bins - 1) / range_max;
+			offset = 0.5 * (bins - 1) + 0.5;
+			break;
+		case WRAP:
+			// fraction of a period from -max
+			scale = 0.5 / range_max;
+			offset = 0.5;
+			break;
+		case SATURATE:
+			// interior bins 1 to bins-2 cover the range
+			scale = 0.5 * (bins - 2) / range_max;
+			offset = 0.5 * (bins - 2) + 1.0;
+			break;
+		}
+	}
+
+	/**
+	 * @brief Discretises a single value.
+	 *
+	 * @param value Continuous value
+	 * @return Bin index in [0, getBins())
+	 */
+	int operator()(double value) const {
+		double t = value * scale + offset;
+		if (mode == WRAP) {
+			// limit to whole periods an int can hold, to match the SSE2 floor below
+			t = t > -wrapLimit() ? t : -wrapLimit();
+			t = t < wrapLimit() ? t : wrapLimit();
+			t = (t - std::floor(t)) * bins;
+		}
+		return clampIndex(t);
+	}
+
+	/**
+	 * @brief Discretises an array of values.
+	 *
+	 * @param values First value to discretise
+	 * @param stride Distance (in doubles) between consecutive values, so that one member of an array of states can be used
+	 * @param indices Array of at least n ints to write the bin indices to
+	 * @param n Number of values
+	 */
+	void discretise(const double* values, std::size_t stride, int* indices, std::size_t n) const {
+		std::size_t i = 0;
+#ifdef __SSE2__
+		const __m128d vscale = _mm_set1_pd(scale);
+		const __m128d voffset = _mm_set1_pd(offset);
+		const __m128d vbins = _mm_set1_pd(static_cast<double>(bins));
+		const __m128d vlow = _mm_setzero_pd();
+		const __m128d vhigh = _mm_set1_pd(static_cast<double>(last));
+		const __m128d vone = _mm_set1_pd(1.0);
+		const __m128d vwrap = _mm_set1_pd(wrapLimit());
+		const __m128d vnwrap = _mm_set1_pd(-wrapLimit());
+		for (; i + 2 <= n; i += 2) {
+			__m128d t = _mm_set_pd(values[(i + 1) * stride], values[i * stride]);
+			t = _mm_add_pd(_mm_mul_pd(t, vscale), voffset);
+			if (mode == WRAP) {
+				// floor from a truncation, corrected where the truncation rounded up
+				t = _mm_min_pd(_mm_max_pd(t, vnwrap), vwrap);
+				__m128d truncated = _mm_cvtepi32_pd(_mm_cvttpd_epi32(t));
+				__m128d floored = _mm_sub_pd(truncated, _mm_and_pd(_mm_cmpgt_pd(truncated, t), vone));
+				t = _mm_mul_pd(_mm_sub_pd(t, floored), vbins);
+			}
+			// max first so that NaN goes to bin 0, as in clampIndex
+			t = _mm_min_pd(_mm_max_pd(t, vlow), vhigh);
+			__m128i result = _mm_cvttpd_epi32(t);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(indices + i), result);
+		}
+#endif
+		for (; i < n; ++i)
+			indices[i] = (*this)(values[i * stride]);
+	}
+
+	/** @brief Number of bins. */
+	int getBins() const { return bins; }
+
+	/** @brief Largest absolute value of the range. */
+	double getMax() const { return range_max; }
+
+	/** @brief Treatment of out-of-range values. */
+	Mode getMode() const { return mode; }
+
+private:
+	/**
+	 * @brief Truncates a scaled value to a bin index, clamping it into range.
+	 *
+	 * @param t Scaled value, where bin k covers [k, k+1)
+	 * @return Bin index in [0, bins)
+	 */
+	int clampIndex(double t) const {
+		// comparisons are false for NaN, which leaves it at 0
+		double low = t > 0.0 ? t : 0.0;
+		double high = low < last ? low : last;
+		return static_cast<int>(high);
+	}
+
+	/** @brief Largest number of periods WRAP mode keeps track of, small enough for an int. */
+	static double wrapLimit() { return 1073741824.0; }
+
+	int bins;
+	double range_max;
+	Mode mode;
+	double last;
+	double scale;
+	double offset;
+};
+
+#endif
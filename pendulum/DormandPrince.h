@@ -0,0 +1,306 @@
+/*
+* DormandPrince.h
+* Robotics 2016
+* Adaptive step Dormand-Prince 5(4) integrator with dense output, for any of the simulators.
+* Header only and dependent on nothing but <cmath>, so it replaces GSL's gsl_odeiv rkf45/rk4.
+*
+* The system is anything that can be called as f(t, y, dydt) with y and dydt arrays of N doubles,
+* e.g. a plain function void f(double t, const double y[], double dydt[]) or a functor.
+*
+*	DormandPrince<2> solver(1e-12, 0);
+*	solver.reset(0, y0);
+*	while (solver.getTime() < tFinal)
+*	{
+*		solver.step(f, tFinal);					// one accepted step, of whatever size the error allows
+*		solver.interpolate(t, y);				// any t between getPreviousTime() and getTime()
+*	}
+*
+* Events are zeros of a function g(t, y), e.g. y[1] for the swing's apexes, called as g(t, y) and returning a double.
+* They are found by root finding on the dense output, so their times are as accurate as the solution itself:
+*
+*	if (solver.evolveToEvent(f, apex, tFinal, tEvent, yEvent)) ...	// state at the next apex before tFinal
+*
+* Written without C++11 so that it also builds for the robot.
+*/
+
+#ifndef DORMANDPRINCE_H_
+#define DORMANDPRINCE_H_
+
+#include <algorithm>
+#include <cmath>
+
+template<int N>
+class DormandPrince
+{
+public:
+
+	// Steps are accepted when the RMS over the components of error / (epsAbs + epsRel * |y|) is at most 1
+	explicit DormandPrince(double _epsAbs, double _epsRel, double _h = 0.01)
+		: epsAbs(_epsAbs), epsRel(_epsRel), h(_h), hDone(0), hMin(1e-14), hMax(0), t(0), tOld(0), evaluations(0), accepted(0), rejected(0), fresh(true)
+	{
+		for (int i = 0; i < N; ++i) y[i] = yOld[i] = yerr[i] = 0;
+	}
+
+	// Start again from time _t and state _y (the step size is kept as a first guess)
+	void reset(double _t, const double _y[])
+	{
+		t = tOld = _t;
+		for (int i = 0; i < N; ++i) y[i] = yOld[i] = _y[i];
+		fresh = true;
+	}
+
+	// Take one accepted step, no further than tMax; returns false if the step size falls below the minimum
+	template<class System>
+	bool step(System& f, double tMax)
+	{
+		if (fresh)
+		{
+			// first stage of the first step; afterwards it is the last stage of the previous step
+			f(t, y, k1);
+			++evaluations;
+			fresh = false;
+		}
+
+		bool last = false;
+		for (;;)
+		{
+			double hStep = h;
+			if (hMax > 0 && hStep > hMax) hStep = hMax;
+			if (t + hStep >= tMax)
+			{
+				hStep = tMax - t;
+				last = true;
+			}
+			if (hStep <= 0) return true;
+
+			attempt(f, hStep);
+
+			// RMS error relative to the tolerances
+			double err = 0;
+			for (int i = 0; i < N; ++i)
+			{
+				double scale = epsAbs + epsRel * std::max(std::abs(y[i]), std::abs(yNew[i]));
+				double e = yerr[i] / scale;
+				err += e * e;
+			}
+			err = std::sqrt(err / N);
+
+			// new step size from the fifth root of the error, limited to a factor of 0.2 to 5
+			double factor = err > 0 ? 0.9 * std::pow(err, -0.2) : 5.0;
+			factor = std::min(5.0, std::max(0.2, factor));
+
+			if (err <= 1.0)
+			{
+				tOld = t;
+				for (int i = 0; i < N; ++i)
+				{
+					yOld[i] = y[i];
+					y[i] = yNew[i];
+				}
+				t = last ? tMax : t + hStep;
+				hDone = hStep;
+				prepareDense(hStep);
+				for (int i = 0; i < N; ++i) k1[i] = k7[i];	// first same as last
+				// a step cut short by tMax says nothing about the best step size
+				if (!last || factor < 1.0) h = hStep * factor;
+				++accepted;
+				return true;
+			}
+
+			// rejected, try again with a smaller step and no growth
+			++rejected;
+			h = hStep * std::min(1.0, factor);
+			last = false;
+			if (h < hMin) return false;
+		}
+	}
+
+	// Step until tEnd is reached exactly; returns false if a step fails
+	template<class System>
+	bool evolve(System& f, double tEnd)
+	{
+		while (t < tEnd)
+		{
+			if (!step(f, tEnd)) return false;
+		}
+		return true;
+	}
+
+	// Step until the event function g changes sign, or tMax is reached; returns true with the time and state of the
+	// event if it was found. direction > 0 only takes rising crossings, < 0 only falling ones.
+	// The solver is left at the end of the step that passed the event, so reset() it there to carry on from the event;
+	// a zero within rounding of the starting time is taken to be that event, and skipped.
+	template<class System, class Event>
+	bool evolveToEvent(System& f, Event& g, double tMax, double& tEvent, double yEvent[], int direction = 0)
+	{
+		double tStart = t + 1e-12 * std::max(1.0, std::abs(t));
+		while (t < tMax)
+		{
+			if (!step(f, tMax)) break;
+			if (locate(g, tEvent, yEvent, direction) && tEvent > tStart) return true;
+		}
+		tEvent = t;
+		for (int i = 0; i < N; ++i) yEvent[i] = y[i];
+		return false;
+	}
+
+	// Find a sign change of g within the last step by root finding on the dense output; false if there is none.
+	// A change of sign that is a jump rather than a zero (e.g. an angle wrapping round) is not an event.
+	template<class Event>
+	bool locate(Event& g, double& tEvent, double yEvent[], int direction = 0) const
+	{
+		if (accepted == 0 || hDone <= 0) return false;
+		double ta = tOld, tb = t;
+		double ga = g(ta, yOld);
+		double gb = g(tb, y);
+		// a zero at the start of the step belongs to the step before
+		if (ga == 0 || (ga < 0) == (gb < 0)) return false;
+		if ((direction > 0 && ga > 0) || (direction < 0 && ga < 0)) return false;
+
+		// Illinois variant of regula falsi: halve the weight of an end that is kept twice running
+		int kept = 0;
+		double tc = tb;
+		for (int k = 0; k < 100 && tb - ta > 1e-14 * std::max(1.0, std::abs(tb)); ++k)
+		{
+			tc = (ta * gb - tb * ga) / (gb - ga);
+			if (!(tc > ta && tc < tb)) tc = 0.5 * (ta + tb);
+			interpolate(tc, yEvent);
+			double gc = g(tc, yEvent);
+			if (gc == 0) break;
+			if ((gc < 0) == (ga < 0))
+			{
+				ta = tc;
+				ga = gc;
+				if (kept == -1) gb *= 0.5;
+				kept = -1;
+			}
+			else
+			{
+				tb = tc;
+				gb = gc;
+				if (kept == 1) ga *= 0.5;
+				kept = 1;
+			}
+		}
+		tEvent = tc;
+		interpolate(tEvent, yEvent);
+
+		// a true zero is small compared with the values either side of it
+		double scale = std::max(std::abs(g(tOld, yOld)), std::abs(g(t, y)));
+		return std::abs(g(tEvent, yEvent)) <= 1e-6 * std::max(1.0, scale);
+	}
+
+	// State at time _t within the last step (between getPreviousTime() and getTime()), fourth order accurate
+	void interpolate(double _t, double _y[]) const
+	{
+		if (accepted == 0 || hDone <= 0)
+		{
+			for (int i = 0; i < N; ++i) _y[i] = y[i];
+			return;
+		}
+		double s = (_t - tOld) / hDone;
+		double s1 = 1.0 - s;
+		for (int i = 0; i < N; ++i)
+		{
+			_y[i] = r1[i] + s * (r2[i] + s1 * (r3[i] + s * (r4[i] + s1 * r5[i])));
+		}
+	}
+
+	double getTime() const { return t; };
+	double getPreviousTime() const { return tOld; };
+	const double* getState() const { return y; };
+	double getError(int i) const { return yerr[i]; };	// Error estimate of the last attempted step
+	double getStepSize() const { return h; };		// Step size the next step will try
+
+	void setStepSize(double _h) { h = _h; };
+	void setMaxStepSize(double _hMax) { hMax = _hMax; };	// 0 for no limit
+	void setMinStepSize(double _hMin) { hMin = _hMin; };
+
+	unsigned long getEvaluations() const { return evaluations; };	// Calls to the system so far
+	unsigned long getAccepted() const { return accepted; };
+	unsigned long getRejected() const { return rejected; };
+
+private:
+
+	// One trial step of size hs from (t, y), filling yNew, yerr and k2 to k7
+	template<class System>
+	void attempt(System& f, double hs)
+	{
+		// Dormand-Prince tableau
+		static const double c2 = 1.0 / 5, c3 = 3.0 / 10, c4 = 4.0 / 5, c5 = 8.0 / 9;
+		static const double a21 = 1.0 / 5;
+		static const double a31 = 3.0 / 40, a32 = 9.0 / 40;
+		static const double a41 = 44.0 / 45, a42 = -56.0 / 15, a43 = 32.0 / 9;
+		static const double a51 = 19372.0 / 6561, a52 = -25360.0 / 2187, a53 = 64448.0 / 6561, a54 = -212.0 / 729;
+		static const double a61 = 9017.0 / 3168, a62 = -355.0 / 33, a63 = 46732.0 / 5247, a64 = 49.0 / 176, a65 = -5103.0 / 18656;
+		static const double a71 = 35.0 / 384, a73 = 500.0 / 1113, a74 = 125.0 / 192, a75 = -2187.0 / 6784, a76 = 11.0 / 84;
+		// difference between the fifth and fourth order weights
+		static const double e1 = 71.0 / 57600, e3 = -71.0 / 16695, e4 = 71.0 / 1920, e5 = -17253.0 / 339200, e6 = 22.0 / 525, e7 = -1.0 / 40;
+
+		double tmp[N];
+		for (int i = 0; i < N; ++i) tmp[i] = y[i] + hs * a21 * k1[i];
+		f(t + c2 * hs, tmp, k2);
+		for (int i = 0; i < N; ++i) tmp[i] = y[i] + hs * (a31 * k1[i] + a32 * k2[i]);
+		f(t + c3 * hs, tmp, k3);
+		for (int i = 0; i < N; ++i) tmp[i] = y[i] + hs * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+		f(t + c4 * hs, tmp, k4);
+		for (int i = 0; i < N; ++i) tmp[i] = y[i] + hs * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+		f(t + c5 * hs, tmp, k5);
+		for (int i = 0; i < N; ++i) tmp[i] = y[i] + hs * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+		f(t + hs, tmp, k6);
+		for (int i = 0; i < N; ++i) yNew[i] = y[i] + hs * (a71 * k1[i] + a73 * k3[i] + a74 * k4[i] + a75 * k5[i] + a76 * k6[i]);
+		f(t + hs, yNew, k7);
+		evaluations += 6;
+
+		for (int i = 0; i < N; ++i)
+		{
+			yerr[i] = hs * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+		}
+	}
+
+	// Coefficients of the continuous extension over the step just accepted (Hairer's dense output for DOPRI5)
+	void prepareDense(double hs)
+	{
+		static const double d1 = -12715105075.0 / 11282082432.0, d3 = 87487479700.0 / 32700410799.0,
+			d4 = -10690763975.0 / 1880347072.0, d5 = 701980252875.0 / 199316789632.0,
+			d6 = -1453857185.0 / 822651844.0, d7 = 69997945.0 / 29380423.0;
+
+		for (int i = 0; i < N; ++i)
+		{
+			double dy = y[i] - yOld[i];
+			double bspl = hs * k1[i] - dy;
+			r1[i] = yOld[i];
+			r2[i] = dy;
+			r3[i] = bspl;
+			r4[i] = dy - hs * k7[i] - bspl;
+			r5[i] = hs * (d1 * k1[i] + d3 * k3[i] + d4 * k4[i] + d5 * k5[i] + d6 * k6[i] + d7 * k7[i]);
+		}
+	}
+
+	double epsAbs;
+	double epsRel;
+	double h;		// Step size to try next
+	double hDone;		// Size of the last accepted step
+	double hMin;
+	double hMax;
+
+	double t;
+	double tOld;
+	double y[N];
+	double yOld[N];
+	double yNew[N];
+	double yerr[N];
+
+	// Stages, k1 holding the derivative at (t, y)
+	double k1[N], k2[N], k3[N], k4[N], k5[N], k6[N], k7[N];
+
+	// Dense output
+	double r1[N], r2[N], r3[N], r4[N], r5[N];
+
+	unsigned long evaluations;
+	unsigned long accepted;
+	unsigned long rejected;
+	bool fresh;	// k1 needs evaluating before the next step
+};
+
+#endif /* DORMANDPRINCE_H_ */
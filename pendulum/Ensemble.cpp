@@ -0,0 +1,509 @@
+/*
+* Ensemble.cpp
+* Robotics 2016
+*
+*/
+
+#define _USE_MATH_DEFINES
+#include "Ensemble.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "CompoundSwing.h"
+#include "Environment.h"
+#include "State3.h"
+#include "SwingEnvironment.h"
+
+namespace
+{
+	//the driven pendulum, parameters mass, length, damping, maxtorque
+	struct PendulumModel
+	{
+		typedef environment Env;
+
+		static std::vector<std::string> names()
+		{
+			return { "mass", "length", "damping", "maxtorque" };
+		}
+
+		static std::vector<double> defaults(const LearnerConfig& config)
+		{
+			return { config.mass, config.length, config.damping, config.maxtorque };
+		}
+
+		//which parameters must be above zero, the rest must not be below it
+		static std::vector<bool> positive()
+		{
+			return { true, true, false, true };
+		}
+
+		static std::unique_ptr<Env> make(const std::vector<double>& p, const LearnerConfig& config)
+		{
+			std::unique_ptr<Env> env(new environment(0, 0, 0, p[3], 0, config.deltatime, p[0], p[1], p[2]));
+			env->setVerbose(false);
+			env->setIntegrator(static_cast<environment::Integrator>(config.integrator));
+			env->setSubsteps(config.substeps);
+			return env;
+		}
+
+		//environment ignores torques above its maximum rather than clamping them, so clamp to this member's here
+		static void act(Env& env, const std::vector<double>& p, float action)
+		{
+			env.setTorque(std::max(-p[3], std::min(static_cast<double>(action), p[3])));
+		}
+
+		//one action per whole unit of the nominal torque, as in runLearner
+		static std::vector<float> actions(const LearnerConfig& config)
+		{
+			std::vector<float> result;
+			for (int i = 0; i < static_cast<int>(2 * config.maxtorque) + 1; ++i) result.push_back(static_cast<float>(-config.maxtorque + i));
+			return result;
+		}
+
+		static double actionMax(const LearnerConfig& config) { return config.maxtorque; };
+
+		//energy pumping: the largest torque in the direction of motion
+		static float pump(double thetadot, float largest) { return thetadot < 0 ? -largest : largest; };
+	};
+
+	//the robot on the swing, parameters robotmass, swingmass, length, height, range, damping, motiontime
+	struct SwingModel
+	{
+		typedef swingEnvironment Env;
+
+		static std::vector<std::string> names()
+		{
+			return { "robotmass", "swingmass", "length", "height", "range", "damping", "motiontime" };
+		}
+
+		static std::vector<double> defaults(const LearnerConfig&)
+		{
+			return { 5.2, 20, 1.9, 0.34, 0.045, 0.05, 0.7 };
+		}
+
+		static std::vector<bool> positive()
+		{
+			return { true, true, true, true, false, false, true };
+		}
+
+		//swingEnvironment always takes Verlet steps of at most its hMax, so the integrator settings do not apply
+		static std::unique_ptr<Env> make(const std::vector<double>& p, const LearnerConfig& config)
+		{
+			std::unique_ptr<Env> env(new swingEnvironment(0, 0, -1, 0, config.deltatime, p[0], p[1], p[2], p[3], p[4], p[5]));
+			env->setMotionTime(p[6]);
+			env->setVerbose(false);
+			return env;
+		}
+
+		static void act(Env& env, const std::vector<double>&, float action)
+		{
+			env.setTorque(action);
+		}
+
+		//sitBackward, halfway and sitForward
+		static std::vector<float> actions(const LearnerConfig&)
+		{
+			return { -1.0f, 0.0f, 1.0f };
+		}
+
+		static double actionMax(const LearnerConfig&) { return 1.0; };
+
+		//moving the centre of mass down-swing pumps the swing, so lean against the direction of motion
+		static float pump(double thetadot, float largest) { return thetadot < 0 ? largest : -largest; };
+	};
+
+	//the robot on the swing as three rigid bodies, parameters swingmass, length, damping, uppermass, lowermass,
+	//servofrequency, motiontime; the postures and actions are those of SwingModel
+	struct CompoundModel
+	{
+		typedef compoundSwing Env;
+
+		static std::vector<std::string> names()
+		{
+			return { "swingmass", "length", "damping", "uppermass", "lowermass", "servofrequency", "motiontime" };
+		}
+
+		static std::vector<double> defaults(const LearnerConfig&)
+		{
+			CompoundParameters p;
+			return { p.swingMass, p.length, p.damping, p.upperMass, p.lowerMass, p.servoFrequency, 0.7 };
+		}
+
+		static std::vector<bool> positive()
+		{
+			return { true, true, false, true, true, true, true };
+		}
+
+		static std::unique_ptr<Env> make(const std::vector<double>& p, const LearnerConfig& config)
+		{
+			CompoundParameters parameters;
+			parameters.swingMass = p[0];
+			parameters.length = p[1];
+			parameters.damping = p[2];
+			parameters.upperMass = p[3];
+			parameters.lowerMass = p[4];
+			parameters.servoFrequency = p[5];
+			std::unique_ptr<Env> env(new compoundSwing(0, 0, -1, 0, config.deltatime, parameters));
+			env->setMotionTime(p[6]);
+			env->setVerbose(false);
+			return env;
+		}
+
+		static void act(Env& env, const std::vector<double>&, float action)
+		{
+			env.setTorque(action);
+		}
+
+		static std::vector<float> actions(const LearnerConfig& config) { return SwingModel::actions(config); };
+
+		static double actionMax(const LearnerConfig& config) { return SwingModel::actionMax(config); };
+
+		static float pump(double thetadot, float largest) { return SwingModel::pump(thetadot, largest); };
+	};
+
+	//wrap an angle into [-pi, pi)
+	double wrapAngle(double theta)
+	{
+		return theta - 2.0 * M_PI * std::floor((theta + M_PI) / (2.0 * M_PI));
+	}
+
+	//choose the best action with probability epsilon, otherwise a random one, as runLearner
+	float selectAction(const PriorityQueue<float, double>& queue, double epsilon, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		if (uniform(rng) < epsilon) return queue.peekFront().first;
+		std::uniform_int_distribution<size_t> pick(0, queue.getSize() - 1);
+		return queue[pick(rng)].first;
+	}
+
+	//call f(begin, end) on an even share of [0, n) in each of up to 'threads' threads, the first share on this one
+	template<class F> void parallelFor(std::size_t n, unsigned int threads, const F& f)
+	{
+		std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(threads, n));
+		std::vector<std::thread> pool;
+		for (std::size_t k = 1; k < count; ++k) pool.emplace_back(f, n * k / count, n * (k + 1) / count);
+		f(0, n / count);
+		for (std::thread& thread : pool) thread.join();
+	}
+
+	//threads that each call f(begin, end) on the same share of [0, n) every time run() is, kept for as long as the
+	//pool rather than started for every call; the first share is done on the thread calling run()
+	class StepPool
+	{
+	public:
+		StepPool(std::size_t n, unsigned int threads, const std::function<void(std::size_t, std::size_t)>& _f) :
+			f(_f), generation(0), pending(0), stopping(false)
+		{
+			std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(threads, n));
+			first = n / count;
+			for (std::size_t k = 1; k < count; ++k) pool.emplace_back(&StepPool::work, this, n * k / count, n * (k + 1) / count);
+		}
+
+		~StepPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			start.notify_all();
+			for (std::thread& thread : pool) thread.join();
+		}
+
+		//every share once, returning when all are done
+		void run()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				++generation;
+				pending = pool.size();
+			}
+			start.notify_all();
+			f(0, first);
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() { return pending == 0; });
+		}
+
+	private:
+		void work(std::size_t begin, std::size_t end)
+		{
+			unsigned long seen = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				start.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				lock.unlock();
+				f(begin, end);
+				lock.lock();
+				if (--pending == 0) done.notify_one();
+			}
+		}
+
+		std::function<void(std::size_t, std::size_t)> f;
+		std::size_t first;
+		std::mutex mutex;
+		std::condition_variable start;
+		std::condition_variable done;
+		unsigned long generation;
+		std::size_t pending;
+		bool stopping;
+		std::vector<std::thread> pool;
+	};
+
+	//draw a full set of parameters for one member
+	template<class Model> std::vector<double> draw(const EnsembleConfig& config, std::mt19937& rng)
+	{
+		std::vector<std::string> names = Model::names();
+		std::vector<double> values = Model::defaults(config.learner);
+		for (std::size_t p = 0; p < names.size(); ++p)
+		{
+			std::map<std::string, Distribution>::const_iterator it = config.parameters.find(names[p]);
+			if (it != config.parameters.end()) values[p] = it->second.sample(rng);
+		}
+		return values;
+	}
+
+	template<class Model> void check(const EnsembleConfig& config)
+	{
+		std::vector<std::string> names = Model::names();
+		std::vector<bool> positive = Model::positive();
+		for (std::map<std::string, Distribution>::const_iterator it = config.parameters.begin(); it != config.parameters.end(); ++it)
+		{
+			std::size_t p = std::find(names.begin(), names.end(), it->first) - names.begin();
+			if (p == names.size()) throw std::invalid_argument("Ensemble: the model has no parameter " + it->first);
+			if (positive[p] ? !it->second.positive() : !it->second.nonNegative())
+			{
+				throw std::invalid_argument("Ensemble: " + it->first + "=" + it->second.describe() + " can draw values " + (positive[p] ? "of zero or below" : "below zero"));
+			}
+		}
+		if (config.members == 0 || config.learner.episode_steps == 0) throw std::invalid_argument("Ensemble: no members or empty episodes");
+	}
+
+	template<class Model> void train(const EnsembleConfig& config, StateSpace& space, const std::function<void(unsigned long, double)>& progress)
+	{
+		check<Model>(config);
+		const LearnerConfig& learner = config.learner;
+		const std::size_t n = config.members;
+		std::mt19937 rng(learner.seed);
+
+		std::vector<std::unique_ptr<typename Model::Env> > envs(n);
+		std::vector<std::vector<double> > parameters(n);
+		std::vector<State> old_states(n, State(0, 0, 0));
+		std::vector<float> actions(n, 0.0f);
+		std::vector<double> returns(n);
+		double epsilon = learner.epsilon_start;
+		unsigned long step = 0;
+
+		//the same threads step the same members throughout, waiting on each other once a step
+		StepPool stepper(n, config.threads, [&envs](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) envs[i]->propagate();
+		});
+
+		for (unsigned long round = 0; round < config.rounds; ++round)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				parameters[i] = draw<Model>(config, rng);
+				envs[i] = Model::make(parameters[i], learner);
+				returns[i] = 0;
+			}
+
+			//one more observation than actions, so that the last action of the episode is learnt from too
+			for (unsigned long j = 0; j <= learner.episode_steps; ++j)
+			{
+				for (std::size_t i = 0; i < n; ++i)
+				{
+					typename Model::Env& env = *envs[i];
+					State current_state(wrapAngle(env.getTheta()), env.getThetadot(), env.getTorque());
+
+					if (j > 0)
+					{
+						double R = current_state.getReward();
+						returns[i] += R;
+
+						//Q-learning update of the action taken from the old state
+						PriorityQueue<float, double>& queue = space[old_states[i]];
+						double oldQ = queue.search(actions[i]).second;
+						double maxQ = space[current_state].peekFront().second;
+						queue.changePriority(actions[i], oldQ + learner.alpha * (R + learner.gamma * maxQ - oldQ));
+					}
+					if (j == learner.episode_steps) continue;
+
+					old_states[i] = current_state;
+					actions[i] = selectAction(space[current_state], epsilon, rng);
+					Model::act(env, parameters[i], actions[i]);
+				}
+				if (j == learner.episode_steps) break;
+
+				if (step++ > learner.epsilon_delay) epsilon = std::min(1.0, epsilon + learner.epsilon_step);
+
+				stepper.run();
+			}
+
+			if (progress)
+			{
+				double total = 0;
+				for (std::size_t i = 0; i < n; ++i) total += returns[i];
+				progress(round, total / n);
+			}
+		}
+	}
+
+	template<class Model> std::vector<MemberResult> evaluate(const EnsembleConfig& config, const Policy& policy)
+	{
+		check<Model>(config);
+		const LearnerConfig& learner = config.learner;
+
+		//parameters are drawn up front so that the same seed gives the same members on any number of threads
+		std::mt19937 rng(learner.seed);
+		std::vector<MemberResult> results(config.members);
+		for (MemberResult& result : results) result.parameters = draw<Model>(config, rng);
+
+		parallelFor(results.size(), config.threads, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				MemberResult& result = results[i];
+				std::unique_ptr<typename Model::Env> env = Model::make(result.parameters, learner);
+				result.episode_return = 0;
+				result.peak_amplitude = 0;
+				result.steps_to_threshold = -1;
+				for (unsigned long j = 0; ; ++j)
+				{
+					State state(wrapAngle(env->getTheta()), env->getThetadot(), env->getTorque());
+					double amplitude = std::abs(state.theta);
+					result.peak_amplitude = std::max(result.peak_amplitude, amplitude);
+					if (result.steps_to_threshold < 0 && amplitude >= learner.amplitude_threshold) result.steps_to_threshold = static_cast<long>(j);
+					if (j > 0) result.episode_return += state.getReward();
+					if (j == learner.episode_steps) break;
+
+					Model::act(*env, result.parameters, policy(state.theta, state.theta_dot, state.torque));
+					env->propagate();
+				}
+			}
+		});
+		return results;
+	}
+}
+
+bool Distribution::parse(const std::string& text, Distribution& distribution)
+{
+	std::vector<std::string> fields;
+	std::istringstream stream(text);
+	std::string field;
+	while (std::getline(stream, field, ':')) fields.push_back(field);
+
+	std::vector<double> values;
+	for (std::size_t k = fields.size() == 1 ? 0 : 1; k < fields.size(); ++k)
+	{
+		char* end = 0;
+		values.push_back(std::strtod(fields[k].c_str(), &end));
+		if (fields[k].empty() || *end != '\0') return false;
+	}
+
+	if (fields.size() == 1) distribution = Distribution(values[0]);
+	else if (fields.size() == 3 && fields[0] == "uniform" && values[0] <= values[1]) distribution = Distribution(UNIFORM, values[0], values[1]);
+	else if (fields.size() == 3 && fields[0] == "normal" && values[0] > 0 && values[1] >= 0) distribution = Distribution(NORMAL, values[0], values[1]);
+	else if (fields.size() == 3 && fields[0] == "lognormal" && values[0] > 0 && values[1] >= 0) distribution = Distribution(LOGNORMAL, values[0], values[1]);
+	else return false;
+	return true;
+}
+
+double Distribution::sample(std::mt19937& rng) const
+{
+	switch (kind)
+	{
+	case UNIFORM:
+		return std::uniform_real_distribution<double>(a, b)(rng);
+	case NORMAL:
+	{
+		//a mass or length below zero makes no sense, so draw again (the mean is positive, so this ends)
+		std::normal_distribution<double> normal(a, b);
+		double x;
+		do x = normal(rng); while (x <= 0);
+		return x;
+	}
+	case LOGNORMAL:
+		return std::lognormal_distribution<double>(std::log(a), b)(rng);
+	default:
+		return a;
+	}
+}
+
+std::string Distribution::describe() const
+{
+	std::ostringstream text;
+	switch (kind)
+	{
+	case UNIFORM: text << "uniform:" << a << ":" << b; break;
+	case NORMAL: text << "normal:" << a << ":" << b; break;
+	case LOGNORMAL: text << "lognormal:" << a << ":" << b; break;
+	default: text << a;
+	}
+	return text.str();
+}
+
+EnsembleConfig::EnsembleConfig() :
+	model(PENDULUM),
+	members(1024),
+	threads(std::max(1u, std::thread::hardware_concurrency())),
+	rounds(50UL)
+{}
+
+std::vector<std::string> parameterNames(EnsembleConfig::Model model)
+{
+	if (model == EnsembleConfig::SWING) return SwingModel::names();
+	if (model == EnsembleConfig::COMPOUND) return CompoundModel::names();
+	return PendulumModel::names();
+}
+
+std::unique_ptr<StateSpace> makeStateSpace(const EnsembleConfig& config)
+{
+	const LearnerConfig& learner = config.learner;
+	std::vector<float> actions = config.model == EnsembleConfig::PENDULUM ? PendulumModel::actions(learner) : SwingModel::actions(learner);
+	double actionMax = config.model == EnsembleConfig::PENDULUM ? PendulumModel::actionMax(learner) : SwingModel::actionMax(learner);
+
+	PriorityQueue<float, double> initiator_queue(MAX);
+	for (float action : actions) initiator_queue.enqueueWithPriority(action, 0);
+	return std::unique_ptr<StateSpace>(new StateSpace(initiator_queue, learner.angle_bins, learner.velocity_bins, static_cast<int>(actions.size()),
+		learner.angle_max, learner.velocity_max, actionMax, Discretiser::WRAP));
+}
+
+void trainEnsemble(const EnsembleConfig& config, StateSpace& space, const std::function<void(unsigned long, double)>& progress)
+{
+	if (config.model == EnsembleConfig::SWING) train<SwingModel>(config, space, progress);
+	else if (config.model == EnsembleConfig::COMPOUND) train<CompoundModel>(config, space, progress);
+	else train<PendulumModel>(config, space, progress);
+}
+
+std::vector<MemberResult> evaluateEnsemble(const EnsembleConfig& config, const Policy& policy)
+{
+	if (config.model == EnsembleConfig::SWING) return evaluate<SwingModel>(config, policy);
+	if (config.model == EnsembleConfig::COMPOUND) return evaluate<CompoundModel>(config, policy);
+	return evaluate<PendulumModel>(config, policy);
+}
+
+Policy greedyPolicy(StateSpace& space)
+{
+	return [&space](double theta, double thetadot, double torque) {
+		return space[theta][thetadot][torque].peekFront().first;
+	};
+}
+
+Policy pumpPolicy(const EnsembleConfig& config)
+{
+	if (config.model != EnsembleConfig::PENDULUM)
+	{
+		//the compound swing takes the same postures as SwingModel
+		float largest = static_cast<float>(SwingModel::actionMax(config.learner));
+		return [largest](double, double thetadot, double) { return SwingModel::pump(thetadot, largest); };
+	}
+	float largest = static_cast<float>(PendulumModel::actionMax(config.learner));
+	return [largest](double, double thetadot, double) { return PendulumModel::pump(thetadot, largest); };
+}
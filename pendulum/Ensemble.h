@@ -0,0 +1,113 @@
+/*
+* Ensemble.h
+* Robotics 2016
+* Domain randomisation for the simulated swing. The model parameters (mass, length, damping, ...) are only
+* guesses, so instead of one environment an ensemble of them is run, each member drawing its parameters from
+* a distribution at the start of every episode. The members are shared out between a pool of threads.
+*
+* trainEnsemble feeds the experience of every member to a single Q-learner, so the policy learnt has to cope
+* with the whole range of models. evaluateEnsemble runs a fixed policy once on every member and reports how
+* it did on each, to show how sensitive the policy is to the parameters.
+*
+* Three models are supported: 'environment' (torque actions), and 'swingEnvironment' and 'compoundSwing' (posture actions).
+*/
+
+#ifndef ENSEMBLE_H_
+#define ENSEMBLE_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Learner.h"
+#include "StateSpace3.h"
+
+// Where one parameter is drawn from
+struct Distribution
+{
+	enum Kind
+	{
+		FIXED,		// Always a
+		UNIFORM,	// Uniform on [a, b]
+		NORMAL,		// Mean a, standard deviation b, drawn again until positive
+		LOGNORMAL	// Median a, standard deviation of the log b
+	};
+
+	Kind kind;
+	double a;
+	double b;
+
+	Distribution(double _value = 0) : kind(FIXED), a(_value), b(0) {};
+	Distribution(Kind _kind, double _a, double _b) : kind(_kind), a(_a), b(_b) {};
+
+	// Reads "0.5", "uniform:lo:hi", "normal:mean:sd" or "lognormal:median:sd", returning false if it cannot
+	static bool parse(const std::string& text, Distribution& distribution);
+
+	double sample(std::mt19937& rng) const;
+	std::string describe() const;
+
+	// Whether every value drawn is above zero, or at least not below it
+	bool positive() const { return kind == NORMAL || kind == LOGNORMAL || a > 0; };
+	bool nonNegative() const { return kind == NORMAL || kind == LOGNORMAL || a >= 0; };
+};
+
+struct EnsembleConfig
+{
+	enum Model
+	{
+		PENDULUM,	// 'environment': parameters mass, length, damping, maxtorque
+		SWING,		// 'swingEnvironment': parameters robotmass, swingmass, length, height, range, damping, motiontime
+		COMPOUND	// 'compoundSwing': parameters swingmass, length, damping, uppermass, lowermass, servofrequency, motiontime
+	};
+
+	Model model;
+	std::size_t members;
+	unsigned int threads;
+
+	// Learning, discretisation, time step, episode length, amplitude threshold and seed; max_steps is unused,
+	// training runs for a number of rounds of one episode per member instead
+	LearnerConfig learner;
+	unsigned long rounds;
+
+	// Distributions by parameter name; parameters not given are fixed at the model's defaults. Masses, lengths and
+	// times must be drawn above zero, damping and range not below it
+	std::map<std::string, Distribution> parameters;
+
+	EnsembleConfig();
+};
+
+// How one member did, with the parameters it drew (in the order of parameterNames)
+struct MemberResult
+{
+	std::vector<double> parameters;
+	double episode_return;
+	double peak_amplitude;		// Largest |theta| over the episode
+	long steps_to_threshold;	// Steps until |theta| first reached the threshold, -1 if never
+};
+
+// Action to take from the state (theta, thetadot, current torque or posture); called from many threads at once
+typedef std::function<float(double, double, double)> Policy;
+
+// The parameters a model draws, in order
+std::vector<std::string> parameterNames(EnsembleConfig::Model model);
+
+// An empty state space and the actions of the model, as runLearner builds them
+std::unique_ptr<StateSpace> makeStateSpace(const EnsembleConfig& config);
+
+// Q-learning from every member at once: the members are stepped together, then each one's transition updates
+// the state space in member order, so the result does not depend on the number of threads.
+// progress, if given, is called after each round with the round and the mean return of the members.
+void trainEnsemble(const EnsembleConfig& config, StateSpace& space, const std::function<void(unsigned long, double)>& progress = nullptr);
+
+// One episode of the policy on every member, each with freshly drawn parameters
+std::vector<MemberResult> evaluateEnsemble(const EnsembleConfig& config, const Policy& policy);
+
+// The best action in each state of a learnt state space (which must not change while the policy is in use)
+Policy greedyPolicy(StateSpace& space);
+
+// Energy pumping with the largest actions, switched as the swing changes direction
+Policy pumpPolicy(const EnsembleConfig& config);
+
+#endif /* ENSEMBLE_H_ */
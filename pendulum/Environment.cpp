@@ -9,57 +9,103 @@
 #include <iostream>
 
 environment::environment(double _theta, double _thetadot, double _torque, double _maxtorque, double _time, double _deltatime, double _mass, double _length, double _gamma)
-	: theta(_theta), thetadot(_thetadot), torque(_torque), maxtorque(_maxtorque), time(_time), dt(_deltatime), mass(_mass), l(_length), gamma(_gamma)
+	: theta(_theta), thetadot(_thetadot), torque(_torque), maxtorque(_maxtorque), time(_time), dt(_deltatime), mass(_mass), l(_length), gamma(_gamma), verbose(true), integrator(RK4), N(100), solver(1e-6, 1e-6), evaluations(0)
 {}
 
 void environment::propagate() // Calculate successive values of theta and thetadot
 {
-	std::cout << "Progagating" << std::endl;
+	if (verbose) std::cout << "Progagating" << std::endl;
 	
-	double N = 100;			// Number of steps the RK4 method will use
 	double h = dt / N;		// Calculates RK4 step size for N steps over the time dt
 
-	for (int i = 0; i < N; ++i) // Calculate theta and thetadot at time t+dt
+	if (integrator == DORMAND_PRINCE)
 	{
-		theta = rk4theta(h); 			// Calculate the value of theta at time t+h
-		thetadot = rk4thetadot(h);		// Calculate the value of thetadot at time t+h
+		// Restart from the current state, as the torque may have changed since the last call
+		double y[2] = { theta, thetadot };
+		Derivative f = { *this };
+		unsigned long before = solver.getEvaluations();
+		solver.reset(time, y);
+		solver.evolve(f, time + dt);
+		theta = solver.getState()[0];
+		thetadot = solver.getState()[1];
+		evaluations += solver.getEvaluations() - before;
+	}
+	else if (integrator == VERLET || integrator == YOSHIDA4)
+	{
+		Split f = { *this };
+		double t = time;
+		symplectic.evolve(f, t, theta, thetadot, dt, N);
+		evaluations += (integrator == YOSHIDA4 ? 6 : 2) * N;
+	}
+	else
+	{
+		for (int i = 0; i < N; ++i) // Calculate theta and thetadot at time t+dt
+		{
+			rk4step(h);			// Calculate the values of theta and thetadot at time t+h
+		}
+		evaluations += 4 * N;
 	}
 
 	time += dt;	 // Propogate time
 				 // Output t, theta, thetadot, and torque to a file either here or in the main
 
-	std::cout << "\tTheta: " << theta << ", Thetadot: " << thetadot << "\n";
+	if (verbose) std::cout << "\tTheta: " << theta << ", Thetadot: " << thetadot << "\n";
+}
+
+bool environment::propagateToEvent(Event _event, double _maxtime, double _phase)
+{
+	if (verbose) std::cout << "Progagating to event" << std::endl;
+
+	double y[2] = { theta, thetadot };
+	Derivative f = { *this };
+	// the phase only rises through the target once per swing, sin(phase - target) falls through zero half a swing later
+	EventFunction g = { _event, _phase, std::sqrt(9.81 / l) };
+	unsigned long before = solver.getEvaluations();
+	solver.reset(time, y);
+	double tEvent;
+	bool found = solver.evolveToEvent(f, g, time + _maxtime, tEvent, y, _event == PHASE ? 1 : 0);
+	theta = y[0];
+	thetadot = y[1];
+	time = tEvent;
+	evaluations += solver.getEvaluations() - before;
+
+	if (verbose) std::cout << "\tTheta: " << theta << ", Thetadot: " << thetadot << ", Time: " << time << "\n";
+	return found;
+}
+
+void environment::setIntegrator(Integrator _integrator, double _tolerance)
+{
+	integrator = _integrator;
+	symplectic.setMethod(integrator == YOSHIDA4 ? Symplectic::YOSHIDA4 : Symplectic::VERLET);
+	solver = DormandPrince<2>(_tolerance, _tolerance, solver.getStepSize());
 }
 
 void environment::setTorque(double _T)
 {
-	std::cout << "Settingt torque to " << _T << std::endl;
+	if (verbose) std::cout << "Settingt torque to " << _T << std::endl;
 	// Absolute value of the torque must be less than or equal to the maximum
 	if (_T < maxtorque || _T == maxtorque) torque = _T;
 }
 
 
-double environment::rk4theta(double h)
+// theta and thetadot are solved together, each stage using both halves of the previous stage
+void environment::rk4step(double h)
 {
-	double k1 = h * thetadot;
-	double k2 = h * (thetadot + 0.5 * k1);
-	double k3 = h * (thetadot + 0.5 * k2);
-	double k4 = h * (thetadot + k3);
-
-	theta += k1 / 6 + k2 / 3 + k3 / 3 + k4 / 6;
+	double k1theta = thetadot;
+	double k1thetadot = thetadotdot(theta, thetadot);
+	double k2theta = thetadot + 0.5 * h * k1thetadot;
+	double k2thetadot = thetadotdot(theta + 0.5 * h * k1theta, k2theta);
+	double k3theta = thetadot + 0.5 * h * k2thetadot;
+	double k3thetadot = thetadotdot(theta + 0.5 * h * k2theta, k3theta);
+	double k4theta = thetadot + h * k3thetadot;
+	double k4thetadot = thetadotdot(theta + h * k3theta, k4theta);
 
-	return theta;
+	theta += h * (k1theta + 2 * k2theta + 2 * k3theta + k4theta) / 6;
+	thetadot += h * (k1thetadot + 2 * k2thetadot + 2 * k3thetadot + k4thetadot) / 6;
 }
-double environment::rk4thetadot(double h)
+
+double environment::thetadotdot(double _theta, double _thetadot)
 {
 	double g = 9.81;
-	double k1 = h * (torque - gamma * thetadot - mass * g * l * sin(theta)) / (mass * l * l);
-	double k2 = h * (torque - gamma * (thetadot + 0.5 * k1) - mass * g * l * sin(theta)) / (mass * l * l);
-	double k3 = h * (torque - gamma * (thetadot + 0.5 * k2) - mass * g * l * sin(theta)) / (mass * l * l);
-	double k4 = h * (torque - gamma * (thetadot + k3) - mass * g * l * sin(theta)) / (mass * l * l);
-
-	thetadot += k1 / 6 + k2 / 3 + k3 / 3 + k4 / 6;
-
-	return thetadot;
+	return (torque - gamma * _thetadot - mass * g * l * sin(_theta)) / (mass * l * l);
 }
-
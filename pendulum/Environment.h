@@ -9,14 +9,37 @@
 #ifndef ENVIRONMENT_H_
 #define ENVIRONMENT_H_
 
+#include <cmath>
+#include "DormandPrince.h"
+#include "Symplectic.h"
+
 class environment
 {
 public:
 
+	enum Integrator
+	{
+		RK4,			// Fixed RK4 steps (100 per propagate by default)
+		DORMAND_PRINCE,		// Adaptive steps to a given tolerance
+		VERLET,			// Fixed symplectic steps, stable for much larger steps over long runs
+		YOSHIDA4		// Fourth order symplectic steps
+	};
+
+	enum Event
+	{
+		APEX,			// thetadot = 0, either end of a swing
+		BOTTOM,			// theta passes through 0 (or a whole turn from it), either way
+		PHASE			// the swing reaches a given phase, atan2(-thetadot / w0, theta) with w0 = sqrt(g / l)
+	};
+
 	explicit environment(double _theta, double _thetadot, double _torque, double _maxtorque, double _time, double _deltatime, double _mass, double _length, double _gamma);
 
 	void propagate(); // Propogate the system through time
 
+	// Propagate to the next event, but for no longer than _maxtime; returns true if the event was reached.
+	// Events are found on the dense output of the Dormand-Prince solver, whichever integrator propagate uses
+	bool propagateToEvent(Event _event, double _maxtime, double _phase = 0);
+
 	double getTheta() { return theta; };
 	double getThetadot() { return thetadot; };
 	double getTorque() { return torque; };
@@ -24,6 +47,12 @@ public:
 
 	void setTorque(double _T);	 	 // Machine learning code sets the torque
 
+	void setVerbose(bool _verbose) { verbose = _verbose; };	// Turn the progress output on or off (e.g. for planner rollouts)
+
+	void setIntegrator(Integrator _integrator, double _tolerance = 1e-6);	// Choose how propagate solves the equation of motion
+	void setSubsteps(int _N) { N = _N; };		// Number of fixed steps per propagate for RK4, VERLET and YOSHIDA4
+	unsigned long getEvaluations() { return evaluations; };		// Evaluations of the equation of motion so far
+
 	void resetPendulum()
 	{
 		theta = 0;
@@ -35,8 +64,38 @@ public:
 private:
 
 	// Runge-Kutta 4 method for solving the equation of motion for a driven pendulum
-	double rk4theta(double h);	  	  // RK4 solve for theta
-	double rk4thetadot(double h);	  // RK4 solve for thetadot
+	void rk4step(double h);	  	  // Advance theta and thetadot together by one RK4 step of size h
+	double thetadotdot(double _theta, double _thetadot);	// Angular acceleration at the given state
+
+	// Equation of motion in the form the Dormand-Prince solver calls
+	struct Derivative
+	{
+		environment& env;
+		void operator()(double, const double y[], double dydt[]) { dydt[0] = y[1]; dydt[1] = env.thetadotdot(y[0], y[1]); };
+	};
+
+	// Event functions, zero at the event
+	struct EventFunction
+	{
+		Event event;
+		double phase;
+		double w0;
+		double operator()(double, const double y[])
+		{
+			if (event == APEX) return y[1];
+			if (event == BOTTOM) return std::remainder(y[0], 6.283185307179586);	// wrapped into [-pi, pi], the jump at the top is not an event
+			return std::sin(std::atan2(-y[1] / w0, y[0]) - phase);
+		};
+	};
+
+	// Equation of motion split into gravity, damping and torque for the symplectic integrator
+	struct Split
+	{
+		environment& env;
+		double acceleration(double, double _theta) { return -9.81 * std::sin(_theta) / env.l; };
+		double damping() { return env.gamma / (env.mass * env.l * env.l); };
+		double drive(double) { return env.torque / (env.mass * env.l * env.l); };
+	};
 
 
 	const double maxtorque;	 	 	 // Set a maximum torque in order to keep the pendulum 'undertorqued' (N m)
@@ -60,6 +119,14 @@ private:
 	double torque;
 	double time;
 
+	bool verbose;	// Print progress to std::cout in propagate and setTorque
+
+	Integrator integrator;
+	int N;				// Number of steps the fixed step methods use per propagate
+	DormandPrince<2> solver;	// Keeps its step size between calls to propagate
+	Symplectic symplectic;
+	unsigned long evaluations;
+
 
 };
 
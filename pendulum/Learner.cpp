@@ -0,0 +1,254 @@
+/*
+* Learner.cpp
+* Robotics 2016
+* Q-learning against the simulated pendulum for a single LearnerConfig.
+*/
+
+#define _USE_MATH_DEFINES
+#include "Learner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "ConvergenceMonitor.h"
+#include "Environment.h"
+#include "PriorityQueue.h"
+#include "State3.h"
+#include "StateSpace3.h"
+
+//PriorityQueue needs to_string for its primitive template types
+template<typename T> std::string to_string(T x) {
+	return static_cast<std::ostringstream&>((std::ostringstream() << std::dec << x)).str();
+}
+
+//defaults: alpha, gamma and the epsilon schedule are the robot learner's (sdk-clean/machinelearning/Main.cpp),
+//the pendulum and the bin counts are main.cpp's (which learns with alpha 0.5 and its own temperature schedule)
+LearnerConfig::LearnerConfig() :
+	alpha(0.8),
+	gamma(0.5),
+	angle_bins(100),
+	velocity_bins(50),
+	angle_max(M_PI),
+	velocity_max(10.0),
+	epsilon_start(0.0),
+	epsilon_step(0.005),
+	epsilon_delay(100UL),
+	deltatime(0.1),
+	mass(0.5),
+	length(0.08),
+	damping(0.5),
+	maxtorque(4.0),
+	integrator(environment::RK4),
+	substeps(100),
+	step_event(-1),
+	event_maxtime(1.0),
+	max_steps(100000UL),
+	episode_steps(200UL),
+	amplitude_threshold(0.5 * M_PI),
+	seed(0)
+{}
+
+bool LearnerConfig::set(const std::string& name, double value)
+{
+	if (!std::isfinite(value)) return false;
+	//counts are rounded, and the unsigned ones cannot hold a negative value
+	const int whole = static_cast<int>(std::floor(value + 0.5));
+	const bool unsignedCount = name == "epsilon_delay" || name == "max_steps" || name == "episode_steps";
+	if (unsignedCount && value < 0) return false;
+	const unsigned long count = static_cast<unsigned long>(value + 0.5);
+
+	if (name == "alpha") alpha = value;
+	else if (name == "gamma") gamma = value;
+	else if (name == "angle_bins") angle_bins = whole;
+	else if (name == "velocity_bins") velocity_bins = whole;
+	else if (name == "angle_max") angle_max = value;
+	else if (name == "velocity_max") velocity_max = value;
+	else if (name == "epsilon_start") epsilon_start = value;
+	else if (name == "epsilon_step") epsilon_step = value;
+	else if (name == "epsilon_delay") epsilon_delay = count;
+	else if (name == "deltatime") deltatime = value;
+	else if (name == "mass") mass = value;
+	else if (name == "length") length = value;
+	else if (name == "damping") damping = value;
+	else if (name == "maxtorque") maxtorque = value;
+	else if (name == "integrator") integrator = whole;
+	else if (name == "substeps") substeps = whole;
+	else if (name == "step_event") step_event = whole;
+	else if (name == "event_maxtime") event_maxtime = value;
+	else if (name == "max_steps") max_steps = count;
+	else if (name == "episode_steps") episode_steps = count;
+	else if (name == "amplitude_threshold") amplitude_threshold = value;
+	else return false;
+	return true;
+}
+
+//the angle is discretised with WRAP and the velocity and torque with CLAMP, so one bin is enough for each
+//(SATURATE, which runLearner does not use, would need three)
+std::string LearnerConfig::validate() const
+{
+	if (!(alpha >= 0 && alpha <= 1)) return "alpha must be in [0, 1]";
+	if (!(gamma >= 0 && gamma <= 1)) return "gamma must be in [0, 1]";
+	if (angle_bins < 1 || velocity_bins < 1) return "angle_bins and velocity_bins must be at least 1";
+	if (!(angle_max > 0) || !(velocity_max > 0)) return "angle_max and velocity_max must be more than 0";
+	if (!(epsilon_start >= 0 && epsilon_start <= 1)) return "epsilon_start must be in [0, 1]";
+	if (!(epsilon_step >= 0)) return "epsilon_step must not be negative";
+	if (!(deltatime > 0)) return "deltatime must be more than 0";
+	if (!(mass > 0) || !(length > 0)) return "mass and length must be more than 0";
+	if (!(damping >= 0)) return "damping must not be negative";
+	if (!(maxtorque > 0)) return "maxtorque must be more than 0";
+	if (integrator < environment::RK4 || integrator > environment::YOSHIDA4) return "integrator must be 0 to 3";
+	if (substeps < 1) return "substeps must be at least 1";
+	if (step_event < -1 || step_event > environment::BOTTOM) return "step_event must be -1, 0 or 1";
+	if (!(event_maxtime > 0)) return "event_maxtime must be more than 0";
+	if (episode_steps < 1) return "episode_steps must be at least 1";
+	if (!(amplitude_threshold > 0)) return "amplitude_threshold must be more than 0";
+	return "";
+}
+
+namespace
+{
+	//choose the best action with probability epsilon, otherwise a random one
+	float selectAction(const PriorityQueue<float, double>& queue, double epsilon, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		if (uniform(rng) < epsilon) return queue.peekFront().first;
+		std::uniform_int_distribution<size_t> pick(0, queue.getSize() - 1);
+		return queue[pick(rng)].first;
+	}
+
+	//wrap an angle into [-pi, pi)
+	double wrapAngle(double theta)
+	{
+		return theta - 2.0 * M_PI * std::floor((theta + M_PI) / (2.0 * M_PI));
+	}
+}
+
+LearnerResult runLearner(const LearnerConfig& config)
+{
+	const std::string problem = config.validate();
+	if (!problem.empty()) throw std::invalid_argument("runLearner: " + problem);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::mt19937 rng(config.seed);
+
+	environment env(0, 0, 0, config.maxtorque, 0, config.deltatime, config.mass, config.length, config.damping);
+	env.setVerbose(false);
+	env.setIntegrator(static_cast<environment::Integrator>(config.integrator));
+	env.setSubsteps(config.substeps);
+
+	//one action per whole unit of torque, as in main.cpp
+	const int torque_bins = static_cast<int>(2 * config.maxtorque) + 1;
+	PriorityQueue<float, double> initiator_queue(MAX);
+	for (int i = 0; i < torque_bins; ++i)
+	{
+		initiator_queue.enqueueWithPriority(static_cast<float>(-config.maxtorque + i), 0);
+	}
+
+	StateSpace space(initiator_queue, config.angle_bins, config.velocity_bins, torque_bins, config.angle_max, config.velocity_max, config.maxtorque, Discretiser::WRAP);
+	ConvergenceMonitor monitor(1000UL, 1e-3, 0.01, 3);
+
+	LearnerResult result;
+	result.steps_to_threshold = -1;
+	result.final_return = 0;
+	result.converged = false;
+
+	State old_state(0, 0, 0);
+	State current_state(0, 0, 0);
+	float action = 0.0f;
+	double epsilon = config.epsilon_start;
+	double episode_return = 0;
+
+	unsigned long i = 0UL;
+	for (; i < config.max_steps; ++i)
+	{
+		//read the state, the state space wraps the angle and clamps the velocity itself
+		current_state.theta = wrapAngle(env.getTheta());
+		current_state.theta_dot = env.getThetadot();
+		current_state.torque = env.getTorque();
+
+		if (result.steps_to_threshold < 0 && std::abs(current_state.theta) >= config.amplitude_threshold)
+		{
+			result.steps_to_threshold = static_cast<long>(i);
+		}
+
+		double R = current_state.getReward();
+		episode_return += R;
+
+		if (i > 0)
+		{
+			//Q-learning update of the action taken from the old state
+			PriorityQueue<float, double>& queue = space[old_state];
+			float oldBest = queue.peekFront().first;
+			double oldQ = queue.search(action).second;
+			double maxQ = space[current_state].peekFront().second;
+			double newQ = oldQ + config.alpha * (R + config.gamma * maxQ - oldQ);
+			queue.changePriority(action, newQ);
+
+			monitor.recordUpdate(space.cell(old_state), oldQ, newQ, queue.peekFront().first != oldBest);
+			monitor.recordReward(R);
+			if (monitor.converged())
+			{
+				result.converged = true;
+				break;
+			}
+		}
+
+		//start a new episode from rest
+		if ((i + 1) % config.episode_steps == 0)
+		{
+			result.final_return = episode_return;
+			episode_return = 0;
+			monitor.endEpisode();
+			env.resetPendulum();
+			old_state = State(0, 0, env.getTorque());
+			action = selectAction(space[old_state], epsilon, rng);
+		}
+		else
+		{
+			old_state = current_state;
+			action = selectAction(space[current_state], epsilon, rng);
+		}
+
+		if (i > config.epsilon_delay) epsilon = std::min(1.0, epsilon + config.epsilon_step);
+
+		env.setTorque(action);
+		if (config.step_event < 0) env.propagate();
+		else env.propagateToEvent(static_cast<environment::Event>(config.step_event), config.event_maxtime);
+	}
+
+	result.steps = i;
+	result.runtime_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+std::string configHeader()
+{
+	return "alpha\tgamma\tabins\tvbins\tamax\tvmax\teps0\tepsstep\tepsdelay\tinteg\tsubsteps\tevent\tevmax";
+}
+
+std::string configRow(const LearnerConfig& config)
+{
+	std::ostringstream row;
+	row << config.alpha << "\t" << config.gamma << "\t"
+		<< config.angle_bins << "\t" << config.velocity_bins << "\t"
+		<< config.angle_max << "\t" << config.velocity_max << "\t"
+		<< config.epsilon_start << "\t" << config.epsilon_step << "\t" << config.epsilon_delay << "\t"
+		<< config.integrator << "\t" << config.substeps << "\t" << config.step_event << "\t" << config.event_maxtime;
+	return row.str();
+}
+
+std::string resultHeader()
+{
+	return "thresh_steps\tfinal_return\truntime_ms\tsteps\tconverged";
+}
+
+std::string resultRow(const LearnerResult& result)
+{
+	std::ostringstream row;
+	row << result.steps_to_threshold << "\t" << result.final_return << "\t"
+		<< result.runtime_ms << "\t" << result.steps << "\t" << (result.converged ? 1 : 0);
+	return row.str();
+}
@@ -0,0 +1,82 @@
+/*
+* Learner.h
+* Robotics 2016
+* A self-contained Q-learning run against the simulated pendulum, with every hyperparameter
+* that main.cpp and the robot learner hard-code gathered into one LearnerConfig, so that
+* many runs can be made side by side (see sweep.cpp).
+*/
+
+#ifndef LEARNER_H_
+#define LEARNER_H_
+
+#include <string>
+
+struct LearnerConfig
+{
+	//learning
+	double alpha;			// learning rate
+	double gamma;			// discount factor
+
+	//discretisation
+	int angle_bins;
+	int velocity_bins;
+	double angle_max;
+	double velocity_max;
+
+	//epsilon-greedy schedule, as on the robot: epsilon is the chance of taking the best action,
+	//starting at epsilon_start and rising by epsilon_step per step after epsilon_delay steps
+	double epsilon_start;
+	double epsilon_step;
+	unsigned long epsilon_delay;
+
+	//pendulum
+	double deltatime;
+	double mass;
+	double length;
+	double damping;
+	double maxtorque;
+
+	//how each step is integrated (see environment::setIntegrator and setSubsteps)
+	int integrator;			// environment::Integrator: 0 RK4, 1 DORMAND_PRINCE, 2 VERLET, 3 YOSHIDA4
+	int substeps;			// fixed steps per step for RK4, VERLET and YOSHIDA4
+
+	//event stepping: each step runs on to the next event rather than for deltatime (see environment::propagateToEvent)
+	int step_event;			// -1 for fixed steps, otherwise environment::Event: 0 APEX, 1 BOTTOM
+	double event_maxtime;		// longest a step may run without reaching the event, in seconds
+
+	//run length
+	unsigned long max_steps;		// total number of steps to run for
+	unsigned long episode_steps;		// steps before the pendulum is reset
+	double amplitude_threshold;		// |theta| at which the swing counts as successful
+
+	unsigned int seed;
+
+	LearnerConfig();
+
+	//set a field by name (alpha, angle_bins, max_steps, ...) from a number, counts being rounded; returns false if
+	//there is no such field or the value cannot be held at all (e.g. a negative count), other ranges are left to validate
+	bool set(const std::string& name, double value);
+
+	//empty if every field is usable, otherwise what is wrong with the first that is not
+	std::string validate() const;
+};
+
+struct LearnerResult
+{
+	long steps_to_threshold;		// steps until |theta| first reached the threshold, -1 if never
+	double final_return;			// return of the last complete episode
+	double runtime_ms;			// wall clock time of the run
+	unsigned long steps;			// steps actually run (fewer than max_steps if converged)
+	bool converged;				// whether the convergence monitor stopped the run
+};
+
+//run Q-learning with the given configuration and report how well it did; throws std::invalid_argument if it does not validate
+LearnerResult runLearner(const LearnerConfig& config);
+
+//one line, tab separated descriptions of a configuration and result, with matching headers
+std::string configHeader();
+std::string configRow(const LearnerConfig& config);
+std::string resultHeader();
+std::string resultRow(const LearnerResult& result);
+
+#endif /* LEARNER_H_ */
@@ -0,0 +1,226 @@
+/*
+* PendulumBatch.cpp
+* Robotics 2016
+*
+*/
+
+#include "PendulumBatch.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	const double g = 9.81;
+
+	// pi split in two so that x - k*pi keeps its accuracy
+	const double pi_hi = 3.141592653589793116;
+	const double pi_lo = 1.2246467991473532072e-16;
+	const double inv_pi = 0.31830988618379067154;
+
+	// Taylor coefficients of sin(r)/r in r^2, accurate to double precision for |r| <= pi/2
+	const double sin_coef[] = {
+		1.0,
+		-1.0 / 6,
+		1.0 / 120,
+		-1.0 / 5040,
+		1.0 / 362880,
+		-1.0 / 39916800,
+		1.0 / 6227020800,
+		-1.0 / 1307674368000,
+		1.0 / 355687428096000,
+		-1.0 / 121645100408832000,
+		1.0 / 51090942171709440000.0,
+	};
+	const int sin_terms = sizeof(sin_coef) / sizeof(sin_coef[0]);
+
+	// Each Lane type wraps one register width with the few operations the step needs, so that
+	// the RK4 step below is written once and used for every instruction set
+
+	struct ScalarLane
+	{
+		typedef double type;
+		static const int width = 1;
+		static type set(double x) { return x; }
+		static type load(const double* p) { return *p; }
+		static void store(double* p, type x) { *p = x; }
+		static type add(type a, type b) { return a + b; }
+		static type sub(type a, type b) { return a - b; }
+		static type mul(type a, type b) { return a * b; }
+		// sin(x) = (-1)^k sin(x - k*pi) with k the nearest integer to x/pi
+		static type sin(type x)
+		{
+			double k = static_cast<double>(static_cast<long long>(x * inv_pi + (x < 0 ? -0.5 : 0.5)));
+			double r = (x - k * pi_hi) - k * pi_lo;
+			double r2 = r * r;
+			double p = sin_coef[sin_terms - 1];
+			for (int i = sin_terms - 2; i >= 0; --i) p = p * r2 + sin_coef[i];
+			p *= r;
+			return (static_cast<long long>(k) & 1) ? -p : p;
+		}
+	};
+
+#ifdef __SSE2__
+	struct SSE2Lane
+	{
+		typedef __m128d type;
+		static const int width = 2;
+		static type set(double x) { return _mm_set1_pd(x); }
+		static type load(const double* p) { return _mm_loadu_pd(p); }
+		static void store(double* p, type x) { _mm_storeu_pd(p, x); }
+		static type add(type a, type b) { return _mm_add_pd(a, b); }
+		static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+		static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+		static type sin(type x)
+		{
+			// nearest integer (ties to even) in the low two 32 bit lanes
+			__m128i ki = _mm_cvtpd_epi32(_mm_mul_pd(x, _mm_set1_pd(inv_pi)));
+			__m128d k = _mm_cvtepi32_pd(ki);
+			__m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(pi_hi))), _mm_mul_pd(k, _mm_set1_pd(pi_lo)));
+			__m128d r2 = _mm_mul_pd(r, r);
+			__m128d p = _mm_set1_pd(sin_coef[sin_terms - 1]);
+			for (int i = sin_terms - 2; i >= 0; --i) p = _mm_add_pd(_mm_mul_pd(p, r2), _mm_set1_pd(sin_coef[i]));
+			p = _mm_mul_pd(p, r);
+			// move the parity of k into the sign bit of each double
+			__m128i sign = _mm_slli_epi64(_mm_unpacklo_epi32(ki, ki), 63);
+			return _mm_xor_pd(p, _mm_castsi128_pd(sign));
+		}
+	};
+#endif
+
+#ifdef __AVX2__
+	struct AVX2Lane
+	{
+		typedef __m256d type;
+		static const int width = 4;
+		static type set(double x) { return _mm256_set1_pd(x); }
+		static type load(const double* p) { return _mm256_loadu_pd(p); }
+		static void store(double* p, type x) { _mm256_storeu_pd(p, x); }
+		static type add(type a, type b) { return _mm256_add_pd(a, b); }
+		static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+		static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+		static type sin(type x)
+		{
+			__m128i ki = _mm256_cvtpd_epi32(_mm256_mul_pd(x, _mm256_set1_pd(inv_pi)));
+			__m256d k = _mm256_cvtepi32_pd(ki);
+			__m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(pi_hi))), _mm256_mul_pd(k, _mm256_set1_pd(pi_lo)));
+			__m256d r2 = _mm256_mul_pd(r, r);
+			__m256d p = _mm256_set1_pd(sin_coef[sin_terms - 1]);
+			for (int i = sin_terms - 2; i >= 0; --i) p = _mm256_add_pd(_mm256_mul_pd(p, r2), _mm256_set1_pd(sin_coef[i]));
+			p = _mm256_mul_pd(p, r);
+			__m256i sign = _mm256_slli_epi64(_mm256_cvtepi32_epi64(ki), 63);
+			return _mm256_xor_pd(p, _mm256_castsi256_pd(sign));
+		}
+	};
+	typedef AVX2Lane WideLane;
+#elif defined(__SSE2__)
+	typedef SSE2Lane WideLane;
+#else
+	typedef ScalarLane WideLane;
+#endif
+
+	// Angular acceleration of the driven, damped pendulum (as in environment::thetadotdot)
+	template<class L>
+	inline typename L::type thetadotdot(typename L::type th, typename L::type thd, typename L::type T, typename L::type gm, typename L::type m, typename L::type I)
+	{
+		return L::mul(L::sub(L::sub(T, L::mul(gm, thd)), L::mul(m, L::sin(th))), I);
+	}
+
+	// N coupled RK4 steps of size h for the pendulums [begin, end), L::width at a time
+	template<class L>
+	std::size_t stepLanes(std::size_t begin, std::size_t end, double h, int N, double* theta, double* thetadot,
+		const double* torque, const double* gamma, const double* mgl, const double* inertia)
+	{
+		typedef typename L::type V;
+		const V vh = L::set(h);
+		const V vhalf = L::set(0.5 * h);
+		const V vsixth = L::set(h / 6);
+		const V vtwo = L::set(2.0);
+
+		std::size_t i = begin;
+		for (; i + L::width <= end; i += L::width)
+		{
+			V th = L::load(theta + i);
+			V thd = L::load(thetadot + i);
+			const V T = L::load(torque + i);
+			const V gm = L::load(gamma + i);
+			const V m = L::load(mgl + i);
+			const V I = L::load(inertia + i);
+
+			for (int n = 0; n < N; ++n)
+			{
+				V k1th = thd;
+				V k1thd = thetadotdot<L>(th, thd, T, gm, m, I);
+				V k2th = L::add(thd, L::mul(vhalf, k1thd));
+				V k2thd = thetadotdot<L>(L::add(th, L::mul(vhalf, k1th)), k2th, T, gm, m, I);
+				V k3th = L::add(thd, L::mul(vhalf, k2thd));
+				V k3thd = thetadotdot<L>(L::add(th, L::mul(vhalf, k2th)), k3th, T, gm, m, I);
+				V k4th = L::add(thd, L::mul(vh, k3thd));
+				V k4thd = thetadotdot<L>(L::add(th, L::mul(vh, k3th)), k4th, T, gm, m, I);
+
+				th = L::add(th, L::mul(vsixth, L::add(L::add(k1th, k4th), L::mul(vtwo, L::add(k2th, k3th)))));
+				thd = L::add(thd, L::mul(vsixth, L::add(L::add(k1thd, k4thd), L::mul(vtwo, L::add(k2thd, k3thd)))));
+			}
+
+			L::store(theta + i, th);
+			L::store(thetadot + i, thd);
+		}
+		return i;
+	}
+}
+
+PendulumBatch::PendulumBatch(std::size_t _size, double _maxtorque, double _mass, double _length, double _gamma)
+	: count(_size), time(0), theta(_size, 0.0), thetadot(_size, 0.0), torque(_size, 0.0),
+	maxtorque(_size), gamma(_size), mgl(_size), inertia(_size)
+{
+	for (std::size_t i = 0; i < count; ++i) setParameters(i, _maxtorque, _mass, _length, _gamma);
+}
+
+void PendulumBatch::propagate(double dt, int N)
+{
+	double h = dt / N;		// RK4 step size for N steps over the time dt
+
+	// full registers first, then the remainder one at a time
+	std::size_t done = stepLanes<WideLane>(0, count, h, N, theta.data(), thetadot.data(), torque.data(), gamma.data(), mgl.data(), inertia.data());
+	stepLanes<ScalarLane>(done, count, h, N, theta.data(), thetadot.data(), torque.data(), gamma.data(), mgl.data(), inertia.data());
+
+	time += dt;
+}
+
+// as environment::setTorque, which only checks the upper limit
+void PendulumBatch::setTorque(std::size_t i, double _T)
+{
+	if (_T <= maxtorque[i]) torque[i] = _T;
+}
+
+void PendulumBatch::setTorques(const double* _T)
+{
+	for (std::size_t i = 0; i < count; ++i) setTorque(i, _T[i]);
+}
+
+void PendulumBatch::setState(std::size_t i, double _theta, double _thetadot)
+{
+	theta[i] = _theta;
+	thetadot[i] = _thetadot;
+}
+
+void PendulumBatch::setParameters(std::size_t i, double _maxtorque, double _mass, double _length, double _gamma)
+{
+	maxtorque[i] = _maxtorque;
+	gamma[i] = _gamma;
+	mgl[i] = _mass * g * _length;
+	inertia[i] = 1.0 / (_mass * _length * _length);
+	setTorque(i, torque[i]);
+}
+
+const char* PendulumBatch::lanes()
+{
+#if defined(__AVX2__)
+	return "AVX2";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+* PendulumBatch.h
+* Robotics 2016
+* Many independent driven pendulums, the same model as 'environment', stored as a structure of arrays
+* and stepped together with a coupled RK4 vectorised across SIMD lanes (AVX2, SSE2 or plain scalar,
+* whichever PendulumBatch.cpp is compiled for, e.g. with -mavx2 or -march=native).
+* All pendulums share the same time; each has its own state, torque and parameters.
+*/
+
+#ifndef PENDULUMBATCH_H_
+#define PENDULUMBATCH_H_
+
+#include <cstddef>
+#include <vector>
+
+class PendulumBatch
+{
+public:
+
+	// Every pendulum starts at rest with zero torque and the given parameters
+	explicit PendulumBatch(std::size_t _size, double _maxtorque, double _mass, double _length, double _gamma);
+
+	void propagate(double dt, int N = 100);	// Propagate every pendulum through time dt using N RK4 steps
+
+	std::size_t size() const { return count; };
+
+	double getTheta(std::size_t i) const { return theta[i]; };
+	double getThetadot(std::size_t i) const { return thetadot[i]; };
+	double getTorque(std::size_t i) const { return torque[i]; };
+	double getTime() const { return time; };
+
+	// Whole arrays, one entry per pendulum
+	const double* getThetas() const { return theta.data(); };
+	const double* getThetadots() const { return thetadot.data(); };
+
+	void setTorque(std::size_t i, double _T);	// Torques above maxtorque are ignored, as by environment::setTorque
+	void setTorques(const double* _T);		// Set every torque at once from an array of size()
+
+	void setState(std::size_t i, double _theta, double _thetadot);
+	void setParameters(std::size_t i, double _maxtorque, double _mass, double _length, double _gamma);
+
+	void resetPendulum(std::size_t i) { setState(i, 0, 0); };	// Reset pendulum i to theta=0, thetadot=0
+	void resetTime() { time = 0; };
+
+	static const char* lanes();	// Name of the instruction set the batch was compiled for
+
+private:
+
+	std::size_t count;
+	double time;
+
+	// State
+	std::vector<double> theta;
+	std::vector<double> thetadot;
+	std::vector<double> torque;
+
+	// Parameters, kept in the form the equation of motion uses
+	std::vector<double> maxtorque;
+	std::vector<double> gamma;		// Damping factor
+	std::vector<double> mgl;		// mass * g * length
+	std::vector<double> inertia;		// 1 / (mass * length^2)
+};
+
+#endif /* PENDULUMBATCH_H_ */
@@ -0,0 +1,268 @@
+/*
+* Planner.h
+* Robotics 2016
+* Anytime receding-horizon planner for choosing the next action without a training phase.
+* The planner rolls a copy of the pendulum model forward for candidate action sequences and
+* keeps the first action with the best expected return found before its time budget runs out.
+*
+* The model type must be copy constructible and provide setTorque(double), propagate(),
+* getTheta(), getThetadot() and getTorque() - i.e. the 'environment' interface.
+*
+* Usage, once per decision step:
+*	double action = planner.plan(*env);	// search from the current state until the budget is spent
+*	env->setTorque(action);
+*	env->propagate();
+*	planner.advance(action);		// keep the subtree below the chosen action for the next step
+*/
+
+#ifndef PLANNER_H_
+#define PLANNER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "State3.h"
+
+template<class Model>
+class Planner
+{
+public:
+
+	//@_actions: the torques the planner may choose between
+	//@_horizon: the number of decision steps to look ahead
+	//@_discount: discount factor applied to rewards further down the horizon
+	//@_budget_ms: wall clock time allowed for each call to plan()
+	//@_threads: number of threads to search with, 0 uses every core
+	explicit Planner(const std::vector<double>& _actions, int _horizon, double _discount, double _budget_ms, unsigned int _threads = 0)
+		: actions(_actions), horizon(_horizon), discount(_discount), budget(_budget_ms), threads(_threads), exploration(1.0), generation(0), iterations(0)
+	{
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		std::random_device seed;
+		for (unsigned int i = 0; i < threads; ++i) rngs.push_back(std::mt19937(seed()));
+	}
+
+	//deny copy construction
+	Planner(const Planner&) = delete;
+
+	// Search from the current state of the model until the time budget runs out, and return the best first action
+	double plan(const Model& current)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+			+ std::chrono::microseconds(static_cast<long>(budget * 1000.0));
+
+		// Every stored state below the root was simulated from a predicted state, so mark it as out of date;
+		// nodes are re-simulated from the real state as they are next visited, keeping their statistics
+		++generation;
+		if (!root) root.reset(new Node(-1));
+		root->model.reset(new Model(current));
+		root->generation = generation;
+		if (root->children.empty())
+		{
+			for (size_t a = 0; a < actions.size(); ++a) root->children.push_back(std::unique_ptr<Node>(new Node(static_cast<int>(a))));
+		}
+
+		// Root parallelisation: each thread owns a disjoint set of first actions and their subtrees
+		unsigned int n = std::min<unsigned int>(threads, static_cast<unsigned int>(actions.size()));
+		std::vector<unsigned long> counts(n, 0UL);
+		std::vector<std::thread> workers;
+		for (unsigned int t = 1; t < n; ++t) workers.push_back(std::thread(&Planner::search, this, t, n, deadline, &counts[t]));
+		search(0, n, deadline, &counts[0]);
+		for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+
+		iterations = 0UL;
+		for (unsigned int t = 0; t < n; ++t) iterations += counts[t];
+
+		// Pick the first action with the highest mean return
+		int best = 0;
+		double bestValue = -std::numeric_limits<double>::infinity();
+		for (size_t a = 0; a < root->children.size(); ++a)
+		{
+			const Node& child = *root->children[a];
+			if (child.visits > 0 && child.mean() > bestValue)
+			{
+				bestValue = child.mean();
+				best = static_cast<int>(a);
+			}
+		}
+		return actions[best];
+	}
+
+	// Re-root the tree below the action that was carried out, so the next search starts from its statistics
+	void advance(double action)
+	{
+		if (!root) return;
+		for (size_t a = 0; a < actions.size(); ++a)
+		{
+			if (actions[a] == action && a < root->children.size())
+			{
+				std::unique_ptr<Node> child(std::move(root->children[a]));
+				root = std::move(child);
+				return;
+			}
+		}
+		root.reset();	// action not in the tree, start again
+	}
+
+	// Throw away the tree, e.g. after the pendulum has been reset
+	void reset() { root.reset(); }
+
+	// Weighting of the exploration term in the UCB1 selection rule
+	void setExploration(double c) { exploration = c; }
+
+	// Number of rollouts performed by the last call to plan()
+	unsigned long getIterations() const { return iterations; }
+
+	// Mean return of each first action after the last call to plan(), in the order of the actions vector
+	std::vector<double> getActionValues() const
+	{
+		std::vector<double> values(actions.size(), 0.0);
+		if (!root) return values;
+		for (size_t a = 0; a < root->children.size(); ++a) values[a] = root->children[a]->mean();
+		return values;
+	}
+
+private:
+
+	// A node of the search tree, holding the model state reached by taking 'action' from its parent
+	struct Node
+	{
+		explicit Node(int _action) : action(_action), reward(0), visits(0), total(0), generation(0) {}
+
+		double mean() const { return visits ? total / visits : 0.0; }
+
+		int action;					// index into the actions vector
+		double reward;					// reward received on entering this node
+		unsigned long visits;
+		double total;					// sum of the returns of every rollout through this node
+		unsigned long generation;			// generation of the root state the model was simulated from
+		std::unique_ptr<Model> model;
+		std::vector<std::unique_ptr<Node> > children;
+	};
+
+	// Reward of a model state, as used by the learners
+	static double reward(Model& model)
+	{
+		State state(model.getTheta(), model.getThetadot(), model.getTorque());
+		return state.getReward();
+	}
+
+	// (Re-)simulate a child from its parent if it has not been simulated from the current root state
+	void refresh(Node& parent, Node& child)
+	{
+		if (child.model && child.generation == generation) return;
+		child.model.reset(new Model(*parent.model));
+		child.model->setTorque(actions[child.action]);
+		child.model->propagate();
+		child.reward = reward(*child.model);
+		child.generation = generation;
+	}
+
+	// UCB1 choice of the child to descend into, trying each child once first
+	Node& select(Node& node)
+	{
+		double logVisits = std::log(static_cast<double>(node.visits + 1));
+		Node* best = 0;
+		double bestScore = -std::numeric_limits<double>::infinity();
+		for (size_t a = 0; a < node.children.size(); ++a)
+		{
+			Node& child = *node.children[a];
+			if (child.visits == 0) return child;
+			double score = child.mean() + exploration * std::sqrt(logVisits / child.visits);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				best = &child;
+			}
+		}
+		return *best;
+	}
+
+	// Play random actions from a state to the end of the horizon and return the discounted reward
+	double rollout(const Model& start, int depth, std::mt19937& rng)
+	{
+		Model model(start);
+		std::uniform_int_distribution<size_t> pick(0, actions.size() - 1);
+		double total = 0;
+		double weight = 1;
+		for (int d = depth; d < horizon; ++d)
+		{
+			model.setTorque(actions[pick(rng)]);
+			model.propagate();
+			total += weight * reward(model);
+			weight *= discount;
+		}
+		return total;
+	}
+
+	// One iteration of tree search below a first action: descend, expand one node, roll out and back up
+	void iterate(Node& first, std::mt19937& rng)
+	{
+		std::vector<Node*> path;
+		refresh(*root, first);
+		path.push_back(&first);
+
+		// Descend through fully expanded nodes
+		Node* node = &first;
+		int depth = 1;
+		while (depth < horizon && !node->children.empty())
+		{
+			Node& child = select(*node);
+			refresh(*node, child);
+			path.push_back(&child);
+			node = &child;
+			++depth;
+		}
+
+		// Expand the leaf and estimate its value with a random rollout
+		double tail = 0;
+		if (depth < horizon)
+		{
+			for (size_t a = 0; a < actions.size(); ++a) node->children.push_back(std::unique_ptr<Node>(new Node(static_cast<int>(a))));
+			tail = rollout(*node->model, depth, rng);
+		}
+
+		// Back up the discounted return from each node on the path to the end of the horizon
+		for (int i = static_cast<int>(path.size()) - 1; i >= 0; --i)
+		{
+			tail = path[i]->reward + discount * tail;
+			path[i]->visits++;
+			path[i]->total += tail;
+		}
+	}
+
+	// Worker loop for one thread, cycling through the first actions it owns until the deadline
+	void search(unsigned int thread, unsigned int stride, std::chrono::steady_clock::time_point deadline, unsigned long* count)
+	{
+		std::mt19937& rng = rngs[thread];
+		unsigned long n = 0;
+		do
+		{
+			for (size_t a = thread; a < root->children.size(); a += stride)
+			{
+				iterate(*root->children[a], rng);
+				++n;
+			}
+		} while (std::chrono::steady_clock::now() < deadline);
+		*count = n;
+	}
+
+	const std::vector<double> actions;
+	const int horizon;
+	const double discount;
+	const double budget;
+	unsigned int threads;
+	double exploration;
+
+	unsigned long generation;	// incremented every time plan() is given a new root state
+	unsigned long iterations;
+
+	std::vector<std::mt19937> rngs;	// one random number generator per thread
+	std::unique_ptr<Node> root;
+};
+
+#endif /* PLANNER_H_ */
@@ -0,0 +1,274 @@
+/*
+* PoincareMap.h
+* Robotics 2016
+* Stroboscopic (one forcing period) map of a periodically driven swing, tabulated once and then interpolated,
+* so that whole periods can be stepped in O(1) instead of integrating through them.
+*
+* The map sends the state (theta, omega) at time t0 + k T to the state at t0 + (k + 1) T. It is tabulated on a grid
+* periodic in theta over [-pi, pi) and spanning [-omegaMax, omegaMax] in omega, each node integrated with the
+* Dormand-Prince solver on a pool of threads, and interpolated with Catmull-Rom splines in both directions. The
+* change in theta is interpolated rather than theta itself, so the result keeps the caller's number of turns.
+* Tables can be saved and loaded again, with a key (e.g. the model parameters) to tell caches apart.
+*
+* The system is anything the Dormand-Prince solver can call as f(t, y, dydt) with y = [theta, omega], and must be
+* copyable (each thread integrates with its own copy).
+*
+*	PoincareMap<PrimeFunc> map(256, 256, 10, 2 * M_PI / par.w);
+*	if (!map.load("map.bin", key)) { map.build(par, 1e-10, 8); map.save("map.bin", key); }
+*	map.advance(theta, omega);		// one period on, false if omega is beyond the table
+*
+* Written without C++11 so that it also builds for the robot.
+*/
+
+#ifndef POINCAREMAP_H_
+#define POINCAREMAP_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include "DormandPrince.h"
+
+// Differences between the table and direct integration over one period
+struct PoincareError
+{
+	double maxTheta;
+	double maxOmega;
+	double rmsTheta;
+	double rmsOmega;
+};
+
+template<class System>
+class PoincareMap
+{
+public:
+
+	// The table is empty until build() or load()
+	explicit PoincareMap(int _thetaPoints, int _omegaPoints, double _omegaMax, double _period, double _t0 = 0)
+		: thetaPoints(_thetaPoints), omegaPoints(std::max(2, _omegaPoints)), omegaMax(_omegaMax), period(_period), t0(_t0), built(false) {}
+
+	// Integrates every node of the grid over one period, on the given number of threads; false if any integration failed
+	bool build(const System& system, double tolerance, int threads)
+	{
+		dtheta.assign(thetaPoints * omegaPoints, 0.0);
+		omega.assign(thetaPoints * omegaPoints, 0.0);
+		threads = std::max(1, std::min(threads, thetaPoints));
+
+		std::vector<pthread_t> workers(threads);
+		std::vector<Job> jobs(threads, Job(system));
+		for (int k = 0; k < threads; ++k)
+		{
+			jobs[k].map = this;
+			jobs[k].begin = thetaPoints * k / threads;
+			jobs[k].end = thetaPoints * (k + 1) / threads;
+			jobs[k].tolerance = tolerance;
+			jobs[k].failed = false;
+			pthread_create(&workers[k], NULL, worker, &jobs[k]);
+		}
+		bool failed = false;
+		for (int k = 0; k < threads; ++k)
+		{
+			pthread_join(workers[k], NULL);
+			failed = failed || jobs[k].failed;
+		}
+		built = true;
+		return !failed;
+	}
+
+	// Advances (theta, omega) by one period; returns false, leaving the state unchanged, if omega is off the table
+	bool advance(double& _theta, double& _omega) const
+	{
+		if (!built || !(std::abs(_omega) <= omegaMax)) return false;
+
+		// position in the grid: theta wraps round, omega is clamped to its ends
+		double u = (_theta + M_PI) / (2.0 * M_PI);
+		u = (u - std::floor(u)) * thetaPoints;
+		double v = (_omega + omegaMax) / (2.0 * omegaMax) * (omegaPoints - 1);
+		int i = std::min(static_cast<int>(u), thetaPoints - 1);
+		int j = std::min(static_cast<int>(v), omegaPoints - 2);
+		double wu[4], wv[4];
+		weights(u - i, wu);
+		weights(v - j, wv);
+
+		double newDtheta = 0, newOmega = 0;
+		for (int a = 0; a < 4; ++a)
+		{
+			int row = ((i + a - 1) % thetaPoints + thetaPoints) % thetaPoints;
+			for (int b = 0; b < 4; ++b)
+			{
+				int column = std::max(0, std::min(j + b - 1, omegaPoints - 1));
+				double w = wu[a] * wv[b];
+				newDtheta += w * dtheta[row * omegaPoints + column];
+				newOmega += w * omega[row * omegaPoints + column];
+			}
+		}
+		_theta += newDtheta;
+		_omega = newOmega;
+		return true;
+	}
+
+	// Compares the table with direct integration at n points spread over the grid (a low discrepancy sequence)
+	PoincareError check(const System& system, int n, double tolerance) const
+	{
+		System f(system);
+		PoincareError error = { 0, 0, 0, 0 };
+		for (int k = 0; k < n; ++k)
+		{
+			// additive recurrence with the plastic number, which fills the square evenly
+			double a = std::fmod(0.5 + k * 0.7548776662466927, 1.0);
+			double b = std::fmod(0.5 + k * 0.5698402909980532, 1.0);
+			double y[2] = { -M_PI + 2.0 * M_PI * a, -omegaMax + 2.0 * omegaMax * b };
+			double theta = y[0], w = y[1];
+			advance(theta, w);
+			integrate(f, y, tolerance);
+			double et = std::abs(theta - y[0]), ew = std::abs(w - y[1]);
+			error.maxTheta = std::max(error.maxTheta, et);
+			error.maxOmega = std::max(error.maxOmega, ew);
+			error.rmsTheta += et * et;
+			error.rmsOmega += ew * ew;
+		}
+		if (n > 0)
+		{
+			error.rmsTheta = std::sqrt(error.rmsTheta / n);
+			error.rmsOmega = std::sqrt(error.rmsOmega / n);
+		}
+		return error;
+	}
+
+	// Writes the table with a key identifying the model; false if the file cannot be written
+	bool save(const char* path, const std::vector<double>& key) const
+	{
+		if (!built) return false;
+		FILE* file = std::fopen(path, "wb");
+		if (!file) return false;
+		Header header = describe(key.size());
+		size_t cells = dtheta.size();
+		bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+			&& (key.empty() || std::fwrite(&key[0], sizeof(double), key.size(), file) == key.size())
+			&& std::fwrite(&dtheta[0], sizeof(double), cells, file) == cells
+			&& std::fwrite(&omega[0], sizeof(double), cells, file) == cells;
+		return std::fclose(file) == 0 && ok;
+	}
+
+	// Reads a table saved for the same grid, period and key; false (leaving the map as it was) otherwise
+	bool load(const char* path, const std::vector<double>& key)
+	{
+		FILE* file = std::fopen(path, "rb");
+		if (!file) return false;
+		Header expected = describe(key.size());
+		Header header;
+		std::vector<double> savedKey(key.size());
+		size_t cells = static_cast<size_t>(thetaPoints) * omegaPoints;
+		std::vector<double> newDtheta(cells), newOmega(cells);
+		bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+			&& std::memcmp(&header, &expected, sizeof(header)) == 0
+			&& (key.empty() || std::fread(&savedKey[0], sizeof(double), key.size(), file) == key.size())
+			&& savedKey == key
+			&& std::fread(&newDtheta[0], sizeof(double), cells, file) == cells
+			&& std::fread(&newOmega[0], sizeof(double), cells, file) == cells;
+		std::fclose(file);
+		if (!ok) return false;
+		dtheta.swap(newDtheta);
+		omega.swap(newOmega);
+		built = true;
+		return true;
+	}
+
+	double getPeriod() const { return period; };
+	double getOmegaMax() const { return omegaMax; };
+	bool isBuilt() const { return built; };
+
+	// Integrates y = [theta, omega] directly over one period, as each node of the table was; false if the solver failed
+	bool integrate(System& f, double y[], double tolerance) const
+	{
+		DormandPrince<2> solver(tolerance, tolerance, period / 100);
+		solver.reset(t0, y);
+		bool ok = solver.evolve(f, t0 + period);
+		y[0] = solver.getState()[0];
+		y[1] = solver.getState()[1];
+		return ok;
+	}
+
+private:
+
+	// Start of a saved table; a mismatch in any field means the table is for something else
+	struct Header
+	{
+		char magic[8];
+		int thetaPoints;
+		int omegaPoints;
+		double omegaMax;
+		double period;
+		double t0;
+		unsigned long keySize;
+	};
+
+	Header describe(size_t keySize) const
+	{
+		Header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "POINCAR", 8);
+		header.thetaPoints = thetaPoints;
+		header.omegaPoints = omegaPoints;
+		header.omegaMax = omegaMax;
+		header.period = period;
+		header.t0 = t0;
+		header.keySize = keySize;
+		return header;
+	}
+
+	// Share of the rows given to one thread, with its own copy of the system
+	struct Job
+	{
+		explicit Job(const System& _system) : system(_system) {}
+		PoincareMap* map;
+		System system;
+		int begin;
+		int end;
+		double tolerance;
+		bool failed;
+	};
+
+	static void* worker(void* arg)
+	{
+		Job& job = *static_cast<Job*>(arg);
+		PoincareMap& map = *job.map;
+		for (int i = job.begin; i < job.end; ++i)
+		{
+			for (int j = 0; j < map.omegaPoints; ++j)
+			{
+				double y[2] = { -M_PI + 2.0 * M_PI * i / map.thetaPoints, -map.omegaMax + 2.0 * map.omegaMax * j / (map.omegaPoints - 1) };
+				double theta = y[0];
+				if (!map.integrate(job.system, y, job.tolerance)) job.failed = true;
+				map.dtheta[i * map.omegaPoints + j] = y[0] - theta;
+				map.omega[i * map.omegaPoints + j] = y[1];
+			}
+		}
+		return NULL;
+	}
+
+	// Catmull-Rom weights of the four nodes around a point a fraction s of the way through its interval
+	static void weights(double s, double w[4])
+	{
+		double s2 = s * s, s3 = s2 * s;
+		w[0] = 0.5 * (-s3 + 2 * s2 - s);
+		w[1] = 0.5 * (3 * s3 - 5 * s2 + 2);
+		w[2] = 0.5 * (-3 * s3 + 4 * s2 + s);
+		w[3] = 0.5 * (s3 - s2);
+	}
+
+	int thetaPoints;
+	int omegaPoints;
+	double omegaMax;
+	double period;
+	double t0;
+	bool built;
+
+	// Change in theta and new omega at each node, indexed by theta point * omegaPoints + omega point
+	std::vector<double> dtheta;
+	std::vector<double> omega;
+};
+
+#endif /* POINCAREMAP_H_ */
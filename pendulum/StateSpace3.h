@@ -6,7 +6,8 @@
 #include <stdexcept>
 #include <iostream>
 #include "PriorityQueue.h"
-#include "State.h"
+#include "State3.h"
+#include "Discretiser.h"
 
 //index with state_space_object[angle][velocity][torque]
 //   or with state_space_object[state_object]
@@ -19,7 +20,9 @@ public:
 	//@_velocity_bins: the size of the second vector
 	//@_torque_bins: the size of the third vector
 	//@queue: the PriorityQueue to initialise the StateSpace with (this should normally contain just one of every action all with 0 priority)
-	explicit StateSpace(const PriorityQueue<float, double>& queue, int _angle_bins, int _velocity_bins, int _torque_bins, double _angle_max, double _velocity_max, double _torque_max);
+	//@_angle_mode: how angles beyond _angle_max are treated (WRAP for an angle that goes round the full circle)
+	//values beyond the limits never throw, velocities and torques are clamped into the end bins
+	explicit StateSpace(const PriorityQueue<float, double>& queue, int _angle_bins, int _velocity_bins, int _torque_bins, double _angle_max, double _velocity_max, double _torque_max, Discretiser::Mode _angle_mode = Discretiser::CLAMP);
 
 
 	//deny copy construction
@@ -31,49 +34,31 @@ public:
 	class SubscriptProxy2
 	{
 	public:
-		SubscriptProxy2(std::vector<PriorityQueue<float, double> >& _vec) :vec(_vec) {}
+		SubscriptProxy2(const StateSpace& _parent, std::vector<PriorityQueue<float, double> >& _vec) :parent(_parent), vec(_vec) {}
 
 		PriorityQueue<float, double>& operator[](const double torque)
 		{
-			//error if angle exceeds bounds
-			if ( std::abs(torque) > torque_max )throw std::domain_error("torque argument exceeded");
-			
-			//get the coefficient
-			int coef=0.5*torque_bins;
-			
-			//descretise index
-			int discrete_index = static_cast<int>( std::round( coef*(1+1/torque_max) ) );
-			
 			//return appropriate vector
-			PriorityQueue<float, double> v=vec[discrete_index];
-			
-			return vec[discrete_index];
+			return vec[parent.torque(torque)];
 		}
 	private:
+		const StateSpace& parent;
 		std::vector<PriorityQueue<float, double> >& vec;
 	};
 
 	class SubscriptProxy1
 	{
 	public:
-		SubscriptProxy1(std::vector<std::vector<PriorityQueue<float, double> > >& _vec) :vec(_vec) {}
+		SubscriptProxy1(const StateSpace& _parent, std::vector<std::vector<PriorityQueue<float, double> > >& _vec) :parent(_parent), vec(_vec) {}
 
 		SubscriptProxy2 operator[](const double velocity)
 		{
-			//error if velocity exceeds bounds
-			if ( std::abs(velocity) > velocity_max )throw std::domain_error("velocity argument exceeded");
-			
-			//get the coefficient
-			int coef=0.5*velocity_bins;
-			
-			//descretise index
-			int discrete_index = static_cast<int>( std::round( coef*(1+1/velocity_max) ) );
-			
 			//return appropriate object
-			return SubscriptProxy2(vec[discrete_index]);
+			return SubscriptProxy2(parent, vec[parent.velocity(velocity)]);
 		}
 
 	private:
+		const StateSpace& parent;
 		std::vector<std::vector<PriorityQueue<float, double> > >& vec;
 	};
 	//-----------------------------------------------------------------------------
@@ -85,14 +70,14 @@ public:
 	//subscript to get state queue from a state object
 	PriorityQueue<float, double>& operator[](const State & state);
 
+	//index of the queue a state falls in, from 0 to angle bins * velocity bins * torque bins - 1 (e.g. for ConvergenceMonitor)
+	std::size_t cell(const State & state) const;
+
 private:
-	//the sizes of the three arrays
-	static int angle_bins;
-	static int velocity_bins;
-	static int torque_bins;
-	static double angle_max;
-	static double velocity_max;
-	static double torque_max;
+	//the discretisers of the three dimensions (per instance, so that several state spaces can be used at once)
+	Discretiser angle;
+	Discretiser velocity;
+	Discretiser torque;
 
 	//the 3d vector that contains the robots previous experiences in each state
 	std::vector< std::vector< std::vector< PriorityQueue<float, double> > > > space;
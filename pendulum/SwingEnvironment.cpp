@@ -0,0 +1,70 @@
+/*
+* SwingEnvironment.cpp
+* Robotics 2016
+*
+*/
+
+#include "SwingEnvironment.h"
+#include <algorithm>
+#include <iostream>
+
+swingEnvironment::swingEnvironment(double _theta, double _thetadot, double _posture, double _time, double _deltatime,
+	double _robotmass, double _swingmass, double _length, double _height, double _range, double _damping)
+	: dt(_deltatime),
+	gl(9.81 / _length),
+	b(_damping),
+	inertia(_robotmass * _length * _length),
+	offset(_range / (_length - _height) * _robotmass / (_robotmass + _swingmass)),
+	force(_robotmass * _robotmass * _range / ((_length - _height) * (_robotmass + _swingmass))),
+	theta(_theta), thetadot(_thetadot), time(_time),
+	start(_posture), target(_posture), startTime(_time), motionTime(0.7),
+	verbose(true), hMax(0.02), symplectic(Symplectic::VERLET)
+{}
+
+void swingEnvironment::propagate() // Calculate successive values of theta and thetadot
+{
+	if (verbose) std::cout << "Progagating" << std::endl;
+
+	// Enough equal steps to keep each one within hMax
+	int N = std::max(1, static_cast<int>(std::ceil(dt / hMax)));
+	Split f = { *this };
+	symplectic.evolve(f, time, theta, thetadot, dt, N);
+
+	if (verbose) std::cout << "\tTheta: " << theta << ", Thetadot: " << thetadot << ", Posture: " << getPosture() << "\n";
+}
+
+// A new posture interrupts any transition in progress and starts from wherever the robot has got to
+void swingEnvironment::setTorque(double _T)
+{
+	if (verbose) std::cout << "Setting posture to " << _T << std::endl;
+	double next = std::max(-1.0, std::min(_T, 1.0));
+	if (next == target) return;
+	start = position(time);
+	target = next;
+	startTime = time;
+}
+
+void swingEnvironment::resetPendulum()
+{
+	theta = 0;
+	thetadot = 0;
+	time = 0;
+	start = target;
+	startTime = 0;
+}
+
+// Smoothstep 3u^2 - 2u^3 from start to target, at rest at both ends
+double swingEnvironment::position(double _t)
+{
+	double u = (_t - startTime) / motionTime;
+	if (u >= 1) return target;
+	if (u <= 0) return start;
+	return start + (target - start) * u * u * (3 - 2 * u);
+}
+
+double swingEnvironment::acceleration(double _t)
+{
+	double u = (_t - startTime) / motionTime;
+	if (u >= 1 || u <= 0) return 0;
+	return (target - start) * (6 - 12 * u) / (motionTime * motionTime);
+}
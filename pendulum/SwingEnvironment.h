@@ -0,0 +1,85 @@
+/*
+* SwingEnvironment.h
+* Robotics 2016
+* Simulate the robot on the swing, in order to train policies offline for the real robot.
+* The robot does not apply a torque directly; it moves between the sitForward and sitBackward postures of
+* MovementTools, which shifts its centre of mass along the swing. Each action starts a posture transition that
+* takes motionTime (700 ms on the robot) and follows a smoothstep, integrated together with the swing
+* dynamics of SinglePendulum/robotpendulum.cpp.
+*
+* The interface matches 'environment', with the "torque" being the posture to move to:
+* -1 for sitBackward, +1 for sitForward and anything between for a lerpSwing part way.
+*/
+
+#ifndef SWINGENVIRONMENT_H_
+#define SWINGENVIRONMENT_H_
+
+#include <cmath>
+#include "Symplectic.h"
+
+class swingEnvironment
+{
+public:
+
+	// Defaults are the values measured for robotpendulum.cpp
+	explicit swingEnvironment(double _theta, double _thetadot, double _posture, double _time, double _deltatime,
+		double _robotmass = 5.2, double _swingmass = 20, double _length = 1.9, double _height = 0.34, double _range = 0.045, double _damping = 0.05);
+
+	void propagate(); // Propogate the swing and the robot through time
+
+	double getTheta() { return theta; };
+	double getThetadot() { return thetadot; };
+	double getTorque() { return target; };	// Posture the robot is moving to (or is in)
+	double getPosture() { return position(time); };	// Where the robot is now, from -1 (backward) to +1 (forward)
+	double getTime() { return time; };
+
+	void setTorque(double _T);	// Start moving to the posture _T, clamped to [-1, 1]
+
+	void setVerbose(bool _verbose) { verbose = _verbose; };
+	void setMotionTime(double _motionTime) { motionTime = _motionTime; };	// Time a full posture transition takes
+	void setMethod(Symplectic::Method _method) { symplectic.setMethod(_method); };
+	void setMaxStepSize(double _hMax) { hMax = _hMax; };	// Largest integration step used within a propagate
+
+	void resetPendulum();	// Reset to theta=0, thetadot=0, time=0 with the robot still in its current posture
+
+private:
+
+	// Posture along the transition at time _t, and its second derivative
+	double position(double _t);
+	double acceleration(double _t);
+
+	// Equation of motion split into gravity on the combined centre of mass, damping and the robot's force
+	struct Split
+	{
+		swingEnvironment& env;
+		double acceleration(double _t, double _theta) { return -env.gl * std::sin(_theta + env.offset * env.position(_t)); };
+		double damping() { return env.b / env.inertia; };
+		double drive(double _t) { return env.force * env.acceleration(_t) / env.inertia; };
+	};
+
+	const double dt;	// The time interval the swing will be propogated over
+
+	// Parameters, kept in the form the equation of motion uses
+	const double gl;	// g / length of the swing
+	const double b;		// Damping coefficient
+	const double inertia;	// robot mass * length^2
+	const double offset;	// Angle the centre of mass moves per unit of posture, range / (length - height) * m / (m + mp)
+	const double force;	// Force on the swing per unit of posture acceleration, m^2 range / ((length - height) (m + mp))
+
+	double theta;
+	double thetadot;
+	double time;
+
+	// Current posture transition, from start to target over [startTime, startTime + motionTime]
+	double start;
+	double target;
+	double startTime;
+	double motionTime;
+
+	bool verbose;	// Print progress to std::cout in propagate and setTorque
+
+	double hMax;
+	Symplectic symplectic;
+};
+
+#endif /* SWINGENVIRONMENT_H_ */
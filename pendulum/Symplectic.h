@@ -0,0 +1,106 @@
+/*
+* Symplectic.h
+* Robotics 2016
+* Fixed step symplectic integrator for a damped, driven pendulum, split into its conservative part and the rest.
+*
+* The equation of motion is taken to be
+*	thetadotdot = acceleration(t, theta) - damping() * thetadot + drive(t)
+* where acceleration is the conservative (e.g. gravitational) part. Each step is a Strang splitting:
+* half a step of damping and drive (solved exactly for the drive at the middle of the half step), a velocity
+* Verlet step of the conservative part, then the other half step of damping and drive. The result is second order
+* and, with no damping or drive, conserves energy to within a bounded error however long it runs.
+* YOSHIDA4 composes three such steps into a fourth order step (Yoshida 1990). Its middle step runs backwards,
+* which undoes and redoes the damping, so it is best kept for lightly damped systems.
+*
+* The system is any object with
+*	double acceleration(double t, double theta);
+*	double damping();
+*	double drive(double t);
+*
+* Written without C++11 so that it also builds for the robot.
+*/
+
+#ifndef SYMPLECTIC_H_
+#define SYMPLECTIC_H_
+
+#include <cmath>
+
+class Symplectic
+{
+public:
+
+	enum Method
+	{
+		VERLET,		// Second order, one evaluation of the acceleration per step
+		YOSHIDA4	// Fourth order, three Verlet steps of sizes w1 h, w0 h, w1 h
+	};
+
+	explicit Symplectic(Method _method = VERLET) : method(_method) {};
+
+	void setMethod(Method _method) { method = _method; };
+	Method getMethod() const { return method; };
+
+	// Advance (t, theta, thetadot) by one step of size h
+	template<class System>
+	void step(System& system, double& t, double& theta, double& thetadot, double h) const
+	{
+		if (method == YOSHIDA4)
+		{
+			// w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 w1
+			const double w1 = 1.3512071919596576;
+			const double w0 = -1.7024143839193153;
+			split(system, t, theta, thetadot, w1 * h);
+			split(system, t, theta, thetadot, w0 * h);
+			split(system, t, theta, thetadot, w1 * h);
+		}
+		else
+		{
+			split(system, t, theta, thetadot, h);
+		}
+	}
+
+	// Advance by N equal steps over a total time dt
+	template<class System>
+	void evolve(System& system, double& t, double& theta, double& thetadot, double dt, int N) const
+	{
+		double h = dt / N;
+		double t0 = t;
+		for (int i = 0; i < N; ++i) step(system, t, theta, thetadot, h);
+		t = t0 + dt;	// Avoid accumulating rounding in t
+	}
+
+private:
+
+	// Strang splitting of one step, symmetric so that it can be composed
+	template<class System>
+	static void split(System& system, double& t, double& theta, double& thetadot, double h)
+	{
+		dissipate(system, t, thetadot, 0.5 * h);
+		thetadot += 0.5 * h * system.acceleration(t, theta);
+		theta += h * thetadot;
+		thetadot += 0.5 * h * system.acceleration(t + h, theta);
+		dissipate(system, t + 0.5 * h, thetadot, 0.5 * h);
+		t += h;
+	}
+
+	// Exact solution of thetadotdot = drive - damping * thetadot over h, with the drive held at its midpoint value
+	template<class System>
+	static void dissipate(System& system, double t, double& thetadot, double h)
+	{
+		double c = system.damping();
+		double a = system.drive(t + 0.5 * h);
+		if (c != 0)
+		{
+			double terminal = a / c;
+			thetadot = terminal + (thetadot - terminal) * std::exp(-c * h);
+		}
+		else
+		{
+			thetadot += a * h;
+		}
+	}
+
+	Method method;
+};
+
+#endif /* SYMPLECTIC_H_ */
@@ -0,0 +1,83 @@
+/*
+* TransitionTable.cpp
+* Robotics 2016
+*
+*/
+
+#include "TransitionTable.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char TransitionTable::magic[8] = "PENDTT1";
+
+TransitionTable::TransitionTable(const char* path)
+	: length(0), data(map(path, length)),
+	header(reinterpret_cast<const TransitionFileHeader*>(data)),
+	actions(reinterpret_cast<const double*>(data + sizeof(TransitionFileHeader))),
+	entries(data + header->entries_offset),
+	angle(header->angle_bins, header->angle_max, static_cast<Discretiser::Mode>(header->angle_mode)),
+	velocity(header->velocity_bins, header->velocity_max)
+{}
+
+TransitionTable::~TransitionTable()
+{
+	munmap(const_cast<char*>(data), length);
+}
+
+int TransitionTable::sample(int cell, int action, double u) const
+{
+	const TransitionEntry& e = entry(cell, action);
+	const Successor* next = successors(cell, action);
+	if (e.count == 0) return cell;
+	// most likely first, so the search is usually short
+	double total = 0;
+	for (std::uint32_t k = 0; k + 1 < e.count; ++k)
+	{
+		total += next[k].probability;
+		if (u < total) return next[k].cell;
+	}
+	return next[e.count - 1].cell;
+}
+
+const char* TransitionTable::map(const char* path, std::size_t& length)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) throw std::runtime_error(std::string("cannot open transition table ") + path);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(TransitionFileHeader))
+	{
+		close(fd);
+		throw std::runtime_error(std::string("transition table too short: ") + path);
+	}
+	length = info.st_size;
+
+	void* mapped = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);	// the mapping keeps the file open
+	if (mapped == MAP_FAILED) throw std::runtime_error(std::string("cannot map transition table ") + path);
+
+	// every size the members will use must be valid before they are built
+	const TransitionFileHeader* h = static_cast<const TransitionFileHeader*>(mapped);
+	const char* error = 0;
+	if (std::memcmp(h->magic, magic, sizeof(magic)) != 0) error = "not a transition table: ";
+	else if (h->version != version || h->header_size != sizeof(TransitionFileHeader)) error = "unsupported transition table version: ";
+	else if (h->angle_bins < 1 || h->velocity_bins < 1 || h->actions < 1 || h->successors < 1
+		|| h->angle_mode < Discretiser::CLAMP || h->angle_mode > Discretiser::SATURATE
+		|| (h->angle_mode == Discretiser::SATURATE && h->angle_bins < 3)
+		|| !(h->angle_max > 0) || !(h->velocity_max > 0)
+		|| h->entry_size != entrySize(h->successors)
+		|| h->entries_offset < sizeof(TransitionFileHeader) + h->actions * sizeof(double)
+		|| h->entries_offset + static_cast<std::uint64_t>(h->angle_bins) * h->velocity_bins * h->actions * h->entry_size > length)
+		error = "corrupt transition table: ";
+	if (error)
+	{
+		munmap(mapped, length);
+		throw std::runtime_error(std::string(error) + path);
+	}
+	return static_cast<const char*>(mapped);
+}
@@ -0,0 +1,118 @@
+/*
+* TransitionTable.h
+* Robotics 2016
+* Precomputed discrete model of the simulated pendulum (see transitions.cpp, which builds it).
+* For every (angle bin, velocity bin, action) the table holds the expected reward and the distribution of
+* successor cells, so planners and replay-style learners can step the model with one indexed load instead
+* of integrating the pendulum.
+*
+* The file is memory mapped and read in place:
+*	TransitionFileHeader
+*	double actions[header.actions]
+*	entries from header.entries_offset, header.entry_size bytes each, ordered by (cell, action)
+*		TransitionEntry, then TransitionEntry::count (of header.successors) Successors by decreasing probability
+* A cell is angle_bin * velocity_bins + velocity_bin, with the bins of the Discretisers given in the header.
+*
+*	TransitionTable table("transitions.bin");
+*	int cell = table.cell(theta, thetadot);
+*	int next = table.sample(cell, action, uniform(rng));
+*/
+
+#ifndef TRANSITIONTABLE_H_
+#define TRANSITIONTABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "Discretiser.h"
+
+struct TransitionFileHeader
+{
+	char magic[8];			// "PENDTT1"
+	std::uint32_t version;
+	std::uint32_t header_size;	// sizeof(TransitionFileHeader), to catch files from other builds
+
+	//discretisation
+	std::int32_t angle_bins;
+	std::int32_t velocity_bins;
+	std::int32_t angle_mode;	// Discretiser::Mode of the angle, the velocity is always CLAMP
+	std::int32_t actions;
+	double angle_max;
+	double velocity_max;
+
+	//pendulum the table was sampled from
+	double deltatime;
+	double mass;
+	double length;
+	double damping;
+	double maxtorque;
+
+	std::int32_t samples;		// simulated start points per (cell, action)
+	std::int32_t successors;	// room for successors in each entry, the most any entry needed
+	std::uint64_t entry_size;	// bytes per entry
+	std::uint64_t entries_offset;	// bytes from the start of the file to the first entry
+};
+
+struct TransitionEntry
+{
+	float reward;		// mean reward of the successor states
+	std::uint32_t count;	// number of distinct successor cells
+};
+
+struct Successor
+{
+	std::uint32_t cell;
+	float probability;
+};
+
+class TransitionTable
+{
+public:
+
+	static const char magic[8];
+	static const std::uint32_t version = 1;
+
+	// Bytes per entry with room for the given number of successors
+	static std::size_t entrySize(int successors) { return sizeof(TransitionEntry) + successors * sizeof(Successor); };
+
+	// Maps the file read only, throws std::runtime_error if it cannot be opened or is not a transition table
+	explicit TransitionTable(const char* path);
+	~TransitionTable();
+
+	//deny copy construction, the table owns its mapping
+	TransitionTable(const TransitionTable&) = delete;
+	TransitionTable& operator=(const TransitionTable&) = delete;
+
+	const TransitionFileHeader& getHeader() const { return *header; };
+	int getCells() const { return header->angle_bins * header->velocity_bins; };
+	int getActions() const { return header->actions; };
+	double getAction(int action) const { return actions[action]; };
+
+	// Cell of a continuous state, discretised as the table was built
+	int cell(double theta, double thetadot) const { return angle(theta) * header->velocity_bins + velocity(thetadot); };
+
+	const TransitionEntry& entry(int cell, int action) const
+	{
+		return *reinterpret_cast<const TransitionEntry*>(entries + (static_cast<std::size_t>(cell) * header->actions + action) * header->entry_size);
+	};
+	const Successor* successors(int cell, int action) const { return reinterpret_cast<const Successor*>(&entry(cell, action) + 1); };
+
+	double reward(int cell, int action) const { return entry(cell, action).reward; };
+
+	// Successor cell for a uniform random number u in [0, 1)
+	int sample(int cell, int action, double u) const;
+
+private:
+
+	// Maps the file and checks its header before any member that depends on it is built
+	static const char* map(const char* path, std::size_t& length);
+
+	std::size_t length;
+	const char* data;
+	const TransitionFileHeader* header;
+	const double* actions;
+	const char* entries;
+	Discretiser angle;
+	Discretiser velocity;
+};
+
+#endif /* TRANSITIONTABLE_H_ */
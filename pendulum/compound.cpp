@@ -0,0 +1,48 @@
+/*
+* compound.cpp
+* Robotics 2016
+* Checks the compound swing: swings it undamped from a given amplitude with the robot held in one posture,
+* and reports how fast it steps and how much of the amplitude is left at the end (the rest is lost to the
+* joint servos, which hold the robot against the swing).
+* Build with: g++ -std=c++11 -O2 compound.cpp CompoundSwing.cpp -o compound
+* Usage: compound [amplitude (rad), 0.3] [seconds, 300] [posture, 0]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include "CompoundSwing.h"
+
+int main(int argc, char* argv[])
+{
+	const double deltatime = 0.1;
+	const double amplitude = argc > 1 ? std::atof(argv[1]) : 0.3;
+	const double seconds = argc > 2 ? std::atof(argv[2]) : 300.0;
+	const double posture = argc > 3 ? std::atof(argv[3]) : 0.0;
+	const int steps = static_cast<int>(seconds / deltatime + 0.5);
+
+	// the amplitude is the largest |theta| over the first and the last 10 seconds, several swings of the 1.9 m swing
+	const int window = std::min(100, steps / 2);
+
+	CompoundParameters parameters;
+	parameters.damping = 0;
+	compoundSwing swing(amplitude, 0, posture, 0, deltatime, parameters);
+	swing.setVerbose(false);
+
+	double first = 0, last = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < steps; ++i)
+	{
+		swing.propagate();
+		double theta = std::abs(swing.getTheta());
+		if (i < window) first = std::max(first, theta);
+		if (i >= steps - window) last = std::max(last, theta);
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << steps << " steps of " << deltatime << " s in " << elapsed << " s, " << steps / elapsed << " steps/s" << std::endl;
+	std::cout << "Amplitude " << first << " -> " << last << " rad, " << 100 * last / first << "% kept over " << seconds << " s" << std::endl;
+	return 0;
+}
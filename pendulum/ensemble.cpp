@@ -0,0 +1,235 @@
+/*
+* ensemble.cpp
+* Robotics 2016
+* Domain-randomised runs of the simulated swing (see Ensemble.h). Either trains one Q-learner on every member
+* of the ensemble and then evaluates its greedy policy on a fresh ensemble, or evaluates the energy pumping
+* policy on its own. Prints the spread of the results over the members and how strongly each parameter is
+* correlated with the return, and can write one line per member.
+*
+* Build with: g++ -std=c++11 -O2 -pthread ensemble.cpp Ensemble.cpp Learner.cpp Environment.cpp SwingEnvironment.cpp CompoundSwing.cpp State3.cpp StateSpace3.cpp -o ensemble
+*
+* Usage: ensemble [--model pendulum|swing|compound] [--policy learn|pump] [--members N] [--rounds N] [--episode N]
+*                 [--threshold A] [--threads N] [--seed S] [--output FILE] [parameter=distribution ...] [setting=value ...]
+*	Distributions are a value, uniform:lo:hi, normal:mean:sd or lognormal:median:sd, e.g.
+*		ensemble --policy learn --members 4096 mass=uniform:0.4:0.6 length=normal:0.08:0.005 damping=lognormal:0.5:0.5
+*		ensemble --model swing --policy pump range=uniform:0.03:0.06 damping=uniform:0.01:0.1
+*		ensemble --model compound --policy learn servofrequency=uniform:10:30 uppermass=normal:2.4:0.2
+*	Parameters: mass length damping maxtorque (pendulum), robotmass swingmass length height range damping motiontime (swing),
+*	            swingmass length damping uppermass lowermass servofrequency motiontime (compound)
+*	Settings: alpha gamma angle_bins velocity_bins angle_max velocity_max epsilon_start epsilon_step epsilon_delay deltatime
+*	          integrator (0 RK4, 1 Dormand-Prince, 2 Verlet, 3 Yoshida) substeps (pendulum), set and validated by LearnerConfig
+*	Masses, lengths and times must be drawn above zero, damping and range not below it
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Ensemble.h"
+
+namespace
+{
+	//quantile of sorted values, by linear interpolation
+	double quantile(const std::vector<double>& sorted, double q)
+	{
+		double position = q * (sorted.size() - 1);
+		std::size_t below = static_cast<std::size_t>(position);
+		if (below + 1 >= sorted.size()) return sorted.back();
+		return sorted[below] + (position - below) * (sorted[below + 1] - sorted[below]);
+	}
+
+	//one line of summary statistics
+	void summarise(const std::string& name, std::vector<double> values)
+	{
+		if (values.empty())
+		{
+			std::cout << name << "\t-\n";
+			return;
+		}
+		double mean = 0, variance = 0;
+		for (double value : values) mean += value;
+		mean /= values.size();
+		for (double value : values) variance += (value - mean) * (value - mean);
+		variance /= std::max<std::size_t>(1, values.size() - 1);
+		std::sort(values.begin(), values.end());
+		std::cout << name << "\t" << mean << "\t" << std::sqrt(variance) << "\t" << values.front() << "\t"
+			<< quantile(values, 0.05) << "\t" << quantile(values, 0.5) << "\t" << quantile(values, 0.95) << "\t" << values.back() << "\n";
+	}
+
+	//Pearson correlation, 0 if either is constant
+	double correlation(const std::vector<double>& x, const std::vector<double>& y)
+	{
+		double mx = 0, my = 0;
+		for (std::size_t i = 0; i < x.size(); ++i)
+		{
+			mx += x[i];
+			my += y[i];
+		}
+		mx /= x.size();
+		my /= y.size();
+		double sxy = 0, sxx = 0, syy = 0;
+		for (std::size_t i = 0; i < x.size(); ++i)
+		{
+			sxy += (x[i] - mx) * (y[i] - my);
+			sxx += (x[i] - mx) * (x[i] - mx);
+			syy += (y[i] - my) * (y[i] - my);
+		}
+		return sxx > 0 && syy > 0 ? sxy / std::sqrt(sxx * syy) : 0;
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: ensemble [--model pendulum|swing|compound] [--policy learn|pump] [--members N] [--rounds N] [--episode N] [--threshold A]"
+			" [--threads N] [--seed S] [--output FILE] [parameter=distribution ...] [setting=value ...]" << std::endl;
+		std::exit(2);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	EnsembleConfig config;
+	config.learner.seed = 1;
+	bool learn = true;
+	std::string outputPath;
+	std::vector<std::string> assignments;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		bool hasValue = i + 1 < argc;
+		if (arg == "--model" && hasValue)
+		{
+			std::string model(argv[++i]);
+			if (model == "pendulum") config.model = EnsembleConfig::PENDULUM;
+			else if (model == "swing") config.model = EnsembleConfig::SWING;
+			else if (model == "compound") config.model = EnsembleConfig::COMPOUND;
+			else usage();
+		}
+		else if (arg == "--policy" && hasValue)
+		{
+			std::string policy(argv[++i]);
+			if (policy == "learn") learn = true;
+			else if (policy == "pump") learn = false;
+			else usage();
+		}
+		else if (arg == "--members" && hasValue) config.members = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--rounds" && hasValue) config.rounds = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--episode" && hasValue) config.learner.episode_steps = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--threshold" && hasValue) config.learner.amplitude_threshold = std::atof(argv[++i]);
+		else if (arg == "--threads" && hasValue) config.threads = std::atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue) config.learner.seed = std::atoi(argv[++i]);
+		else if (arg == "--output" && hasValue) outputPath = argv[++i];
+		else if (arg.find('=') != std::string::npos) assignments.push_back(arg);
+		else usage();
+	}
+	if (config.members == 0 || config.learner.episode_steps == 0) usage();
+	if (config.threads == 0) config.threads = 1;
+
+	//the model must be known before its parameters can be told from the learner settings
+	std::vector<std::string> names = parameterNames(config.model);
+	for (const std::string& assignment : assignments)
+	{
+		std::string name = assignment.substr(0, assignment.find('='));
+		std::string value = assignment.substr(assignment.find('=') + 1);
+		if (std::find(names.begin(), names.end(), name) != names.end())
+		{
+			Distribution distribution;
+			if (!Distribution::parse(value, distribution))
+			{
+				std::cerr << "Cannot read the distribution " << value << " of " << name << std::endl;
+				usage();
+			}
+			config.parameters[name] = distribution;
+		}
+		else
+		{
+			char* end = 0;
+			double number = std::strtod(value.c_str(), &end);
+			if (value.empty() || *end != '\0' || !config.learner.set(name, number)) usage();
+		}
+	}
+	std::string problem = config.learner.validate();
+	if (!problem.empty())
+	{
+		std::cerr << "ensemble: " << problem << std::endl;
+		usage();
+	}
+
+	std::cerr << config.members << " members on " << config.threads << " threads";
+	for (const auto& parameter : config.parameters) std::cerr << ", " << parameter.first << "=" << parameter.second.describe();
+	std::cerr << std::endl;
+
+	//the ensemble checks its parameters before it runs anything
+	std::vector<MemberResult> results;
+	try
+	{
+		if (learn)
+		{
+			std::unique_ptr<StateSpace> space = makeStateSpace(config);
+			trainEnsemble(config, *space, [](unsigned long round, double meanReturn) {
+				std::cerr << "round " << round + 1 << "\tmean return " << meanReturn << std::endl;
+			});
+
+			//evaluate on members the learner has not seen
+			EnsembleConfig evaluation(config);
+			evaluation.learner.seed = config.learner.seed + 1;
+			results = evaluateEnsemble(evaluation, greedyPolicy(*space));
+		}
+		else
+		{
+			results = evaluateEnsemble(config, pumpPolicy(config));
+		}
+	}
+	catch (const std::invalid_argument& error)
+	{
+		std::cerr << error.what() << std::endl;
+		usage();
+	}
+
+	//spread of the results
+	std::vector<double> returns, peaks, thresholds;
+	for (const MemberResult& result : results)
+	{
+		returns.push_back(result.episode_return);
+		peaks.push_back(result.peak_amplitude);
+		if (result.steps_to_threshold >= 0) thresholds.push_back(static_cast<double>(result.steps_to_threshold));
+	}
+	std::cout << "#\tmean\tsd\tmin\tp5\tp50\tp95\tmax\n";
+	summarise("return", returns);
+	summarise("peak", peaks);
+	summarise("thresh_steps", thresholds);
+	std::cout << "reached threshold\t" << static_cast<double>(thresholds.size()) / results.size() << "\n";
+
+	//which parameters the return depends on
+	for (std::size_t p = 0; p < names.size(); ++p)
+	{
+		if (config.parameters.count(names[p]) == 0 || config.parameters[names[p]].kind == Distribution::FIXED) continue;
+		std::vector<double> values;
+		for (const MemberResult& result : results) values.push_back(result.parameters[p]);
+		std::cout << "correlation of return with " << names[p] << "\t" << correlation(values, returns) << "\n";
+	}
+
+	if (!outputPath.empty())
+	{
+		std::ofstream output(outputPath.c_str());
+		if (!output)
+		{
+			std::cerr << "Cannot write " << outputPath << std::endl;
+			return 1;
+		}
+		for (const std::string& name : names) output << name << "\t";
+		output << "return\tpeak\tthresh_steps\n";
+		for (const MemberResult& result : results)
+		{
+			for (double value : result.parameters) output << value << "\t";
+			output << result.episode_return << "\t" << result.peak_amplitude << "\t" << result.steps_to_threshold << "\n";
+		}
+	}
+
+	return 0;
+}
@@ -9,7 +9,8 @@
 #include "StateSpace3.h"
 #include "PriorityQueue.h"
 #include "State3.h"
-#include "environment.h"
+#include "Environment.h"
+#include "ConvergenceMonitor.h"
 
 template<typename T> std::string to_string(T x) {
 	return static_cast<std::ostringstream&>((std::ostringstream() << std::dec << x)).str();
@@ -21,8 +22,8 @@ double temperature(unsigned long t);
 //function to select next action
 float selectAction(PriorityQueue<float, double>& a_queue, unsigned long int iterations);
 
-//function to update a q value
-void updateQ(StateSpace & space, float  action, State & new_state, State & old_state, double alpha, double gamma);
+//function to update a q value, reporting the update to the convergence monitor
+void updateQ(StateSpace & space, float  action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor);
 
 int main() {
 	//learning factor
@@ -74,20 +75,27 @@ int main() {
 
 	file << "Trialno" << "\t" << "Time" << "\t" << "Theta" << "\t\t" << "Thetadot" << "\t\t" << "Torque" << std::endl;
 
+	//stop once the policy has settled: windows of 1000 updates, stable when max |dQ| < 1e-3
+	//and < 1% of visited cells change their best action, with a flat return over the last 20 trials
+	ConvergenceMonitor monitor(1000UL, 1e-3, 0.01, 3);
+	monitor.setRewardTrend(20, 1e-3);
+
 	double trialno = 1;
 	unsigned long i = 0UL;
-	while (true) {
+	while (!monitor.converged()) {
 		current_state.theta = env->getTheta();
 		current_state.theta_dot = env->getThetadot();
 		current_state.torque = env->getTorque();
 		std::cout << "State Read" << std::endl;
 
-		updateQ(space, chosen_action, old_state, current_state, alpha, gamma);
+		updateQ(space, chosen_action, old_state, current_state, alpha, gamma, monitor);
 		std::cout << "Q Updated" << std::endl;
+		if (monitor.getUpdates() % 1000UL == 0UL) std::cout << monitor << std::endl;
 
 		if (current_state.theta > 2*M_PI && current_state.theta_dot> 2*M_PI && env->getTime() >= 10) {
 			env->resetPendulum();
 			std::domain_error("unsuccessful trial");
+			monitor.endEpisode();
 			trialno++;
 			i = 0;
 		}
@@ -105,6 +113,8 @@ int main() {
 		++i;
 	}
 
+	std::cout << "Converged after " << monitor.getUpdates() << " updates: " << monitor << std::endl;
+
 	file.close();
 	delete env;
 	return 1;
@@ -156,12 +166,14 @@ float selectAction(PriorityQueue<float, double>& a_queue, unsigned long iteratio
 	return -1; //note that this line should never be reached	
 }
 
-void updateQ(StateSpace & space, float action, State & new_state, State & old_state, double alpha, double gamma) {
+void updateQ(StateSpace & space, float action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor) {
 	//std::cout << action << std::endl;
 	//std::cout << space[old_state].toString() << std::endl << "-----------";
 //	space[old_state];
 	//oldQ value reference
-	double oldQ = space[old_state].search(action).second;
+	PriorityQueue<float, double>& queue = space[old_state];
+	float oldBest = queue.peekFront().first;
+	double oldQ = queue.search(action).second;
 
 	//reward given to current state 
 	double R = new_state.getReward();
@@ -172,5 +184,8 @@ void updateQ(StateSpace & space, float action, State & new_state, State & old_st
 	//new Q value determined by Q learning algorithm
 	double newQ = oldQ + alpha * (R + (gamma * maxQ) - oldQ);
 	//std::cout << "New Q-Value: " << newQ << std::endl;
-	space[old_state].changePriority(action, newQ);
+	queue.changePriority(action, newQ);
+
+	monitor.recordUpdate(space.cell(old_state), oldQ, newQ, queue.peekFront().first != oldBest);
+	monitor.recordReward(R);
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*
+* plan.cpp
+* Robotics 2016
+* Drives the simulated pendulum with the receding-horizon planner instead of Q-learning.
+* Build with: g++ -std=c++11 -O2 -pthread plan.cpp Environment.cpp State3.cpp -o plan
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "Environment.h"
+#include "Planner.h"
+#include "State3.h"
+
+int main(int argc, char* argv[])
+{
+	const double deltatime = 0.1;
+	const double mass = 0.5;
+	const double length = 0.08;
+	const double gamma = 0.5;
+	const double maxtorque = 4.0;
+
+	// Planner settings: look 'horizon' decisions ahead and spend 'budget' ms per decision
+	const int horizon = 10;
+	const double discount = 0.9;
+	const double budget = argc > 1 ? std::atof(argv[1]) : 50.0;
+	const int steps = argc > 2 ? std::atoi(argv[2]) : 200;
+
+	environment* env = new environment(0, 0, 0, maxtorque, 0, deltatime, mass, length, gamma);
+	env->setVerbose(false);
+
+	// The same torques the Q-learner chooses between
+	std::vector<double> actions;
+	for (int i = 0; i < (maxtorque * 2) + 1; ++i)
+	{
+		actions.push_back(-maxtorque + i);
+	}
+
+	Planner<environment> planner(actions, horizon, discount, budget);
+
+	std::ofstream file("plan_output.txt");
+	file.precision(6);
+	file << "Time" << "\t" << "Theta" << "\t\t" << "Thetadot" << "\t\t" << "Torque" << "\t" << "Rollouts" << std::endl;
+
+	for (int i = 0; i < steps; ++i)
+	{
+		double action = planner.plan(*env);
+		env->setTorque(action);
+		env->propagate();
+		planner.advance(action);
+
+		file << env->getTime() << "\t" << env->getTheta() << "\t\t" << env->getThetadot() << "\t\t" << env->getTorque() << "\t" << planner.getIterations() << std::endl;
+	}
+
+	std::cout << "Final theta: " << env->getTheta() << ", thetadot: " << env->getThetadot() << std::endl;
+
+	file.close();
+	delete env;
+	return 0;
+}
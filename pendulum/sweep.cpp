@@ -0,0 +1,172 @@
+/*
+* sweep.cpp
+* Robotics 2016
+* Hyperparameter sweep for the simulated Q-learner. Every configuration is run with runLearner
+* on a pool of threads (one per core by default) and a line is printed as each run finishes.
+*
+* Build with: g++ -std=c++11 -O2 -pthread sweep.cpp Learner.cpp Environment.cpp State3.cpp StateSpace3.cpp -o sweep
+*
+* Usage: sweep [options] [parameter=values ...]
+*	Grid search (default): every combination of the listed values is run, e.g.
+*		sweep alpha=0.2,0.5,0.8 gamma=0.5,0.9 angle_bins=50,100
+*	Random search: --random N draws N configurations, each parameter uniformly from lo:hi, e.g.
+*		sweep --random 64 alpha=0.1:0.9 gamma=0.3:0.99 velocity_max=5:20
+*	Parameters: alpha gamma angle_bins velocity_bins angle_max velocity_max epsilon_start epsilon_step epsilon_delay
+*	            deltatime mass length damping maxtorque (see LearnerConfig::set; every configuration is validated first)
+*	            integrator (0 RK4, 1 Dormand-Prince, 2 Verlet, 3 Yoshida) substeps, e.g. sweep integrator=0,2,3 substeps=4,16,100
+*	            step_event (-1 fixed steps of deltatime, 0 to each apex, 1 to each pass through the bottom) event_maxtime,
+*	            e.g. sweep step_event=-1,0,1 to compare learning once per deltatime with once per half swing
+*	Options: --steps N (max steps per run), --episode N (steps per episode), --threshold A (amplitude, radians),
+*	         --threads N, --seed S, --repeats N (runs per configuration, with different seeds)
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Learner.h"
+
+namespace
+{
+	//split "a,b,c" or "lo:hi" into numbers, false if any of them is not a number
+	bool splitValues(const std::string& text, char separator, std::vector<double>& values)
+	{
+		std::istringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, separator))
+		{
+			char* end = 0;
+			values.push_back(std::strtod(item.c_str(), &end));
+			if (item.empty() || *end != '\0') return false;
+		}
+		return true;
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: sweep [--random N] [--steps N] [--episode N] [--threshold A] [--threads N] [--seed S] [--repeats N] [parameter=values ...]" << std::endl;
+		std::exit(2);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	LearnerConfig base;
+	unsigned long randomCount = 0;
+	unsigned int threads = std::thread::hardware_concurrency();
+	unsigned int seed = 1;
+	unsigned int repeats = 1;
+	std::vector<std::pair<std::string, std::string> > parameters;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		bool hasValue = i + 1 < argc;
+		if (arg == "--random" && hasValue) randomCount = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--steps" && hasValue) base.max_steps = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--episode" && hasValue) base.episode_steps = std::strtoul(argv[++i], 0, 10);
+		else if (arg == "--threshold" && hasValue) base.amplitude_threshold = std::atof(argv[++i]);
+		else if (arg == "--threads" && hasValue) threads = std::atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue) seed = std::atoi(argv[++i]);
+		else if (arg == "--repeats" && hasValue) repeats = std::atoi(argv[++i]);
+		else if (arg.find('=') != std::string::npos)
+		{
+			std::string name = arg.substr(0, arg.find('='));
+			LearnerConfig check;
+			if (!check.set(name, 1)) usage();
+			parameters.push_back(std::make_pair(name, arg.substr(arg.find('=') + 1)));
+		}
+		else usage();
+	}
+	if (threads == 0) threads = 1;
+	if (repeats == 0) repeats = 1;
+
+	//build the list of configurations
+	std::vector<LearnerConfig> configs;
+	if (randomCount > 0)
+	{
+		std::mt19937 rng(seed);
+		for (unsigned long n = 0; n < randomCount; ++n)
+		{
+			LearnerConfig config(base);
+			for (size_t p = 0; p < parameters.size(); ++p)
+			{
+				std::vector<double> range;
+				if (!splitValues(parameters[p].second, ':', range) || range.size() != 2 || range[0] > range[1]) usage();
+				std::uniform_real_distribution<double> uniform(range[0], range[1]);
+				if (!config.set(parameters[p].first, uniform(rng))) usage();
+			}
+			configs.push_back(config);
+		}
+	}
+	else
+	{
+		configs.push_back(base);
+		for (size_t p = 0; p < parameters.size(); ++p)
+		{
+			std::vector<double> values;
+			if (!splitValues(parameters[p].second, ',', values) || values.empty()) usage();
+			std::vector<LearnerConfig> expanded;
+			for (size_t c = 0; c < configs.size(); ++c)
+			{
+				for (size_t v = 0; v < values.size(); ++v)
+				{
+					LearnerConfig config(configs[c]);
+					if (!config.set(parameters[p].first, values[v])) usage();
+					expanded.push_back(config);
+				}
+			}
+			configs.swap(expanded);
+		}
+	}
+
+	//every configuration is checked before any is run, so that one bad value does not end the sweep part way
+	for (size_t c = 0; c < configs.size(); ++c)
+	{
+		std::string problem = configs[c].validate();
+		if (!problem.empty())
+		{
+			std::cerr << "sweep: " << problem << " (configuration " << c << ")" << std::endl;
+			usage();
+		}
+	}
+
+	//each configuration is repeated with its own seed
+	std::vector<LearnerConfig> runs;
+	for (size_t c = 0; c < configs.size(); ++c)
+	{
+		for (unsigned int r = 0; r < repeats; ++r)
+		{
+			configs[c].seed = seed + static_cast<unsigned int>(c * repeats + r);
+			runs.push_back(configs[c]);
+		}
+	}
+
+	std::cerr << "Running " << runs.size() << " configurations on " << threads << " threads" << std::endl;
+	std::cout << "id\t" << configHeader() << "\t" << resultHeader() << std::endl;
+
+	//workers take the next run from a shared counter and print each result as it completes
+	std::atomic<size_t> next(0);
+	std::mutex outputMutex;
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			for (size_t n = next++; n < runs.size(); n = next++)
+			{
+				LearnerResult result = runLearner(runs[n]);
+				std::lock_guard<std::mutex> lock(outputMutex);
+				std::cout << n << "\t" << configRow(runs[n]) << "\t" << resultRow(result) << std::endl;
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+
+	return 0;
+}
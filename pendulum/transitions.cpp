@@ -0,0 +1,249 @@
+/*
+* transitions.cpp
+* Robotics 2016
+* Builds the TransitionTable of the simulated pendulum for the discretisation runLearner uses.
+* Each (cell, action) is simulated from a number of random start points within the cell, all actions and start
+* points of a cell at once in a PendulumBatch, and cells are shared out between a pool of threads.
+* The same seed gives the same table whatever the number of threads.
+*
+* Build with: g++ -std=c++11 -O2 -march=native -pthread transitions.cpp TransitionTable.cpp PendulumBatch.cpp Learner.cpp Environment.cpp State3.cpp StateSpace3.cpp -o transitions
+*
+* Usage: transitions [--output FILE] [--samples N] [--threads N] [--seed S] [parameter=value ...]
+*	Parameters: angle_bins velocity_bins angle_max velocity_max deltatime mass length damping maxtorque
+*	(set and validated by LearnerConfig, whose defaults they take, with the angle wrapped as in runLearner)
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "Learner.h"
+#include "PendulumBatch.h"
+#include "State3.h"
+#include "TransitionTable.h"
+
+namespace
+{
+	//the values a bin covers, so that start points can be drawn from within it
+	void binRange(const Discretiser& bins, int bin, double& low, double& high)
+	{
+		double max = bins.getMax();
+		int n = bins.getBins();
+		switch (bins.getMode())
+		{
+		case Discretiser::WRAP:
+			low = -max + 2 * max * bin / n;
+			high = -max + 2 * max * (bin + 1) / n;
+			break;
+		case Discretiser::SATURATE:
+			// the end bins take everything beyond the range, of which one interior width is sampled
+			low = -max + 2 * max * (bin - 1) / (n - 2);
+			high = -max + 2 * max * bin / (n - 2);
+			break;
+		default:
+		{
+			// bin centres from -max to max, a bin either side of each
+			double width = n > 1 ? 2 * max / (n - 1) : 2 * max;
+			double centre = n > 1 ? -max + width * bin : 0;
+			low = centre - 0.5 * width;
+			high = centre + 0.5 * width;
+			break;
+		}
+		}
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: transitions [--output FILE] [--samples N] [--threads N] [--seed S] [parameter=value ...]" << std::endl;
+		std::exit(2);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	LearnerConfig config;
+	std::string output = "transitions.bin";
+	int samples = 32;
+	unsigned int threads = std::thread::hardware_concurrency();
+	unsigned int seed = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		bool hasValue = i + 1 < argc;
+		if (arg == "--output" && hasValue) output = argv[++i];
+		else if (arg == "--samples" && hasValue) samples = std::atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue) threads = std::atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue) seed = std::atoi(argv[++i]);
+		else if (arg.find('=') != std::string::npos)
+		{
+			std::string value = arg.substr(arg.find('=') + 1);
+			char* end = 0;
+			double number = std::strtod(value.c_str(), &end);
+			if (value.empty() || *end != '\0' || !config.set(arg.substr(0, arg.find('=')), number)) usage();
+		}
+		else usage();
+	}
+	if (threads == 0) threads = 1;
+	if (samples < 1) usage();
+	std::string problem = config.validate();
+	if (!problem.empty())
+	{
+		std::cerr << "transitions: " << problem << std::endl;
+		usage();
+	}
+
+	//as in runLearner: one action per whole unit of torque, angle wrapped, velocity clamped
+	const Discretiser angle(config.angle_bins, config.angle_max, Discretiser::WRAP);
+	const Discretiser velocity(config.velocity_bins, config.velocity_max);
+	std::vector<double> actions;
+	for (int i = 0; i < static_cast<int>(2 * config.maxtorque) + 1; ++i) actions.push_back(-config.maxtorque + i);
+
+	const int cells = config.angle_bins * config.velocity_bins;
+	const int A = static_cast<int>(actions.size());
+
+	std::cerr << "Sampling " << cells << " cells x " << A << " actions x " << samples << " start points on " << threads << " threads" << std::endl;
+
+	//the successors of each (cell, action) are collected first, as the entry size depends on the largest
+	std::vector<float> rewards(static_cast<std::size_t>(cells) * A);
+	std::vector<std::vector<Successor> > found(static_cast<std::size_t>(cells) * A);
+
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			PendulumBatch batch(static_cast<std::size_t>(A) * samples, config.maxtorque, config.mass, config.length, config.damping);
+			std::vector<int> nextCells(batch.size());
+			std::vector<double> thetas(batch.size());
+			for (int c = next++; c < cells; c = next++)
+			{
+				//seeded by cell, so the table does not depend on which thread builds which cell
+				std::mt19937 rng(seed + c);
+				double alow, ahigh, vlow, vhigh;
+				binRange(angle, c / config.velocity_bins, alow, ahigh);
+				binRange(velocity, c % config.velocity_bins, vlow, vhigh);
+				std::uniform_real_distribution<double> startAngle(alow, ahigh);
+				std::uniform_real_distribution<double> startVelocity(vlow, vhigh);
+
+				batch.resetTime();
+				for (int a = 0; a < A; ++a)
+				{
+					for (int s = 0; s < samples; ++s)
+					{
+						std::size_t i = static_cast<std::size_t>(a) * samples + s;
+						batch.setState(i, startAngle(rng), startVelocity(rng));
+						batch.setTorque(i, actions[a]);
+					}
+				}
+				batch.propagate(config.deltatime);
+
+				//wrap the angles as runLearner does before the reward, the discretiser wraps them itself
+				for (std::size_t i = 0; i < batch.size(); ++i)
+				{
+					double theta = batch.getTheta(i);
+					thetas[i] = theta - 2.0 * angle.getMax() * std::floor((theta + angle.getMax()) / (2.0 * angle.getMax()));
+				}
+				std::vector<int> angleBins(batch.size());
+				std::vector<int> velocityBins(batch.size());
+				angle.discretise(thetas.data(), 1, angleBins.data(), batch.size());
+				velocity.discretise(batch.getThetadots(), 1, velocityBins.data(), batch.size());
+
+				for (int a = 0; a < A; ++a)
+				{
+					std::size_t first = static_cast<std::size_t>(a) * samples;
+					double reward = 0;
+					for (int s = 0; s < samples; ++s)
+					{
+						std::size_t i = first + s;
+						nextCells[i] = angleBins[i] * config.velocity_bins + velocityBins[i];
+						reward += State(thetas[i], batch.getThetadot(i), actions[a]).getReward();
+					}
+
+					//count the distinct successors, most likely first
+					std::sort(nextCells.begin() + first, nextCells.begin() + first + samples);
+					std::vector<Successor>& entry = found[static_cast<std::size_t>(c) * A + a];
+					for (int s = 0; s < samples;)
+					{
+						int e = s;
+						while (e < samples && nextCells[first + e] == nextCells[first + s]) ++e;
+						Successor successor = { static_cast<std::uint32_t>(nextCells[first + s]), static_cast<float>(e - s) / samples };
+						entry.push_back(successor);
+						s = e;
+					}
+					std::stable_sort(entry.begin(), entry.end(), [](const Successor& x, const Successor& y) { return x.probability > y.probability; });
+					rewards[static_cast<std::size_t>(c) * A + a] = static_cast<float>(reward / samples);
+				}
+			}
+		}));
+	}
+	for (std::size_t t = 0; t < workers.size(); ++t) workers[t].join();
+
+	int successors = 1;
+	for (std::size_t e = 0; e < found.size(); ++e) successors = std::max(successors, static_cast<int>(found[e].size()));
+
+	TransitionFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, TransitionTable::magic, sizeof(header.magic));
+	header.version = TransitionTable::version;
+	header.header_size = sizeof(TransitionFileHeader);
+	header.angle_bins = config.angle_bins;
+	header.velocity_bins = config.velocity_bins;
+	header.angle_mode = Discretiser::WRAP;
+	header.actions = A;
+	header.angle_max = config.angle_max;
+	header.velocity_max = config.velocity_max;
+	header.deltatime = config.deltatime;
+	header.mass = config.mass;
+	header.length = config.length;
+	header.damping = config.damping;
+	header.maxtorque = config.maxtorque;
+	header.samples = samples;
+	header.successors = successors;
+	header.entry_size = TransitionTable::entrySize(successors);
+	header.entries_offset = sizeof(TransitionFileHeader) + A * sizeof(double);
+	const std::size_t length = header.entries_offset + found.size() * header.entry_size;
+
+	//write through a shared mapping of the output file
+	int fd = open(output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, length) != 0)
+	{
+		std::cerr << "Cannot create " << output << ": " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+	void* mapped = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		std::cerr << "Cannot map " << output << ": " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+
+	char* data = static_cast<char*>(mapped);
+	std::memcpy(data, &header, sizeof(header));
+	std::memcpy(data + sizeof(header), actions.data(), A * sizeof(double));
+	for (std::size_t e = 0; e < found.size(); ++e)
+	{
+		char* place = data + header.entries_offset + e * header.entry_size;
+		TransitionEntry entry = { rewards[e], static_cast<std::uint32_t>(found[e].size()) };
+		std::memcpy(place, &entry, sizeof(entry));
+		std::memcpy(place + sizeof(entry), found[e].data(), found[e].size() * sizeof(Successor));
+	}
+	msync(mapped, length, MS_SYNC);
+	munmap(mapped, length);
+
+	std::cerr << "Wrote " << length << " bytes to " << output << ", up to " << successors << " successors per entry" << std::endl;
+
+	return 0;
+}
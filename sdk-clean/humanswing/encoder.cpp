@@ -1,14 +0,0 @@
-#include "encoder.h"
-
-Encoder::Encoder()
-{
-    cal = 0;
-
-
-    libusb_device_handle * mypmd = pmd_find_first();
-    handle = mypmd;
-
-
-
-
-}
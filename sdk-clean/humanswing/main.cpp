@@ -7,8 +7,10 @@
 #include <iomanip>
 #include <fstream>
 #include <cstdlib>
+#include <cmath>
 #include <unistd.h>
 #include <getopt.h>
+#include <time.h>
 #include <boost/shared_ptr.hpp>
 #include <qi/os.hpp>
 #include <qi/path.hpp>
@@ -20,6 +22,7 @@
 #include <alcommon/albrokermanager.h>
 #include <alproxies/almotionproxy.h>
 #include <alproxies/alrobotpostureproxy.h>
+#include <alproxies/almemoryproxy.h>
 
 #include "encoder.h"
 #include "createmodule.h"
@@ -175,7 +178,24 @@ int main(int argc, char* argv[])
 	// Calibrate the encoder
 	encoder.Calibrate();
 
-	float lastAngle;
+	// Fuse the encoder with the gyroscope, publishing the state 100 times a second
+	if(verb)
+		std::cout << bold_on << "Starting estimator..." << bold_off << std::endl;
+	SwingEstimator estimator;
+	encoder.SetEstimator(&estimator);
+	estimator.Start(100);
+
+	// The gyroscope is optional: without it the estimator runs on the encoder alone
+	boost::shared_ptr<AL::ALMemoryProxy> memory;
+	try
+	{
+		memory = boost::shared_ptr<AL::ALMemoryProxy>(new AL::ALMemoryProxy(pip, pport));
+	}
+	catch(...)
+	{
+		std::cerr << "Failed to create memory proxy, not using the gyroscope" << std::endl;
+	}
+
 	float currentAngle = encoder.GetAngle();
 
 	// Min, max for last swing
@@ -203,11 +223,38 @@ int main(int argc, char* argv[])
 		qi::os::gettimeofday(&currentTime);
 	     	time = 1000 * (currentTime.tv_sec - startTime.tv_sec) 
 		     + 0.001 * (currentTime.tv_usec - startTime.tv_usec);
-		lastAngle = currentAngle;
-		currentAngle = encoder.GetAngle();
+		if (memory)
+		{
+			try
+			{
+				timespec now;
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				float gyroscope = memory->getData("Device/SubDeviceList/InertialSensor/GyroscopeY/Sensor/Value");
+				estimator.Add(SwingEstimator::GYROSCOPE, now.tv_sec + 1e-9 * now.tv_nsec, gyroscope);
+			}
+			catch(...)
+			{
+			}
+		}
+
+		// Use the fused state, predicted to now, falling back to the encoder until there is one
+		SwingState state;
+		float velocity;
+		if (estimator.GetState(state))
+		{
+			currentAngle = state.theta * 180.0 / M_PI;
+			velocity = state.thetaDot;
+		}
+		else
+		{
+			EncoderSample sample;
+			encoder.GetSample(sample);
+			currentAngle = sample.angle;
+			velocity = sample.velocity;
+		}
 		
-		// Check for direction of motion, and a change in direction
-		forwards = currentAngle < lastAngle;
+		// Check for direction of motion from the velocity, and a change in direction
+		forwards = velocity < 0;
 		if (forwards == backwards)
 		{
 			float moveTime = 1000 * (static_cast<int>(currentTime.tv_sec) - static_cast<int>(startTime.tv_sec)) 
@@ -228,6 +275,10 @@ int main(int argc, char* argv[])
 		qi::os::msleep(30);
 	}
 
+	// Stop feeding the estimator before it goes
+	encoder.SetEstimator(NULL);
+	estimator.Stop();
+
 	// Get a handle to the module and close it
 	
 	boost::shared_ptr<AL::ALModuleCore> module = broker->getModuleByName(moduleName);
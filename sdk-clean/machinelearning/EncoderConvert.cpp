@@ -0,0 +1,102 @@
+/**
+ * @file EncoderConvert.cpp
+ *
+ * @brief Turns a binary encoder recording into the text format of the old encoder logs.
+ *
+ * Each line holds the time in milliseconds since the first record, kept to the microsecond, and the angle
+ * in degrees, separated by a tab, as sdk/encoder/main.cpp used to write them. Records marked as following a
+ * gap are preceded by a comment line giving the number of readings lost, worked out from the sequence numbers.
+ * Only the records between the -f and -t times (in seconds from the first record) are written; the start is
+ * found by binary search, so cutting a short piece out of a long recording is quick.
+ *
+ * Usage:
+ * \verbatim
+ encoderconvert [-o output] [-f from] [-t to] [-c zero_count] recording
+ * \endverbatim
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include "EncoderRecord.h"
+
+/**
+ * @brief Program launcher!
+ *
+ * @return Program exit code
+ */
+int main(int argc, char* argv[]) {
+	const char* outputPath = NULL;
+	double from = 0.0;
+	double to = -1.0;
+	long zero = 0;
+
+	int option;
+	while ((option = getopt(argc, argv, "o:f:t:c:")) != -1) {
+		switch (option) {
+		case 'o': outputPath = optarg; break;
+		case 'f': from = std::atof(optarg); break;
+		case 't': to = std::atof(optarg); break;
+		case 'c': zero = std::atol(optarg); break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-o output] [-f from] [-t to] [-c zero_count] recording" << std::endl;
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		std::cerr << "No recording given" << std::endl;
+		return 1;
+	}
+
+	try {
+		EncoderReplay replay(argv[optind]);
+		if (replay.Size() == 0) {
+			std::cerr << argv[optind] << " holds no readings" << std::endl;
+			return 0;
+		}
+
+		std::ofstream file;
+		if (outputPath != NULL) {
+			file.open(outputPath);
+			if (!file) {
+				std::cerr << "Could not create " << outputPath << std::endl;
+				return 1;
+			}
+		}
+		std::ostream& output = outputPath != NULL ? file : std::cout;
+
+		const long counts = replay.GetHeader().counts;
+		const int64_t first = replay[0].time;
+		std::size_t i = replay.Seek(first + static_cast<int64_t>(from * 1e9));
+		const int64_t end = to >= 0.0 ? first + static_cast<int64_t>(to * 1e9) : replay[replay.Size() - 1].time;
+
+		char line[64];
+		for (; i < replay.Size() && replay[i].time <= end; ++i) {
+			const EncoderRecord& record = replay[i];
+			if ((record.flags & EncoderRecord::GAP) && i > 0)
+				output << "# " << static_cast<uint32_t>(record.sequence - replay[i - 1].sequence - 1)
+					<< " readings lost\n";
+			long count = (static_cast<long>(record.raw) - zero) % counts;
+			if (count < 0)
+				count += counts;
+			std::snprintf(line, sizeof(line), "%.3f\t%.4f\n", 1e-6 * (record.time - first), count * 360.0 / counts);
+			output << line;
+		}
+		output.flush();
+		if (!output) {
+			std::cerr << "Could not write the text" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file EncoderDaemon.cpp
+ *
+ * @brief Encoder daemon: owns the PMD1208FS and publishes its readings in shared memory.
+ *
+ * Only one process can open the device, so the daemon opens it and every other program reads the
+ * readings it publishes (see EncoderShared.h). An Encoder constructed while the daemon runs reads
+ * from it without any change to the program, so the learner, humanswing and the encoder logger can
+ * all run at once. The daemon runs until it is sent SIGINT or SIGTERM, and then removes the shared
+ * memory. With -o it also records every reading, as sdk/encoder/main.cpp does.
+ *
+ * The shared memory is named by -n, or ENCODER_SHM in the environment, or is /robot-swing-encoder.
+ *
+ * Usage:
+ * \verbatim
+ encoderd [-r rate] [-w window] [-d depth] [-s slots] [-n name] [-o recording] [-v]
+ * \endverbatim
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <signal.h>
+#include <unistd.h>
+#include "encoder.h"
+#include "EncoderRecord.h"
+#include "EncoderShared.h"
+
+/**
+ * @brief Program launcher!
+ *
+ * @return Program exit code
+ */
+int main(int argc, char* argv[]) {
+	double rate = 500.0;
+	std::size_t window = 15;
+	int depth = 4;
+	std::size_t slots = 4096;
+	const char* name = std::getenv("ENCODER_SHM");
+	const char* recordingPath = NULL;
+	bool verbose = false;
+	if (name == NULL || *name == '\0')
+		name = ENCODER_SHARED_NAME;
+
+	int option;
+	while ((option = getopt(argc, argv, "r:w:d:s:n:o:v")) != -1) {
+		switch (option) {
+		case 'r': rate = std::atof(optarg); break;
+		case 'w': window = std::atol(optarg); break;
+		case 'd': depth = std::atoi(optarg); break;
+		case 's': slots = std::atol(optarg); break;
+		case 'n': name = optarg; break;
+		case 'o': recordingPath = optarg; break;
+		case 'v': verbose = true; break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-r rate] [-w window] [-d depth] [-s slots] [-n name] [-o recording] [-v]" << std::endl;
+			return 1;
+		}
+	}
+	if (rate <= 0) {
+		std::cerr << "The rate must be more than 0" << std::endl;
+		return 1;
+	}
+
+	// the signals are waited for below, so block them before any thread is started
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	// refused if another daemon is publishing, before the device is touched
+	EncoderPublisher publisher(rate, name, slots);
+	if (!publisher.IsOpen())
+		return 1;
+
+	// declared before the encoder, so that it outlives the encoder's thread
+	std::auto_ptr<EncoderRecorder> recorder;
+	if (recordingPath != NULL) {
+		recorder.reset(new EncoderRecorder(recordingPath));
+		if (!recorder->IsOpen())
+			return 1;
+	}
+
+	Encoder encoder(rate, window, depth, false);
+	EncoderSample sample;
+	if (!encoder.GetSample(sample))
+		return 1;
+	encoder.SetRecorder(recorder.get());
+	encoder.SetPublisher(&publisher);
+	if (verbose)
+		std::cout << "Publishing the encoder as " << name << " at " << rate << " readings/s" << std::endl;
+
+	// a line a second if verbose, until told to stop
+	const timespec second = { 1, 0 };
+	unsigned long lastSequence = sample.sequence;
+	for (;;) {
+		const int received = sigtimedwait(&signals, NULL, &second);
+		if (received == SIGINT || received == SIGTERM)
+			break;
+		if (verbose && encoder.GetSample(sample)) {
+			std::cout << sample.angle << " deg\t" << sample.sequence - lastSequence << " readings/s" << std::endl;
+			lastSequence = sample.sequence;
+		}
+	}
+
+	encoder.SetPublisher(NULL);
+	encoder.SetRecorder(NULL);
+	if (verbose)
+		encoder.PrintTiming(stdout);
+	if (recorder.get() != NULL) {
+		recorder->Close();
+		if (recorder->GetDropped() > 0)
+			std::cerr << recorder->GetDropped() << " readings not recorded" << std::endl;
+	}
+	return 0;
+}
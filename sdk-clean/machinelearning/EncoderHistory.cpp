@@ -0,0 +1,132 @@
+/**
+ * @file EncoderHistory.cpp
+ *
+ * @brief Implementation file for EncoderHistory class.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include "EncoderHistory.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Creates an empty buffer holding the given number of readings (at least three, so that there
+ * is always enough for the quadratic).
+ */
+EncoderHistory::EncoderHistory(std::size_t _window) :
+	window(std::max<std::size_t>(3, _window)) {
+	times.resize(window);
+	positions.resize(window);
+	Clear();
+}
+
+void EncoderHistory::Clear() {
+	next = 0;
+	count = 0;
+	added = 0;
+	lastCount = 0;
+	unwrapped = 0;
+	origin = 0;
+	base = 0;
+	std::fill(s, s + 5, 0.0);
+	std::fill(sx, sx + 3, 0.0);
+	position = 0;
+	velocity = 0;
+	acceleration = 0;
+}
+
+/**
+ * The count is unwrapped by taking the change since the last reading to be the shortest way
+ * round, which is right as long as the encoder turns less than half a turn between readings.
+ */
+void EncoderHistory::Add(double time, unsigned int raw) {
+	raw %= COUNTS;
+	if (count == 0) {
+		unwrapped = raw;
+	}
+	else {
+		int change = static_cast<int>(raw) - static_cast<int>(lastCount);
+		if (change >= static_cast<int>(COUNTS / 2))
+			change -= COUNTS;
+		else if (change < -static_cast<int>(COUNTS / 2))
+			change += COUNTS;
+		unwrapped += change;
+	}
+	lastCount = raw;
+
+	if (count == window)
+		Accumulate(times[next], positions[next], -1.0);
+	else
+		++count;
+	times[next] = time;
+	positions[next] = unwrapped;
+	next = (next + 1) % window;
+
+	if (++added >= window || count == 1)
+		Rebuild();
+	else
+		Accumulate(time, unwrapped, 1.0);
+
+	Fit();
+}
+
+void EncoderHistory::Accumulate(double time, double x, double sign) {
+	double u = time - origin;
+	double uk = sign;
+	x -= base;
+	for (int k = 0; k < 5; ++k) {
+		s[k] += uk;
+		if (k < 3)
+			sx[k] += x * uk;
+		uk *= u;
+	}
+}
+
+/**
+ * The origin moves to the oldest reading in the buffer, so the times in the sums stay within
+ * the span of the buffer.
+ */
+void EncoderHistory::Rebuild() {
+	std::size_t oldest = (next + window - count) % window;
+	origin = times[oldest];
+	base = positions[oldest];
+	std::fill(s, s + 5, 0.0);
+	std::fill(sx, sx + 3, 0.0);
+	for (std::size_t i = 0; i < count; ++i) {
+		std::size_t j = (oldest + i) % window;
+		Accumulate(times[j], positions[j], 1.0);
+	}
+	added = 0;
+}
+
+/**
+ * Solves the normal equations of the quadratic by Cramer's rule, falling back to a straight line
+ * through the last two readings while there are too few distinct times for a quadratic.
+ */
+void EncoderHistory::Fit() {
+	std::size_t latest = (next + window - 1) % window;
+	double u = times[latest] - origin;
+	position = unwrapped;
+	velocity = 0;
+	acceleration = 0;
+	if (count < 2)
+		return;
+
+	double det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2]) + s[2] * (s[1] * s[3] - s[2] * s[2]);
+	if (count >= 3 && det > 1e-12 * s[0] * s[2] * s[4]) {
+		double a = (sx[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (sx[1] * s[4] - s[3] * sx[2]) + s[2] * (sx[1] * s[3] - s[2] * sx[2])) / det;
+		double b = (s[0] * (sx[1] * s[4] - sx[2] * s[3]) - sx[0] * (s[1] * s[4] - s[3] * s[2]) + s[2] * (s[1] * sx[2] - sx[1] * s[2])) / det;
+		double c = (s[0] * (s[2] * sx[2] - s[3] * sx[1]) - s[1] * (s[1] * sx[2] - sx[1] * s[2]) + sx[0] * (s[1] * s[3] - s[2] * s[2])) / det;
+		position = base + a + b * u + c * u * u;
+		velocity = b + 2 * c * u;
+		acceleration = 2 * c;
+		return;
+	}
+
+	std::size_t previous = (latest + window - 1) % window;
+	double dt = times[latest] - times[previous];
+	if (dt > 0)
+		velocity = (positions[latest] - positions[previous]) / dt;
+}
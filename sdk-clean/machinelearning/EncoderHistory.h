@@ -0,0 +1,128 @@
+/**
+ * @file EncoderHistory.h
+ *
+ * @brief Interface file for EncoderHistory class.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef ENCODER_HISTORY_H
+#define ENCODER_HISTORY_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class EncoderHistory
+ *
+ * @brief Ring buffer of the latest encoder readings, with the angle, velocity and acceleration
+ * estimated from them.
+ *
+ * Each reading is a CLOCK_MONOTONIC timestamp and the raw 11-bit count. The counts are unwrapped,
+ * so that passing through zero does not look like a jump of a whole turn, and a quadratic
+ * \f$x(t) = a + b t + c t^2\f$ is fitted by least squares to the readings in the buffer - a
+ * Savitzky-Golay filter that allows for uneven sampling. The estimates are taken from the fit at
+ * the time of the latest reading.
+ *
+ * The sums the fit needs are updated as each reading enters and leaves the buffer, so adding a
+ * reading costs the same whatever the size of the buffer. They are rebuilt from the buffer each
+ * time it has been filled, which keeps the times small and stops rounding errors building up.
+ *
+ * Not thread safe: the encoder's sampling thread owns it and publishes the estimates.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class EncoderHistory {
+public:
+
+	/**
+	 * @brief Constructor with the number of readings kept.
+	 *
+	 * @param _window Readings in the buffer and the fit, at least 3.
+	 */
+	explicit EncoderHistory(std::size_t _window);
+
+	/**
+	 * @brief Adds a reading, replacing the oldest once the buffer is full.
+	 *
+	 * @param time Time of the reading in seconds.
+	 * @param raw Raw encoder count, 0 - 2047.
+	 */
+	void Add(double time, unsigned int raw);
+
+	/**
+	 * @brief Gets the fitted angle at the latest reading.
+	 *
+	 * @return Angle in unwrapped counts.
+	 */
+	double GetPosition() const { return position; }
+
+	/**
+	 * @brief Gets the fitted velocity at the latest reading.
+	 *
+	 * @return Velocity in counts per second, 0 until there are two readings.
+	 */
+	double GetVelocity() const { return velocity; }
+
+	/**
+	 * @brief Gets the fitted acceleration at the latest reading.
+	 *
+	 * @return Acceleration in counts per second squared, 0 until there are three readings.
+	 */
+	double GetAcceleration() const { return acceleration; }
+
+	/**
+	 * @brief Gets the number of readings in the buffer.
+	 */
+	std::size_t GetCount() const { return count; }
+
+	/**
+	 * @brief Empties the buffer.
+	 */
+	void Clear();
+
+	/// Counts in one turn of the encoder.
+	static const unsigned int COUNTS = 2048;
+
+private:
+
+	/**
+	 * @brief Adds (sign = 1) or removes (sign = -1) a reading from the sums.
+	 */
+	void Accumulate(double time, double x, double sign);
+
+	/**
+	 * @brief Recomputes the sums from the buffer, about a new origin.
+	 */
+	void Rebuild();
+
+	/**
+	 * @brief Solves the fit and updates the estimates.
+	 */
+	void Fit();
+
+	std::vector<double> times;
+	std::vector<double> positions;
+	std::size_t window;
+	std::size_t next;		///< Where the next reading goes.
+	std::size_t count;
+	std::size_t added;		///< Readings since the sums were rebuilt.
+
+	unsigned int lastCount;
+	double unwrapped;		///< Latest count, unwrapped.
+
+	// sums of u^k and x u^k over the buffer, u being the time since the origin and x the
+	// unwrapped count less the base
+	double origin;
+	double base;
+	double s[5];
+	double sx[3];
+
+	double position;
+	double velocity;
+	double acceleration;
+};
+
+#endif // ENCODER_HISTORY_H
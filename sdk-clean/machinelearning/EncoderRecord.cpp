@@ -0,0 +1,224 @@
+/**
+ * @file EncoderRecord.cpp
+ *
+ * @brief Implementation file for the encoder recording writer and reader.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include "EncoderRecord.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = { 'E', 'N', 'C', 'R', 'E', 'C', 0, 0 };
+
+/**
+ * @brief A clock's time in nanoseconds.
+ */
+static int64_t clockTime(clockid_t clock) {
+	timespec now;
+	clock_gettime(clock, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * The header is written straight away, so that a recording cut short by a crash can still be read.
+ */
+EncoderRecorder::EncoderRecorder(const std::string& path, std::size_t _blockRecords, std::size_t _blocks) :
+	fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)),
+	blockRecords(std::max<std::size_t>(1, _blockRecords)),
+	blocks(std::max<std::size_t>(2, _blocks)),
+	buffer(blockRecords * blocks),
+	current(0),
+	fill(0),
+	gap(false),
+	dropped(0),
+	full(0),
+	oldest(0),
+	closing(false),
+	running(false) {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&ready, NULL);
+	if (fd < 0) {
+		std::cerr << "EncoderRecorder: cannot create " << path << ": " << std::strerror(errno) << std::endl;
+		return;
+	}
+
+	EncoderRecordHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = 1;
+	header.recordSize = sizeof(EncoderRecord);
+	header.counts = 2048;
+	header.startWall = clockTime(CLOCK_REALTIME);
+	header.startMonotonic = clockTime(CLOCK_MONOTONIC);
+	if (write(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+		std::cerr << "EncoderRecorder: cannot write " << path << std::endl;
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	running = pthread_create(&thread, NULL, Write, this) == 0;
+	if (!running)
+		std::cerr << "EncoderRecorder: could not start the writing thread, writing each block as it fills" << std::endl;
+}
+
+EncoderRecorder::~EncoderRecorder() {
+	Close();
+	pthread_cond_destroy(&ready);
+	pthread_mutex_destroy(&mutex);
+}
+
+void EncoderRecorder::Add(int64_t time, unsigned int raw, unsigned long sequence, unsigned int flags) {
+	if (fd < 0 || closing)
+		return;
+
+	if (fill == blockRecords) {
+		// hand the block over, unless every other block is still waiting to be written
+		bool handed = false;
+		pthread_mutex_lock(&mutex);
+		if (full + 1 < blocks) {
+			++full;
+			handed = true;
+			pthread_cond_signal(&ready);
+		}
+		pthread_mutex_unlock(&mutex);
+		if (!running) {
+			// no thread, so write it here
+			WriteRecords(&buffer[current * blockRecords], blockRecords);
+			pthread_mutex_lock(&mutex);
+			--full;
+			pthread_mutex_unlock(&mutex);
+			handed = true;
+		}
+		if (!handed) {
+			++dropped;
+			gap = true;
+			return;
+		}
+		current = (current + 1) % blocks;
+		fill = 0;
+	}
+
+	EncoderRecord& record = buffer[current * blockRecords + fill++];
+	record.time = time;
+	record.raw = static_cast<uint16_t>(raw);
+	record.flags = static_cast<uint16_t>(flags | (gap ? EncoderRecord::GAP : 0));
+	record.sequence = static_cast<uint32_t>(sequence);
+	gap = false;
+}
+
+void EncoderRecorder::Close() {
+	if (fd < 0)
+		return;
+	pthread_mutex_lock(&mutex);
+	closing = true;
+	pthread_cond_signal(&ready);
+	pthread_mutex_unlock(&mutex);
+	if (running) {
+		pthread_join(thread, NULL);
+		running = false;
+	}
+
+	// the thread has written every full block, leaving the one being filled
+	WriteRecords(&buffer[current * blockRecords], fill);
+	fill = 0;
+	close(fd);
+	fd = -1;
+	if (dropped > 0)
+		std::cerr << "EncoderRecorder: " << dropped << " readings dropped" << std::endl;
+}
+
+void* EncoderRecorder::Write(void* recorder) {
+	EncoderRecorder& self = *static_cast<EncoderRecorder*>(recorder);
+	pthread_mutex_lock(&self.mutex);
+	while (true) {
+		while (self.full == 0 && !self.closing)
+			pthread_cond_wait(&self.ready, &self.mutex);
+		if (self.full == 0)
+			break;
+
+		// Add never fills a block that is still waiting, so it can be written without the lock
+		pthread_mutex_unlock(&self.mutex);
+		self.WriteRecords(&self.buffer[self.oldest * self.blockRecords], self.blockRecords);
+		self.oldest = (self.oldest + 1) % self.blocks;
+		pthread_mutex_lock(&self.mutex);
+		--self.full;
+	}
+	pthread_mutex_unlock(&self.mutex);
+	return NULL;
+}
+
+bool EncoderRecorder::WriteRecords(const EncoderRecord* records, std::size_t count) {
+	const char* data = reinterpret_cast<const char*>(records);
+	std::size_t left = count * sizeof(EncoderRecord);
+	while (left > 0) {
+		ssize_t written = write(fd, data, left);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0) {
+			std::cerr << "EncoderRecorder: write failed: " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		data += written;
+		left -= written;
+	}
+	return true;
+}
+
+EncoderReplay::EncoderReplay(const std::string& path) :
+	map(MAP_FAILED),
+	length(0),
+	header(NULL),
+	records(NULL),
+	size(0) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("cannot open " + path);
+	struct stat status;
+	if (fstat(fd, &status) < 0 || static_cast<std::size_t>(status.st_size) < sizeof(EncoderRecordHeader)) {
+		close(fd);
+		throw std::runtime_error(path + " is too short to be an encoder recording");
+	}
+	length = status.st_size;
+	map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		throw std::runtime_error("cannot map " + path);
+
+	header = static_cast<const EncoderRecordHeader*>(map);
+	if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != 1
+		|| header->recordSize < sizeof(EncoderRecord)) {
+		munmap(map, length);
+		throw std::runtime_error(path + " is not an encoder recording");
+	}
+	records = static_cast<const char*>(map) + sizeof(EncoderRecordHeader);
+	size = (length - sizeof(EncoderRecordHeader)) / header->recordSize;
+	madvise(map, length, MADV_SEQUENTIAL);
+}
+
+EncoderReplay::~EncoderReplay() {
+	munmap(map, length);
+}
+
+std::size_t EncoderReplay::Seek(int64_t time) const {
+	std::size_t low = 0, high = size;
+	while (low < high) {
+		std::size_t middle = low + (high - low) / 2;
+		if ((*this)[middle].time < time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
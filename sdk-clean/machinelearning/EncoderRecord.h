@@ -0,0 +1,217 @@
+/**
+ * @file EncoderRecord.h
+ *
+ * @brief Interface file for the binary encoder recording format, its writer and its reader.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef ENCODER_RECORD_H
+#define ENCODER_RECORD_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * @struct EncoderRecordHeader
+ *
+ * @brief The 64 bytes at the start of a recording.
+ *
+ * The records follow straight after, to the end of the file. Everything is stored in the byte
+ * order of the machine that wrote it (little endian on the robot and the PCs).
+ */
+struct EncoderRecordHeader {
+	char magic[8];			///< "ENCREC" followed by two zero bytes.
+	uint32_t version;		///< Format version, 1.
+	uint32_t recordSize;		///< sizeof(EncoderRecord), so old readers can skip new fields.
+	uint32_t counts;		///< Counts in one turn of the encoder.
+	uint32_t reserved;
+	int64_t startWall;		///< CLOCK_REALTIME when the recording started, in nanoseconds.
+	int64_t startMonotonic;		///< CLOCK_MONOTONIC at the same moment, to place the records in the day.
+	char padding[24];
+};
+
+/**
+ * @struct EncoderRecord
+ *
+ * @brief One encoder reading, 16 bytes.
+ */
+struct EncoderRecord {
+	int64_t time;			///< CLOCK_MONOTONIC time of the reading in nanoseconds.
+	uint16_t raw;			///< Raw count, 0 - 2047.
+	uint16_t flags;			///< STREAMED and GAP bits.
+	uint32_t sequence;		///< Number of the reading (low 32 bits), from 1.
+
+	/// The reading came from the digin stream, timed as its reply arrived.
+	static const uint16_t STREAMED = 1;
+	/// Readings just before this one were dropped because the disk could not keep up.
+	static const uint16_t GAP = 2;
+};
+
+/**
+ * @class EncoderRecorder
+ *
+ * @brief Writes encoder readings to a recording from a background thread.
+ *
+ * Readings are copied into fixed-size blocks, and each full block is handed to the writing
+ * thread, so Add is a copy into memory and only takes a lock once per block. If every block is
+ * waiting to be written the reading is dropped rather than holding up the sampling, and the next
+ * reading kept is marked GAP.
+ *
+ * Add must only be called from one thread at a time - the encoder's sampling thread.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class EncoderRecorder {
+public:
+
+	/**
+	 * @brief Creates the file and starts the writing thread.
+	 *
+	 * @param path File to write, replaced if it exists.
+	 * @param blockRecords Readings in each block written.
+	 * @param blocks Blocks that can wait to be written before readings are dropped.
+	 */
+	explicit EncoderRecorder(const std::string& path, std::size_t blockRecords = 4096, std::size_t blocks = 8);
+
+	/**
+	 * @brief Destructor, writes what is left and closes the file.
+	 */
+	~EncoderRecorder();
+
+	/**
+	 * @brief Whether the file was created.
+	 */
+	bool IsOpen() const { return fd >= 0; }
+
+	/**
+	 * @brief Adds a reading.
+	 *
+	 * @param time CLOCK_MONOTONIC time of the reading in nanoseconds.
+	 * @param raw Raw count.
+	 * @param sequence Number of the reading.
+	 * @param flags EncoderRecord::STREAMED if the reading came from the digin stream.
+	 */
+	void Add(int64_t time, unsigned int raw, unsigned long sequence, unsigned int flags = 0);
+
+	/**
+	 * @brief Writes what is left, stops the thread and closes the file. Readings added after
+	 * this are ignored.
+	 */
+	void Close();
+
+	/**
+	 * @brief Gets the number of readings dropped so far.
+	 */
+	unsigned long GetDropped() const { return dropped; }
+
+private:
+	/**
+	 * @brief Writing thread, writes full blocks until closed.
+	 */
+	static void* Write(void* recorder);
+
+	/**
+	 * @brief Writes a block of records, returning false on an error.
+	 */
+	bool WriteRecords(const EncoderRecord* records, std::size_t count);
+
+	int fd;
+	std::size_t blockRecords;
+	std::size_t blocks;
+	std::vector<EncoderRecord> buffer;	///< blocks * blockRecords records.
+
+	// only touched by the thread calling Add
+	std::size_t current;		///< Block being filled.
+	std::size_t fill;		///< Records in it.
+	bool gap;			///< Readings dropped since the last one kept.
+	unsigned long dropped;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t ready;
+	std::size_t full;		///< Blocks waiting for the writing thread.
+	std::size_t oldest;		///< First of them, only touched by the writing thread.
+	bool closing;
+	bool running;
+	pthread_t thread;
+};
+
+/**
+ * @class EncoderReplay
+ *
+ * @brief Reads a recording by mapping it into memory.
+ *
+ * Opening costs the same however long the recording, and the records are read in place, so a
+ * multi-hour capture can be replayed or searched straight away. A record cut short at the end,
+ * as left by a crash, is ignored.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class EncoderReplay {
+public:
+
+	/**
+	 * @brief Maps a recording.
+	 *
+	 * @param path File to read.
+	 * @throw Throws std::runtime_error if the file cannot be read or is not a recording.
+	 */
+	explicit EncoderReplay(const std::string& path);
+
+	/**
+	 * @brief Destructor, unmaps the file.
+	 */
+	~EncoderReplay();
+
+	/**
+	 * @brief Gets the header.
+	 */
+	const EncoderRecordHeader& GetHeader() const { return *header; }
+
+	/**
+	 * @brief Gets the number of records.
+	 */
+	std::size_t Size() const { return size; }
+
+	/**
+	 * @brief Gets a record.
+	 *
+	 * @param i Index of the record, less than Size().
+	 */
+	const EncoderRecord& operator[](std::size_t i) const {
+		return *reinterpret_cast<const EncoderRecord*>(records + i * header->recordSize);
+	}
+
+	/**
+	 * @brief Finds the first record at or after a time, by binary search.
+	 *
+	 * @param time CLOCK_MONOTONIC time in nanoseconds.
+	 * @return Index of the record, Size() if every record is earlier.
+	 */
+	std::size_t Seek(int64_t time) const;
+
+	/**
+	 * @brief Gets the time of a record from the start of the recording.
+	 *
+	 * @return Seconds since the first record.
+	 */
+	double GetSeconds(std::size_t i) const { return 1e-9 * ((*this)[i].time - (*this)[0].time); }
+
+private:
+	EncoderReplay(const EncoderReplay&);
+	EncoderReplay& operator=(const EncoderReplay&);
+
+	void* map;
+	std::size_t length;
+	const EncoderRecordHeader* header;
+	const char* records;
+	std::size_t size;
+};
+
+#endif // ENCODER_RECORD_H
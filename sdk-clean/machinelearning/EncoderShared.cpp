@@ -0,0 +1,279 @@
+/**
+ * @file EncoderShared.cpp
+ *
+ * @brief Implementation file for the shared memory publisher and subscriber of encoder readings.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include "EncoderShared.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = { 'E', 'N', 'C', 'S', 'H', 'M', 0, 0 };
+
+/**
+ * Memory left by a publisher that died is removed and made again, so that readers still holding
+ * the old memory see its publisher is gone rather than readings from a new one. The ".lock" is
+ * taken first, so that no other publisher can be doing the same at once.
+ */
+EncoderPublisher::EncoderPublisher(double rate, const std::string& name, std::size_t _slots) :
+	name(name),
+	lockFd(-1),
+	fd(-1),
+	size(0),
+	header(NULL),
+	slots(NULL) {
+	std::size_t count = 2;
+	while (count < _slots)
+		count *= 2;
+
+	const std::string lockName = name + ".lock";
+	lockFd = shm_open(lockName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (lockFd < 0) {
+		std::cerr << "EncoderPublisher: cannot create " << lockName << ": " << std::strerror(errno) << std::endl;
+		return;
+	}
+	if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+		EncoderSubscriber existing;
+		std::cerr << "EncoderPublisher: " << name << " is already published";
+		if (existing.Open(name) && existing.IsAlive())
+			std::cerr << " by process " << existing.GetPid();
+		std::cerr << std::endl;
+		close(lockFd);
+		lockFd = -1;
+		return;
+	}
+	shm_unlink(name.c_str());
+
+	fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		std::cerr << "EncoderPublisher: cannot create " << name << ": " << std::strerror(errno) << std::endl;
+		close(lockFd);
+		lockFd = -1;
+		return;
+	}
+	const std::size_t length = sizeof(EncoderSharedHeader) + count * sizeof(EncoderSharedSlot);
+	void* memory = MAP_FAILED;
+	if (flock(fd, LOCK_EX | LOCK_NB) == 0 && ftruncate(fd, length) == 0)
+		memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED) {
+		std::cerr << "EncoderPublisher: cannot map " << name << ": " << std::strerror(errno) << std::endl;
+		close(fd);
+		fd = -1;
+		shm_unlink(name.c_str());
+		close(lockFd);
+		lockFd = -1;
+		return;
+	}
+
+	// new memory is zeroed, so every slot starts out empty
+	size = length;
+	header = static_cast<EncoderSharedHeader*>(memory);
+	slots = reinterpret_cast<EncoderSharedSlot*>(header + 1);
+	header->version = 1;
+	header->slotSize = sizeof(EncoderSharedSlot);
+	header->slots = count;
+	header->pid = getpid();
+	header->rate = rate;
+	header->written = 0;
+	header->counts = 2048;
+	__sync_synchronize();
+	std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+}
+
+EncoderPublisher::~EncoderPublisher() {
+	if (header != NULL) {
+		munmap(header, size);
+		shm_unlink(name.c_str());
+		close(fd);
+		close(lockFd);
+	}
+}
+
+void EncoderPublisher::Add(unsigned int raw, double time, float velocity, float acceleration, float latency, unsigned int flags) {
+	if (header == NULL)
+		return;
+	// 0 marks a slot being written, so the count goes from 2^32 - 1 to 1
+	uint32_t number = header->written + 1;
+	if (number == 0)
+		number = 1;
+	EncoderSharedSlot& slot = slots[(number - 1) & (header->slots - 1)];
+
+	// empty while writing, with barriers so that the fields are not written outside that time
+	slot.number = 0;
+	__sync_synchronize();
+	slot.raw = raw;
+	slot.flags = flags;
+	slot.time = time;
+	slot.velocity = velocity;
+	slot.acceleration = acceleration;
+	slot.latency = latency;
+	__sync_synchronize();
+	slot.number = number;
+	__sync_synchronize();
+	header->written = number;
+}
+
+EncoderSubscriber::EncoderSubscriber() :
+	fd(-1),
+	takeoverFd(-1),
+	size(0),
+	header(NULL),
+	slots(NULL) {
+}
+
+EncoderSubscriber::~EncoderSubscriber() {
+	Close();
+}
+
+bool EncoderSubscriber::Open(const std::string& name) {
+	Close();
+	fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		// no daemon running is not an error
+		if (errno != ENOENT)
+			std::cerr << "EncoderSubscriber: cannot open " << name << ": " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	struct stat status;
+	void* memory = MAP_FAILED;
+	if (fstat(fd, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(EncoderSharedHeader))
+		memory = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED) {
+		std::cerr << "EncoderSubscriber: cannot map " << name << std::endl;
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	const EncoderSharedHeader* mapped = static_cast<const EncoderSharedHeader*>(memory);
+	if (std::memcmp(mapped->magic, MAGIC, sizeof(MAGIC)) != 0 || mapped->version != 1 ||
+	    mapped->slotSize != sizeof(EncoderSharedSlot) || mapped->slots == 0 ||
+	    (mapped->slots & (mapped->slots - 1)) != 0 ||
+	    static_cast<std::size_t>(status.st_size) < sizeof(EncoderSharedHeader) + mapped->slots * sizeof(EncoderSharedSlot)) {
+		std::cerr << "EncoderSubscriber: " << name << " is not an encoder ring" << std::endl;
+		munmap(memory, status.st_size);
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	__sync_synchronize();
+	this->name = name;
+	size = status.st_size;
+	header = mapped;
+	slots = reinterpret_cast<const EncoderSharedSlot*>(header + 1);
+	return true;
+}
+
+void EncoderSubscriber::Close() {
+	if (takeoverFd >= 0) {
+		close(takeoverFd);
+		takeoverFd = -1;
+	}
+	if (header != NULL) {
+		munmap(const_cast<EncoderSharedHeader*>(header), size);
+		close(fd);
+		fd = -1;
+		header = NULL;
+		slots = NULL;
+	}
+}
+
+/**
+ * A shared lock can only be had once the publisher's exclusive one has gone. It is given straight
+ * back, so that a new publisher can take the memory over.
+ */
+bool EncoderSubscriber::IsAlive() const {
+	if (header == NULL)
+		return false;
+	if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+		flock(fd, LOCK_UN);
+		return false;
+	}
+	return errno == EWOULDBLOCK;
+}
+
+/**
+ * Like the publisher's ".lock", the object is never removed, and the system lets go of the lock
+ * however the process holding it ends. Taking it again while it is held succeeds.
+ */
+bool EncoderSubscriber::TakeOver() {
+	if (header == NULL)
+		return false;
+	if (takeoverFd < 0) {
+		takeoverFd = shm_open((name + ".device").c_str(), O_RDWR | O_CREAT, 0644);
+		if (takeoverFd < 0) {
+			std::cerr << "EncoderSubscriber: cannot create " << name << ".device: " << std::strerror(errno) << std::endl;
+			return false;
+		}
+	}
+	return flock(takeoverFd, LOCK_EX | LOCK_NB) == 0;
+}
+
+bool EncoderSubscriber::Copy(uint32_t number, EncoderSharedReading& reading) const {
+	const EncoderSharedSlot& slot = slots[(number - 1) & (header->slots - 1)];
+	if (number == 0 || slot.number != number)
+		return false;
+	__sync_synchronize();
+	reading.number = number;
+	reading.raw = slot.raw;
+	reading.flags = slot.flags;
+	reading.time = slot.time;
+	reading.velocity = slot.velocity;
+	reading.acceleration = slot.acceleration;
+	reading.latency = slot.latency;
+	__sync_synchronize();
+	return slot.number == number;
+}
+
+bool EncoderSubscriber::Latest(EncoderSharedReading& reading) const {
+	// only fails if the whole ring is written over during the copy
+	for (;;) {
+		const uint32_t number = header->written;
+		if (number == 0)
+			return false;
+		__sync_synchronize();
+		if (Copy(number, reading))
+			return true;
+	}
+}
+
+void EncoderSubscriber::Cursor(EncoderSharedCursor& cursor) const {
+	cursor.next = header->written + 1;
+	cursor.lost = 0;
+}
+
+/**
+ * No reading is numbered 0, so a cursor that comes to it as the count wraps goes straight on to 1;
+ * a ring overrun across the wrap counts the missing number among the readings lost.
+ */
+bool EncoderSubscriber::Next(EncoderSharedCursor& cursor, EncoderSharedReading& reading) const {
+	for (;;) {
+		if (cursor.next == 0)
+			cursor.next = 1;
+		const uint32_t written = header->written;
+		if (static_cast<int32_t>(written - cursor.next) < 0)
+			return false;
+		__sync_synchronize();
+
+		// the slot after the latest may be being written, so at most slots - 1 can be read
+		const uint32_t available = written - cursor.next + 1;
+		if (available > header->slots - 1) {
+			cursor.lost += available - (header->slots - 1);
+			cursor.next = written + 2 - header->slots;
+		}
+		if (Copy(cursor.next, reading)) {
+			++cursor.next;
+			return true;
+		}
+		// written over as it was copied: the next time round skips it
+	}
+}
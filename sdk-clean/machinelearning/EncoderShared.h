@@ -0,0 +1,243 @@
+/**
+ * @file EncoderShared.h
+ *
+ * @brief Interface file for the shared memory ring through which the encoder daemon publishes its readings.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef ENCODER_SHARED_H
+#define ENCODER_SHARED_H
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+/// Shared memory object the daemon publishes to, unless ENCODER_SHM in the environment names another.
+#define ENCODER_SHARED_NAME "/robot-swing-encoder"
+
+/**
+ * @struct EncoderSharedHeader
+ *
+ * @brief The 64 bytes at the start of the shared memory, followed by the slots.
+ *
+ * Counters are 32 bits so that they are written atomically on the robot's 32 bit processor;
+ * they wrap after 2^32 readings (49 days at 1000 readings/sec), and are compared with
+ * wrapping arithmetic. Reading numbers skip 0, which marks a slot being written.
+ */
+struct EncoderSharedHeader {
+	char magic[8];			///< "ENCSHM" followed by two zero bytes, written last.
+	uint32_t version;		///< Layout version, 1.
+	uint32_t slotSize;		///< sizeof(EncoderSharedSlot).
+	uint32_t slots;			///< Number of slots, a power of two.
+	int32_t pid;			///< Process of the daemon writing the readings.
+	double rate;			///< Readings per second the daemon asked for.
+	volatile uint32_t written;	///< Number of the latest reading published, 0 before the first.
+	uint32_t counts;		///< Counts in one turn of the encoder.
+	char padding[24];
+};
+
+/**
+ * @struct EncoderSharedSlot
+ *
+ * @brief One reading in the ring, 32 bytes. Reading n goes in slot (n - 1) % slots.
+ */
+struct EncoderSharedSlot {
+	volatile uint32_t number;	///< Number of the reading held, 0 while it is being written.
+	uint16_t raw;			///< Raw count, 0 - 2047.
+	uint16_t flags;			///< EncoderRecord flags.
+	double time;			///< CLOCK_MONOTONIC time of the reading, in seconds.
+	float velocity;			///< Fitted velocity, in radians/sec.
+	float acceleration;		///< Fitted acceleration, in radians/sec^2.
+	float latency;			///< Seconds from the request to the reply.
+	uint32_t reserved;
+};
+
+/**
+ * @struct EncoderSharedReading
+ *
+ * @brief A reading copied out of the ring.
+ */
+struct EncoderSharedReading {
+	uint32_t number;		///< Number of the reading, from 1.
+	unsigned int raw;
+	unsigned int flags;
+	double time;
+	float velocity;
+	float acceleration;
+	float latency;
+};
+
+/**
+ * @struct EncoderSharedCursor
+ *
+ * @brief A reader's place in the ring, for readers that want every reading.
+ */
+struct EncoderSharedCursor {
+	uint32_t next;			///< Number of the next reading to read.
+	unsigned long lost;		///< Readings overwritten before they were read.
+};
+
+/**
+ * @class EncoderPublisher
+ *
+ * @brief Writes encoder readings into a ring in POSIX shared memory, for other processes to read.
+ *
+ * There is one writer, the thread publishing the encoder's readings, and any number of readers
+ * in any process, which never take a lock and are never waited for. Each reading is written
+ * into its slot with the slot's number set to 0, and the number of the reading is set once the
+ * rest is in place; a reader copies a slot and then checks that the number is still the one it
+ * wanted, so a copy overlapping a write is noticed and thrown away. The latest reading's number
+ * is then published in the header.
+ *
+ * Only one publisher may use a name at a time. The publisher holds an exclusive lock on the
+ * memory, which the system lets go of however its process ends, so that readers can tell it has
+ * stopped and memory left by one that died is replaced. It first takes an exclusive lock on a
+ * second object, the name followed by ".lock", which is never removed; of two publishers
+ * started together only one gets it, before either looks at or removes the memory.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class EncoderPublisher {
+public:
+
+	/**
+	 * @brief Creates the shared memory.
+	 *
+	 * @param rate Readings per second, for the readers' information.
+	 * @param name Name of the shared memory object.
+	 * @param slots Readings kept, rounded up to a power of two.
+	 */
+	explicit EncoderPublisher(double rate, const std::string& name = ENCODER_SHARED_NAME, std::size_t slots = 4096);
+
+	/**
+	 * @brief Destructor, unmaps and removes the shared memory.
+	 */
+	~EncoderPublisher();
+
+	/**
+	 * @brief Whether the shared memory was created.
+	 */
+	bool IsOpen() const { return header != NULL; }
+
+	/**
+	 * @brief Publishes a reading. Must only be called from one thread at a time.
+	 */
+	void Add(unsigned int raw, double time, float velocity, float acceleration, float latency, unsigned int flags);
+
+private:
+	std::string name;
+	int lockFd;			///< The name's ".lock", held open and locked while publishing.
+	int fd;				///< Held open, with the lock, while publishing.
+	std::size_t size;
+	EncoderSharedHeader* header;
+	EncoderSharedSlot* slots;
+};
+
+/**
+ * @class EncoderSubscriber
+ *
+ * @brief Reads the readings an EncoderPublisher in another process writes.
+ *
+ * The latest reading is a copy out of shared memory, so it can be read as often as wanted.
+ * A reader that wants every reading keeps a cursor, and must come back before the ring fills
+ * (4096 readings, four seconds at 1000 readings/sec, by default) or lose the oldest.
+ * Once the publisher has stopped, the subscribers that want to open the device themselves
+ * decide which of them does with TakeOver.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class EncoderSubscriber {
+public:
+
+	/**
+	 * @brief Creates a subscriber not attached to anything.
+	 */
+	EncoderSubscriber();
+
+	/**
+	 * @brief Destructor, unmaps the shared memory.
+	 */
+	~EncoderSubscriber();
+
+	/**
+	 * @brief Maps a publisher's shared memory.
+	 *
+	 * @param name Name of the shared memory object.
+	 * @return false if there is none, or it is not an encoder ring.
+	 */
+	bool Open(const std::string& name = ENCODER_SHARED_NAME);
+
+	/**
+	 * @brief Unmaps the shared memory.
+	 */
+	void Close();
+
+	/**
+	 * @brief Whether shared memory is mapped.
+	 */
+	bool IsOpen() const { return header != NULL; }
+
+	/**
+	 * @brief Whether the publisher is still running (still holds its lock).
+	 */
+	bool IsAlive() const;
+
+	/**
+	 * @brief Takes an exclusive lock on the name followed by ".device", held until Close, so that
+	 *	  only one subscriber opens the device in place of a publisher that has stopped.
+	 *
+	 * @return false if another process holds it.
+	 */
+	bool TakeOver();
+
+	/**
+	 * @brief Gets the process of the publisher.
+	 */
+	int GetPid() const { return header->pid; }
+
+	/**
+	 * @brief Gets the readings per second the publisher asked for.
+	 */
+	double GetRate() const { return header->rate; }
+
+	/**
+	 * @brief Copies the latest reading.
+	 *
+	 * @return false if there has been none.
+	 */
+	bool Latest(EncoderSharedReading& reading) const;
+
+	/**
+	 * @brief Points a cursor at the next reading to arrive.
+	 */
+	void Cursor(EncoderSharedCursor& cursor) const;
+
+	/**
+	 * @brief Copies the reading at a cursor and moves the cursor past it.
+	 *
+	 * If the reading has been overwritten the cursor is moved on to the oldest one left, and
+	 * the readings skipped are added to its lost count.
+	 *
+	 * @return false if there is no new reading.
+	 */
+	bool Next(EncoderSharedCursor& cursor, EncoderSharedReading& reading) const;
+
+private:
+	/**
+	 * @brief Copies reading number from its slot, returning false if it is not there.
+	 */
+	bool Copy(uint32_t number, EncoderSharedReading& reading) const;
+
+	std::string name;
+	int fd;				///< Held open to test the publisher's lock.
+	int takeoverFd;			///< The name's ".device", once TakeOver has been called.
+	std::size_t size;
+	const EncoderSharedHeader* header;
+	const EncoderSharedSlot* slots;
+};
+
+#endif // ENCODER_SHARED_H
@@ -15,11 +15,13 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <sys/time.h>
 #include "StateSpace.h"
 #include "PriorityQueue.h"
 #include "State.h"
 #include "encoder.h"
 #include "CreateModule.h"
+#include "ConvergenceMonitor.h"
 
 /**
 * @brief Gives a std::string representation of a primitive type.
@@ -43,6 +45,17 @@ bool fileExists(const char* filename) {
 	return file.good();
 }
 
+/**
+ * @brief Gives the wall clock time in seconds
+ *
+ * @return Seconds since the epoch, with microsecond resolution
+ */
+double wallTime() {
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + 1e-6 * now.tv_usec;
+}
+
 /**
  * @brief Analog to temperature variable in Boltzmann Distribution, computes 'evolution variable' of system.
  *
@@ -100,8 +113,9 @@ int selectAction_BoltzmannFactor(const PriorityQueue<int, double>& a_queue, unsi
  * @param old_state Reference to State instance giving the old system state
  * @param alpha Learning rate of temporal difference learning algorithm (in the interval [0,1])
  * @param gamma Discount factor applied to q-learning equation (in the interval [0,1])
+ * @param monitor ConvergenceMonitor instance the size of the update and any change of best action are reported to
  */
-void updateQ(StateSpace & space, int action, State & new_state, State & old_state, double alpha, double gamma);
+void updateQ(StateSpace & space, int action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor);
 
 /**
  * @brief Performs all proxy initialisation through NAO SDK functions and structures, setting up a connection
@@ -212,8 +226,14 @@ int main() {
 	initiator_queue.enqueueWithPriority(action_forwards, 0.0);
 	initiator_queue.enqueueWithPriority(action_backwards, 0.0);
 
+	// every raw encoder reading of the run goes to a binary recording, declared before the
+	// encoder so that it outlives it (see encoderconvert to turn it into text)
+	const std::string runName = to_string(std::time(NULL));
+	EncoderRecorder recorder("encoderData-" + runName + ".enc");
+
 	// create encoder and calibrate to current angle
 	Encoder encoder;
+	encoder.SetRecorder(&recorder);
 	encoder.Calibrate();
 	
 	std::cout << "Encoder angle calibrated... " << std::endl;
@@ -231,20 +251,26 @@ int main() {
 	
 	const char* serializedSpacePath = "serializedStateSpaceData.txt";
 	
-	// create output file to send encoder data to
-	const char* encoderDataPath = "encoderData.txt";
-	std::ofstream encoderOutput(encoderDataPath);
+	// create output file to send encoder data to, one per run so that past runs can be
+	// used for offline training (see OfflineTrainer.cpp)
+	const std::string encoderDataPath = "encoderData-" + runName + ".txt";
+	std::ofstream encoderOutput(encoderDataPath.c_str());
+	encoderOutput.precision(10);
+	encoderOutput << "#time\ttheta\ttheta_dot\trobot_state\taction" << std::endl;
+	const double startTime = wallTime();
 	
 	// if file containing previous state space data exists
 	// get handle to this file and stream contents to space object
 	if (fileExists(serializedSpacePath)) {
 		std::ifstream inputFile(serializedSpacePath);
-		std::string firstFileLine;
-		std::getline(inputFile, firstFileLine);
-		// if file is not empty, save file data to state space object
-		// FIXME: extraction for statespace
-		//if (!firstFileLine.empty())
-		//	inputFile >> space;
+		try {
+			inputFile >> space;
+			std::cout << "Loaded state space from " << serializedSpacePath << std::endl;
+		}
+		// keep the initial queues if the file is from a differently sized state space
+		catch (const std::runtime_error& e) {
+			std::cerr << "Could not load " << serializedSpacePath << ": " << e.what() << std::endl;
+		}
 	}
 	
 	// Create State objects for current state and previous state
@@ -258,23 +284,29 @@ int main() {
 
 	bool useEpsilonGreedy = true;
 
+	// Stop early once the policy has stopped changing: windows of 50 updates,
+	// stable when max |dQ| < 1e-3 and < 2% of visited cells change their best action
+	ConvergenceMonitor monitor(50UL, 1e-3, 0.02, 3);
+
 	// Each iteration currently requires 700ms time for action performing
 	// => increase maxIterations for longer learning times
 	const unsigned long maxIterations = 500UL;
-	for(unsigned long i = 0UL; i < maxIterations; ++i) {
-		// set current state angle to angle received from encoder
-		// and set current state velocity to difference in new and
-		// old state angles over some time difference
-		current_state.theta = M_PI * (encoder.GetAngle()) / 180.0;
-		current_state.theta_dot = (current_state.theta - old_state.theta) / 700.0; //Needs actual time
+	for(unsigned long i = 0UL; i < maxIterations && !monitor.converged(); ++i) {
+		// set current state angle and velocity from the same encoder reading,
+		// the velocity being fitted over the readings the encoder thread has taken
+		EncoderSample sample;
+		encoder.GetSample(sample);
+		current_state.theta = M_PI * sample.angle / 180.0;
+		current_state.theta_dot = sample.velocity;
 		current_state.robot_state = static_cast<ROBOT_STATE>(chosen_action);
 
-		// save encoder data to encoderData.txt output file
-		encoderOutput << current_state.theta << std::endl;
-
 		// call updateQ function with state space, previous and current states
 		// and learning rate, discount factor
-		updateQ(space, chosen_action, old_state, current_state, alpha, gamma);
+		updateQ(space, chosen_action, old_state, current_state, alpha, gamma, monitor);
+
+		// report progress every window
+		if (monitor.getUpdates() % 50UL == 0UL)
+			std::cout << monitor << std::endl;
 
 		// set old_state to current_state
 		old_state = current_state;
@@ -291,10 +323,21 @@ int main() {
 		else 
 			chosen_action = selectAction_BoltzmannFactor(space[current_state], i);
 
+		// log the state and the action taken from it, for offline training
+		encoderOutput << wallTime() - startTime << "\t" << current_state.theta << "\t" << current_state.theta_dot << "\t"
+			<< current_state.robot_state << "\t" << chosen_action << std::endl;
+
 		// depending upon chosen action, call robot movement tools proxy with either
 		// swingForwards or swingBackwards commands.
 		(chosen_action) ? movementToolsProxy.callVoid("swingForwards") : movementToolsProxy.callVoid("swingBackwards");
 	}
+
+	if (monitor.converged())
+		std::cout << "Converged after " << monitor.getUpdates() << " updates" << std::endl;
+	std::cout << monitor << std::endl;
+
+	// how regularly the encoder was read, to size the sampling rate against
+	encoder.PrintTiming(stdout);
 	
 	// create output file for sending final contents of StateSpace object to, allowing 
 	// use of previously acquired learning runs to use for future learning runs
@@ -367,9 +410,13 @@ int selectAction_EpsilonGreedy(const PriorityQueue<int, double>& a_queue, double
 	return a_queue[ round( rand_num*(a_queue.getSize()-1) ) ].first;
 }
 
-void updateQ(StateSpace & space, int action, State & new_state, State & old_state, double alpha, double gamma) {
+void updateQ(StateSpace & space, int action, State & new_state, State & old_state, double alpha, double gamma, ConvergenceMonitor & monitor) {
+	// queue of the state being updated, and its best action before the update
+	PriorityQueue<int, double>& queue = space[old_state];
+	int oldBest = queue.peekFront().first;
+
 	//oldQ value reference
-	double oldQ = space[old_state].search(action).second;
+	double oldQ = queue.search(action).second;
 
 	//reward given to current state 
 	double R = new_state.getReward();
@@ -381,5 +428,9 @@ void updateQ(StateSpace & space, int action, State & new_state, State & old_stat
 	double newQ = oldQ + alpha * (R + (gamma * maxQ) - oldQ);
 
 	// change priority of action to new Q value
-	space[old_state].changePriority(action, newQ);
+	queue.changePriority(action, newQ);
+
+	// report the update to the convergence monitor
+	monitor.recordUpdate(space.cell(old_state), oldQ, newQ, queue.peekFront().first != oldBest);
+	monitor.recordReward(R);
 }
@@ -0,0 +1,377 @@
+/**
+ * @file OfflineTrainer.cpp
+ *
+ * @brief Trains the state space offline from the encoder logs written by previous robot runs.
+ *
+ * Every run of the learner writes an encoderData-<time>.txt file holding, for each iteration, the time, angle,
+ * velocity and robot state together with the action chosen from that state. This program rebuilds the
+ * transitions \f$(s, a, R(s'), s')\f$ from any number of such logs and runs fitted Q-iteration over the whole
+ * data set,
+ *
+ * \f[ Q_{k+1} (s,a) = Q_k (s,a) + \alpha \left[ \frac{1}{N_{s,a}} \sum_{(s,a,s')} \left( R(s') + \gamma \underset{a'}{max} Q_k(s',a') \right) - Q_k (s,a) \right] \f]
+ *
+ * until the largest change in a sweep falls below a tolerance. Each sweep only reads \f$Q_k\f$, so the
+ * state-action pairs are shared out between threads. The result is written in the serialised state space
+ * format, ready for the robot to load as serializedStateSpaceData.txt.
+ *
+ * Usage:
+ * \verbatim
+ offlinetrainer [-i initial_space] [-o output_space] [-a alpha] [-g gamma] [-t tolerance] [-n max_sweeps] [-j threads] log...
+ * \endverbatim
+ *
+ * @author Machine Learning Team 2015-2016
+ * @date March, 2016
+ */
+
+// Uncomment for use with Visual Studio C++ Compiler
+//#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "StateSpace.h"
+#include "PriorityQueue.h"
+#include "State.h"
+
+/**
+* @brief Gives a std::string representation of a primitive type.
+*
+* @remark Can be used to print priority queue contents.
+* @param x Primitive type such as int, double, long ...
+* @return std::string conversion of param x
+*/
+template<typename T> std::string to_string(T x) {
+	return static_cast<std::ostringstream&>((std::ostringstream() << std::dec << x)).str();
+}
+
+/**
+ * @struct Transition
+ *
+ * @brief A single logged step, with the states replaced by their cell numbers in the state space.
+ */
+struct Transition {
+	size_t cell;
+	size_t action;
+	double reward;
+	size_t next_cell;
+
+	/** @brief Orders transitions by state-action pair, so that each pair forms a contiguous run. */
+	bool operator<(const Transition& other) const {
+		return cell < other.cell || (cell == other.cell && action < other.action);
+	}
+};
+
+/**
+ * @struct SweepJob
+ *
+ * @brief The share of one fitted Q-iteration sweep given to a single thread.
+ */
+struct SweepJob {
+	// state-action pairs [begin, end) of the pair list
+	size_t begin;
+	size_t end;
+
+	// shared, read-only inputs
+	const std::vector<Transition>* transitions;
+	const std::vector<size_t>* pair_starts;
+	const std::vector<double>* q;
+	const std::vector<double>* v;
+	size_t actions;
+	double alpha;
+	double gamma;
+
+	// output, written only by this thread
+	std::vector<double>* q_next;
+	double max_delta;
+};
+
+/**
+ * @brief Performs one thread's share of a sweep, updating every state-action pair in its range.
+ *
+ * @param arg Pointer to the SweepJob describing the range
+ * @return NULL
+ */
+void* sweepWorker(void* arg) {
+	SweepJob& job = *static_cast<SweepJob*>(arg);
+	const std::vector<Transition>& transitions = *job.transitions;
+	const std::vector<size_t>& starts = *job.pair_starts;
+
+	job.max_delta = 0.0;
+	for (size_t p = job.begin; p < job.end; ++p) {
+		// mean of the one step targets over every logged transition from this pair
+		double target = 0.0;
+		for (size_t t = starts[p]; t < starts[p + 1]; ++t)
+			target += transitions[t].reward + job.gamma * (*job.v)[transitions[t].next_cell];
+		target /= (starts[p + 1] - starts[p]);
+
+		size_t index = transitions[starts[p]].cell * job.actions + transitions[starts[p]].action;
+		double oldQ = (*job.q)[index];
+		double newQ = oldQ + job.alpha * (target - oldQ);
+		(*job.q_next)[index] = newQ;
+		job.max_delta = std::max(job.max_delta, std::abs(newQ - oldQ));
+	}
+	return NULL;
+}
+
+/**
+ * @brief Reads the transitions from one log file.
+ *
+ * Lines starting with '#' are skipped, and a line without all five columns breaks the run of transitions. The
+ * angles and velocities of the whole file are discretised in one go, with the same discretisers as the state
+ * space, and a transition is made from each pair of consecutive readable lines. Cell numbers are
+ * (robot_state * angle bins + angle bin) * velocity bins + velocity bin.
+ *
+ * @param path Log file to read
+ * @param space State space whose discretisers give the bin of each state
+ * @param action_index Map from action code to column of the Q table
+ * @param transitions Vector to append the transitions to
+ * @param dropped Incremented for every transition with an unknown action
+ * @return False if the file could not be opened
+ */
+bool readLog(const char* path, const StateSpace& space, const std::map<int, size_t>& action_index,
+	std::vector<Transition>& transitions, unsigned long& dropped) {
+	std::ifstream file(path);
+	if (!file.good())
+		return false;
+
+	// rows of theta, theta_dot, plus the other columns kept separately
+	std::vector<double> states;
+	std::vector<int> robotStates;
+	std::vector<int> actions;
+	std::vector<bool> continues;
+	bool havePrevious = false;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		double time, theta, theta_dot;
+		int robot_state, action;
+		if (!(fields >> time >> theta >> theta_dot >> robot_state >> action) || robot_state < 0 || robot_state > 1) {
+			havePrevious = false;
+			continue;
+		}
+
+		states.push_back(theta);
+		states.push_back(theta_dot);
+		robotStates.push_back(robot_state);
+		actions.push_back(action);
+		continues.push_back(havePrevious);
+		havePrevious = true;
+	}
+
+	const size_t rows = robotStates.size();
+	if (rows == 0)
+		return true;
+
+	std::vector<int> angleBins(rows);
+	std::vector<int> velocityBins(rows);
+	space.getAngleDiscretiser().discretise(&states[0], 2, &angleBins[0], rows);
+	space.getVelocityDiscretiser().discretise(&states[1], 2, &velocityBins[0], rows);
+
+	const size_t angleCount = space.getAngleDiscretiser().getBins();
+	const size_t velocityCount = space.getVelocityDiscretiser().getBins();
+	for (size_t r = 1; r < rows; ++r) {
+		if (!continues[r])
+			continue;
+
+		std::map<int, size_t>::const_iterator column = action_index.find(actions[r - 1]);
+		if (column == action_index.end()) {
+			++dropped;
+			continue;
+		}
+
+		State next(states[2 * r], states[2 * r + 1], static_cast<ROBOT_STATE>(robotStates[r]));
+		Transition transition;
+		transition.cell = (robotStates[r - 1] * angleCount + angleBins[r - 1]) * velocityCount + velocityBins[r - 1];
+		transition.action = column->second;
+		transition.reward = next.getReward();
+		transition.next_cell = (robotStates[r] * angleCount + angleBins[r]) * velocityCount + velocityBins[r];
+		transitions.push_back(transition);
+	}
+	return true;
+}
+
+/**
+ * @brief Program launcher!
+ *
+ * Reads the logs named on the command line, runs fitted Q-iteration on them and writes the resulting state space.
+ *
+ * @return Program exit code
+ */
+int main(int argc, char* argv[]) {
+	const char* initialPath = NULL;
+	const char* outputPath = "serializedStateSpaceData.txt";
+	// fitted Q-iteration takes the full step by default, lower values damp each sweep
+	double alpha = 1.0;
+	// Discount factor, as used on the robot
+	double gamma = 0.5;
+	double tolerance = 1e-6;
+	unsigned long maxSweeps = 1000UL;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int option;
+	while ((option = getopt(argc, argv, "i:o:a:g:t:n:j:")) != -1) {
+		switch (option) {
+		case 'i': initialPath = optarg; break;
+		case 'o': outputPath = optarg; break;
+		case 'a': alpha = std::atof(optarg); break;
+		case 'g': gamma = std::atof(optarg); break;
+		case 't': tolerance = std::atof(optarg); break;
+		case 'n': maxSweeps = std::strtoul(optarg, NULL, 10); break;
+		case 'j': threads = std::atol(optarg); break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-i initial_space] [-o output_space] [-a alpha] [-g gamma]"
+				<< " [-t tolerance] [-n max_sweeps] [-j threads] log..." << std::endl;
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		std::cerr << "No log files given" << std::endl;
+		return 1;
+	}
+	if (threads < 1)
+		threads = 1;
+
+	// the actions and state space must match those in Main.cpp for the robot to load the result
+	PriorityQueue<int, double> initiator_queue(MAX);
+	initiator_queue.enqueueWithPriority(FORWARD, 0.0);
+	initiator_queue.enqueueWithPriority(BACKWARD, 0.0);
+
+	const int angleBins = 100;
+	const int velocityBins = 50;
+	const double angleMax = 0.25*M_PI;
+	const double velocityMax = 1.0;
+	StateSpace space(angleBins, velocityBins, angleMax, velocityMax, initiator_queue);
+
+	// start from a previous state space if one is given
+	if (initialPath) {
+		std::ifstream initialFile(initialPath);
+		try {
+			initialFile >> space;
+		}
+		catch (const std::runtime_error& e) {
+			std::cerr << "Could not load " << initialPath << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	std::map<int, size_t> actionIndex;
+	std::vector<int> actions;
+	for (size_t i = 0; i < initiator_queue.getSize(); ++i) {
+		actionIndex[initiator_queue[i].first] = actions.size();
+		actions.push_back(initiator_queue[i].first);
+	}
+
+	// rebuild the transitions from every log
+	std::vector<Transition> transitions;
+	unsigned long dropped = 0UL;
+	for (int i = optind; i < argc; ++i) {
+		if (!readLog(argv[i], space, actionIndex, transitions, dropped))
+			std::cerr << "Could not read " << argv[i] << std::endl;
+	}
+	if (transitions.empty()) {
+		std::cerr << "No transitions found" << std::endl;
+		return 1;
+	}
+
+	// group the transitions by state-action pair
+	std::sort(transitions.begin(), transitions.end());
+	std::vector<size_t> pairStarts;
+	for (size_t t = 0; t < transitions.size(); ++t) {
+		if (t == 0 || transitions[t - 1] < transitions[t])
+			pairStarts.push_back(t);
+	}
+	const size_t pairs = pairStarts.size();
+	pairStarts.push_back(transitions.size());
+
+	std::cout << "Read " << transitions.size() << " transitions (" << dropped << " dropped) covering "
+		<< pairs << " state-action pairs" << std::endl;
+
+	// dense Q table of every cell, in the cell order used by readLog, starting from the state space values
+	const int angleCount = space.getAngleDiscretiser().getBins();
+	const int velocityCount = space.getVelocityDiscretiser().getBins();
+	std::vector<PriorityQueue<int, double>*> queues;
+	for (unsigned int r = 0; r < 2; ++r) {
+		for (int a = 0; a < angleCount; ++a) {
+			for (int b = 0; b < velocityCount; ++b)
+				queues.push_back(&space.at(r, a, b));
+		}
+	}
+
+	const size_t actionCount = actions.size();
+	std::vector<double> q(queues.size() * actionCount);
+	for (size_t c = 0; c < queues.size(); ++c) {
+		for (size_t a = 0; a < actionCount; ++a)
+			q[c * actionCount + a] = queues[c]->search(actions[a]).second;
+	}
+	std::vector<double> qNext(q);
+	std::vector<double> v(queues.size());
+
+	if (static_cast<size_t>(threads) > pairs)
+		threads = static_cast<long>(pairs);
+	std::vector<pthread_t> workers(threads);
+	std::vector<SweepJob> jobs(threads);
+	for (long k = 0; k < threads; ++k) {
+		jobs[k].begin = pairs * k / threads;
+		jobs[k].end = pairs * (k + 1) / threads;
+		jobs[k].transitions = &transitions;
+		jobs[k].pair_starts = &pairStarts;
+		jobs[k].q = &q;
+		jobs[k].v = &v;
+		jobs[k].actions = actionCount;
+		jobs[k].alpha = alpha;
+		jobs[k].gamma = gamma;
+		jobs[k].q_next = &qNext;
+	}
+
+	std::clock_t start = std::clock();
+	unsigned long sweep = 0UL;
+	double maxDelta = 0.0;
+	for (; sweep < maxSweeps; ++sweep) {
+		// best value of every cell under the current Q table
+		for (size_t c = 0; c < queues.size(); ++c)
+			v[c] = *std::max_element(q.begin() + c * actionCount, q.begin() + (c + 1) * actionCount);
+
+		for (long k = 0; k < threads; ++k)
+			pthread_create(&workers[k], NULL, sweepWorker, &jobs[k]);
+		maxDelta = 0.0;
+		for (long k = 0; k < threads; ++k) {
+			pthread_join(workers[k], NULL);
+			maxDelta = std::max(maxDelta, jobs[k].max_delta);
+		}
+
+		// unvisited pairs are copied across unchanged
+		q = qNext;
+		if (maxDelta < tolerance) {
+			++sweep;
+			break;
+		}
+	}
+
+	std::cout << sweep << " sweeps on " << threads << " threads, last max |dQ| " << maxDelta << ", "
+		<< 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC << " ms CPU" << std::endl;
+
+	// copy the Q table back into the state space queues and save it
+	for (size_t c = 0; c < queues.size(); ++c) {
+		for (size_t a = 0; a < actionCount; ++a)
+			queues[c]->changePriority(actions[a], q[c * actionCount + a]);
+	}
+
+	std::ofstream output(outputPath);
+	output << space;
+	output.close();
+	std::cout << "Wrote " << outputPath << std::endl;
+
+	return 0;
+}
@@ -9,11 +9,6 @@
 
 #include "StateSpace.h"
 
-int StateSpace::angle_bins;
-int StateSpace::velocity_bins;
-double StateSpace::angle_max;
-double StateSpace::velocity_max;
-
 /**
 * Creates a state space object initialised with a given number of bins for discretising angles and
 * velocities of the system. A (const referenced) PriorityQueue instance is passed to the constructor
@@ -21,12 +16,10 @@ double StateSpace::velocity_max;
 * the queue of default initial action(s) and prioritised experience(s).
 */
 StateSpace::StateSpace(int _angle_bins, int _velocity_bins, double _angle_max, double _velocity_max, const PriorityQueue<int, double>& queue) :
+	angle(_angle_bins, _angle_max),
+	velocity(_velocity_bins, _velocity_max),
 	space1(_angle_bins, std::vector< PriorityQueue<int, double> >(_velocity_bins, PriorityQueue<int, double>(queue))),
 	space2(_angle_bins, std::vector< PriorityQueue<int, double> >(_velocity_bins, PriorityQueue<int, double>(queue))) {
-	angle_bins = _angle_bins - 1;
-	velocity_bins = _velocity_bins - 1;
-	angle_max = _angle_max;
-	velocity_max = _velocity_max;
 }
 
 /**
@@ -42,7 +35,7 @@ StateSpace::SubscriptProxy1 StateSpace::operator[](const unsigned int robot_stat
 	//throw if the the index is out of bounds
 	if (robot_state>1)throw std::domain_error("action index exceeded");
 	//return proxy object to accept second [] operator
-	return SubscriptProxy1(robot_state ? space1 : space2);
+	return SubscriptProxy1(*this, robot_state ? space1 : space2);
 }
 
 /**
@@ -58,3 +51,12 @@ PriorityQueue<int, double>& StateSpace::operator[](const State & state) {
 	//call the subscript operators with the members of the state object
 	return (*this)[state.robot_state][state.theta][state.theta_dot];
 }
+
+/**
+* Cells are numbered in the order streamInsertion writes them: all of robot state 1 (space1), then all
+* of robot state 0, each angle bin in turn.
+*/
+std::size_t StateSpace::cell(const State & state) const {
+	const std::size_t block = state.robot_state ? 0 : 1;
+	return (block * angle.getBins() + angle(state.theta)) * velocity.getBins() + velocity(state.theta_dot);
+}
@@ -17,6 +17,7 @@
 #include <fstream>
 #include "PriorityQueue.h"
 #include "State.h"
+#include "Discretiser.h"
 
 //index with state_space_object[robot_state][angle][velocity]
 //   or with state_space_object[state_object]
@@ -31,6 +32,9 @@
 * actions and experiences. Primarily uses a 2-dimensional std::vector container storing PriorityQueue
 * instances which in turn hold the actions and prioritised experiences at each state of the system.
 *
+* Angles and velocities are turned into indices by a Discretiser each, so out-of-range values are
+* clamped into the end bins rather than causing an error.
+*
 * @author Machine Learning Team 2015-2016
 * @date February, 2016
 */
@@ -42,6 +46,8 @@ public:
 	*
 	* @param _angle_bins The number of bins for angles of the system space
 	* @param _velocity_bins The number of bins for velocity of the system space
+	* @param _angle_max The largest absolute angle, mapped to the end bins
+	* @param _velocity_max The largest absolute velocity, mapped to the end bins
 	* @param queue A PriorityQueue instance (referenced to avoid copying) containing initial (default) action and experience.
 	*/
 	explicit StateSpace(int _angle_bins, int _velocity_bins, double _angle_max, double _velocity_max, const PriorityQueue<int, double>& queue);
@@ -62,32 +68,23 @@ public:
 		/**
 		 * @brief Constructor, initialises vec field to argument.
 		 *
+		 * @param _discretiser Discretiser for the velocity
 		 * @param _vec std::vector containing PriorityQueue instance to initialise object with
 		 */
-		SubscriptProxy2(std::vector< PriorityQueue<int, double> >& _vec) :vec(_vec) {}
+		SubscriptProxy2(const Discretiser& _discretiser, std::vector< PriorityQueue<int, double> >& _vec) :discretiser(_discretiser), vec(_vec) {}
 
 		/**
 		 * @brief Overloaded subscript operator.
 		 *
-		 * @param velocity Velocity index to find
+		 * @param velocity Velocity to find, clamped to the end bins if |velocity| exceeds velocity_max
 		 * @return Reference to PriorityQueue instance at index of state space
-		 * @throw Throws std::domain_error exception if |velocity| exceeds velocity_max
-		 * @exceptionsafety Strong-Guarantee - if an exception is thrown there are no changes in the container.
 		 */
 		PriorityQueue<int, double>& operator[](const double velocity) {
-			//error if angle exceeds bounds
-			if (std::abs(velocity)>velocity_max)throw std::domain_error("velocity argument exceeded");
-
-			//get the coefficient
-			double coef = 0.5*velocity_bins;
-
-			//descretise index
-			int discrete_index = static_cast<int>(round(coef*(1 + velocity / velocity_max)));
-
 			//return appropriate array
-			return vec[discrete_index];
+			return vec[discretiser(velocity)];
 		}
 	private:
+		const Discretiser& discretiser;
 		std::vector< PriorityQueue<int, double> >& vec;
 	};
 
@@ -103,33 +100,24 @@ public:
 		/**
 		 * @brief Constructor, initialises vec field to argument.
 		 *
+		 * @param _parent StateSpace the proxy belongs to, for its discretisers
 		 * @param _vec std::vector of std::vectors containing PriorityQueue instance to initialise object with
 		 */
-		SubscriptProxy1(std::vector< std::vector< PriorityQueue<int, double> > >& _vec) :vec(_vec) {}
+		SubscriptProxy1(const StateSpace& _parent, std::vector< std::vector< PriorityQueue<int, double> > >& _vec) :parent(_parent), vec(_vec) {}
 
 		/**
 		 * @brief Overloaded subscript operator.
 		 *
-		 * @param angle Angle index to find
+		 * @param angle Angle to find, clamped to the end bins if |angle| exceeds angle_max
 		 * @return A SubscriptProxy2 object corresponding to angle index
-		 * @throw Throws std::domain_error exception if |angle| exceeds angle_max
-		 * @exceptionsafety Strong-Guarantee - if an exception is thrown there are no changes in the container.
 		 */
 		SubscriptProxy2 operator[](const double angle) {
-			//throw if angle exceeds bounds
-			if (std::abs(angle) > angle_max)throw std::domain_error("angle argument exceeded");
-
-			//get the coefficient
-			double coef = 0.5*angle_bins;
-
-			//descretise index
-			int discrete_index = static_cast<int>(round(coef*(1 + angle / angle_max)));
-
 			//return appropriate object
-			return SubscriptProxy2(vec[discrete_index]);
+			return SubscriptProxy2(parent.velocity, vec[parent.angle(angle)]);
 		}
 
 	private:
+		const StateSpace& parent;
 		std::vector< std::vector< PriorityQueue<int, double> > >& vec;
 	};
 	//---------------------------------------------------------------------------------------------------------
@@ -154,47 +142,117 @@ public:
 	*/
 	PriorityQueue<int, double>& operator[](const State & state);
 
+	/**
+	* @brief Gives the index of the queue a state falls in, e.g. for ConvergenceMonitor.
+	*
+	* @param state Constant reference to a State object
+	* @return Index in [0, 2 * angle bins * velocity bins), the cells of robot state 1 first
+	*/
+	std::size_t cell(const State & state) const;
+
+	/**
+	* @brief Accesses a queue by its bin indices, as given by the discretisers.
+	*
+	* @param robot_state Robot state indexing variable (0 or 1)
+	* @param angle_index Angle bin, in [0, angle bins)
+	* @param velocity_index Velocity bin, in [0, velocity bins)
+	* @return Reference to PriorityQueue object contained at this location in state space
+	*/
+	PriorityQueue<int, double>& at(const unsigned int robot_state, const int angle_index, const int velocity_index) {
+		return (robot_state ? space1 : space2)[angle_index][velocity_index];
+	}
+
+	/** @brief Discretiser used for the angle. */
+	const Discretiser& getAngleDiscretiser() const { return angle; }
+
+	/** @brief Discretiser used for the velocity. */
+	const Discretiser& getVelocityDiscretiser() const { return velocity; }
+
 	/**
 	 * @brief Insert state space object data into an output stream instance
 	 *
+	 * The data is written as a header line giving the number of angle and velocity bins and the two limits,
+	 * followed by one block per cell (all cells of the first robot state, then all of the second) of the form,
+	 *
+	 * \verbatim
+	 [queue size] + "\n"
+	 [action1] + "\t" + [priority1] + "\n"
+	 ...
+	 * \endverbatim
+	 *
+	 * so that streamExtraction can read it back exactly.
+	 *
 	 * @param stream std::ostream reference to send state space data to
 	 * @param space State space instance to write to std::ostream object
 	 * @param Reference to std::ostream instance containing contents of state space
 	 */
 	static std::ostream& streamInsertion(std::ostream& stream, const StateSpace& space) {
-		for (unsigned short i = 0; i<StateSpace::angle_bins; ++i) {
-			for (unsigned short j = 0; j<StateSpace::angle_bins; ++j) {
-				stream << space.space1[i][j];
-				stream << space.space2[i][j];
+		// enough digits for the priorities to survive a round trip
+		std::streamsize oldPrecision = stream.precision(17);
+
+		stream << space.space1.size() << "\t" << space.space1[0].size() << "\t"
+			<< space.angle.getMax() << "\t" << space.velocity.getMax() << "\n";
+
+		const std::vector< std::vector< PriorityQueue<int, double> > >* spaces[2] = { &space.space1, &space.space2 };
+		for (unsigned short k = 0; k < 2; ++k) {
+			for (size_t i = 0; i < spaces[k]->size(); ++i) {
+				for (size_t j = 0; j < (*spaces[k])[i].size(); ++j) {
+					stream << (*spaces[k])[i][j].getSize() << "\n";
+					stream << (*spaces[k])[i][j];
+				}
 			}
 		}
+
+		stream.precision(oldPrecision);
 		return stream;
 	}
 
 	/**
 	 * @brief Extract data from an input stream and write into a state space object
 	 *
+	 * Reads the format written by streamInsertion, replacing the contents of every queue.
+	 *
 	 * @param stream std::istream reference to retrieve data from
 	 * @param space State space instance to save data from std::istream object to
 	 * @return Reference to std::istream instance containing contents of state space
+	 * @throw Throws std::runtime_error if the stored dimensions or limits differ from those of space,
+	 *		  or if the data ends early
+	 * @exceptionsafety Strong-Guarantee - if an exception is thrown there are no changes in the container.
 	 */
 	static std::istream& streamExtraction(std::istream& stream, StateSpace& space) {
-		int action1 = 0;
-		double priority1 = 0;
-		int action2 = 0;
-		double priority2 = 0;
-
-		for (unsigned short i = 0; i<StateSpace::angle_bins; ++i) {
-			for (unsigned short j = 0; j<StateSpace::angle_bins; ++j) {
-				stream >> action1;
-				stream >> priority1;
-				stream >> action2;
-				stream >> priority2;
-
-				space.space1[i][j].enqueueWithPriority(action1, priority1);
-				space.space2[i][j].enqueueWithPriority(action2, priority2);
+		size_t angleBins = 0;
+		size_t velocityBins = 0;
+		double angleMax = 0.0;
+		double velocityMax = 0.0;
+
+		stream >> angleBins >> velocityBins >> angleMax >> velocityMax;
+		if (!stream || angleBins != space.space1.size() || velocityBins != space.space1[0].size()
+			|| std::abs(angleMax - space.angle.getMax()) > 1e-9 || std::abs(velocityMax - space.velocity.getMax()) > 1e-9)
+			throw std::runtime_error("state space data does not match state space dimensions");
+
+		// read into copies so that space is untouched if the data is bad
+		std::vector< std::vector< PriorityQueue<int, double> > > spaces[2] = { space.space1, space.space2 };
+		for (unsigned short k = 0; k < 2; ++k) {
+			for (size_t i = 0; i < spaces[k].size(); ++i) {
+				for (size_t j = 0; j < spaces[k][i].size(); ++j) {
+					size_t size = 0;
+					stream >> size;
+					PriorityQueue<int, double>& queue = spaces[k][i][j];
+					queue.clear();
+					for (size_t n = 0; n < size; ++n) {
+						int action = 0;
+						double priority = 0.0;
+						stream >> action >> priority;
+						queue.enqueueWithPriority(action, priority);
+					}
+					if (!stream)
+						throw std::runtime_error("state space data ended early");
+				}
 			}
 		}
+
+		space.space1.swap(spaces[0]);
+		space.space2.swap(spaces[1]);
 		return stream;
 	}
 
@@ -214,13 +272,9 @@ private:
 	*/
 	StateSpace(const StateSpace&);
 
-	//the sizes of the two arrays
-	static int angle_bins;
-	static int velocity_bins;
-
-	//the max absolute values of the dimensions
-	static double angle_max;
-	static double velocity_max;
+	//discretisers for the two dimensions, holding their sizes and max absolute values
+	Discretiser angle;
+	Discretiser velocity;
 
 	//the 2d array that contains the robots previous experiences in each state
 	std::vector< std::vector< PriorityQueue<int, double> > > space1;
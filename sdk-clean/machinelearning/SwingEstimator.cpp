@@ -0,0 +1,347 @@
+/**
+ * @file SwingEstimator.cpp
+ *
+ * @brief Implementation file for the SwingEstimator class.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#include "SwingEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+
+/// Longest step the pendulum model is integrated over, in seconds.
+static const double MAX_STEP = 0.01;
+
+/// Spread of the state before the first reading: a quarter turn, and 2 radians/sec.
+static const double PRIOR_THETA_SD = 0.5 * M_PI;
+static const double PRIOR_THETA_DOT_SD = 2.0;
+
+/**
+ * @brief Current CLOCK_MONOTONIC time, in seconds.
+ */
+static double monotonicTime() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/**
+ * @brief An angle brought into -pi to pi.
+ */
+static double wrapAngle(double angle) {
+	return angle - 2.0 * M_PI * std::floor((angle + M_PI) / (2.0 * M_PI));
+}
+
+SwingEstimator::SwingEstimator(double length, double damping, double accelerationSd, double lag) :
+	gOverL(9.81 / length),
+	damping(damping),
+	q(accelerationSd * accelerationSd),
+	lag(lag),
+	gate(5.0),
+	count(0),
+	clockOffset(HUGE_VAL),
+	lock(0),
+	sequence(0),
+	rate(0),
+	running(0) {
+	pthread_mutex_init(&mutex, NULL);
+	std::memset(&checkpoint, 0, sizeof(checkpoint));
+	current = checkpoint;
+	std::memset(used, 0, sizeof(used));
+	std::memset(rejected, 0, sizeof(rejected));
+	std::memset(late, 0, sizeof(late));
+	for (int i = 0; i < 6; ++i)
+		published[i] = 0;
+
+	const SwingSensor encoder = { 0, 1.0, 0.0, 0.002, 0.0 };
+	const SwingSensor gyroscope = { 1, 1.0, 0.0, 0.05, 0.01 };
+	const SwingSensor landmark = { 0, -1.0, 0.0, 0.02, 0.1 };
+	sensors[ENCODER] = encoder;
+	sensors[GYROSCOPE] = gyroscope;
+	sensors[LANDMARK] = landmark;
+}
+
+SwingEstimator::~SwingEstimator() {
+	Stop();
+	pthread_mutex_destroy(&mutex);
+}
+
+void SwingEstimator::SetSensor(Sensor sensor, const SwingSensor& model) {
+	pthread_mutex_lock(&mutex);
+	sensors[sensor] = model;
+	pthread_mutex_unlock(&mutex);
+}
+
+SwingSensor SwingEstimator::GetSensor(Sensor sensor) const {
+	pthread_mutex_lock(&mutex);
+	SwingSensor model = sensors[sensor];
+	pthread_mutex_unlock(&mutex);
+	return model;
+}
+
+void SwingEstimator::SetGate(double sds) {
+	pthread_mutex_lock(&mutex);
+	gate = sds;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * The readings are kept in time order. One that comes after all the others, the usual case,
+ * only needs the current filter moved on to it; one that lands among them has the filter run
+ * again from the checkpoint.
+ */
+bool SwingEstimator::Add(Sensor sensor, double time, double value) {
+	const double arrival = monotonicTime();
+	pthread_mutex_lock(&mutex);
+	Reading reading;
+	reading.time = time - sensors[sensor].latency;
+	reading.value = value;
+	reading.sensor = sensor;
+	if (arrival - time < clockOffset)
+		clockOffset = arrival - time;
+
+	// make room by folding the oldest reading in early
+	if (count == MAX_PENDING) {
+		Correct(checkpoint, pending[0]);
+		std::memmove(pending, pending + 1, (count - 1) * sizeof(Reading));
+		--count;
+	}
+	if (checkpoint.started && reading.time < checkpoint.t) {
+		++late[sensor];
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+
+	std::size_t i = count;
+	while (i > 0 && pending[i - 1].time > reading.time) {
+		pending[i] = pending[i - 1];
+		--i;
+	}
+	pending[i] = reading;
+	++count;
+
+	bool accepted;
+	if (i == count - 1) {
+		accepted = Correct(current, reading);
+	}
+	else {
+		current = checkpoint;
+		accepted = false;
+		for (std::size_t j = 0; j < count; ++j) {
+			bool ok = Correct(current, pending[j]);
+			if (j == i)
+				accepted = ok;
+		}
+	}
+	if (accepted)
+		++used[sensor];
+	else
+		++rejected[sensor];
+
+	Advance();
+	pthread_mutex_unlock(&mutex);
+	return accepted;
+}
+
+void SwingEstimator::Advance() {
+	const double oldest = pending[count - 1].time - lag;
+	std::size_t folded = 0;
+	while (folded < count && pending[folded].time < oldest)
+		Correct(checkpoint, pending[folded++]);
+	if (folded > 0) {
+		std::memmove(pending, pending + folded, (count - folded) * sizeof(Reading));
+		count -= folded;
+	}
+}
+
+/**
+ * The pendulum is integrated in steps of at most MAX_STEP, each moving the covariance on with
+ * the model's Jacobian and adding the random acceleration's share,
+ *
+ * \f[ P \leftarrow F P F^T + q \left( \begin{array}{cc} h^3/3 & h^2/2 \\ h^2/2 & h \end{array} \right) \f]
+ */
+void SwingEstimator::Propagate(Filter& filter, double time) const {
+	while (filter.t < time) {
+		const double h = std::min(MAX_STEP, time - filter.t);
+		const double theta = filter.x[0], thetaDot = filter.x[1];
+		const double acceleration = -gOverL * std::sin(theta) - damping * thetaDot;
+
+		// F = [1, h; f10, f11]
+		const double f10 = -gOverL * std::cos(theta) * h;
+		const double f11 = 1.0 - damping * h;
+		const double p00 = filter.P[0][0], p01 = filter.P[0][1], p11 = filter.P[1][1];
+		const double a00 = p00 + h * p01, a01 = p01 + h * p11;		// first row of F P
+		const double a10 = f10 * p00 + f11 * p01, a11 = f10 * p01 + f11 * p11;
+
+		filter.P[0][0] = a00 + h * a01 + q * h * h * h / 3.0;
+		filter.P[0][1] = filter.P[1][0] = f10 * a00 + f11 * a01 + q * h * h / 2.0;
+		filter.P[1][1] = f10 * a10 + f11 * a11 + q * h;
+
+		filter.x[0] = theta + thetaDot * h + 0.5 * acceleration * h * h;
+		filter.x[1] = thetaDot + acceleration * h;
+		filter.t += h;
+	}
+}
+
+/**
+ * Every reading is of one component of the state, so the update is scalar: with \f$ s \f$ the
+ * scale and \f$ c \f$ the component, \f$ S = s^2 P_{cc} + R \f$ and \f$ K = s P_{\cdot c} / S \f$.
+ */
+bool SwingEstimator::Correct(Filter& filter, const Reading& reading) const {
+	if (!filter.started) {
+		filter.x[0] = filter.x[1] = 0;
+		filter.P[0][0] = PRIOR_THETA_SD * PRIOR_THETA_SD;
+		filter.P[1][1] = PRIOR_THETA_DOT_SD * PRIOR_THETA_DOT_SD;
+		filter.P[0][1] = filter.P[1][0] = 0;
+		filter.t = reading.time;
+		filter.started = true;
+	}
+	else {
+		Propagate(filter, reading.time);
+	}
+
+	const SwingSensor& model = sensors[reading.sensor];
+	const int c = model.component;
+	double innovation = reading.value - (model.scale * filter.x[c] + model.offset);
+	if (c == 0)
+		innovation = wrapAngle(innovation);
+	const double S = model.scale * model.scale * filter.P[c][c] + model.sd * model.sd;
+	if (innovation * innovation > gate * gate * S)
+		return false;
+
+	const double PHt[2] = { model.scale * filter.P[0][c], model.scale * filter.P[1][c] };
+	const double K[2] = { PHt[0] / S, PHt[1] / S };
+	filter.x[0] += K[0] * innovation;
+	filter.x[1] += K[1] * innovation;
+	filter.P[0][0] -= K[0] * PHt[0];
+	filter.P[0][1] -= K[0] * PHt[1];
+	filter.P[1][0] = filter.P[0][1];
+	filter.P[1][1] -= K[1] * PHt[1];
+	return true;
+}
+
+double SwingEstimator::ReadingsNow() const {
+	const double now = monotonicTime();
+	return clockOffset == HUGE_VAL ? now : now - clockOffset;
+}
+
+void SwingEstimator::PredictLocked(double time, SwingState& state) const {
+	Filter filter = current;
+	Propagate(filter, time);
+	state.theta = wrapAngle(filter.x[0]);
+	state.thetaDot = filter.x[1];
+	state.time = filter.t;
+	state.varTheta = filter.P[0][0];
+	state.covariance = filter.P[0][1];
+	state.varThetaDot = filter.P[1][1];
+}
+
+bool SwingEstimator::Predict(double time, SwingState& state) {
+	pthread_mutex_lock(&mutex);
+	const bool started = current.started;
+	if (started)
+		PredictLocked(time, state);
+	pthread_mutex_unlock(&mutex);
+	state.sequence = sequence;
+	return started;
+}
+
+bool SwingEstimator::PredictNow(SwingState& state) {
+	pthread_mutex_lock(&mutex);
+	const double now = ReadingsNow();
+	pthread_mutex_unlock(&mutex);
+	return Predict(now, state);
+}
+
+void SwingEstimator::GetCounts(Sensor sensor, unsigned long& used, unsigned long& rejected, unsigned long& late) const {
+	pthread_mutex_lock(&mutex);
+	used = this->used[sensor];
+	rejected = this->rejected[sensor];
+	late = this->late[sensor];
+	pthread_mutex_unlock(&mutex);
+}
+
+bool SwingEstimator::Start(double rate) {
+	if (running || rate <= 0)
+		return false;
+	this->rate = rate;
+	running = 1;
+	if (pthread_create(&thread, NULL, Run, this) != 0) {
+		running = 0;
+		return false;
+	}
+	return true;
+}
+
+void SwingEstimator::Stop() {
+	if (running) {
+		running = 0;
+		pthread_join(thread, NULL);
+	}
+}
+
+void SwingEstimator::Publish(const SwingState& state) {
+	// odd while writing, as in Encoder::Publish
+	__sync_fetch_and_add(&lock, 1UL);
+	published[0] = state.theta;
+	published[1] = state.thetaDot;
+	published[2] = state.time;
+	published[3] = state.varTheta;
+	published[4] = state.covariance;
+	published[5] = state.varThetaDot;
+	sequence = sequence + 1;
+	__sync_fetch_and_add(&lock, 1UL);
+}
+
+bool SwingEstimator::GetState(SwingState& state) const {
+	unsigned long before, after;
+	do {
+		before = lock;
+		__sync_synchronize();
+		state.theta = published[0];
+		state.thetaDot = published[1];
+		state.time = published[2];
+		state.varTheta = published[3];
+		state.covariance = published[4];
+		state.varThetaDot = published[5];
+		state.sequence = sequence;
+		__sync_synchronize();
+		after = lock;
+	} while ((before & 1UL) || before != after);
+	return state.sequence > 0;
+}
+
+void* SwingEstimator::Run(void* estimator) {
+	SwingEstimator& self = *static_cast<SwingEstimator*>(estimator);
+
+	// absolute deadlines, as in Encoder::ReadAngle
+	const long period = static_cast<long>(1e9 / self.rate);
+	timespec next, now;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (self.running) {
+		next.tv_nsec += period;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			++next.tv_sec;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+			next = now;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {}
+
+		SwingState state;
+		pthread_mutex_lock(&self.mutex);
+		const bool started = self.current.started;
+		if (started)
+			self.PredictLocked(self.ReadingsNow(), state);
+		pthread_mutex_unlock(&self.mutex);
+		if (started)
+			self.Publish(state);
+	}
+	return NULL;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file SwingEstimator.h
+ *
+ * @brief Interface file for the SwingEstimator class, which fuses the swing's sensors into one state.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+
+#ifndef SWING_ESTIMATOR_H
+#define SWING_ESTIMATOR_H
+
+#include <cstddef>
+#include <pthread.h>
+
+/**
+ * @struct SwingState
+ *
+ * @brief The fused state of the swing, with its uncertainty.
+ */
+struct SwingState {
+	double theta;			///< Angle in radians, -pi to pi.
+	double thetaDot;		///< Angular velocity in radians/sec.
+	double time;			///< Time the state is for, in seconds on the readings' clock.
+	double varTheta;		///< Variance of theta.
+	double covariance;		///< Covariance of theta and thetaDot.
+	double varThetaDot;		///< Variance of thetaDot.
+	unsigned long sequence;		///< Number of states published so far, 1 for the first.
+};
+
+/**
+ * @struct SwingSensor
+ *
+ * @brief How one sensor's readings relate to the state: value = scale * state[component] + offset.
+ */
+struct SwingSensor {
+	int component;			///< 0 if the sensor reads the angle, 1 if the angular velocity.
+	double scale;			///< -1 for a sensor that reads the other way.
+	double offset;			///< Reading at zero angle (or velocity).
+	double sd;			///< Standard deviation of the readings' noise.
+	double latency;			///< Seconds between what is read and the time given with the reading.
+};
+
+/**
+ * @class SwingEstimator
+ *
+ * @brief Extended Kalman filter over the swing's angle and angular velocity.
+ *
+ * The process model is a damped pendulum, with the robot's pumping taken as random angular
+ * acceleration. Readings from the encoder, the NAO's gyroscope and landmark bearings from the
+ * camera can be added from any thread, in any combination and at their own rates, each with
+ * the time it was taken. Readings arriving late or out of order are put in their place: the
+ * filter keeps the last lag seconds of readings and, when one lands among them, runs again from
+ * a checkpoint before it. Older readings are dropped and counted as late. A reading further
+ * from its prediction than the gate allows (in standard deviations) is rejected, which keeps
+ * encoder glitches and misidentified landmarks out.
+ *
+ * Start runs a thread that publishes the state, predicted forward to the present so that the
+ * sensors' latencies are made up, at a fixed rate; GetState reads it through a sequence lock
+ * and never waits. Reading times can be on any clock that runs at the rate of CLOCK_MONOTONIC
+ * (such as the simulated board's): the present on that clock is taken to be the shortest delay
+ * yet seen between a reading's time and its arrival.
+ *
+ * All the matrices are 2x2 and the readings kept are a fixed array, so nothing is allocated
+ * once the estimator is constructed.
+ *
+ * @author Coding and Machine Learning Teams 2015-2016
+ * @date March, 2016
+ */
+class SwingEstimator {
+public:
+
+	/// The sensors readings can come from.
+	enum Sensor {
+		ENCODER,		///< Encoder angle, calibrated, in radians.
+		GYROSCOPE,		///< GyroscopeY from ALMemory, in radians/sec.
+		LANDMARK,		///< Landmark angleY from CameraTools::getLandmark, in radians.
+		SENSORS
+	};
+
+	/// Readings kept for putting late ones in their place.
+	static const std::size_t MAX_PENDING = 128;
+
+	/**
+	 * @brief Creates an estimator with the default sensor models, knowing nothing of the state.
+	 *
+	 * @param length Length of the pendulum in metres.
+	 * @param damping Damping rate in 1/sec.
+	 * @param accelerationSd Standard deviation of the unmodelled angular acceleration, in
+	 *		  radians/sec^2 per root second.
+	 * @param lag Longest a reading can be late and still be used, in seconds.
+	 */
+	explicit SwingEstimator(double length = 1.0, double damping = 0.05, double accelerationSd = 0.5, double lag = 0.5);
+
+	/**
+	 * @brief Destructor, stops the publishing thread.
+	 */
+	~SwingEstimator();
+
+	/**
+	 * @brief Sets how a sensor's readings relate to the state.
+	 *
+	 * The defaults read the encoder angle directly (sd 0.002 rad), the gyroscope as the angular
+	 * velocity (sd 0.05 rad/s, 10 ms late) and landmark bearings as the negative angle (sd
+	 * 0.02 rad, 100 ms late), with no offsets.
+	 */
+	void SetSensor(Sensor sensor, const SwingSensor& model);
+
+	/**
+	 * @brief Gets how a sensor's readings relate to the state.
+	 */
+	SwingSensor GetSensor(Sensor sensor) const;
+
+	/**
+	 * @brief Sets how far, in standard deviations, a reading may be from its prediction.
+	 */
+	void SetGate(double sds);
+
+	/**
+	 * @brief Adds a reading.
+	 *
+	 * @param sensor Where the reading came from.
+	 * @param time When it was taken, in seconds (less the sensor's latency).
+	 * @param value The reading.
+	 * @return false if it was too late or was rejected.
+	 */
+	bool Add(Sensor sensor, double time, double value);
+
+	/**
+	 * @brief Starts publishing the state.
+	 *
+	 * @param rate States per second.
+	 * @return false if the thread could not be started.
+	 */
+	bool Start(double rate = 100.0);
+
+	/**
+	 * @brief Stops publishing the state.
+	 */
+	void Stop();
+
+	/**
+	 * @brief Gets the latest published state.
+	 *
+	 * @param state Set to the state.
+	 * @return false if none has been published with readings behind it.
+	 */
+	bool GetState(SwingState& state) const;
+
+	/**
+	 * @brief Predicts the state at a time, from all the readings so far.
+	 *
+	 * @param time Time on the readings' clock, in seconds.
+	 * @param state Set to the prediction (its sequence is that of the latest published state).
+	 * @return false if there have been no readings.
+	 */
+	bool Predict(double time, SwingState& state);
+
+	/**
+	 * @brief Predicts the state now, from all the readings so far.
+	 */
+	bool PredictNow(SwingState& state);
+
+	/**
+	 * @brief Gets the number of a sensor's readings used, rejected by the gate, and too late.
+	 */
+	void GetCounts(Sensor sensor, unsigned long& used, unsigned long& rejected, unsigned long& late) const;
+
+private:
+	/**
+	 * @brief Mean and covariance at a time.
+	 */
+	struct Filter {
+		double x[2];
+		double P[2][2];
+		double t;
+		bool started;
+	};
+
+	/**
+	 * @brief One reading waiting in case an earlier one arrives.
+	 */
+	struct Reading {
+		double time;
+		double value;
+		int sensor;
+	};
+
+	/**
+	 * @brief Publishing thread, publishes the predicted state every 1 / rate seconds until stopped.
+	 */
+	static void* Run(void* estimator);
+
+	/**
+	 * @brief Moves a filter forward to a time with the pendulum model.
+	 */
+	void Propagate(Filter& filter, double time) const;
+
+	/**
+	 * @brief Moves a filter to a reading's time and corrects it with the reading.
+	 *
+	 * @return false if the reading was rejected.
+	 */
+	bool Correct(Filter& filter, const Reading& reading) const;
+
+	/**
+	 * @brief Folds the readings older than the lag into the checkpoint. Lock held.
+	 */
+	void Advance();
+
+	/**
+	 * @brief Predicts the state at a time. Lock held.
+	 */
+	void PredictLocked(double time, SwingState& state) const;
+
+	/**
+	 * @brief The present on the readings' clock. Lock held.
+	 */
+	double ReadingsNow() const;
+
+	/**
+	 * @brief Copies a state out through the sequence lock.
+	 */
+	void Publish(const SwingState& state);
+
+	double gOverL;
+	double damping;
+	double q;			///< Variance of the angular acceleration per second.
+	double lag;
+	double gate;
+	SwingSensor sensors[SENSORS];
+
+	mutable pthread_mutex_t mutex;	///< Guards everything below, up to the published state.
+	Filter checkpoint;		///< With every reading older than those pending.
+	Filter current;			///< With every reading.
+	Reading pending[MAX_PENDING];	///< In time order.
+	std::size_t count;
+	double clockOffset;		///< Shortest delay seen from a reading's time to its arrival.
+	unsigned long used[SENSORS];
+	unsigned long rejected[SENSORS];
+	unsigned long late[SENSORS];
+
+	// latest published state, guarded by the sequence lock: odd while the publisher writes it
+	volatile unsigned long lock;
+	volatile double published[6];
+	volatile unsigned long sequence;
+
+	double rate;
+	volatile int running;
+	pthread_t thread;
+};
+
+#endif // SWING_ESTIMATOR_H
@@ -8,93 +8,360 @@
  */
 
 #include "encoder.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
 
 /**
- * Creates an encoder instance with cal field initialised to zero and the libusb_device_handle pointer
- * initialised with call to pmd_find_first. If multi-threading is enabled, a mutex is initialised 
- * and a POSIX thread is created here.
+ * @brief Current CLOCK_MONOTONIC time, unaffected by changes to the wall clock.
+ *
+ * @return Time in seconds.
+ */
+static double monotonicTime() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/**
+ * Creates an encoder instance with cal field initialised to zero, reading from the encoder daemon if it
+ * is running, and otherwise with the libusb_device_handle pointer initialised with call to
+ * pmd_find_first. One reading is taken straight away, so that there is always a reading to return, and
+ * then the stream and the sampling thread, which polls if there is no stream, are started if a rate was given.
  */
-Encoder::Encoder() :
+Encoder::Encoder(double rate, std::size_t window, int depth, bool attach) :
 	cal(0),
-	handle(pmd_find_first()) {
-	//  thread_mutex_init(&mut, NULL);
-	//  pthread_create(&thread, NULL, ReadAngle, NULL);
+	rate(rate),
+	depth(depth),
+	handle(NULL),
+	retryTime(0),
+	history(window),
+	lastTime(-1),
+	lock(0),
+	actual_angle(0),
+	velocity(0),
+	acceleration(0),
+	time(0),
+	sequence(0),
+	lostAt(0),
+	recorder(NULL),
+	estimator(NULL),
+	publisher(NULL),
+	daemonGone(0),
+	takenElsewhere(0),
+	stream(NULL),
+	running(0) {
+	pthread_mutex_init(&timingLock, NULL);
+	std::memset(&timing, 0, sizeof(timing));
+
+	const char* name = std::getenv("ENCODER_SHM");
+	if (name == NULL)
+		name = ENCODER_SHARED_NAME;
+	if (attach && *name != '\0' && shared.Open(name)) {
+		if (shared.IsAlive()) {
+			shared.Cursor(cursor);
+			if (rate > 0) {
+				running = 1;
+				if (pthread_create(&thread, NULL, ReadAngle, this) != 0) {
+					std::cerr << "Encoder: could not start the following thread, following on each call instead" << std::endl;
+					running = 0;
+					this->rate = 0;
+				}
+			}
+			return;
+		}
+		// kept mapped, for its lock on taking the device over
+		std::cerr << "Encoder: the encoder daemon has stopped, opening the device" << std::endl;
+		daemonGone = 1;
+		if (!TakeDevice() && !takenElsewhere)
+			std::cerr << "Encoder: no PMD1208FS found, trying again each second" << std::endl;
+	}
+	else if (!OpenDevice()) {
+		std::cerr << "Encoder: no PMD1208FS found" << std::endl;
+		return;
+	}
+	if (rate > 0) {
+		running = 1;
+		if (pthread_create(&thread, NULL, ReadAngle, this) != 0) {
+			std::cerr << "Encoder: could not start the sampling thread, reading on each call instead" << std::endl;
+			running = 0;
+			this->rate = 0;
+		}
+	}
 }
 
 /**
- * Destroys encoder object, if multi-threading is enabled the mutex field is destroyed here.
+ * Destroys encoder object, stopping the sampling thread before the device is closed. The thread
+ * goes first, as it may start the stream itself if the daemon it was following stops, or stop it and
+ * open the device again.
  */
 Encoder::~Encoder()
 {
-//pthread_mutex_destroy(&mut);
+	if (running) {
+		running = 0;
+		pthread_join(thread, NULL);
+	}
+	if (stream != NULL)
+		pmd_digin_stop(stream);
+	if (std::getenv("PMD_STATS") != NULL) {
+		pmd_histogram_print(stderr, "encoder interval", &timing.interval);
+		pmd_histogram_print(stderr, "encoder latency", &timing.latency);
+	}
+	// the library prints its own statistics as the device closes
+	if (handle != NULL)
+		pmd_close(handle);
+	pthread_mutex_destroy(&timingLock);
 }
 
 float Encoder::GetAngle() {
-	unsigned int a;//, c;
+	EncoderSample sample;
+	GetSample(sample);
+	return sample.angle;
+}
 
-	a = pmd_digin16(handle);
-	raw_angle = a & (2047);
-	//  std::cout << raw_angle << "\t";
-	actual_angle = raw_angle*(360.0 / 2048.0);
+float Encoder::GetVelocity() {
+	EncoderSample sample;
+	GetSample(sample);
+	return sample.velocity;
+}
 
-	//  unsigned int a, b, c;
-	//  a = pmd_digin(handle, 0);
-	//  b = pmd_digin(handle, 1);
-	//  c = b << 8;
-	//  raw_angle = (a | c) & (2047);
-	//  actual_angle = raw_angle * (360.0/2048.0) - cal;
+float Encoder::GetAcceleration() {
+	EncoderSample sample;
+	GetSample(sample);
+	return sample.acceleration;
+}
 
-	return actual_angle - cal;
+bool Encoder::GetSample(EncoderSample& sample) {
+	if (rate <= 0 && (handle != NULL || shared.IsOpen()))
+		Sample();
+	Read(sample);
+	sample.angle -= cal;
+	return sample.sequence > lostAt;
 }
 
-//float Encoder::GetAngle()
-//{
-//pthread_mutex_lock (&mut);
-//return actual_angle;
-//pthread_mutex_unlock (&mut);
-//}
+void Encoder::Calibrate() {
+	// the sample is already relative to the old calibration
+	EncoderSample sample;
+	GetSample(sample);
+	cal += sample.angle;
+}
 
-/*
-float Encoder::GetVelocity()
-{
-pthread_mutex_lock (&mut);
-return velocity;
-pthread_mutex_unlock (&mut);
+void Encoder::GetTiming(EncoderTiming& timing) {
+	pthread_mutex_lock(&timingLock);
+	timing = this->timing;
+	pthread_mutex_unlock(&timingLock);
 }
-*/
 
-void Encoder::Calibrate() {
-	/*
-	unsigned int a, b, c;
-	a = pmd_digin(handle, 0);
-	b = pmd_digin(handle, 1);
-	c = b << 8;
-	raw_angle = (a | c) & (2047);
-	actual_angle = raw_angle * (360.0/2048.0) - cal;
-	*/
-	cal = GetAngle();
+bool Encoder::GetUsbStats(pmd_usb_stats& stats) {
+	return handle != NULL && pmd_usb_stats_get(handle, &stats) == 0;
+}
 
+void Encoder::PrintTiming(FILE* file) {
+	EncoderTiming copy;
+	GetTiming(copy);
+	if (GetRate() > 0)
+		std::fprintf(file, "encoder: %g readings/s requested, %.1f us apart\n", GetRate(), 1e6 / GetRate());
+	pmd_histogram_print(file, "encoder interval", &copy.interval);
+	pmd_histogram_print(file, "encoder latency", &copy.latency);
+	pmd_usb_stats stats;
+	if (GetUsbStats(stats))
+		pmd_usb_stats_print(file, &stats);
 }
 
-/*void* Encoder::ReadAngle()
-{
-while(true)
-{
-raw_angle = pmd_digin16(handle) & (2047);
+void Encoder::OnReading(const pmd_digin_sample* reading, void* encoder) {
+	static_cast<Encoder*>(encoder)->Publish(reading->value & 2047, reading->time, reading->latency,
+		EncoderRecord::STREAMED);
+}
 
-pthread_mutex_lock (&mut);
+bool Encoder::OpenDevice() {
+	// pmd_find_all, unlike pmd_find_first, says nothing when there is no device, as when looking each second
+	retryTime = monotonicTime();
+	if (pmd_find_all(&handle, 1) < 1) {
+		handle = NULL;
+		return false;
+	}
+	Sample();
+	if (rate > 0) {
+		stream = pmd_digin_start(handle, depth, static_cast<int>(1e6 / rate), OnReading, this);
+		if (stream == NULL)
+			std::cerr << "Encoder: could not start the digin stream, polling instead" << std::endl;
+	}
+	return true;
+}
 
-//calibrate angle
-actual_angle = raw_angle*(360.0/2048.0) - cal;
+bool Encoder::TakeDevice() {
+	retryTime = monotonicTime();
+	if (!shared.TakeOver()) {
+		if (!takenElsewhere)
+			std::cerr << "Encoder: another process has taken the device over from the encoder daemon" << std::endl;
+		takenElsewhere = 1;
+		return false;
+	}
+	return OpenDevice();
+}
 
-//calculate velocity
-velocity=(actual_angle-old_angle)/0.01;
+void Encoder::Sample() {
+	if (IsShared()) {
+		Follow();
+		return;
+	}
+	// a stream stopped by the device going away or failing is not started again on the same handle;
+	// closing the device and opening it again resets the board
+	if (stream != NULL) {
+		if (pmd_digin_active(stream))
+			return;
+		std::cerr << "Encoder: the digin stream has stopped, opening the device again" << std::endl;
+		pmd_digin_stop(stream);
+		stream = NULL;
+		lostAt = sequence;
+		pmd_close(handle);
+		handle = NULL;
+		if (!OpenDevice())
+			std::cerr << "Encoder: no PMD1208FS found, trying again each second" << std::endl;
+		return;
+	}
+	// only without a device once the daemon or the stream has stopped, when it is looked for again each second
+	if (handle == NULL) {
+		if (monotonicTime() - retryTime >= 1.0) {
+			if (daemonGone)
+				TakeDevice();
+			else
+				OpenDevice();
+		}
+		return;
+	}
+	const double before = monotonicTime();
+	unsigned int raw = pmd_digin16(handle) & 2047;
+	const double now = monotonicTime();
+	Publish(raw, now, now - before, 0);
+}
+
+void Encoder::Follow() {
+	EncoderSharedReading reading;
+	unsigned long lost = cursor.lost;
+	bool followed = false;
+	while (shared.Next(cursor, reading)) {
+		followed = true;
+		// readings the ring lost before they could be followed show as a gap in the recording
+		unsigned int flags = reading.flags;
+		if (cursor.lost != lost) {
+			flags |= EncoderRecord::GAP;
+			lost = cursor.lost;
+		}
+		Time(reading.time, reading.latency);
+		Deliver(reading.raw, reading.time, reading.number, flags);
+	}
+
+	// a daemon that has died publishes nothing more, so only then is its lock looked at; the memory
+	// stays mapped until the encoder is destroyed, as other threads may be reading it
+	if (!followed && !shared.IsAlive()) {
+		std::cerr << "Encoder: the encoder daemon has stopped, opening the device" << std::endl;
+		daemonGone = 1;
+		if (!TakeDevice() && !takenElsewhere)
+			std::cerr << "Encoder: no PMD1208FS found, trying again each second" << std::endl;
+	}
+}
+
+void Encoder::Time(double now, double latency) {
+	pthread_mutex_lock(&timingLock);
+	if (lastTime >= 0 && now >= lastTime)
+		pmd_histogram_add(&timing.interval, static_cast<unsigned long long>(1e9 * (now - lastTime)));
+	pmd_histogram_add(&timing.latency, static_cast<unsigned long long>(1e9 * latency));
+	pthread_mutex_unlock(&timingLock);
+	lastTime = now;
+}
+
+void Encoder::Publish(unsigned int raw, double now, double latency, unsigned int flags) {
+	Time(now, latency);
+
+	history.Add(now, raw);
+	const double radians = 2.0 * M_PI / EncoderHistory::COUNTS;
+	const float fitVelocity = history.GetVelocity() * radians;
+	const float fitAcceleration = history.GetAcceleration() * radians;
+
+	// odd while writing, with barriers so that the fields are not written outside the odd period
+	__sync_fetch_and_add(&lock, 1UL);
+	actual_angle = raw * (360.0 / 2048.0);
+	velocity = fitVelocity;
+	acceleration = fitAcceleration;
+	time = now;
+	sequence = sequence + 1;
+	__sync_fetch_and_add(&lock, 1UL);
 
-pthread_mutex_unlock (&mut);
+	EncoderPublisher* out = publisher;
+	if (out != NULL)
+		out->Add(raw, now, fitVelocity, fitAcceleration, latency, flags);
+	Deliver(raw, now, sequence, flags);
+}
+
+void Encoder::Deliver(unsigned int raw, double now, unsigned long number, unsigned int flags) {
+	EncoderRecorder* to = recorder;
+	if (to != NULL)
+		to->Add(static_cast<int64_t>(floor(now * 1e9 + 0.5)), raw, number, flags);
+
+	// calibrated and brought into -pi to pi, as the estimator's angle is
+	SwingEstimator* fuse = estimator;
+	if (fuse != NULL) {
+		const double angle = (raw * (360.0 / 2048.0) - cal) * (M_PI / 180.0);
+		fuse->Add(SwingEstimator::ENCODER, now, angle - 2.0 * M_PI * floor((angle + M_PI) / (2.0 * M_PI)));
+	}
+}
+
+void Encoder::Read(EncoderSample& sample) const {
+	if (IsShared()) {
+		EncoderSharedReading reading;
+		if (shared.Latest(reading)) {
+			sample.angle = reading.raw * (360.0 / 2048.0);
+			sample.velocity = reading.velocity;
+			sample.acceleration = reading.acceleration;
+			sample.time = reading.time;
+			sample.sequence = reading.number;
+		}
+		else {
+			std::memset(&sample, 0, sizeof(sample));
+		}
+		return;
+	}
+
+	unsigned long before, after;
+	do {
+		before = lock;
+		__sync_synchronize();
+		sample.angle = actual_angle;
+		sample.velocity = velocity;
+		sample.acceleration = acceleration;
+		sample.time = time;
+		sample.sequence = sequence;
+		__sync_synchronize();
+		after = lock;
+	} while ((before & 1UL) || before != after);
+}
+
+void* Encoder::ReadAngle(void* encoder)
+{
+	Encoder& self = *static_cast<Encoder*>(encoder);
 
-//sleep for 10ms
-qi::os::msleep(10);
+	// absolute deadlines, so that the time taken by each reading does not add up; a running stream
+	// takes the readings itself, and is only checked every tenth of a second
+	const long period = static_cast<long>(1e9 / self.rate);
+	const long check = 100000000L;
+	timespec next, now;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (self.running) {
+		next.tv_nsec += self.stream != NULL && period < check ? check : period;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			++next.tv_sec;
+		}
 
-pthread_exit((void)* 0);
+		// if a reading overran, carry on from now rather than catching up with a burst
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+			next = now;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {}
+		self.Sample();
+	}
+	return NULL;
 }
-}*/
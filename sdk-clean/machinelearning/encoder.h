@@ -11,9 +11,38 @@
 #define ENCODER_H
 
 #include "pmd1208fs.h"
+#include "EncoderHistory.h"
+#include "EncoderRecord.h"
+#include "EncoderShared.h"
+#include "SwingEstimator.h"
+#include <cstddef>
+#include <cstdio>
 #include <iostream>
 #include <pthread.h>
 
+/**
+ * @struct EncoderSample
+ *
+ * @brief One reading of the encoder, as published by the sampling thread.
+ */
+struct EncoderSample {
+	float angle;			///< Calibrated angle in degrees.
+	float velocity;			///< Velocity in radians/sec, from the fit over the recent readings.
+	float acceleration;		///< Acceleration in radians/sec^2, from the same fit.
+	double time;			///< CLOCK_MONOTONIC time the reading was taken, in seconds.
+	unsigned long sequence;		///< Number of readings taken so far, 1 for the first.
+};
+
+/**
+ * @struct EncoderTiming
+ *
+ * @brief How long the readings took and how regularly they came.
+ */
+struct EncoderTiming {
+	pmd_histogram interval;		///< Between successive readings, in ns; its spread is the sampling jitter.
+	pmd_histogram latency;		///< From the request to the reply of each reading, in ns.
+};
+
 /**
  * @class Encoder
  *
@@ -21,6 +50,36 @@
  *
  * Holds angle data for encoder component of robot-swing system at any given stage, used
  * to find and update angles and (indirectly) velocities of the robot on the swing.
+ *
+ * The device is read at a fixed rate by a pmd_digin_start stream, which keeps several
+ * requests in flight on the bus, or by a sampling thread polling with pmd_digin16 if the
+ * stream cannot be started. Either way one thread publishes the latest reading through a
+ * sequence lock, so that GetAngle is a memory read and never waits on USB. Readers retry
+ * only if they overlap a write.
+ * The stream stops itself if the device goes away or all its transfers fail. The sampling
+ * thread checks it ten times a second, and once it has stopped closes the device and opens it
+ * again, looking for it each second until it is back; until the device gives a reading
+ * GetSample returns false.
+ * Each reading also goes into an EncoderHistory, whose fit over the recent readings gives
+ * the velocity and acceleration published with the angle.
+ * With a rate of zero no thread is started and every call reads the device directly, in
+ * which case the encoder must only be used from one thread.
+ * SetRecorder also hands every reading, raw and timed, to an EncoderRecorder, and
+ * SetEstimator each calibrated angle to a SwingEstimator.
+ *
+ * Only one process can open the device. If the encoder daemon (encoderd) is running, the
+ * encoder reads its readings from shared memory instead of opening the device, so any number
+ * of processes can read the encoder at once. GetSample is then a copy of the daemon's latest
+ * reading, and a thread follows every reading at the given rate to time them and hand them to
+ * the recorder and estimator. The calibration is each process's own.
+ * If the daemon stops, the encoder notices when its readings stop coming and opens the device
+ * itself, as though no daemon had been running; until the device gives a reading GetSample
+ * returns false. Of the processes that were reading from the daemon only the one that gets
+ * EncoderSubscriber::TakeOver opens the device. The others say so once and stay without a
+ * device, trying for the lock each second in case the process holding it ends. A daemon
+ * started again later is not attached to.
+ * The time between readings and the time each took are kept in histograms (GetTiming), which
+ * are printed when the encoder is destroyed if PMD_STATS is set in the environment.
  * 
  * @author Coding and Machine Learning Teams 2015-2016
  * @date March, 2016
@@ -29,12 +88,20 @@ class Encoder {
 public:
 
 	/**
-	 * @brief Default constructor.
+	 * @brief Opens the first PMD1208FS and starts sampling it.
+	 *
+	 * @param rate Readings per second, 0 to read on each call instead, or HUGE_VAL for as fast
+	 *		  as the bus allows.
+	 * @param window Readings the velocity and acceleration are fitted over.
+	 * @param depth Requests kept in flight on the bus.
+	 * @param attach Whether to read from the encoder daemon, if it is running, rather than the
+	 *		  device. Its shared memory is named by ENCODER_SHM in the environment if set,
+	 *		  and not used if that is empty.
 	 */
-	explicit Encoder();
+	explicit Encoder(double rate = 100.0, std::size_t window = 15, int depth = 4, bool attach = true);
 	
 	/**
-	 * @brief Destructor.
+	 * @brief Destructor, stops the sampling and closes the device.
 	 */
 	~Encoder();
 
@@ -46,30 +113,183 @@ public:
 	float GetAngle();
 
 	/**
-	 * @brief Gets the current robot velocity, interpolated (indirect - may be inaccurate).
+	 * @brief Gets the latest reading with its time and sequence number.
+	 *
+	 * @param sample Set to the latest reading.
+	 * @return false if there has been no reading yet, or none since the daemon stopped.
+	 */
+	bool GetSample(EncoderSample& sample);
+
+	/**
+	 * @brief Gets the current robot velocity, from a quadratic fit over the recent readings.
 	 *
 	 * @return Current value of the robot velocity, in radians/sec.
 	 */
 	float GetVelocity();
 
+	/**
+	 * @brief Gets the current robot acceleration, from the same fit.
+	 *
+	 * @return Current value of the robot acceleration, in radians/sec^2.
+	 */
+	float GetAcceleration();
+
 	/**
 	 * @brief Calibrates the encoder angle.
 	 */
 	void Calibrate();
 
+	/**
+	 * @brief Gets the sampling rate.
+	 *
+	 * @return Readings per second (the daemon's, if reading from it), 0 if readings are taken
+	 *	   on each call.
+	 */
+	double GetRate() const { return IsShared() ? shared.GetRate() : rate; }
+
+	/**
+	 * @brief Whether the readings come from the encoder daemon rather than the device.
+	 */
+	bool IsShared() const { return shared.IsOpen() && !daemonGone; }
+
+	/**
+	 * @brief Records every reading from now on, or stops recording.
+	 *
+	 * @param recorder Recorder to add the readings to, which must outlive the encoder or be
+	 *		   replaced first, or NULL to stop.
+	 */
+	void SetRecorder(EncoderRecorder* recorder) { this->recorder = recorder; }
+
+	/**
+	 * @brief Adds every reading from now on, as a calibrated angle, to an estimator, or stops.
+	 *
+	 * @param estimator Estimator to add the readings to, which must outlive the encoder or be
+	 *		    replaced first, or NULL to stop.
+	 */
+	void SetEstimator(SwingEstimator* estimator) { this->estimator = estimator; }
+
+	/**
+	 * @brief Publishes every reading from now on to other processes, or stops. Used by the daemon.
+	 *
+	 * @param publisher Publisher to add the readings to, which must outlive the encoder or be
+	 *		    replaced first, or NULL to stop.
+	 */
+	void SetPublisher(EncoderPublisher* publisher) { this->publisher = publisher; }
+
+	/**
+	 * @brief Gets the histograms of the time between readings and the time each took.
+	 *
+	 * @param timing Set to a copy of the histograms.
+	 */
+	void GetTiming(EncoderTiming& timing);
+
+	/**
+	 * @brief Gets the device's USB timing and error counts, as kept by the PMD1208FS library.
+	 *
+	 * @param stats Set to the device's statistics.
+	 * @return false if there is no device.
+	 */
+	bool GetUsbStats(pmd_usb_stats& stats);
+
+	/**
+	 * @brief Prints the timing histograms and the device's USB statistics.
+	 *
+	 * @param file Where to print them.
+	 */
+	void PrintTiming(FILE* file);
+
 private:
-	//      void* ReadAngle();
+	/**
+	 * @brief Sampling thread, reads the device (or follows the daemon) every 1 / rate seconds until
+	 *	  stopped, or while the stream runs checks every tenth of a second that it still does.
+	 */
+	static void* ReadAngle(void* encoder);
+
+	/**
+	 * @brief Stream callback, publishes a reading.
+	 */
+	static void OnReading(const pmd_digin_sample* reading, void* encoder);
+
+	/**
+	 * @brief Opens the first PMD1208FS, takes a reading and starts the stream if there is a rate.
+	 *
+	 * @return false if no device was found.
+	 */
+	bool OpenDevice();
+
+	/**
+	 * @brief Opens the device in place of the stopped daemon, if no other process already has.
+	 *
+	 * @return false if another process has taken the device over or no device was found.
+	 */
+	bool TakeDevice();
+
+	/**
+	 * @brief Reads the device once and publishes the reading, follows the daemon's readings, or
+	 *	  opens the device again if the stream has stopped.
+	 */
+	void Sample();
+
+	/**
+	 * @brief Hands the daemon's readings since the last call to the recorder and estimator, and
+	 *	  opens the device if the daemon has stopped.
+	 */
+	void Follow();
+
+	/**
+	 * @brief Counts a reading's time since the last and its latency in the histograms.
+	 */
+	void Time(double now, double latency);
+
+	/**
+	 * @brief Hands a reading to the recorder and estimator.
+	 */
+	void Deliver(unsigned int raw, double now, unsigned long number, unsigned int flags);
+
+	/**
+	 * @brief Publishes a reading taken at the given time, latency seconds after it was requested.
+	 */
+	void Publish(unsigned int raw, double now, double latency, unsigned int flags);
+
+	/**
+	 * @brief Copies the latest published reading, or the daemon's, retrying while it is being written.
+	 */
+	void Read(EncoderSample& sample) const;
 
 	float cal;
-	float raw_angle;
-	float actual_angle;
-	//      float old_angle;
-	//      float velocity;
+	double rate;
+	int depth;
 
 	libusb_device_handle * handle;
+	double retryTime;		///< When the device was last looked for.
+
+	EncoderHistory history;		///< Only used by the thread taking readings.
+
+	pthread_mutex_t timingLock;	///< Held while the timing is updated or copied.
+	EncoderTiming timing;
+	double lastTime;		///< Time of the previous reading, negative before the first.
+
+	// latest reading, guarded by the sequence lock: odd while the sampling thread writes it
+	volatile unsigned long lock;
+	volatile float actual_angle;
+	volatile float velocity;
+	volatile float acceleration;
+	volatile double time;
+	volatile unsigned long sequence;
+	volatile unsigned long lostAt;	///< Sequence of the last reading before the stream stopped.
+
+	EncoderRecorder* volatile recorder;
+	SwingEstimator* volatile estimator;
+	EncoderPublisher* volatile publisher;
+
+	EncoderSubscriber shared;	///< Open if the readings come from the daemon.
+	EncoderSharedCursor cursor;	///< Next of the daemon's readings to follow.
+	volatile int daemonGone;	///< Set once the daemon has stopped, after which shared is not read.
+	int takenElsewhere;		///< Set once another process was found to have taken the device over.
 
-	//      pthread_t thread;
-	//      pthread_mutex_t mut;
+	pmd_digin_stream* stream;
+	volatile int running;
+	pthread_t thread;
 };
 
 #endif // ENCODER_H
@@ -11,6 +11,7 @@
 #ifndef __PMD1208FS_H__
 #define __PMD1208FS_H__
 
+#include <stdio.h>
 #include <libusb-1.0/libusb.h>
 
 #ifdef __cplusplus
@@ -18,12 +19,22 @@ extern "C" {
 #endif
 
 	/**
-	 * @brief Find a PMD1208FS device. Return a device handle or NULL.
+	 * @brief Find a PMD1208FS device not already open. Return a device handle or NULL.
+	 *		  Each device has a libusb context of its own, so boards do not wait on each other.
 	 *
 	 * @return Handle to device, or NULL if none found.
 	 */
 	libusb_device_handle* pmd_find_first(void);
 
+	/**
+	 * @brief Open every PMD1208FS not already open, up to max of them.
+	 *
+	 * @param handles Array receiving the handles, each to be closed with pmd_close.
+	 * @param max Size of handles.
+	 * @return Number of devices opened, or a negative libusb error.
+	 */
+	int pmd_find_all(libusb_device_handle** handles, int max);
+
 	/**
 	 * @brief Close the PMD1208FS device.
 	 *
@@ -125,6 +136,23 @@ extern "C" {
 	 */
 	int pmd_ainactive(libusb_device_handle* pmdhandle);
 
+	/**
+	 * @brief Called from the collection thread when a non-blocking ainscan finishes,
+	 *		  with status 0 if all the data arrived, or -EIO.
+	 */
+	typedef void (*pmd_ainscan_callback)(libusb_device_handle* pmdhandle, int status, void* user_data);
+
+	/**
+	 * @brief Set the function called when a non-blocking ainscan on this device finishes.
+	 *
+	 * @param pmdhandle Handle to PMD1208FS device.
+	 * @param callback Function to call, or NULL for none.
+	 * @param user_data Passed to the callback.
+	 * @return 0, or -ENODEV for a handle not from pmd_find_first or pmd_find_all.
+	 */
+	int pmd_ainscan_notify(libusb_device_handle* pmdhandle,
+			pmd_ainscan_callback callback, void* user_data);
+
 	/**
 	 * @brief Force a non-blocking ainscan to finish. Check pmd_ainactive to
 	 *		  see when it has. Automatically issues ainstop first.
@@ -133,6 +161,80 @@ extern "C" {
 	 */
 	void pmd_ainkill(libusb_device_handle* pmdhandle);
 
+	struct pmd_ain_stream;
+
+	/**
+	 * @brief Start a continuous analogue input scan, running until pmd_ainstream_stop.
+	 *		  Samples are numbered from 0 and interleaved by channel as in ainscan, and go
+	 *		  into a ring allocated once, served by one worker thread for the whole stream.
+	 *
+	 * @param pmdhandle Handle to PMD1208FS device.
+	 * @param lowch First channel.
+	 * @param highch Last channel.
+	 * @param interval Time between samples of the same channel (us), 0 for external clock.
+	 * @param trigger 0 for internal trigger, -1/+1 for external falling/rising edge.
+	 * @param bufsize Samples in the ring, rounded up to whole packets and sets of channels.
+	 * @return The stream, or NULL on error.
+	 */
+	struct pmd_ain_stream* pmd_ainstream_start(libusb_device_handle* pmdhandle,
+			int lowch, int highch, int interval, int trigger, int bufsize);
+
+	/**
+	 * @brief Stop a continuous scan, waiting for its transfers to end, and free it.
+	 */
+	void pmd_ainstream_stop(struct pmd_ain_stream* stream);
+
+	/**
+	 * @brief A reader's place in a continuous scan. A reader that falls more than the
+	 *		  ring behind is moved on to the oldest sample left.
+	 */
+	struct pmd_ain_cursor {
+		unsigned long long position;	///< Number of the next sample to read.
+		unsigned long overruns;		///< Times this reader was lapped.
+		unsigned long long lost;	///< Samples it missed because of that.
+	};
+
+	/**
+	 * @brief Point a cursor at the next sample to arrive.
+	 */
+	void pmd_ainstream_cursor(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor);
+
+	/**
+	 * @brief Wait for samples after the cursor and point at them in place in the ring.
+	 *
+	 * @param data Set to the first sample after the cursor.
+	 * @param min Samples to wait for.
+	 * @param timeout Longest wait, ms.
+	 * @return Samples readable from data, fewer than min where the ring wraps or on timeout,
+	 *		   or -EIO if the scan has failed and nothing is left.
+	 */
+	int pmd_ainstream_read(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor,
+			const int16_t **data, int min, int timeout);
+
+	/**
+	 * @brief Move the cursor past n samples that have been used.
+	 *
+	 * @return How many of them were overwritten while being read.
+	 */
+	int pmd_ainstream_release(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor, int n);
+
+	/**
+	 * @brief Counters for a continuous scan.
+	 */
+	struct pmd_ain_stream_stats {
+		unsigned long long samples;	///< Complete and in order so far.
+		unsigned long packets;		///< Packets received.
+		unsigned long long missed;	///< Samples in packets that never came, zeroed.
+		unsigned long overruns;		///< Times any reader was lapped.
+		unsigned long errors;		///< Failed or out of place transfers.
+		int failed;			///< The scan stopped because of an error.
+	};
+
+	/**
+	 * @brief Get the counters for a continuous scan.
+	 */
+	void pmd_ainstream_stats(struct pmd_ain_stream* stream, struct pmd_ain_stream_stats* stats);
+
 	/**
 	 * @brief Tell analogue input to stop sending. Returns 2 (bytes sent) or negative libusb error.
 	 *		  Should not be needed in user code.
@@ -193,6 +295,144 @@ extern "C" {
 	 */
 	int pmd_digin16(libusb_device_handle* pmdhandle);
 
+	/**
+	 * @brief One reading from a digital input stream.
+	 */
+	struct pmd_digin_sample {
+		unsigned int value;	///< Both ports, as pmd_digin16 returns.
+		double time;		///< CLOCK_MONOTONIC time the reply arrived, in seconds.
+		double latency;		///< Time from sending the request to its reply, in seconds.
+		unsigned long seqno;	///< Readings delivered so far, from 1.
+	};
+
+	/**
+	 * @brief Called from the stream's worker thread with each reading.
+	 */
+	typedef void (*pmd_digin_callback)(const struct pmd_digin_sample* sample, void* user_data);
+
+	struct pmd_digin_stream;
+
+	/**
+	 * @brief Start streaming digital input.
+	 *
+	 * Keeps up to depth digin16 requests in flight, each with a reply transfer waiting, so that
+	 * the bus is not left idle between the request and reply of each reading.
+	 *
+	 * @remark The callback must not call pmd_digin_stop, and while a stream runs nothing else may
+	 *		   read the device's replies (digin, digin16, ain, serial, cin).
+	 * @param pmdhandle Handle to PMD1208FS device.
+	 * @param depth Requests kept in flight, 1 - 16.
+	 * @param interval Minimum time between requests in microseconds, 0 to read as fast as the bus allows.
+	 * @param callback Function given each reading.
+	 * @param user_data Passed to the callback.
+	 * @return The stream, or NULL on error.
+	 */
+	struct pmd_digin_stream* pmd_digin_start(libusb_device_handle* pmdhandle,
+		int depth, int interval, pmd_digin_callback callback, void* user_data);
+
+	/**
+	 * @brief Stop a digital input stream, waiting for its transfers to end, and free it.
+	 *
+	 * @param stream Stream to stop.
+	 */
+	void pmd_digin_stop(struct pmd_digin_stream* stream);
+
+	/**
+	 * @brief Readings delivered so far by a digital input stream.
+	 *
+	 * @param stream Stream to query.
+	 * @return Number of readings.
+	 */
+	unsigned long pmd_digin_readings(struct pmd_digin_stream* stream);
+
+	/**
+	 * @brief Failed transfers so far in a digital input stream.
+	 *
+	 * @param stream Stream to query.
+	 * @return Number of failed transfers.
+	 */
+	unsigned long pmd_digin_errors(struct pmd_digin_stream* stream);
+
+	/**
+	 * @brief Whether a digital input stream is still running.
+	 *
+	 * A stream stops itself, and delivers no more readings, once the device has gone or every one
+	 * of its reply transfers has failed. It must still be freed with pmd_digin_stop.
+	 *
+	 * @param stream Stream to query.
+	 * @return Non-zero while the stream runs, 0 once it has stopped.
+	 */
+	int pmd_digin_active(struct pmd_digin_stream* stream);
+
+	/// Buckets for each power of two in a pmd_histogram.
+	#define PMD_HIST_SUB_BUCKETS 16
+	/// Buckets in a pmd_histogram, enough for values up to 2^40 ns.
+	#define PMD_HIST_BUCKETS (37 * PMD_HIST_SUB_BUCKETS)
+
+	/**
+	 * @brief Log-linear (HdrHistogram style) histogram of times in ns, each known to within 1/16.
+	 *
+	 * Adding takes no lock, so one histogram must not be used from two threads at once.
+	 * Zero with memset to start.
+	 */
+	struct pmd_histogram {
+		unsigned long long count;
+		unsigned long long sum;		///< ns.
+		unsigned long long min, max;	///< ns.
+		unsigned long buckets[PMD_HIST_BUCKETS];
+	};
+
+	/**
+	 * @brief Count a value in ns.
+	 */
+	void pmd_histogram_add(struct pmd_histogram* hist, unsigned long long value);
+
+	/**
+	 * @brief The value that percentile % of those counted are at or below.
+	 *
+	 * @param percentile 0 - 100.
+	 * @return Value in ns, to within 1/16, or 0 if nothing has been counted.
+	 */
+	unsigned long long pmd_histogram_percentile(const struct pmd_histogram* hist, double percentile);
+
+	/**
+	 * @brief Print a one line summary in us: count, mean, min, percentiles and max.
+	 */
+	void pmd_histogram_print(FILE* file, const char* name, const struct pmd_histogram* hist);
+
+	/// Entries in pmd_usb_stats::errors.
+	#define PMD_USB_ERRORS 13
+
+	/**
+	 * @brief Timing and errors of a device's USB traffic.
+	 *
+	 * If PMD_STATS is set in the environment, pmd_close prints them to stderr.
+	 */
+	struct pmd_usb_stats {
+		struct pmd_histogram transaction;	///< Request to reply of the synchronous reads (digin16 etc.).
+		struct pmd_histogram stream;		///< Request to reply in digin streams.
+		unsigned long errors[PMD_USB_ERRORS];	///< Failures, [-code] for libusb errors -1 to -12, [0] for others.
+	};
+
+	/**
+	 * @brief Copy a device's statistics.
+	 *
+	 * @return 0, or -ENODEV for a handle not from pmd_find_first or pmd_find_all.
+	 */
+	int pmd_usb_stats_get(libusb_device_handle* pmdhandle, struct pmd_usb_stats* stats);
+
+	/**
+	 * @brief Zero a device's statistics.
+	 *
+	 * @return 0, or -ENODEV for an unknown handle.
+	 */
+	int pmd_usb_stats_reset(libusb_device_handle* pmdhandle);
+
+	/**
+	 * @brief Print both histograms and any errors.
+	 */
+	void pmd_usb_stats_print(FILE* file, const struct pmd_usb_stats* stats);
+
 	/**
 	 * @brief Zero the counter.
 	 *
@@ -28,13 +28,31 @@ void showmenu(void) {
     printf("1: serial      9: crst       g: timeout\n");
     printf("2: ain         a: cin        h: aoutscan\n");
     printf("3: aout        b: ainstop    i: digin16\n");
-    printf("4: ainscan     c: aoutstop\n");
-    printf("5: ainscan_nb  d: reset\n");
+    printf("4: ainscan     c: aoutstop   j: digin stream\n");
+    printf("5: ainscan_nb  d: reset       k: ain stream\n");
     printf("6: digconf     e: errcode\n");
     printf("7: digin       f: flash\n");
     printf("8: digout                    0: quit\n");
 }
 
+/* Totals for the digin stream demo */
+struct digin_totals {
+    unsigned long n;
+    double latency;
+    double maxlatency;
+    unsigned int last;
+};
+
+void digin_count(const struct pmd_digin_sample* sample, void* user_data) {
+    struct digin_totals* totals = (struct digin_totals*)user_data;
+    totals->n++;
+    totals->latency += sample->latency;
+    if (sample->latency > totals->maxlatency) {
+        totals->maxlatency = sample->latency;
+    }
+    totals->last = sample->value;
+}
+
 int main(void) {
     libusb_device_handle* mypmd;
     int i, ret;
@@ -190,6 +208,65 @@ int main(void) {
         case 'i':  //digin16
             printf("dports are 0x%4x\n", pmd_digin16(mypmd));
             break;
+        case 'j':  //digin stream
+            printf("depth interval(us, 0=flat out) seconds? ");
+            scanf("%d %d %d", &n, &t, &val);
+            {
+                struct digin_totals totals = {0, 0, 0, 0};
+                struct pmd_digin_stream* stream = pmd_digin_start(mypmd, n, t, digin_count, &totals);
+                if (!stream) {
+                    printf("digin stream failed to start\n");
+                    break;
+                }
+                sleep(val);
+                pmd_digin_stop(stream);
+                if (totals.n > 0) {
+                    printf("%lu readings (%.0f/s), latency mean %.3f ms max %.3f ms, last 0x%4x\n",
+                           totals.n, (double)totals.n / val, 1e3 * totals.latency / totals.n,
+                           1e3 * totals.maxlatency, totals.last);
+                }
+            }
+            break;
+        case 'k':  //ain stream
+            printf("lowch highch time(us) trig seconds? ");
+            scanf("%d %d %d %d %d", &lowch, &highch, &t, &trig, &val);
+            {
+                struct pmd_ain_stream* stream;
+                struct pmd_ain_stream_stats stats;
+                struct pmd_ain_cursor cursor;
+                const int16_t* samples;
+                double sum = 0;
+                unsigned long long count = 0;
+                int j;
+                stream = pmd_ainstream_start(mypmd, lowch, highch, t, trig, 65536);
+                if (!stream) {
+                    printf("ain stream failed to start\n");
+                    break;
+                }
+                /* mean of the first channel, once a second */
+                pmd_ainstream_cursor(stream, &cursor);
+                for (i = 0; i < val; i++) {
+                    sleep(1);
+                    while ((n = pmd_ainstream_read(stream, &cursor, &samples, 1, 0)) > 0) {
+                        for (j = 0; j < n; j++) {
+                            if ((cursor.position + j) % (highch-lowch+1) == 0) {
+                                sum += samples[j];
+                                count++;
+                            }
+                        }
+                        pmd_ainstream_release(stream, &cursor, n);
+                    }
+                    pmd_ainstream_stats(stream, &stats);
+                    printf("%llu samples, ch %d mean %.1f, missed %llu, overruns %lu, errors %lu%s\n",
+                           stats.samples, lowch, count ? sum / count : 0.0, stats.missed,
+                           stats.overruns, stats.errors, stats.failed ? ", failed" : "");
+                    sum = 0;
+                    count = 0;
+                    if (n < 0) break;
+                }
+                pmd_ainstream_stop(stream);
+            }
+            break;
         case '0':
         case 'q':
             pmd_close(mypmd);
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <pthread.h>
+#include <time.h>
 #include "pmd1208fs.h"
 #include "version.h"
 
@@ -40,6 +41,8 @@
 
 #define UNUSED __attribute__((unused))
 
+static void stats_error(libusb_device_handle* pmdhandle, int code);
+
 /* Translate a libusb error into a static string */
 char* usb_get_errmsg(int errcode) {
     switch (errcode) {
@@ -80,6 +83,7 @@ static int send_control(libusb_device_handle* pmdhandle,
     //        ret, msgsize, msg[0], msg[1], msg[2], msg[3], msg[4]);
     if (ret < 0) {
         err("failed to send control %x: %s code %d\n", msg[0], usb_get_errmsg(ret), ret);
+        stats_error(pmdhandle, ret);
     }
     return ret;
 }
@@ -98,49 +102,279 @@ static int get_data(libusb_device_handle* pmdhandle,
     //    *receivedlength, maxlength, data[0], data[1], data[2], data[3], data[4]);
     if (ret) {
         err("failed to get from ep 0x81: %s\n", usb_get_errmsg(ret));
+        stats_error(pmdhandle, ret);
     }
     return ret;
 }
 
 
-/* Find a PMD1208FS device.  Return a device handle, or NULL. */
-libusb_device_handle* pmd_find_first(void) {
-    int i, ret;
-    libusb_device_handle* pmd;
-    
-    ret = libusb_init(NULL);
+/* Analogue scan state, one per device */
+struct ainscan_control {
+    int bytes_awaited;
+    uint16_t last_pkt_seqno;
+    int last_pkt_bytes;
+    int error;
+    int active_transfers;
+    int16_t *data;
+    int datsize;
+};
+
+/* Everything kept for one open device.  Each device has its own libusb
+ * context, so its transfers are handled by its own event loop and a scan on
+ * one board never waits on events from another. */
+struct pmd_device {
+    libusb_device_handle* handle;
+    libusb_context* ctx;
+    struct ainscan_control scancontrol;
+    struct libusb_transfer *xfers[NUM_XFERS];
+    pmd_ainscan_callback done;  /* called when a non-blocking scan ends */
+    void* done_data;
+    struct pmd_ain_stream* ainstream;   /* continuous scan, if running */
+    pthread_mutex_t stats_lock;
+    struct pmd_usb_stats stats;
+    struct pmd_device* next;
+};
+
+static struct pmd_device* devices = NULL;
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The device a handle belongs to, or NULL if it was not opened here */
+static struct pmd_device* find_device(libusb_device_handle* pmdhandle) {
+    struct pmd_device* dev;
+    pthread_mutex_lock(&devices_lock);
+    for (dev = devices; dev && dev->handle != pmdhandle; dev = dev->next) {}
+    pthread_mutex_unlock(&devices_lock);
+    return dev;
+}
+
+/* Whether this process already has the PMD at bus:address open */
+static int is_open(uint8_t bus, uint8_t address) {
+    struct pmd_device* dev;
+    libusb_device* usbdev;
+    pthread_mutex_lock(&devices_lock);
+    for (dev = devices; dev; dev = dev->next) {
+        usbdev = libusb_get_device(dev->handle);
+        if (libusb_get_bus_number(usbdev) == bus && libusb_get_device_address(usbdev) == address) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&devices_lock);
+    return dev != NULL;
+}
+
+/* CLOCK_MONOTONIC in ns */
+static unsigned long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Count a failure by its libusb error code.  Device's stats_lock held */
+static void stats_count(struct pmd_usb_stats* stats, int code) {
+    stats->errors[code < 0 && -code < PMD_USB_ERRORS ? -code : 0]++;
+}
+
+/* The same, for the device a handle belongs to, if it was opened here */
+static void stats_error(libusb_device_handle* pmdhandle, int code) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    if (dev) {
+        pthread_mutex_lock(&dev->stats_lock);
+        stats_count(&dev->stats, code);
+        pthread_mutex_unlock(&dev->stats_lock);
+    }
+}
+
+/* The libusb error nearest to the status of a failed transfer */
+static int status_error(enum libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        default: return LIBUSB_ERROR_IO;
+    }
+}
+
+/* Send a request and read its reply, as the synchronous reads do, timing
+ * the two together for the device's statistics.  Returns zero or the first
+ * negative LIBUSB_ERROR_* */
+static int transact(libusb_device_handle* pmdhandle,
+                    unsigned char msg[],
+                    uint16_t msgsize,
+                    int* receivedlength,
+                    unsigned int timeout) {
+    unsigned long long start = monotonic_ns();
+    struct pmd_device* dev;
+    int ret;
+
+    ret = send_control(pmdhandle, msg, msgsize, 3000);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = get_data(pmdhandle, msg, IN_PKT_SIZE, receivedlength, timeout);
+    if (ret == 0 && (dev = find_device(pmdhandle))) {
+        pthread_mutex_lock(&dev->stats_lock);
+        pmd_histogram_add(&dev->stats.transaction, monotonic_ns() - start);
+        pthread_mutex_unlock(&dev->stats_lock);
+    }
+    return ret;
+}
+
+/* Release the first n interfaces of a PMD that open_device could not finish
+ * opening, and close it */
+static void abandon_device(libusb_device_handle* pmd, libusb_context* ctx, int n) {
+    while (n-- > 0) {
+        libusb_release_interface(pmd, n);
+    }
+    libusb_close(pmd);
+    libusb_exit(ctx);
+}
+
+/* Open the PMD at bus:address in a context of its own, claim it and add it
+ * to the device list.  Return a device handle, or NULL, at once and quietly
+ * if another process has the board claimed. */
+static libusb_device_handle* open_device(uint8_t bus, uint8_t address) {
+    int i, ret, config;
+    ssize_t n;
+    libusb_context* ctx;
+    libusb_device** list;
+    libusb_device_handle* pmd = NULL;
+    struct pmd_device* dev;
+
+    ret = libusb_init(&ctx);
     if (ret) {
         err("failed to init libusb: %s\n", usb_get_errmsg(ret));
         return NULL;
     }
-    
-    pmd = libusb_open_device_with_vid_pid(NULL, PMD_VID, PMD_PID);
+    n = libusb_get_device_list(ctx, &list);
+    for (i = 0; i < n; i++) {
+        if (libusb_get_bus_number(list[i]) == bus && libusb_get_device_address(list[i]) == address) {
+            if ((ret = libusb_open(list[i], &pmd))) {
+                err("failed to open device: %s\n", usb_get_errmsg(ret));
+                pmd = NULL;
+            }
+            break;
+        }
+    }
+    if (n >= 0) {
+        libusb_free_device_list(list, 1);
+    }
     if (!pmd) {
-        err("device not found\n");
-        libusb_exit(NULL);
+        libusb_exit(ctx);
         return NULL;
     }
-    
+
+    /* nothing may disturb the board until its interfaces are claimed, as
+     * another process may be streaming from it: detaching leaves interfaces
+     * claimed through usbfs alone, and setting the configuration the board
+     * already has would reset it */
     for(i = 0; i < 4; i++) {
         libusb_detach_kernel_driver(pmd, i);
     }
-    libusb_reset_device(pmd);  /* fixes odd-number-of-operations timeout */
-    libusb_set_configuration(pmd, 1);
+    if (libusb_get_configuration(pmd, &config) || config != 1) {
+        libusb_set_configuration(pmd, 1);
+    }
     for(i = 0; i < 4; i++) {
         ret = libusb_claim_interface(pmd, i);
         if (ret) {
-            err("failed to claim interface: %s\n", usb_get_errmsg(ret));
-            libusb_close(pmd);
-            libusb_exit(NULL);
+            if (ret != LIBUSB_ERROR_BUSY) {
+                err("failed to claim interface: %s\n", usb_get_errmsg(ret));
+            }
+            abandon_device(pmd, ctx, i);
             return NULL;
         }
     }
+    /* fixes odd-number-of-operations timeout; libusb claims the interfaces
+     * again afterwards, or gives up the handle if the board came back as
+     * another device */
+    ret = libusb_reset_device(pmd);
+    if (ret == LIBUSB_ERROR_NOT_FOUND) {
+        err("failed to reset device: %s\n", usb_get_errmsg(ret));
+        abandon_device(pmd, ctx, 0);
+        return NULL;
+    }
+
+    dev = calloc(1, sizeof(*dev));
+    if (!dev) {
+        err("no memory for device\n");
+        abandon_device(pmd, ctx, 4);
+        return NULL;
+    }
+    dev->handle = pmd;
+    dev->ctx = ctx;
+    pthread_mutex_init(&dev->stats_lock, NULL);
+    pthread_mutex_lock(&devices_lock);
+    dev->next = devices;
+    devices = dev;
+    pthread_mutex_unlock(&devices_lock);
+    return pmd;
+}
+
+/* Open every PMD1208FS not already open, up to max of them, putting their
+ * handles in handles[].  Return the number opened, or a negative libusb error */
+int pmd_find_all(libusb_device_handle** handles, int max) {
+    int i, found, ret;
+    ssize_t n;
+    libusb_context* ctx;
+    libusb_device** list;
+    struct libusb_device_descriptor desc;
+
+    ret = libusb_init(&ctx);
+    if (ret) {
+        err("failed to init libusb: %s\n", usb_get_errmsg(ret));
+        return ret;
+    }
+    n = libusb_get_device_list(ctx, &list);
+    if (n < 0) {
+        err("failed to list devices: %s\n", usb_get_errmsg((int)n));
+        libusb_exit(ctx);
+        return (int)n;
+    }
+    /* boards this process has open are skipped before open_device, as it
+     * could claim them again and would reset them under the thread using
+     * them; boards other processes have open are left by open_device */
+    found = 0;
+    for (i = 0; i < n && found < max; i++) {
+        if (libusb_get_device_descriptor(list[i], &desc) == 0
+                && desc.idVendor == PMD_VID && desc.idProduct == PMD_PID
+                && !is_open(libusb_get_bus_number(list[i]), libusb_get_device_address(list[i]))) {
+            handles[found] = open_device(libusb_get_bus_number(list[i]), libusb_get_device_address(list[i]));
+            if (handles[found]) {
+                found++;
+            }
+        }
+    }
+    libusb_free_device_list(list, 1);
+    libusb_exit(ctx);
+    return found;
+}
+
+/* Find a PMD1208FS device not already open.  Return a device handle, or NULL. */
+libusb_device_handle* pmd_find_first(void) {
+    libusb_device_handle* pmd;
+    if (pmd_find_all(&pmd, 1) < 1) {
+        err("device not found\n");
+        return NULL;
+    }
     return pmd;
 }
 
 /* Close the PMD1208FS device. */
 void pmd_close(libusb_device_handle* pmdhandle) {
     int i, ret;
+    struct pmd_device** link;
+    struct pmd_device* dev = NULL;
+
+    pthread_mutex_lock(&devices_lock);
+    for (link = &devices; *link; link = &(*link)->next) {
+        if ((*link)->handle == pmdhandle) {
+            dev = *link;
+            *link = dev->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&devices_lock);
+
     for(i = 0; i < 4; i++) {
         ret = libusb_release_interface(pmdhandle, i);
         if (ret) {
@@ -148,7 +382,51 @@ void pmd_close(libusb_device_handle* pmdhandle) {
         }
     }
     libusb_close(pmdhandle);
-    libusb_exit(NULL);
+    if (dev) {
+        if (getenv("PMD_STATS")) {
+            fprintf(stderr, "pmd %p:\n", (void*)pmdhandle);
+            pmd_usb_stats_print(stderr, &dev->stats);
+        }
+        libusb_exit(dev->ctx);
+        pthread_mutex_destroy(&dev->stats_lock);
+        free(dev);
+    }
+}
+
+/* Copy a device's statistics */
+int pmd_usb_stats_get(libusb_device_handle* pmdhandle, struct pmd_usb_stats* stats) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    if (!dev) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&dev->stats_lock);
+    *stats = dev->stats;
+    pthread_mutex_unlock(&dev->stats_lock);
+    return 0;
+}
+
+/* Zero a device's statistics */
+int pmd_usb_stats_reset(libusb_device_handle* pmdhandle) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    if (!dev) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&dev->stats_lock);
+    memset(&dev->stats, 0, sizeof(dev->stats));
+    pthread_mutex_unlock(&dev->stats_lock);
+    return 0;
+}
+
+/* Set the function called when a non-blocking ainscan on this device ends */
+int pmd_ainscan_notify(libusb_device_handle* pmdhandle,
+          pmd_ainscan_callback callback, void* user_data) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    if (!dev) {
+        return -ENODEV;
+    }
+    dev->done = callback;
+    dev->done_data = user_data;
+    return 0;
 }
 
 /* Flash the device LED.  Return 2 (bytes sent) or negative libusb error */
@@ -164,11 +442,7 @@ char *pmd_serial(libusb_device_handle* pmdhandle) {
     static char serialno[9];
     unsigned char msgbuf[64] = {0x55, 0x00, 0x00, 0x20, 0x08};
     uint16_t msgsize = 5;
-    ret = send_control(pmdhandle, msgbuf, msgsize, 3000);
-    if (ret < 0) {
-        return "????????";
-    }
-    ret = get_data(pmdhandle, msgbuf, 64, &rxlength, 5000);
+    ret = transact(pmdhandle, msgbuf, msgsize, &rxlength, 5000);
     if (ret) {
         return "????????";
     }
@@ -190,12 +464,7 @@ int pmd_ain(libusb_device_handle* pmdhandle, int channel, int range) {
     msgbuf[0] = 0x10;
     msgbuf[1] = (unsigned char) channel;
     msgbuf[2] = (unsigned char) range;
-    ret = send_control(pmdhandle, msgbuf, 3, 3000);
-    if (ret < 0) {
-        return -2049 + ret;
-    }
-    
-    ret = get_data(pmdhandle, msgbuf, 64, &rxlength, 5000);
+    ret = transact(pmdhandle, msgbuf, 3, &rxlength, 5000);
     if (ret < 0) {
         return -2049 + ret;
     }
@@ -210,23 +479,67 @@ int pmd_ainstop(libusb_device_handle* pmdhandle) {
     return(send_control(pmdhandle, msgbuf, msgsize, 3000));
 }
 
-/* Globals  -- there can only ever be one scan in progress, and one set of xfers for it */
-struct ainscan_control {
-    int bytes_awaited;
-    uint16_t last_pkt_seqno;
-    int last_pkt_bytes;
-    int error;
-    int active_transfers;
-    int16_t *data;
-    int datsize;
-} scancontrol;
-
-struct libusb_transfer *xfers[NUM_XFERS];
-
 /* prototypes for transfers */
 static void xfer_cb(struct libusb_transfer *xfer);
 void* ainscan_worker(void* arg);
 
+/* Work out the adc timer for a scan, stop any conversions in progress and
+ * send the sync and trigger options.  Returns the trigger bit of the scan
+ * options (0 or 4), or a negative error */
+static int ain_configure(libusb_device_handle* pmdhandle, int nchannels,
+          int interval, int trigger, int *pre, long int *timer) {
+    int adctime;    /* us per conversion */
+    unsigned char syncopts; /* sync options */
+    unsigned char trigopts; /* trigger options */
+    unsigned char msgbuf[64];
+    int ret;
+
+    /* calculate timer settings */
+    if (interval == 0) {
+        adctime = 1000000;  /* fake timer settings (10 sps) for external clock */
+        syncopts = 1;     /* external adc clock, skip first pulse (not gated) */
+    } else if (interval/nchannels < 20) {
+        /* set to allow < 20 in order to force errors */
+        err("conversion time below 20us\n");
+        return -EINVAL;
+    } else {
+        adctime = 10 * interval / nchannels; /* 10ths of us */
+        syncopts = 0; /* internal adc clock */
+    }
+    *pre = -1;
+    do {
+        (*pre)++;
+        *timer = adctime / (1<<*pre);
+    } while (*timer > 0xffff);
+    
+    /* Stop any existing conversions, just in case */
+    if ((ret = pmd_ainstop(pmdhandle)) < 0) {
+        err("ainstop failed: %s\n", usb_get_errmsg(ret));
+        return ret;
+    }
+    
+    /* Set the sync options */
+    msgbuf[0] = 0x43;
+    msgbuf[1] = syncopts;
+    if ((ret = send_control(pmdhandle, msgbuf, 2, 3000)) < 0) {
+        err("set sync failed: %s\n", usb_get_errmsg(ret));
+        return ret;
+    }
+    
+    /* Set ext trig polarity if necessary */
+    if (trigger == 0) {
+        return 0; /* internal trigger */
+    }
+    trigopts = (trigger > 0) ? 1 : 0;
+    msgbuf[0] = 0x42;
+    msgbuf[1] = trigopts;
+    if ((ret = send_control(pmdhandle, msgbuf, 2, 3000)) < 0) {
+        err("set trig failed: %s\n", usb_get_errmsg(ret));
+        return ret;
+    }
+    return 4; /* external trigger */
+}
+
 /* Perform an analogue input scan.  The last parameter, 'blocking',  determines
  * whether this function blocks until all the data have been received.
  * 
@@ -244,18 +557,29 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
           int16_t *data, int datsize, int blocking) {
     int nchannels;
     int totalpts;   /* overall number of conversions */
-    int adctime;    /* us per conversion */
     long int timer; /* adc timer fine setting */
     int pre;        /* adc timer prescaler */
-    unsigned char syncopts; /* sync options */
     unsigned char scanopts; /* scan options */
-    unsigned char trigopts; /* trigger options */
     unsigned char msgbuf[64];
     int ret, i, returncode;
-    /* scancontrol is global, to allow for nonblocking case */
+    /* scancontrol belongs to the device, to allow for nonblocking case */
+    struct pmd_device* dev = find_device(pmdhandle);
+    struct ainscan_control* scancontrol;
+    struct libusb_transfer **xfers;
+    
+    if (!dev) {
+        err("ainscan on a device not opened by pmd_find_first or pmd_find_all\n");
+        return -ENODEV;
+    }
+    scancontrol = &dev->scancontrol;
+    xfers = dev->xfers;
     
     /* Segfault city awaits if we have outstanding xfers (including cancellations) */
-    ret = scancontrol.active_transfers;
+    if (dev->ainstream) {
+        err("declined to ainscan while streaming\n");
+        return -EAGAIN;
+    }
+    ret = scancontrol->active_transfers;
     if (ret > 0) {
         err("declined to ainscan while %d transfers active\n", ret);
         return -EAGAIN;
@@ -276,59 +600,19 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
     }
     
     /* Scan control struct to help completion handler sort the data */
-    scancontrol.bytes_awaited = totalpts * 2;
-    scancontrol.last_pkt_seqno = (uint16_t)((totalpts * 2 - 1) / (IN_PKT_SIZE-2));
-    scancontrol.last_pkt_bytes = 1+(totalpts * 2 - 1) % (IN_PKT_SIZE-2);
-    scancontrol.error = 0;
-    scancontrol.active_transfers = 0;
-    scancontrol.data = data;
-    scancontrol.datsize = datsize;
-    
-    /* calculate timer settings */
-    if (interval == 0) {
-        adctime = 1000000;  /* fake timer settings (10 sps) for external clock */
-        syncopts = 1;     /* external adc clock, skip first pulse (not gated) */
-    } else if (interval/nchannels < 20) {
-        /* set to allow < 20 in order to force errors */
-        err("conversion time below 20us\n");
-        return -EINVAL;
-    } else {
-        adctime = 10 * interval / nchannels; /* 10ths of us */
-        syncopts = 0; /* internal adc clock */
-    }
-    pre = -1;
-    do {
-        pre++;
-        timer = adctime / (1<<pre);
-    } while (timer > 0xffff);
-    
-    /* Stop any existing conversions, just in case */
-    if ((ret = pmd_ainstop(pmdhandle)) < 0) {
-        err("ainstop failed: %s\n", usb_get_errmsg(ret));
-        return ret;
-    }
+    scancontrol->bytes_awaited = totalpts * 2;
+    scancontrol->last_pkt_seqno = (uint16_t)((totalpts * 2 - 1) / (IN_PKT_SIZE-2));
+    scancontrol->last_pkt_bytes = 1+(totalpts * 2 - 1) % (IN_PKT_SIZE-2);
+    scancontrol->error = 0;
+    scancontrol->active_transfers = 0;
+    scancontrol->data = data;
+    scancontrol->datsize = datsize;
     
-    /* Set the sync options */
-    msgbuf[0] = 0x43;
-    msgbuf[1] = syncopts;
-    if ((ret = send_control(pmdhandle, msgbuf, 2, 3000)) < 0) {
-        err("set sync failed: %s\n", usb_get_errmsg(ret));
+    /* Set the timer, sync and trigger; scanopts bit 0 asks for one scan */
+    if ((ret = ain_configure(pmdhandle, nchannels, interval, trigger, &pre, &timer)) < 0) {
         return ret;
     }
-    
-    /* Set trigger options in scanopts; set ext trig polarity if necessary */
-    if (trigger == 0) {
-        scanopts = 1; /* internal trigger, one scan */
-    } else {
-        scanopts = 5; /* external trigger, one scan */
-        trigopts = (trigger > 0) ? 1 : 0;
-        msgbuf[0] = 0x42;
-        msgbuf[1] = trigopts;
-        if ((ret = send_control(pmdhandle, msgbuf, 2, 3000)) < 0) {
-            err("set trig failed: %s\n", usb_get_errmsg(ret));
-            return ret;
-        }
-    }
+    scanopts = (unsigned char)(ret | 1);
     
     /* Create the transfers */
     for (i = 0; i < NUM_XFERS; i++) {
@@ -353,7 +637,7 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
                                 databuf,
                                 IN_PKT_SIZE,
                                 xfer_cb, 
-                                &scancontrol, // user data
+                                scancontrol, // user data
                                 0); // no timeout
         xfers[i]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
     }
@@ -384,7 +668,7 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
             returncode = ret;
             goto out_cancel_transfers;  /// should also cancel scan??
         } else {
-            scancontrol.active_transfers++;
+            scancontrol->active_transfers++;
         }
     }
     
@@ -392,7 +676,7 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
     if (! blocking) {
         pthread_t worker;
     
-        ret = pthread_create(&worker, NULL, ainscan_worker, NULL);
+        ret = pthread_create(&worker, NULL, ainscan_worker, dev);
         if (ret) {
             err("failed to create ain worker thread: err %d\n", ret);
             /* make positive errors negative! +ENOMEM was seen 
@@ -410,14 +694,14 @@ int pmd_ainscan(libusb_device_handle* pmdhandle,
     /* This is the blocking case ...*/
     
     /* Handle the returning transfers */
-    while (scancontrol.bytes_awaited > 0 && !scancontrol.error) {
-        ret = libusb_handle_events(NULL); /* block 2s, handle 1 event */
+    while (scancontrol->bytes_awaited > 0 && !scancontrol->error) {
+        ret = libusb_handle_events(dev->ctx); /* block 2s, handle 1 event */
         /* Any error means the data are trash, probably even from those
          * packets that arrived without error.  Flag this to the caller */
-        if (scancontrol.error) {
+        if (scancontrol->error) {
             returncode = -EIO; 
         }
-        dbg("handle_events returned %d, bytes_awaited = %d, error = %d\n", ret, scancontrol.bytes_awaited, scancontrol.error);
+        dbg("handle_events returned %d, bytes_awaited = %d, error = %d\n", ret, scancontrol->bytes_awaited, scancontrol->error);
     }
     
     /* Either we are in blocking mode, and data arrived OK, or some error
@@ -432,9 +716,9 @@ out_cancel_transfers:
     }
 
     // Handle the cancellations
-    while(scancontrol.active_transfers > 0) {
-        ret = libusb_handle_events(NULL);
-        dbg("cancellation handle_events returned %d, active_transfers=%d\n", ret, scancontrol.active_transfers);
+    while(scancontrol->active_transfers > 0) {
+        ret = libusb_handle_events(dev->ctx);
+        dbg("cancellation handle_events returned %d, active_transfers=%d\n", ret, scancontrol->active_transfers);
     }
 
 out_free_transfers:
@@ -446,16 +730,18 @@ out_free_transfers:
 }
 
 /* Data collection thread for pmd_ainscan_nb */
-void* ainscan_worker(UNUSED void* arg) {
-    /* scancontrol is the global struct */
+void* ainscan_worker(void* arg) {
+    struct pmd_device* dev = (struct pmd_device*)arg;
+    struct ainscan_control* scancontrol = &dev->scancontrol;
+    struct libusb_transfer **xfers = dev->xfers;
     int i;
     int ret __attribute__ ((unused));  /* only used when DEBUG is defined */
     
     dbg("nb worker starting\n");
     /* Poll for and handle the returning transfers */
-    while (scancontrol.bytes_awaited > 0 && !scancontrol.error) {
-        ret = libusb_handle_events(NULL); /* block 2s, handle 1 event */
-        dbg("nb handle_events returned %d, bytes_awaited = %d, error = %d\n", ret, scancontrol.bytes_awaited, scancontrol.error);
+    while (scancontrol->bytes_awaited > 0 && !scancontrol->error) {
+        ret = libusb_handle_events(dev->ctx); /* block 2s, handle 1 event */
+        dbg("nb handle_events returned %d, bytes_awaited = %d, error = %d\n", ret, scancontrol->bytes_awaited, scancontrol->error);
     }
     
     /* All bytes in, or error found in completion handler. Either way,
@@ -466,41 +752,52 @@ void* ainscan_worker(UNUSED void* arg) {
     }
 
     /* Handle the cancellations */
-    while(scancontrol.active_transfers > 0) {
-        ret = libusb_handle_events(NULL);
-        dbg("nb cancellation handle_events returned %d, active_transfers=%d\n", ret, scancontrol.active_transfers);
+    while(scancontrol->active_transfers > 0) {
+        ret = libusb_handle_events(dev->ctx);
+        dbg("nb cancellation handle_events returned %d, active_transfers=%d\n", ret, scancontrol->active_transfers);
     }
     /* free the transfers - their buffers get done automatically */
     for (i = 0; i < NUM_XFERS; i++) {
         libusb_free_transfer(xfers[i]);
     }
     dbg("nb handler finishing\n");
+    if (dev->done) {
+        dev->done(dev->handle, scancontrol->error ? -EIO : 0, dev->done_data);
+    }
     return 0; /* end of collecton thread*/
 }
 
 /* Return the number of bytes outstanding in the current ainscan.  Zero
  * signifies proper completion, so the output data are now ready.  Negative is
  * either a detected error (-EIO), or some equally erroneous bad counting */
-int pmd_ainawaited(UNUSED libusb_device_handle* pmdhandle) {
-    if (scancontrol.error) {
+int pmd_ainawaited(libusb_device_handle* pmdhandle) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    if (!dev) {
+        return -ENODEV;
+    }
+    if (dev->scancontrol.error) {
         return -EIO;
     } else {
-        return scancontrol.bytes_awaited;
+        return dev->scancontrol.bytes_awaited;
     }
 }
 
 /* Return the number of active USB transfers.  If it is not zero, ainscan
  * will return -EAGAIN.  This goes to zero a short while after ainawaited
  * goes to zero -- up to a few seconds if an ainkill was issued */
-int pmd_ainactive(UNUSED libusb_device_handle* pmdhandle) {
-    return scancontrol.active_transfers;
+int pmd_ainactive(libusb_device_handle* pmdhandle) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    return dev ? dev->scancontrol.active_transfers : 0;
 }
 
 /* Force a non-blocking ainscan to finish.  Check pmd_ainactive to see
  * when it has.   Automatically issues ainstop first */
 void pmd_ainkill(libusb_device_handle* pmdhandle) {
+    struct pmd_device* dev = find_device(pmdhandle);
     pmd_ainstop(pmdhandle);
-    scancontrol.error = 1;
+    if (dev) {
+        dev->scancontrol.error = 1;
+    }
 }
 
 /* ain completion handler */
@@ -577,6 +874,397 @@ static void xfer_cb(struct libusb_transfer *xfer) {
 }
 
 
+/* Continuous analogue input.
+ * The scan runs until it is stopped, and its packets are copied into a ring
+ * of int16 samples that readers look at in place.  Packets carry a 16-bit
+ * seqno, which is unwrapped into a packet number counted from the start.
+ * They come back on three endpoints, so can arrive a little out of order:
+ * 'committed' only moves past a packet once all those before it are in, and
+ * a packet that has not come by the time one AIN_REORDER later arrives is
+ * taken to be lost and zeroed.
+ *
+ * Each reader has a cursor, the number of the next sample it wants.  The
+ * device cannot be held up, so a reader that falls more than the ring behind
+ * is moved on, and the samples it missed are counted against its cursor.
+ * The transfers and the worker thread last as long as the stream.
+ */
+
+#define AIN_PKT_SAMPLES ((IN_PKT_SIZE-2)/2)
+#define AIN_REORDER 32  /* packets that may be in ahead of the committed one */
+
+struct pmd_ain_stream {
+    struct pmd_device* dev;
+    int nchannels;
+    int16_t* ring;
+    unsigned long ring_packets;
+    unsigned long long capacity;    /* samples in the ring */
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    int stopping;
+    int cancelled;
+    int failed;
+    int active_transfers;
+    struct libusb_transfer* xfers[NUM_XFERS];
+
+    unsigned long long committed;   /* packets, all those before are in */
+    uint32_t received;              /* bit i: packet committed+i is in */
+    unsigned long long written;     /* one past the furthest packet written */
+    struct pmd_ain_stream_stats stats;
+};
+
+static void ainstream_cb(struct libusb_transfer *xfer);
+static void* ainstream_worker(void* arg);
+
+/* Oldest sample still in the ring, rounded up to a whole set of channels.
+ * Lock held. */
+static unsigned long long ainstream_oldest(struct pmd_ain_stream* stream) {
+    unsigned long long end = stream->written * AIN_PKT_SAMPLES;
+    unsigned long long oldest;
+    if (end <= stream->capacity) {
+        return 0;
+    }
+    oldest = end - stream->capacity;
+    return (oldest + stream->nchannels - 1) / stream->nchannels * stream->nchannels;
+}
+
+/* Move a lapped cursor on to the oldest sample left.  Lock held. */
+static void ainstream_catch_up(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor) {
+    unsigned long long oldest = ainstream_oldest(stream);
+    if (cursor->position < oldest) {
+        cursor->lost += oldest - cursor->position;
+        cursor->overruns++;
+        stream->stats.overruns++;
+        cursor->position = oldest;
+    }
+}
+
+/* Start a continuous analogue input scan.  Returns the stream, or NULL */
+struct pmd_ain_stream* pmd_ainstream_start(libusb_device_handle* pmdhandle,
+          int lowch, int highch, int interval, int trigger, int bufsize) {
+    struct pmd_device* dev = find_device(pmdhandle);
+    struct pmd_ain_stream* stream;
+    pthread_condattr_t attr;
+    unsigned char msgbuf[64];
+    long int timer;
+    int pre, i, ret;
+
+    if (!dev) {
+        err("ainstream on a device not opened by pmd_find_first or pmd_find_all\n");
+        return NULL;
+    }
+    if (dev->ainstream || dev->scancontrol.active_transfers > 0) {
+        err("declined to start ainstream while a scan is active\n");
+        return NULL;
+    }
+    if (lowch < 0 || lowch > 3 || highch < 0 || highch > 3 || highch < lowch || bufsize < 1) {
+        err("invalid ainstream argument\n");
+        return NULL;
+    }
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        err("no memory for ainstream\n");
+        return NULL;
+    }
+    stream->dev = dev;
+    stream->nchannels = highch - lowch + 1;
+
+    /* whole packets, a whole number of sets of channels, and enough room
+     * that packets arriving early do not overwrite what readers can see */
+    stream->ring_packets = (bufsize + AIN_PKT_SAMPLES - 1) / AIN_PKT_SAMPLES;
+    if (stream->ring_packets < 2 * AIN_REORDER) {
+        stream->ring_packets = 2 * AIN_REORDER;
+    }
+    stream->ring_packets += stream->ring_packets % stream->nchannels
+        ? stream->nchannels - stream->ring_packets % stream->nchannels : 0;
+    stream->capacity = (unsigned long long)stream->ring_packets * AIN_PKT_SAMPLES;
+    stream->ring = calloc(stream->ring_packets, AIN_PKT_SAMPLES * sizeof(int16_t));
+    if (!stream->ring) {
+        err("no memory for ainstream buffer\n");
+        free(stream);
+        return NULL;
+    }
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->arrived, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (i = 0; i < NUM_XFERS; i++) {
+        unsigned char *databuf = malloc(IN_PKT_SIZE);
+        stream->xfers[i] = libusb_alloc_transfer(0);
+        if (!databuf || !stream->xfers[i]) {
+            err("no memory for ainstream transfers\n");
+            free(databuf);
+            goto out_free;
+        }
+        libusb_fill_interrupt_transfer(stream->xfers[i], pmdhandle, 0x83+i%3,
+                                databuf, IN_PKT_SIZE, ainstream_cb, stream, 0);
+        stream->xfers[i]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+    }
+
+    /* scanopts bit 0 clear: scan until ainstop, ignoring the count */
+    if ((ret = ain_configure(pmdhandle, stream->nchannels, interval, trigger, &pre, &timer)) < 0) {
+        goto out_free;
+    }
+    msgbuf[0] = 0x11;
+    msgbuf[1] = (unsigned char)lowch;
+    msgbuf[2] = (unsigned char)highch;
+    msgbuf[3] = msgbuf[4] = msgbuf[5] = msgbuf[6] = 0;
+    msgbuf[7] = (unsigned char)pre;
+    msgbuf[8] = timer & 0xff;
+    msgbuf[9] = (timer & 0xff00)>>8;
+    msgbuf[10]= (unsigned char)ret;
+
+    pthread_mutex_lock(&stream->lock);
+    for (i = 0; i < NUM_XFERS; i++) {
+        if ((ret = libusb_submit_transfer(stream->xfers[i])) < 0) {
+            err("submit ainstream transfer %d failed: %s\n", i, usb_get_errmsg(ret));
+            stream->stopping = 1;
+            break;
+        }
+        stream->active_transfers++;
+    }
+    pthread_mutex_unlock(&stream->lock);
+    if (!stream->stopping && (ret = send_control(pmdhandle, msgbuf, 11, 3000)) < 0) {
+        err("failed sending ain start: %s\n", usb_get_errmsg(ret));
+        stream->stopping = 1;
+    }
+
+    /* the worker cancels and cleans up if anything failed */
+    if ((ret = pthread_create(&stream->worker, NULL, ainstream_worker, stream))) {
+        err("failed to create ainstream worker thread: err %d\n", ret);
+        stream->stopping = 1;
+        ainstream_worker(stream);
+        goto out_free;
+    }
+    dev->ainstream = stream;
+    if (stream->stopping) {
+        pmd_ainstream_stop(stream);
+        return NULL;
+    }
+    return stream;
+
+out_free:
+    for (i = 0; i < NUM_XFERS; i++) {
+        libusb_free_transfer(stream->xfers[i]);
+    }
+    pthread_cond_destroy(&stream->arrived);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream->ring);
+    free(stream);
+    return NULL;
+}
+
+/* Stop a continuous scan and free it.  Blocks until its transfers have ended */
+void pmd_ainstream_stop(struct pmd_ain_stream* stream) {
+    int i;
+    if (!stream) {
+        return;
+    }
+    pmd_ainstop(stream->dev->handle);
+    pthread_mutex_lock(&stream->lock);
+    stream->stopping = 1;
+    pthread_cond_broadcast(&stream->arrived);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->worker, NULL);
+    stream->dev->ainstream = NULL;
+
+    for (i = 0; i < NUM_XFERS; i++) {
+        libusb_free_transfer(stream->xfers[i]);
+    }
+    pthread_cond_destroy(&stream->arrived);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream->ring);
+    free(stream);
+}
+
+/* Point a cursor at the next sample to arrive */
+void pmd_ainstream_cursor(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor) {
+    pthread_mutex_lock(&stream->lock);
+    cursor->position = stream->committed * AIN_PKT_SAMPLES;
+    cursor->position -= cursor->position % stream->nchannels;
+    cursor->overruns = 0;
+    cursor->lost = 0;
+    pthread_mutex_unlock(&stream->lock);
+}
+
+/* Wait for samples after a cursor and point *data at them in the ring */
+int pmd_ainstream_read(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor,
+          const int16_t **data, int min, int timeout) {
+    struct timespec deadline;
+    unsigned long long available, offset;
+    int ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    while (1) {
+        ainstream_catch_up(stream, cursor);
+        available = stream->committed * AIN_PKT_SAMPLES - cursor->position;
+        if (available >= (unsigned long long)(min > 0 ? min : 1) || stream->failed
+                || stream->stopping || ret == ETIMEDOUT) {
+            break;
+        }
+        ret = pthread_cond_timedwait(&stream->arrived, &stream->lock, &deadline);
+    }
+    offset = cursor->position % stream->capacity;
+    if (available > stream->capacity - offset) {
+        available = stream->capacity - offset;  /* up to the end of the ring */
+    }
+    if (available > 0x7fffffff) {
+        available = 0x7fffffff;
+    }
+    *data = stream->ring + offset;
+    ret = (available == 0 && stream->failed) ? -EIO : (int)available;
+    pthread_mutex_unlock(&stream->lock);
+    return ret;
+}
+
+/* Move a cursor past n samples.  Returns how many of them were overwritten */
+int pmd_ainstream_release(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor, int n) {
+    unsigned long long oldest, end = cursor->position + n;
+    int overwritten = 0;
+
+    pthread_mutex_lock(&stream->lock);
+    oldest = ainstream_oldest(stream);
+    if (oldest > cursor->position) {
+        overwritten = (int)((oldest < end ? oldest : end) - cursor->position);
+        cursor->lost += overwritten;
+        cursor->overruns++;
+        stream->stats.overruns++;
+    }
+    cursor->position = end;
+    pthread_mutex_unlock(&stream->lock);
+    return overwritten;
+}
+
+/* Counters for a continuous scan */
+void pmd_ainstream_stats(struct pmd_ain_stream* stream, struct pmd_ain_stream_stats* stats) {
+    pthread_mutex_lock(&stream->lock);
+    *stats = stream->stats;
+    stats->samples = stream->committed * AIN_PKT_SAMPLES;
+    stats->failed = stream->failed;
+    pthread_mutex_unlock(&stream->lock);
+}
+
+/* Event loop for a continuous scan: on stopping cancels the transfers and
+ * waits for the cancellations to come back */
+static void* ainstream_worker(void* arg) {
+    struct pmd_ain_stream* stream = (struct pmd_ain_stream*)arg;
+    struct timeval tv;
+    int i, active;
+
+    while (1) {
+        pthread_mutex_lock(&stream->lock);
+        if (stream->stopping && !stream->cancelled) {
+            for (i = 0; i < NUM_XFERS; i++) {
+                libusb_cancel_transfer(stream->xfers[i]);
+            }
+            stream->cancelled = 1;
+        }
+        active = stream->active_transfers;
+        pthread_mutex_unlock(&stream->lock);
+
+        if (stream->stopping && active == 0) {
+            break;
+        }
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        libusb_handle_events_timeout(stream->dev->ctx, &tv);
+    }
+    dbg("ainstream worker finishing\n");
+    return 0;
+}
+
+/* Copy a packet into the ring and advance the committed packet.  Lock held. */
+static void ainstream_store(struct pmd_ain_stream* stream, unsigned char* buffer) {
+    uint16_t seqno = *(uint16_t*)(buffer+IN_PKT_SIZE-2);
+    unsigned int ahead = (uint16_t)(seqno - (uint16_t)stream->committed);
+    unsigned long long packet, before = stream->committed;
+    int16_t* slot;
+    int i;
+
+    if (ahead >= 0x8000 || (ahead < AIN_REORDER && (stream->received & (1u << ahead)))) {
+        err("ainstream stale seqno %d\n", seqno);
+        stream->stats.errors++;
+        return;
+    }
+    /* packets that should have come by now are not coming */
+    while (ahead >= AIN_REORDER) {
+        if (!(stream->received & 1)) {
+            memset(stream->ring + (stream->committed % stream->ring_packets) * AIN_PKT_SAMPLES,
+                   0, AIN_PKT_SAMPLES * sizeof(int16_t));
+            stream->stats.missed += AIN_PKT_SAMPLES;
+        }
+        stream->received >>= 1;
+        stream->committed++;
+        ahead--;
+    }
+
+    packet = stream->committed + ahead;
+    slot = stream->ring + (packet % stream->ring_packets) * AIN_PKT_SAMPLES;
+    for (i = 0; i < AIN_PKT_SAMPLES; i++) {
+        slot[i] = *(((int16_t*)buffer)+i)/16;
+    }
+    stream->stats.packets++;
+    if (packet + 1 > stream->written) {
+        stream->written = packet + 1;
+    }
+    stream->received |= 1u << ahead;
+    while (stream->received & 1) {
+        stream->received >>= 1;
+        stream->committed++;
+    }
+    if (stream->committed != before) {
+        pthread_cond_broadcast(&stream->arrived);
+    }
+}
+
+/* ainstream completion handler */
+static void ainstream_cb(struct libusb_transfer *xfer) {
+    struct pmd_ain_stream* stream = (struct pmd_ain_stream*)(xfer->user_data);
+    int ret;
+
+    pthread_mutex_lock(&stream->lock);
+    if (xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        stream->active_transfers--;
+        if (xfer->status != LIBUSB_TRANSFER_CANCELLED) {
+            /* packets would go missing from then on, so give up */
+            err("ainstream xfer status %d ep %x\n", xfer->status, xfer->endpoint);
+            stream->stats.errors++;
+            pthread_mutex_lock(&stream->dev->stats_lock);
+            stats_count(&stream->dev->stats, status_error(xfer->status));
+            pthread_mutex_unlock(&stream->dev->stats_lock);
+            stream->failed = 1;
+            stream->stopping = 1;
+            pthread_cond_broadcast(&stream->arrived);
+        }
+        pthread_mutex_unlock(&stream->lock);
+        return;
+    }
+
+    ainstream_store(stream, xfer->buffer);
+    if (stream->stopping) {
+        stream->active_transfers--;
+    } else if ((ret = libusb_submit_transfer(xfer)) < 0) {
+        err("resubmit ainstream transfer failed: %s\n", usb_get_errmsg(ret));
+        stream->stats.errors++;
+        stream->active_transfers--;
+        stream->failed = 1;
+        stream->stopping = 1;
+        pthread_cond_broadcast(&stream->arrived);
+    }
+    pthread_mutex_unlock(&stream->lock);
+}
+
 /* Send a value to an analogue output channel (0 or 1).  Value 0...4095.
  * Returns 4 (bytes sent) or a negative libusb error */
 int pmd_aout(libusb_device_handle* pmdhandle, int channel, int value) {
@@ -620,8 +1308,7 @@ int pmd_digin(libusb_device_handle* pmdhandle, int port) {
     int rxlength;
     msgbuf[0] = 0x03;
     msgbuf[1] = 0x00;
-    send_control(pmdhandle, msgbuf, 2, 3000);
-    get_data(pmdhandle, msgbuf, 64, &rxlength, 3000);
+    transact(pmdhandle, msgbuf, 2, &rxlength, 3000);
     if (port == 0) {
         return msgbuf[1];
     } else {
@@ -636,11 +1323,373 @@ int pmd_digin16(libusb_device_handle* pmdhandle) {
     int rxlength;
     msgbuf[0] = 0x03;
     msgbuf[1] = 0x00;
-    send_control(pmdhandle, msgbuf, 2, 3000);
-    get_data(pmdhandle, msgbuf, 64, &rxlength, 3000);
+    transact(pmdhandle, msgbuf, 2, &rxlength, 3000);
     return msgbuf[1] + (msgbuf[2] << 8);
 }
 
+/* Asynchronous digital input.
+ * Every reading is a request on the control endpoint followed by a reply on
+ * ep 0x81.  digin16 makes the two transfers in turn and waits for each, so
+ * the bus idles while the host turns round.  A stream instead keeps up to
+ * 'depth' requests in flight with a reply transfer waiting for each, and a
+ * worker thread runs the libusb event loop.  Each reply is timestamped as it
+ * completes and handed to the callback, and another request goes out at once
+ * (or when the pacing interval allows).
+ *
+ * The stream's state is shared between the worker and whichever thread
+ * libusb runs the completion handlers in, so it is all under stream->lock.
+ * The user callback is called without the lock held.
+ */
+
+#define DIGIN_MAX_DEPTH 16
+#define DIGIN_REQUEST_SIZE 2
+
+struct pmd_digin_stream {
+    libusb_device_handle* pmdhandle;
+    struct pmd_device* dev;
+    libusb_context* ctx;
+    int depth;
+    double interval;        /* s between requests, 0 for as fast as possible */
+    pmd_digin_callback callback;
+    void* user_data;
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    int stopping;
+    int cancelled;
+
+    struct libusb_transfer* requests[DIGIN_MAX_DEPTH];
+    unsigned long request_id[DIGIN_MAX_DEPTH];  /* 0 when the slot is free */
+    struct libusb_transfer* replies[DIGIN_MAX_DEPTH];
+    int active_transfers;
+    int active_replies;     /* the stream stops itself once none is left */
+
+    /* requests sent and not yet answered, oldest first, to give latencies */
+    double sent_time[DIGIN_MAX_DEPTH];
+    unsigned long sent_id[DIGIN_MAX_DEPTH];
+    int awaited;
+
+    double next_due;
+    unsigned long next_id;
+    unsigned long seqno;
+    unsigned long errors;
+};
+
+static void digin_request_cb(struct libusb_transfer *xfer);
+static void digin_reply_cb(struct libusb_transfer *xfer);
+static void* digin_worker(void* arg);
+
+/* CLOCK_MONOTONIC in seconds */
+static double monotonic_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/* Send requests until depth are awaited or pacing says wait.  Lock held. */
+static void digin_pump(struct pmd_digin_stream* stream, double now) {
+    int slot, ret;
+    while (!stream->stopping && stream->awaited < stream->depth
+           && (stream->interval <= 0 || now >= stream->next_due)) {
+        for (slot = 0; slot < stream->depth && stream->request_id[slot]; slot++) {}
+        if (slot == stream->depth) {
+            return; /* all request transfers still completing */
+        }
+        if ((ret = libusb_submit_transfer(stream->requests[slot])) < 0) {
+            err("digin request failed: %s\n", usb_get_errmsg(ret));
+            stream->errors++;
+            if (ret == LIBUSB_ERROR_NO_DEVICE) {
+                stream->stopping = 1;
+            }
+            return;
+        }
+        stream->request_id[slot] = ++stream->next_id;
+        stream->sent_time[stream->awaited] = now;
+        stream->sent_id[stream->awaited] = stream->next_id;
+        stream->awaited++;
+        stream->active_transfers++;
+        if (stream->interval > 0) {
+            /* keep to the grid, unless so far behind that we would burst */
+            stream->next_due += stream->interval;
+            if (stream->next_due < now) {
+                stream->next_due = now + stream->interval;
+            }
+        }
+    }
+}
+
+/* Start streaming digital input.  Returns the stream, or NULL on error */
+struct pmd_digin_stream* pmd_digin_start(libusb_device_handle* pmdhandle,
+          int depth, int interval, pmd_digin_callback callback, void* user_data) {
+    struct pmd_digin_stream* stream;
+    struct pmd_device* dev = find_device(pmdhandle);
+    int i, ret;
+
+    if (!dev) {
+        err("digin_start on a device not opened by pmd_find_first or pmd_find_all\n");
+        return NULL;
+    }
+    if (!callback || depth < 1 || depth > DIGIN_MAX_DEPTH || interval < 0) {
+        err("invalid digin_start argument\n");
+        return NULL;
+    }
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        err("no memory for digin stream\n");
+        return NULL;
+    }
+    stream->pmdhandle = pmdhandle;
+    stream->dev = dev;
+    stream->ctx = dev->ctx;
+    stream->depth = depth;
+    stream->interval = 1e-6 * interval;
+    stream->callback = callback;
+    stream->user_data = user_data;
+    pthread_mutex_init(&stream->lock, NULL);
+
+    for (i = 0; i < depth; i++) {
+        unsigned char *request = malloc(LIBUSB_CONTROL_SETUP_SIZE + DIGIN_REQUEST_SIZE);
+        unsigned char *reply = malloc(IN_PKT_SIZE);
+        stream->requests[i] = libusb_alloc_transfer(0);
+        stream->replies[i] = libusb_alloc_transfer(0);
+        if (!request || !reply || !stream->requests[i] || !stream->replies[i]) {
+            err("no memory for digin transfers\n");
+            free(request);
+            free(reply);
+            goto out_free;
+        }
+        /* the same request as send_control makes for digin16 */
+        libusb_fill_control_setup(request, 0x21, 0x09, 0x200 + 0x03, 0, DIGIN_REQUEST_SIZE);
+        request[LIBUSB_CONTROL_SETUP_SIZE] = 0x03;
+        request[LIBUSB_CONTROL_SETUP_SIZE + 1] = 0x00;
+        libusb_fill_control_transfer(stream->requests[i], pmdhandle, request,
+                                digin_request_cb, stream, 3000);
+        stream->requests[i]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+        libusb_fill_interrupt_transfer(stream->replies[i], pmdhandle, 0x81,
+                                reply, IN_PKT_SIZE, digin_reply_cb, stream, 0);
+        stream->replies[i]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+    }
+
+    /* replies first, so that none can be missed */
+    pthread_mutex_lock(&stream->lock);
+    for (i = 0; i < depth; i++) {
+        if ((ret = libusb_submit_transfer(stream->replies[i])) < 0) {
+            err("submit digin reply %d failed: %s\n", i, usb_get_errmsg(ret));
+            stream->stopping = 1;
+            break;
+        }
+        stream->active_transfers++;
+        stream->active_replies++;
+    }
+    stream->next_due = monotonic_time();
+    pthread_mutex_unlock(&stream->lock);
+
+    /* the worker cancels and cleans up if the submissions failed */
+    if ((ret = pthread_create(&stream->worker, NULL, digin_worker, stream))) {
+        err("failed to create digin worker thread: err %d\n", ret);
+        stream->stopping = 1;
+        digin_worker(stream);
+        goto out_free;
+    }
+    pthread_mutex_lock(&stream->lock);
+    ret = stream->stopping;
+    pthread_mutex_unlock(&stream->lock);
+    if (ret) {
+        pmd_digin_stop(stream);
+        return NULL;
+    }
+    return stream;
+
+out_free:
+    for (i = 0; i < depth; i++) {
+        libusb_free_transfer(stream->requests[i]);
+        libusb_free_transfer(stream->replies[i]);
+    }
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+    return NULL;
+}
+
+/* Stop a stream and free it.  Blocks until all its transfers have ended */
+void pmd_digin_stop(struct pmd_digin_stream* stream) {
+    int i;
+    if (!stream) {
+        return;
+    }
+    pthread_mutex_lock(&stream->lock);
+    stream->stopping = 1;
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->worker, NULL);
+
+    for (i = 0; i < stream->depth; i++) {
+        libusb_free_transfer(stream->requests[i]);
+        libusb_free_transfer(stream->replies[i]);
+    }
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+}
+
+/* Number of readings delivered so far */
+unsigned long pmd_digin_readings(struct pmd_digin_stream* stream) {
+    unsigned long n;
+    pthread_mutex_lock(&stream->lock);
+    n = stream->seqno;
+    pthread_mutex_unlock(&stream->lock);
+    return n;
+}
+
+/* Number of failed transfers so far */
+unsigned long pmd_digin_errors(struct pmd_digin_stream* stream) {
+    unsigned long n;
+    pthread_mutex_lock(&stream->lock);
+    n = stream->errors;
+    pthread_mutex_unlock(&stream->lock);
+    return n;
+}
+
+/* Whether the stream is still running, rather than stopped by itself */
+int pmd_digin_active(struct pmd_digin_stream* stream) {
+    int active;
+    pthread_mutex_lock(&stream->lock);
+    active = !stream->stopping;
+    pthread_mutex_unlock(&stream->lock);
+    return active;
+}
+
+/* Event loop for a digin stream: paces the requests, and on stopping cancels
+ * everything and waits for the cancellations to come back */
+static void* digin_worker(void* arg) {
+    struct pmd_digin_stream* stream = (struct pmd_digin_stream*)arg;
+    struct timeval tv;
+    double now, wait;
+    int i, active;
+
+    while (1) {
+        pthread_mutex_lock(&stream->lock);
+        now = monotonic_time();
+        if (stream->stopping && !stream->cancelled) {
+            for (i = 0; i < stream->depth; i++) {
+                if (stream->request_id[i]) {
+                    libusb_cancel_transfer(stream->requests[i]);
+                }
+                libusb_cancel_transfer(stream->replies[i]);
+            }
+            stream->cancelled = 1;
+        }
+        digin_pump(stream, now);
+        active = stream->active_transfers;
+        wait = 0.1;
+        if (!stream->stopping && stream->interval > 0 && stream->awaited < stream->depth) {
+            wait = stream->next_due - now;
+            if (wait < 0) {
+                wait = 0;
+            }
+        }
+        pthread_mutex_unlock(&stream->lock);
+
+        if (stream->stopping && active == 0) {
+            break;
+        }
+        tv.tv_sec = (time_t)wait;
+        tv.tv_usec = (suseconds_t)(1e6 * (wait - tv.tv_sec));
+        libusb_handle_events_timeout(stream->ctx, &tv);
+    }
+    dbg("digin worker finishing\n");
+    return 0;
+}
+
+/* digin request completion handler */
+static void digin_request_cb(struct libusb_transfer *xfer) {
+    struct pmd_digin_stream* stream = (struct pmd_digin_stream*)(xfer->user_data);
+    int slot, i;
+
+    pthread_mutex_lock(&stream->lock);
+    stream->active_transfers--;
+    for (slot = 0; slot < stream->depth && stream->requests[slot] != xfer; slot++) {}
+
+    if (xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        /* no reply will come, so forget the request */
+        if (xfer->status != LIBUSB_TRANSFER_CANCELLED) {
+            err("digin request status %d\n", xfer->status);
+            stream->errors++;
+            pthread_mutex_lock(&stream->dev->stats_lock);
+            stats_count(&stream->dev->stats, status_error(xfer->status));
+            pthread_mutex_unlock(&stream->dev->stats_lock);
+        }
+        for (i = 0; i < stream->awaited && stream->sent_id[i] != stream->request_id[slot]; i++) {}
+        if (i < stream->awaited) {
+            memmove(stream->sent_time + i, stream->sent_time + i + 1, (stream->awaited - i - 1) * sizeof(double));
+            memmove(stream->sent_id + i, stream->sent_id + i + 1, (stream->awaited - i - 1) * sizeof(unsigned long));
+            stream->awaited--;
+        }
+        if (xfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+            stream->stopping = 1;
+        }
+    }
+    stream->request_id[slot] = 0;
+    digin_pump(stream, monotonic_time());
+    pthread_mutex_unlock(&stream->lock);
+}
+
+/* digin reply completion handler */
+static void digin_reply_cb(struct libusb_transfer *xfer) {
+    struct pmd_digin_stream* stream = (struct pmd_digin_stream*)(xfer->user_data);
+    struct pmd_digin_sample sample;
+    double now = monotonic_time();
+    int ret;
+
+    pthread_mutex_lock(&stream->lock);
+    if (xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        stream->active_transfers--;
+        stream->active_replies--;
+        if (xfer->status != LIBUSB_TRANSFER_CANCELLED) {
+            err("digin reply status %d\n", xfer->status);
+            stream->errors++;
+            pthread_mutex_lock(&stream->dev->stats_lock);
+            stats_count(&stream->dev->stats, status_error(xfer->status));
+            pthread_mutex_unlock(&stream->dev->stats_lock);
+            /* carry on with one fewer reply, unless the device has gone */
+            if (xfer->status == LIBUSB_TRANSFER_NO_DEVICE || stream->active_replies == 0) {
+                stream->stopping = 1;
+            }
+        }
+        pthread_mutex_unlock(&stream->lock);
+        return;
+    }
+
+    sample.value = xfer->buffer[1] + (xfer->buffer[2] << 8);
+    sample.time = now;
+    sample.latency = 0;
+    if (stream->awaited > 0) {
+        /* replies come back in the order the requests went out */
+        sample.latency = now - stream->sent_time[0];
+        pthread_mutex_lock(&stream->dev->stats_lock);
+        pmd_histogram_add(&stream->dev->stats.stream, (unsigned long long)(1e9 * sample.latency));
+        pthread_mutex_unlock(&stream->dev->stats_lock);
+        memmove(stream->sent_time, stream->sent_time + 1, (stream->awaited - 1) * sizeof(double));
+        memmove(stream->sent_id, stream->sent_id + 1, (stream->awaited - 1) * sizeof(unsigned long));
+        stream->awaited--;
+    }
+    sample.seqno = ++stream->seqno;
+
+    if (stream->stopping) {
+        stream->active_transfers--;
+        stream->active_replies--;
+    } else if ((ret = libusb_submit_transfer(xfer)) < 0) {
+        err("resubmit digin reply failed: %s\n", usb_get_errmsg(ret));
+        stream->errors++;
+        stream->active_transfers--;
+        /* with no reply left to read, requests would go unanswered */
+        if (--stream->active_replies == 0) {
+            stream->stopping = 1;
+        }
+    }
+    digin_pump(stream, now);
+    pthread_mutex_unlock(&stream->lock);
+
+    stream->callback(&sample, stream->user_data);
+}
+
 /* Zero the counter. Returns 2 (bytes sent) or a negative libusb error */
 int pmd_crst(libusb_device_handle* pmdhandle) {
     unsigned char msgbuf[64];
@@ -656,8 +1705,7 @@ unsigned long pmd_cin(libusb_device_handle* pmdhandle) {
     int rxlength;
     msgbuf[0] = 0x21;
     msgbuf[1] = 0x00;
-    send_control(pmdhandle, msgbuf, 2, 3000);
-    get_data(pmdhandle, msgbuf, 64, &rxlength, 3000);
+    transact(pmdhandle, msgbuf, 2, &rxlength, 3000);
     memcpy(&count, &msgbuf[1], 4);  /* NOTE little-endian */
     return count;
 }
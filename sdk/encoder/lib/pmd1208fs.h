@@ -3,15 +3,25 @@
 /* pmd1208fs.h  --  Header for libpmd1208fs library 
  * Copyright 2005 - 2015   Mark Colclough  */
 
+#include <stdio.h>
 #include <libusb-1.0/libusb.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Find a PMD1208FS device.  Return a device handle, or NULL. */
+/* Find a PMD1208FS device not already open.  Return a device handle, or NULL.
+ * Each device is opened in a libusb context of its own, so several boards can
+ * scan at once without their transfers waiting on each other. */
 libusb_device_handle* pmd_find_first(void);
 
+/* Open every PMD1208FS not already open, up to max of them, and put their
+ * handles in handles[].  Returns the number opened (0 if none), or a negative
+ * libusb error.  Each handle must be closed with pmd_close.  Boards this
+ * process or another already has open are left alone: a board is reset once
+ * it has been claimed. */
+int pmd_find_all(libusb_device_handle** handles, int max);
+
 /* Close the PMD1208FS device. */
 void pmd_close(libusb_device_handle* pmdhandle);
 
@@ -36,7 +46,8 @@ int pmd_ain(libusb_device_handle* pmdhandle, int channel, int range);
  * data is an array of int16_t that the caller must provide for receiving the
  * data, and datsize is the size of that array.
  * Return value is 0 or a negative error code: either -EINVAL, -ENOMEM, -EIO,
- * -EAGAIN or a libusb error.
+ * -EAGAIN, -ENODEV (a handle not from pmd_find_first or pmd_find_all) or a
+ * libusb error.  Scans on different devices are independent.
  */
 int pmd_ainscan(libusb_device_handle* pmdhandle,
           int lowch, int highch, int npts, int interval, int trigger,
@@ -52,10 +63,70 @@ int pmd_ainawaited(libusb_device_handle* pmdhandle);
  * goes to zero -- up to a few seconds if an ainkill was issued */
 int pmd_ainactive(libusb_device_handle* pmdhandle);
 
+/* Called from the collection thread when a non-blocking ainscan finishes,
+ * with status 0 if all the data arrived, or -EIO. */
+typedef void (*pmd_ainscan_callback)(libusb_device_handle* pmdhandle, int status, void* user_data);
+
+/* Set the function called when a non-blocking ainscan on this device
+ * finishes (NULL for none).  Returns 0, or -ENODEV for an unknown handle */
+int pmd_ainscan_notify(libusb_device_handle* pmdhandle,
+          pmd_ainscan_callback callback, void* user_data);
+
 /* Force a non-blocking ainscan to finish.  Check pmd_ainactive to see
  * when it has.   Automatically issues ainstop first */
 void pmd_ainkill(libusb_device_handle* pmdhandle);
 
+/* Continuous analogue input.  pmd_ainstream_start runs a scan of channels
+ * lowch..highch until pmd_ainstream_stop, with interval and trigger as for
+ * ainscan, into a ring of at least bufsize samples (rounded up to whole
+ * packets and whole sets of channels).  Samples are numbered from 0 at the
+ * start of the scan, interleaved by channel as in ainscan, so sample k is
+ * from channel lowch + k % nchannels.  One worker thread and one set of
+ * transfers serve the whole stream.  No other ainscan may run on the device
+ * meanwhile.  Returns the stream, or NULL on error */
+struct pmd_ain_stream;
+struct pmd_ain_stream* pmd_ainstream_start(libusb_device_handle* pmdhandle,
+          int lowch, int highch, int interval, int trigger, int bufsize);
+
+/* Stop a continuous scan, waiting for its transfers to end, and free it */
+void pmd_ainstream_stop(struct pmd_ain_stream* stream);
+
+/* A reader's place in a continuous scan.  Any number of readers may each
+ * have one.  The scan never waits for readers: one that falls more than the
+ * ring behind is moved on to the oldest sample left, counting an overrun and
+ * the samples it lost */
+struct pmd_ain_cursor {
+    unsigned long long position;    /* number of the next sample to read */
+    unsigned long overruns;         /* times this reader was lapped */
+    unsigned long long lost;        /* samples it missed because of that */
+};
+
+/* Point a cursor at the next sample to arrive */
+void pmd_ainstream_cursor(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor);
+
+/* Wait up to timeout ms for at least min samples after the cursor, and point
+ * *data at them, in place in the ring.  Returns the number that can be read
+ * from *data, which is fewer than min where the ring wraps or on timeout,
+ * or -EIO if the scan has failed and there is nothing left to read.  The
+ * cursor does not move until pmd_ainstream_release */
+int pmd_ainstream_read(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor,
+          const int16_t **data, int min, int timeout);
+
+/* Move the cursor past n samples that have been used.  Returns how many of
+ * them were overwritten while they were being read (0 if all were good) */
+int pmd_ainstream_release(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor, int n);
+
+/* Counters for a continuous scan */
+struct pmd_ain_stream_stats {
+    unsigned long long samples;     /* complete, in order, so far */
+    unsigned long packets;          /* packets received */
+    unsigned long long missed;      /* samples in packets that never came (zeroed) */
+    unsigned long overruns;         /* times any reader was lapped */
+    unsigned long errors;           /* failed or out of place transfers */
+    int failed;                     /* the scan stopped because of an error */
+};
+void pmd_ainstream_stats(struct pmd_ain_stream* stream, struct pmd_ain_stream_stats* stats);
+
 /* Tell analogue input to stop sending. Returns 2 (bytes sent) or negative libusb error.
  * Should not be needed in user code */
 int pmd_ainstop(libusb_device_handle* pmdhandle);
@@ -82,6 +153,84 @@ int pmd_digin(libusb_device_handle* pmdhandle, int port);
  * Returns 0-65535 (or junk if the read failed) */
 int pmd_digin16(libusb_device_handle* pmdhandle);
     
+/* Streamed digital input.  pmd_digin_start keeps up to depth (1..16)
+ * digin16 requests in flight and calls callback from a worker thread with
+ * each reading, timestamped with CLOCK_MONOTONIC as its reply arrives.
+ * interval is the minimum time between requests (us), 0 to read as fast as
+ * the bus allows.  The callback must not call pmd_digin_stop, and while a
+ * stream runs nothing else may read the device's replies (digin, digin16,
+ * ain, serial, cin).  Returns the stream, or NULL on error */
+struct pmd_digin_sample {
+    unsigned int value;     /* both ports, as digin16 returns */
+    double time;            /* when the reply arrived, s */
+    double latency;         /* from sending the request to its reply, s */
+    unsigned long seqno;    /* readings delivered so far, from 1 */
+};
+typedef void (*pmd_digin_callback)(const struct pmd_digin_sample* sample, void* user_data);
+struct pmd_digin_stream;
+struct pmd_digin_stream* pmd_digin_start(libusb_device_handle* pmdhandle,
+          int depth, int interval, pmd_digin_callback callback, void* user_data);
+
+/* Stop a digin stream, waiting for its transfers to end, and free it */
+void pmd_digin_stop(struct pmd_digin_stream* stream);
+
+/* Readings delivered and failed transfers, so far, in a digin stream */
+unsigned long pmd_digin_readings(struct pmd_digin_stream* stream);
+unsigned long pmd_digin_errors(struct pmd_digin_stream* stream);
+
+/* Whether a digin stream is still running.  A stream stops itself, and
+ * delivers no more readings, once the device has gone or every one of its
+ * reply transfers has failed; it must still be freed with pmd_digin_stop */
+int pmd_digin_active(struct pmd_digin_stream* stream);
+
+/* Latency histograms.  Values, in ns, are counted in log-linear buckets as
+ * in HdrHistogram: one per ns below 16 ns, then 16 to each power of two, so
+ * that any value up to 2^40 ns (18 minutes) is known to within 1/16.
+ * Adding a value takes a few instructions and no lock; the caller must not
+ * add to or read one histogram from two threads at once.  Zero a histogram
+ * with memset to start it. */
+#define PMD_HIST_SUB_BUCKETS 16
+#define PMD_HIST_BUCKETS (37 * PMD_HIST_SUB_BUCKETS)
+struct pmd_histogram {
+    unsigned long long count;
+    unsigned long long sum;         /* ns */
+    unsigned long long min, max;    /* ns */
+    unsigned long buckets[PMD_HIST_BUCKETS];
+};
+
+/* Count a value in ns (larger ones are counted as 2^40 - 1) */
+void pmd_histogram_add(struct pmd_histogram* hist, unsigned long long value);
+
+/* The value in ns that percentile % (0..100) of those counted are at or
+ * below, to within 1/16; 0 if the histogram is empty */
+unsigned long long pmd_histogram_percentile(const struct pmd_histogram* hist, double percentile);
+
+/* Print a one line summary in us: count, mean, min, percentiles and max */
+void pmd_histogram_print(FILE* file, const char* name, const struct pmd_histogram* hist);
+
+/* Timing and errors of each device's USB traffic.  The synchronous reads
+ * (digin, digin16, ain, cin, serial) are timed from sending the request to
+ * receiving the reply, and digin streams from each request to its reply.
+ * Failures are counted by libusb error: errors[-code] for LIBUSB_ERROR_IO
+ * (-1) to LIBUSB_ERROR_NOT_SUPPORTED (-12), errors[0] for any other.
+ * Transfers that fail in a stream are counted under the nearest error code.
+ * If PMD_STATS is set in the environment, pmd_close prints the device's
+ * statistics to stderr. */
+#define PMD_USB_ERRORS 13
+struct pmd_usb_stats {
+    struct pmd_histogram transaction;
+    struct pmd_histogram stream;
+    unsigned long errors[PMD_USB_ERRORS];
+};
+
+/* Copy a device's statistics, or zero them.  Return 0, or -ENODEV for a
+ * handle not from pmd_find_first or pmd_find_all */
+int pmd_usb_stats_get(libusb_device_handle* pmdhandle, struct pmd_usb_stats* stats);
+int pmd_usb_stats_reset(libusb_device_handle* pmdhandle);
+
+/* Print statistics: both histograms and any errors */
+void pmd_usb_stats_print(FILE* file, const struct pmd_usb_stats* stats);
+
 /* Zero the counter. Returns 2 (bytes sent) or a negative libusb error */
 int pmd_crst(libusb_device_handle* pmdhandle);
 
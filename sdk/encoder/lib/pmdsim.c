@@ -0,0 +1,1210 @@
+/* pmdsim.c  --  Simulated USB1208FS, implementing the libpmd1208fs API
+ *               without the hardware (settings in pmdsim.h)
+ *
+ * There is one simulated board.  Its state, the settings and the simulated
+ * clock are all under board.lock; waits for the simulated clock, and calls
+ * back into user code, are made without it.
+ *
+ * The clock runs at 'speed' times real time, or with speed 0 it is virtual:
+ * it only moves when something waits for a later time, so the transfers go
+ * as fast as the host allows.  A transfer takes 'latency' plus a draw of
+ * the jitter, and the reading is taken at the time the reply comes back.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include "pmd1208fs.h"
+#include "pmdsim.h"
+#include "version.h"
+
+#define COUNTS 2048
+#define AIN_PKT_SAMPLES 31
+#define DIGIN_MAX_DEPTH 16
+#define SIM_TWO_PI 6.283185307179586
+
+#undef err
+#define err(arg...) fprintf(stderr, arg)
+
+enum { SOURCE_PENDULUM, SOURCE_SINE, SOURCE_FILE };
+
+/* The settings described in pmdsim.h */
+struct sim_settings {
+    int source;
+    char file[256];
+    double amplitude;   /* rad */
+    double period;
+    double length, mass, damping, maxtorque;
+    double offset, noise;
+    double latency, jitter;     /* s */
+    double speed;
+    double fail, glitch, stuck;
+    unsigned long disconnect;
+    unsigned int seed;
+};
+
+static struct sim_board {
+    pthread_mutex_t lock;
+    int configured;
+    int open;
+    int gone;               /* disconnected */
+    struct sim_settings set;
+    pmdsim_source source;   /* user's source, overriding set.source */
+    void* source_data;
+
+    /* the simulated clock */
+    double start_real;
+    double start_sim;
+    double virtual_time;
+
+    /* pendulum source */
+    double theta, thetadot, time;
+
+    /* file source, angles unwrapped */
+    double* file_time;
+    double* file_angle;
+    int file_rows;
+
+    unsigned int last_count;
+    unsigned int rng;
+    unsigned long transfers, failures;
+    struct pmd_usb_stats stats;     /* with the simulated latencies */
+    int aout[2];
+    unsigned long counter;
+
+    /* analogue scan (ainscan) */
+    int scan_active;
+    int scan_awaited;
+    int scan_error;
+    int scan_killed;
+    pmd_ainscan_callback done;
+    void* done_data;
+    struct pmd_ain_stream* ainstream;
+} board = { .lock = PTHREAD_MUTEX_INITIALIZER, .rng = 1, .aout = { 2048, 2048 } };
+
+#define SIM_HANDLE ((libusb_device_handle*)&board)
+
+/* CLOCK_MONOTONIC in seconds */
+static double monotonic_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/* Simulated time.  Lock held. */
+static double sim_now(void) {
+    if (board.set.speed > 0) {
+        return board.start_sim + (monotonic_time() - board.start_real) * board.set.speed;
+    }
+    return board.virtual_time;
+}
+
+/* Wait until simulated time t, giving up early if *stop is set.  In steps
+ * of at most 0.1 s, so that stopping is not held up.  Lock not held. */
+static void sim_wait(double t, volatile int* stop) {
+    struct timespec pause;
+    double wait;
+    while (!stop || !*stop) {
+        pthread_mutex_lock(&board.lock);
+        if (board.set.speed <= 0) {
+            if (t > board.virtual_time) {
+                board.virtual_time = t;
+            }
+            pthread_mutex_unlock(&board.lock);
+            return;
+        }
+        wait = (t - sim_now()) / board.set.speed;
+        pthread_mutex_unlock(&board.lock);
+        if (wait <= 0) {
+            return;
+        }
+        if (wait > 0.1) {
+            wait = 0.1;
+        }
+        pause.tv_sec = (time_t)wait;
+        pause.tv_nsec = (long)(1e9 * (wait - pause.tv_sec));
+        nanosleep(&pause, NULL);
+    }
+}
+
+/* Uniform on (0, 1) and standard normal.  Lock held. */
+static double sim_uniform(void) {
+    return (rand_r(&board.rng) + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+static double sim_normal(void) {
+    return sqrt(-2.0 * log(sim_uniform())) * cos(SIM_TWO_PI * sim_uniform());
+}
+
+/* Angular acceleration of the pendulum, as in the pendulum simulator */
+static double pendulum_acceleration(double theta, double thetadot) {
+    double torque = board.set.maxtorque * (board.aout[0] - 2048) / 2048.0;
+    return (torque - board.set.damping * thetadot - board.set.mass * 9.81 * board.set.length * sin(theta))
+        / (board.set.mass * board.set.length * board.set.length);
+}
+
+/* Advance the pendulum to time t by RK4 steps of at most 1 ms.  It never
+ * goes back, so an earlier time gets the latest state.  Lock held. */
+static void pendulum_advance(double t) {
+    double h, k1t, k1w, k2t, k2w, k3t, k3w, k4t, k4w;
+    while (board.time < t) {
+        h = t - board.time;
+        if (h > 1e-3) {
+            h = 1e-3;
+        }
+        k1t = board.thetadot;
+        k1w = pendulum_acceleration(board.theta, board.thetadot);
+        k2t = board.thetadot + 0.5 * h * k1w;
+        k2w = pendulum_acceleration(board.theta + 0.5 * h * k1t, k2t);
+        k3t = board.thetadot + 0.5 * h * k2w;
+        k3w = pendulum_acceleration(board.theta + 0.5 * h * k2t, k3t);
+        k4t = board.thetadot + h * k3w;
+        k4w = pendulum_acceleration(board.theta + h * k3t, k4t);
+        board.theta += h * (k1t + 2 * k2t + 2 * k3t + k4t) / 6;
+        board.thetadot += h * (k1w + 2 * k2w + 2 * k3w + k4w) / 6;
+        board.time += h;
+    }
+}
+
+/* The recording at time t, looped and linearly interpolated.  Lock held. */
+static double file_angle(double t) {
+    int lo, hi, mid;
+    double span, u;
+    if (board.file_rows == 1) {
+        return board.file_angle[0];
+    }
+    span = board.file_time[board.file_rows - 1] - board.file_time[0];
+    t = board.file_time[0] + fmod(t, span);
+    if (t < board.file_time[0]) {
+        t += span;
+    }
+    lo = 0;
+    hi = board.file_rows - 1;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (board.file_time[mid] <= t) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    u = (t - board.file_time[lo]) / (board.file_time[hi] - board.file_time[lo]);
+    return board.file_angle[lo] + u * (board.file_angle[hi] - board.file_angle[lo]);
+}
+
+/* Angle and angular velocity at time t.  Lock held. */
+static double sim_angle(double t) {
+    if (board.source) {
+        return board.source(t, board.source_data);
+    }
+    switch (board.set.source) {
+    case SOURCE_SINE:
+        return board.set.amplitude * sin(SIM_TWO_PI * t / board.set.period);
+    case SOURCE_FILE:
+        return board.file_rows > 0 ? file_angle(t) : 0;
+    default:
+        pendulum_advance(t);
+        return board.theta;
+    }
+}
+
+static double sim_velocity(double t) {
+    if (!board.source && board.set.source == SOURCE_PENDULUM) {
+        pendulum_advance(t);
+        return board.thetadot;
+    }
+    return (sim_angle(t + 1e-3) - sim_angle(t - 1e-3)) / 2e-3;
+}
+
+/* Both digital ports at time t: the 11-bit encoder count, with the
+ * configured noise and faults.  Lock held. */
+static unsigned int sim_ports(double t) {
+    double counts = board.set.offset + sim_angle(t) * COUNTS / SIM_TWO_PI;
+    long count;
+    if (board.set.noise > 0) {
+        counts += board.set.noise * sim_normal();
+    }
+    count = ((long)floor(counts + 0.5) % COUNTS + COUNTS) % COUNTS;
+    if (board.set.stuck > 0 && sim_uniform() < board.set.stuck) {
+        count = board.last_count;
+    } else if (board.set.glitch > 0 && sim_uniform() < board.set.glitch) {
+        count ^= 1L << (rand_r(&board.rng) % 11);
+    }
+    board.last_count = (unsigned int)count;
+    return (unsigned int)count;
+}
+
+/* An analogue channel at time t: 0 the angle (+-pi full scale), 1 the
+ * angular velocity (+-10 rad/s), the others nothing.  Lock held. */
+static int sim_channel(int channel, double t) {
+    double value = 0;
+    if (channel == 0) {
+        value = remainder(sim_angle(t), SIM_TWO_PI) / M_PI;
+    } else if (channel == 1) {
+        value = sim_velocity(t) / 10;
+    }
+    if (value > 1) {
+        value = 1;
+    } else if (value < -1) {
+        value = -1;
+    }
+    return (int)floor(2047 * value + 0.5);
+}
+
+/* Account for one transfer, drawing its latency and any fault.  Returns 0
+ * or a negative libusb error.  Lock held. */
+static int sim_transfer(double* latency) {
+    *latency = board.set.latency;
+    if (board.set.jitter > 0) {
+        *latency += fabs(board.set.jitter * sim_normal());
+    }
+    if (board.gone) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    board.transfers++;
+    if (board.set.disconnect && board.transfers >= board.set.disconnect) {
+        err("pmdsim: board disconnected after %lu transfers\n", board.transfers);
+        board.gone = 1;
+        board.failures++;
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if (board.set.fail > 0 && sim_uniform() < board.set.fail) {
+        board.failures++;
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    return 0;
+}
+
+/* Count a failure in the statistics.  Lock held. */
+static void sim_count_error(int code) {
+    board.stats.errors[code < 0 && -code < PMD_USB_ERRORS ? -code : 0]++;
+}
+
+/* A request and its reply, as the synchronous calls make.  Returns 0 or a
+ * negative libusb error, with the time of the reply */
+static int sim_exchange(libusb_device_handle* pmdhandle, double* when) {
+    double latency;
+    int ret;
+    if (pmdhandle != SIM_HANDLE || !board.open) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    pthread_mutex_lock(&board.lock);
+    ret = sim_transfer(&latency);
+    *when = sim_now() + latency;
+    if (ret < 0) {
+        sim_count_error(ret);
+    } else {
+        pmd_histogram_add(&board.stats.transaction, (unsigned long long)(1e9 * latency));
+    }
+    pthread_mutex_unlock(&board.lock);
+    sim_wait(*when, NULL);
+    return ret;
+}
+
+/* Settings */
+
+static void sim_defaults(struct sim_settings* set) {
+    memset(set, 0, sizeof(*set));
+    set->source = SOURCE_PENDULUM;
+    set->amplitude = 30 * M_PI / 180;
+    set->period = 2;
+    set->length = 1;
+    set->mass = 1;
+    set->damping = 0.05;
+    set->latency = 1e-3;
+    set->jitter = 1e-4;
+    set->speed = 1;
+    set->seed = 1;
+}
+
+/* Read a recording for the file source.  Lock held. */
+static int sim_load(const char* path) {
+    FILE* in = fopen(path, "r");
+    char line[256];
+    double t, count, last = 0, unwrapped = 0, change;
+    int rows = 0, size = 0;
+    double *times = NULL, *angles = NULL, *grown;
+
+    if (!in) {
+        err("pmdsim: cannot read %s\n", path);
+        return -ENOENT;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        if (line[0] == '#' || sscanf(line, "%lf %lf", &t, &count) != 2) {
+            continue;
+        }
+        if (rows == size) {
+            size = size ? 2 * size : 1024;
+            if (!(grown = realloc(times, size * sizeof(double)))) {
+                break;
+            }
+            times = grown;
+            if (!(grown = realloc(angles, size * sizeof(double)))) {
+                break;
+            }
+            angles = grown;
+        }
+        /* the shorter way round from the last count */
+        change = rows ? count - last : count;
+        change -= COUNTS * floor(change / COUNTS + 0.5);
+        unwrapped += change;
+        last = count;
+        times[rows] = t;
+        angles[rows] = unwrapped * SIM_TWO_PI / COUNTS;
+        if (rows == 0 || t > times[rows - 1]) {
+            rows++;
+        }
+    }
+    fclose(in);
+    if (rows == 0) {
+        err("pmdsim: no readings in %s\n", path);
+        free(times);
+        free(angles);
+        return -EINVAL;
+    }
+    free(board.file_time);
+    free(board.file_angle);
+    board.file_time = times;
+    board.file_angle = angles;
+    board.file_rows = rows;
+    return 0;
+}
+
+/* A number from a setting, flagging anything that is not one */
+static double sim_number(const char* value, int* ret) {
+    char* end;
+    double x = strtod(value, &end);
+    if (end == value || *end) {
+        err("pmdsim: %s is not a number\n", value);
+        *ret = -EINVAL;
+    }
+    return x;
+}
+
+int pmdsim_configure(const char* settings) {
+    char copy[1024];
+    char *token, *save, *value;
+    double now;
+    int ret = 0, restart = 0;
+    struct sim_settings* set = &board.set;
+
+    pthread_mutex_lock(&board.lock);
+    if (!board.configured) {
+        /* the clock starts at zero */
+        sim_defaults(set);
+        board.configured = 1;
+        restart = 1;
+        now = 0;
+    } else {
+        now = sim_now();
+    }
+    strncpy(copy, settings ? settings : "", sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = 0;
+    for (token = strtok_r(copy, " \t\n,", &save); token; token = strtok_r(NULL, " \t\n,", &save)) {
+        value = strchr(token, '=');
+        if (!value) {
+            err("pmdsim: setting %s has no value\n", token);
+            ret = -EINVAL;
+            continue;
+        }
+        *value++ = 0;
+        if (!strcmp(token, "source")) {
+            if (!strcmp(value, "pendulum")) set->source = SOURCE_PENDULUM;
+            else if (!strcmp(value, "sine")) set->source = SOURCE_SINE;
+            else if (!strcmp(value, "file")) set->source = SOURCE_FILE;
+            else ret = -EINVAL;
+            restart = 1;
+        }
+        else if (!strcmp(token, "file")) {
+            strncpy(set->file, value, sizeof(set->file) - 1);
+            set->source = SOURCE_FILE;
+            if (sim_load(set->file) < 0) ret = -EINVAL;
+        }
+        else if (!strcmp(token, "amplitude")) { set->amplitude = sim_number(value, &ret) * M_PI / 180; restart = 1; }
+        else if (!strcmp(token, "period")) set->period = sim_number(value, &ret);
+        else if (!strcmp(token, "length")) set->length = sim_number(value, &ret);
+        else if (!strcmp(token, "mass")) set->mass = sim_number(value, &ret);
+        else if (!strcmp(token, "damping")) set->damping = sim_number(value, &ret);
+        else if (!strcmp(token, "maxtorque")) set->maxtorque = sim_number(value, &ret);
+        else if (!strcmp(token, "offset")) set->offset = sim_number(value, &ret);
+        else if (!strcmp(token, "noise")) set->noise = sim_number(value, &ret);
+        else if (!strcmp(token, "latency")) set->latency = 1e-6 * sim_number(value, &ret);
+        else if (!strcmp(token, "jitter")) set->jitter = 1e-6 * sim_number(value, &ret);
+        else if (!strcmp(token, "speed")) set->speed = sim_number(value, &ret);
+        else if (!strcmp(token, "fail")) set->fail = sim_number(value, &ret);
+        else if (!strcmp(token, "glitch")) set->glitch = sim_number(value, &ret);
+        else if (!strcmp(token, "stuck")) set->stuck = sim_number(value, &ret);
+        else if (!strcmp(token, "disconnect")) set->disconnect = (unsigned long)sim_number(value, &ret);
+        else if (!strcmp(token, "seed")) { set->seed = (unsigned int)sim_number(value, &ret); board.rng = set->seed; }
+        else {
+            err("pmdsim: unknown setting %s\n", token);
+            ret = -EINVAL;
+        }
+    }
+    if (set->period <= 0 || set->length <= 0 || set->mass <= 0 || set->speed < 0) {
+        err("pmdsim: period, length and mass must be positive, speed not negative\n");
+        sim_defaults(set);
+        ret = -EINVAL;
+    }
+    if (set->source == SOURCE_FILE && board.file_rows == 0) {
+        err("pmdsim: file source without a file\n");
+        ret = -EINVAL;
+    }
+    /* carry the clock on from where it was, at the new speed */
+    board.start_sim = now;
+    board.virtual_time = now;
+    board.start_real = monotonic_time();
+    if (restart) {
+        board.theta = set->amplitude;
+        board.thetadot = 0;
+        board.time = now;
+    }
+    pthread_mutex_unlock(&board.lock);
+    return ret;
+}
+
+void pmdsim_set_source(pmdsim_source source, void* user_data) {
+    pthread_mutex_lock(&board.lock);
+    board.source = source;
+    board.source_data = user_data;
+    pthread_mutex_unlock(&board.lock);
+}
+
+double pmdsim_time(void) {
+    double now;
+    pthread_mutex_lock(&board.lock);
+    now = sim_now();
+    pthread_mutex_unlock(&board.lock);
+    return now;
+}
+
+unsigned long pmdsim_transfers(void) {
+    unsigned long n;
+    pthread_mutex_lock(&board.lock);
+    n = board.transfers;
+    pthread_mutex_unlock(&board.lock);
+    return n;
+}
+
+unsigned long pmdsim_failures(void) {
+    unsigned long n;
+    pthread_mutex_lock(&board.lock);
+    n = board.failures;
+    pthread_mutex_unlock(&board.lock);
+    return n;
+}
+
+/* The libpmd1208fs API */
+
+char* usb_get_errmsg(int errcode) {
+    switch (errcode) {
+        case LIBUSB_SUCCESS: return "usb success";
+        case LIBUSB_ERROR_IO: return "usb io error";
+        case LIBUSB_ERROR_INVALID_PARAM: return "usb param error";
+        case LIBUSB_ERROR_ACCESS: return "usb access error";
+        case LIBUSB_ERROR_NO_DEVICE: return "usb nodevice error";
+        case LIBUSB_ERROR_NOT_FOUND: return "usb notfound error";
+        case LIBUSB_ERROR_BUSY: return "usb busy error";
+        case LIBUSB_ERROR_TIMEOUT: return "usb timeout error";
+        case LIBUSB_ERROR_OVERFLOW: return "usb overflow error";
+        case LIBUSB_ERROR_PIPE: return "usb pipe error";
+        case LIBUSB_ERROR_INTERRUPTED: return "usb interrupted error";
+        case LIBUSB_ERROR_NO_MEM: return "usb nomem error";
+        case LIBUSB_ERROR_NOT_SUPPORTED: return "usb not supported error";
+        case LIBUSB_ERROR_OTHER: return "usb mystery error";
+        default: return "usb unknown error";
+    }
+}
+
+/* The simulated board, set up from PMDSIM the first time, unless it is
+ * already open or has been disconnected */
+int pmd_find_all(libusb_device_handle** handles, int max) {
+    int configured;
+    pthread_mutex_lock(&board.lock);
+    configured = board.configured;
+    pthread_mutex_unlock(&board.lock);
+    if (!configured && pmdsim_configure(getenv("PMDSIM")) < 0) {
+        err("pmdsim: some of PMDSIM was not understood\n");
+    }
+    pthread_mutex_lock(&board.lock);
+    if (board.open || board.gone || max < 1) {
+        pthread_mutex_unlock(&board.lock);
+        return 0;
+    }
+    board.open = 1;
+    pthread_mutex_unlock(&board.lock);
+    handles[0] = SIM_HANDLE;
+    return 1;
+}
+
+libusb_device_handle* pmd_find_first(void) {
+    libusb_device_handle* pmd;
+    if (pmd_find_all(&pmd, 1) < 1) {
+        err("device not found\n");
+        return NULL;
+    }
+    return pmd;
+}
+
+void pmd_close(libusb_device_handle* pmdhandle) {
+    if (pmdhandle == SIM_HANDLE) {
+        pthread_mutex_lock(&board.lock);
+        board.open = 0;
+        if (getenv("PMD_STATS")) {
+            fprintf(stderr, "pmdsim:\n");
+            pmd_usb_stats_print(stderr, &board.stats);
+        }
+        pthread_mutex_unlock(&board.lock);
+    }
+}
+
+/* Latencies are those simulated, not the time the calls took */
+int pmd_usb_stats_get(libusb_device_handle* pmdhandle, struct pmd_usb_stats* stats) {
+    if (pmdhandle != SIM_HANDLE) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&board.lock);
+    *stats = board.stats;
+    pthread_mutex_unlock(&board.lock);
+    return 0;
+}
+
+int pmd_usb_stats_reset(libusb_device_handle* pmdhandle) {
+    if (pmdhandle != SIM_HANDLE) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&board.lock);
+    memset(&board.stats, 0, sizeof(board.stats));
+    pthread_mutex_unlock(&board.lock);
+    return 0;
+}
+
+int pmd_flash(libusb_device_handle* pmdhandle) {
+    double when;
+    int ret = sim_exchange(pmdhandle, &when);
+    return ret < 0 ? ret : 2;
+}
+
+char *pmd_serial(libusb_device_handle* pmdhandle) {
+    double when;
+    if (sim_exchange(pmdhandle, &when) < 0) {
+        return "????????";
+    }
+    return "SIM00001";
+}
+
+/* The range is ignored: channels read full scale as described above */
+int pmd_ain(libusb_device_handle* pmdhandle, int channel, int range) {
+    double when;
+    int ret, value;
+    (void)range;
+    if ((ret = sim_exchange(pmdhandle, &when)) < 0) {
+        return -2049 + ret;
+    }
+    pthread_mutex_lock(&board.lock);
+    value = sim_channel(channel & 7, when);
+    pthread_mutex_unlock(&board.lock);
+    return value;
+}
+
+/* An analogue scan, filled a packet at a time as the simulated clock
+ * reaches it, so that its samples are of the angle as it happens */
+struct sim_scan {
+    int lowch, nchannels, totalpts;
+    double start, dt;
+    int16_t* data;
+};
+
+static int sim_scan_run(struct sim_scan* scan) {
+    double latency, t;
+    int k, i, end, ret = 0;
+    for (k = 0; k < scan->totalpts; k += AIN_PKT_SAMPLES) {
+        end = k + AIN_PKT_SAMPLES < scan->totalpts ? k + AIN_PKT_SAMPLES : scan->totalpts;
+        sim_wait(scan->start + end * scan->dt, &board.scan_killed);
+        pthread_mutex_lock(&board.lock);
+        if (board.scan_killed || (ret = sim_transfer(&latency)) < 0) {
+            board.scan_error = 1;
+            pthread_mutex_unlock(&board.lock);
+            return -EIO;
+        }
+        for (i = k; i < end; i++) {
+            t = scan->start + i * scan->dt;
+            scan->data[i] = (int16_t)sim_channel(scan->lowch + i % scan->nchannels, t);
+        }
+        board.scan_awaited -= 2 * (end - k);
+        pthread_mutex_unlock(&board.lock);
+    }
+    return 0;
+}
+
+static void* sim_scan_worker(void* arg) {
+    struct sim_scan* scan = (struct sim_scan*)arg;
+    int ret = sim_scan_run(scan);
+    pmd_ainscan_callback done;
+    void* done_data;
+    free(scan);
+    pthread_mutex_lock(&board.lock);
+    board.scan_active = 0;
+    done = board.done;
+    done_data = board.done_data;
+    pthread_mutex_unlock(&board.lock);
+    if (done) {
+        done(SIM_HANDLE, ret, done_data);
+    }
+    return 0;
+}
+
+/* External clock (interval 0) is taken to tick every ms */
+int pmd_ainscan(libusb_device_handle* pmdhandle,
+          int lowch, int highch, int npts, int interval, int trigger,
+          int16_t *data, int datsize, int blocking) {
+    struct sim_scan* scan;
+    pthread_t worker;
+    int nchannels, ret;
+    (void)trigger;
+
+    if (pmdhandle != SIM_HANDLE || !board.open) {
+        return -ENODEV;
+    }
+    if (lowch < 0 || lowch > 3 || highch < 0 || highch > 3 || highch < lowch) {
+        err("invalid channel\n");
+        return -EINVAL;
+    }
+    nchannels = highch - lowch + 1;
+    if (npts * nchannels > datsize || npts * nchannels < 1) {
+        err("invalid data size\n");
+        return -EINVAL;
+    }
+    if (interval != 0 && interval / nchannels < 20) {
+        err("conversion time below 20us\n");
+        return -EINVAL;
+    }
+    scan = malloc(sizeof(*scan));
+    if (!scan) {
+        return -ENOMEM;
+    }
+    pthread_mutex_lock(&board.lock);
+    if (board.scan_active || board.ainstream) {
+        pthread_mutex_unlock(&board.lock);
+        free(scan);
+        err("declined to ainscan while a scan is active\n");
+        return -EAGAIN;
+    }
+    scan->lowch = lowch;
+    scan->nchannels = nchannels;
+    scan->totalpts = npts * nchannels;
+    scan->start = sim_now();
+    scan->dt = 1e-6 * (interval ? (double)interval / nchannels : 1000);
+    scan->data = data;
+    board.scan_active = 1;
+    board.scan_awaited = 2 * scan->totalpts;
+    board.scan_error = 0;
+    board.scan_killed = 0;
+    pthread_mutex_unlock(&board.lock);
+
+    if (!blocking) {
+        if ((ret = pthread_create(&worker, NULL, sim_scan_worker, scan))) {
+            free(scan);
+            pthread_mutex_lock(&board.lock);
+            board.scan_active = 0;
+            pthread_mutex_unlock(&board.lock);
+            return -abs(ret);
+        }
+        pthread_detach(worker);
+        return 0;
+    }
+    ret = sim_scan_run(scan);
+    free(scan);
+    pthread_mutex_lock(&board.lock);
+    board.scan_active = 0;
+    pthread_mutex_unlock(&board.lock);
+    return ret;
+}
+
+int pmd_ainawaited(libusb_device_handle* pmdhandle) {
+    int ret;
+    if (pmdhandle != SIM_HANDLE) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&board.lock);
+    ret = board.scan_error ? -EIO : board.scan_awaited;
+    pthread_mutex_unlock(&board.lock);
+    return ret;
+}
+
+int pmd_ainactive(libusb_device_handle* pmdhandle) {
+    int ret;
+    if (pmdhandle != SIM_HANDLE) {
+        return 0;
+    }
+    pthread_mutex_lock(&board.lock);
+    ret = board.scan_active;
+    pthread_mutex_unlock(&board.lock);
+    return ret;
+}
+
+int pmd_ainscan_notify(libusb_device_handle* pmdhandle,
+          pmd_ainscan_callback callback, void* user_data) {
+    if (pmdhandle != SIM_HANDLE) {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&board.lock);
+    board.done = callback;
+    board.done_data = user_data;
+    pthread_mutex_unlock(&board.lock);
+    return 0;
+}
+
+void pmd_ainkill(libusb_device_handle* pmdhandle) {
+    pmd_ainstop(pmdhandle);
+    pthread_mutex_lock(&board.lock);
+    board.scan_killed = 1;
+    pthread_mutex_unlock(&board.lock);
+}
+
+int pmd_ainstop(libusb_device_handle* pmdhandle) {
+    double when;
+    int ret = sim_exchange(pmdhandle, &when);
+    return ret < 0 ? ret : 2;
+}
+
+/* Continuous analogue input, generated a packet at a time into a ring, with
+ * the same cursors as the real library.  Packets arrive in order here, so
+ * a packet that fails is simply zeroed and counted as missed. */
+struct pmd_ain_stream {
+    int lowch;
+    int nchannels;
+    double start, dt;
+    int16_t* ring;
+    unsigned long ring_packets;
+    unsigned long long capacity;
+    pthread_t worker;
+    pthread_cond_t arrived;
+    volatile int stopping;
+    unsigned long long committed;   /* packets */
+    struct pmd_ain_stream_stats stats;
+};
+
+static void* sim_ainstream_worker(void* arg) {
+    struct pmd_ain_stream* stream = (struct pmd_ain_stream*)arg;
+    unsigned long long k, n;
+    int16_t* slot;
+    double latency;
+    int i, ret;
+
+    for (k = 0; ; k++) {
+        sim_wait(stream->start + (k + 1) * AIN_PKT_SAMPLES * stream->dt, &stream->stopping);
+        pthread_mutex_lock(&board.lock);
+        if (stream->stopping) {
+            pthread_mutex_unlock(&board.lock);
+            break;
+        }
+        slot = stream->ring + (k % stream->ring_packets) * AIN_PKT_SAMPLES;
+        ret = sim_transfer(&latency);
+        if (ret == LIBUSB_ERROR_NO_DEVICE) {
+            stream->stats.errors++;
+            stream->stats.failed = 1;
+            stream->stopping = 1;
+            pthread_cond_broadcast(&stream->arrived);
+            pthread_mutex_unlock(&board.lock);
+            break;
+        } else if (ret < 0) {
+            memset(slot, 0, AIN_PKT_SAMPLES * sizeof(int16_t));
+            stream->stats.missed += AIN_PKT_SAMPLES;
+        } else {
+            for (i = 0; i < AIN_PKT_SAMPLES; i++) {
+                n = k * AIN_PKT_SAMPLES + i;
+                slot[i] = (int16_t)sim_channel(stream->lowch + n % stream->nchannels,
+                                               stream->start + n * stream->dt);
+            }
+            stream->stats.packets++;
+        }
+        stream->committed = k + 1;
+        pthread_cond_broadcast(&stream->arrived);
+        pthread_mutex_unlock(&board.lock);
+    }
+    return 0;
+}
+
+struct pmd_ain_stream* pmd_ainstream_start(libusb_device_handle* pmdhandle,
+          int lowch, int highch, int interval, int trigger, int bufsize) {
+    struct pmd_ain_stream* stream;
+    pthread_condattr_t attr;
+    (void)trigger;
+
+    if (pmdhandle != SIM_HANDLE || !board.open) {
+        return NULL;
+    }
+    if (lowch < 0 || lowch > 3 || highch < 0 || highch > 3 || highch < lowch || bufsize < 1
+            || (interval != 0 && interval / (highch - lowch + 1) < 20)) {
+        err("invalid ainstream argument\n");
+        return NULL;
+    }
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->lowch = lowch;
+    stream->nchannels = highch - lowch + 1;
+    stream->dt = 1e-6 * (interval ? (double)interval / stream->nchannels : 1000);
+    stream->ring_packets = (bufsize + AIN_PKT_SAMPLES - 1) / AIN_PKT_SAMPLES;
+    stream->ring_packets += stream->ring_packets % stream->nchannels
+        ? stream->nchannels - stream->ring_packets % stream->nchannels : 0;
+    stream->capacity = (unsigned long long)stream->ring_packets * AIN_PKT_SAMPLES;
+    stream->ring = calloc(stream->ring_packets, AIN_PKT_SAMPLES * sizeof(int16_t));
+    if (!stream->ring) {
+        free(stream);
+        return NULL;
+    }
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->arrived, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&board.lock);
+    if (board.scan_active || board.ainstream) {
+        pthread_mutex_unlock(&board.lock);
+        err("declined to start ainstream while a scan is active\n");
+        goto out_free;
+    }
+    board.ainstream = stream;
+    stream->start = sim_now();
+    pthread_mutex_unlock(&board.lock);
+    if (pthread_create(&stream->worker, NULL, sim_ainstream_worker, stream)) {
+        pthread_mutex_lock(&board.lock);
+        board.ainstream = NULL;
+        pthread_mutex_unlock(&board.lock);
+        goto out_free;
+    }
+    return stream;
+
+out_free:
+    pthread_cond_destroy(&stream->arrived);
+    free(stream->ring);
+    free(stream);
+    return NULL;
+}
+
+void pmd_ainstream_stop(struct pmd_ain_stream* stream) {
+    if (!stream) {
+        return;
+    }
+    pthread_mutex_lock(&board.lock);
+    stream->stopping = 1;
+    pthread_cond_broadcast(&stream->arrived);
+    pthread_mutex_unlock(&board.lock);
+    pthread_join(stream->worker, NULL);
+    pthread_mutex_lock(&board.lock);
+    board.ainstream = NULL;
+    pthread_mutex_unlock(&board.lock);
+    pthread_cond_destroy(&stream->arrived);
+    free(stream->ring);
+    free(stream);
+}
+
+/* Oldest sample still in the ring, rounded up to a whole set of channels.
+ * Lock held. */
+static unsigned long long sim_ainstream_oldest(struct pmd_ain_stream* stream) {
+    unsigned long long end = stream->committed * AIN_PKT_SAMPLES;
+    unsigned long long oldest;
+    if (end <= stream->capacity) {
+        return 0;
+    }
+    oldest = end - stream->capacity;
+    return (oldest + stream->nchannels - 1) / stream->nchannels * stream->nchannels;
+}
+
+void pmd_ainstream_cursor(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor) {
+    pthread_mutex_lock(&board.lock);
+    cursor->position = stream->committed * AIN_PKT_SAMPLES;
+    cursor->position -= cursor->position % stream->nchannels;
+    cursor->overruns = 0;
+    cursor->lost = 0;
+    pthread_mutex_unlock(&board.lock);
+}
+
+/* The timeout is in real time, whatever the speed */
+int pmd_ainstream_read(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor,
+          const int16_t **data, int min, int timeout) {
+    struct timespec deadline;
+    unsigned long long available, offset, oldest;
+    int ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
+    }
+
+    pthread_mutex_lock(&board.lock);
+    while (1) {
+        oldest = sim_ainstream_oldest(stream);
+        if (cursor->position < oldest) {
+            cursor->lost += oldest - cursor->position;
+            cursor->overruns++;
+            stream->stats.overruns++;
+            cursor->position = oldest;
+        }
+        available = stream->committed * AIN_PKT_SAMPLES - cursor->position;
+        if (available >= (unsigned long long)(min > 0 ? min : 1) || stream->stopping || ret == ETIMEDOUT) {
+            break;
+        }
+        ret = pthread_cond_timedwait(&stream->arrived, &board.lock, &deadline);
+    }
+    offset = cursor->position % stream->capacity;
+    if (available > stream->capacity - offset) {
+        available = stream->capacity - offset;
+    }
+    if (available > 0x7fffffff) {
+        available = 0x7fffffff;
+    }
+    *data = stream->ring + offset;
+    ret = (available == 0 && stream->stats.failed) ? -EIO : (int)available;
+    pthread_mutex_unlock(&board.lock);
+    return ret;
+}
+
+int pmd_ainstream_release(struct pmd_ain_stream* stream, struct pmd_ain_cursor* cursor, int n) {
+    unsigned long long oldest, end = cursor->position + n;
+    int overwritten = 0;
+
+    pthread_mutex_lock(&board.lock);
+    oldest = sim_ainstream_oldest(stream);
+    if (oldest > cursor->position) {
+        overwritten = (int)((oldest < end ? oldest : end) - cursor->position);
+        cursor->lost += overwritten;
+        cursor->overruns++;
+        stream->stats.overruns++;
+    }
+    cursor->position = end;
+    pthread_mutex_unlock(&board.lock);
+    return overwritten;
+}
+
+void pmd_ainstream_stats(struct pmd_ain_stream* stream, struct pmd_ain_stream_stats* stats) {
+    pthread_mutex_lock(&board.lock);
+    *stats = stream->stats;
+    stats->samples = stream->committed * AIN_PKT_SAMPLES;
+    pthread_mutex_unlock(&board.lock);
+}
+
+/* Channel 0 drives the pendulum's torque */
+int pmd_aout(libusb_device_handle* pmdhandle, int channel, int value) {
+    double when;
+    int ret;
+    if (value < 0) {
+        value = 0;
+    } else if (value > 4095) {
+        value = 4095;
+    }
+    if ((ret = sim_exchange(pmdhandle, &when)) < 0) {
+        return ret;
+    }
+    pthread_mutex_lock(&board.lock);
+    pendulum_advance(when);
+    board.aout[channel & 1] = value;
+    pthread_mutex_unlock(&board.lock);
+    return 4;
+}
+
+int pmd_digconf(libusb_device_handle* pmdhandle, int port, int direction) {
+    double when;
+    int ret = sim_exchange(pmdhandle, &when);
+    (void)port;
+    (void)direction;
+    return ret < 0 ? ret : 3;
+}
+
+int pmd_digout(libusb_device_handle* pmdhandle, int port, int data) {
+    double when;
+    int ret = sim_exchange(pmdhandle, &when);
+    (void)port;
+    (void)data;
+    return ret < 0 ? ret : 3;
+}
+
+int pmd_digin(libusb_device_handle* pmdhandle, int port) {
+    int ports = pmd_digin16(pmdhandle);
+    return port == 0 ? ports & 0xff : (ports >> 8) & 0xff;
+}
+
+/* A failed read returns 0xffff, the real library's junk */
+int pmd_digin16(libusb_device_handle* pmdhandle) {
+    double when;
+    int value;
+    if (sim_exchange(pmdhandle, &when) < 0) {
+        return 0xffff;
+    }
+    pthread_mutex_lock(&board.lock);
+    value = (int)sim_ports(when);
+    pthread_mutex_unlock(&board.lock);
+    return value;
+}
+
+/* Streamed digital input.  Up to depth requests are in flight, each
+ * answered after its own latency, but never before the one ahead of it, as
+ * on the bus.  Failed transfers are counted and their readings lost; when
+ * the board goes away the stream stops. */
+struct pmd_digin_stream {
+    int depth;
+    double interval;
+    pmd_digin_callback callback;
+    void* user_data;
+    pthread_t worker;
+    volatile int stopping;
+    unsigned long seqno;
+    unsigned long errors;
+};
+
+static void* sim_digin_worker(void* arg) {
+    struct pmd_digin_stream* stream = (struct pmd_digin_stream*)arg;
+    struct pmd_digin_sample sample;
+    double sent[DIGIN_MAX_DEPTH], due[DIGIN_MAX_DEPTH];
+    int failed[DIGIN_MAX_DEPTH];
+    double now, next, latency, last_due = 0;
+    int n = 0, ret;
+
+    pthread_mutex_lock(&board.lock);
+    next = sim_now();
+    pthread_mutex_unlock(&board.lock);
+    while (!stream->stopping) {
+        /* send all that the depth and pacing allow */
+        pthread_mutex_lock(&board.lock);
+        now = sim_now();
+        while (n < stream->depth && (stream->interval <= 0 || next <= now)) {
+            ret = sim_transfer(&latency);
+            sent[n] = now;
+            due[n] = now + latency > last_due ? now + latency : last_due;
+            failed[n] = ret;
+            last_due = due[n];
+            n++;
+            if (stream->interval > 0) {
+                next += stream->interval;
+                if (next < now) {
+                    next = now + stream->interval;
+                }
+            }
+        }
+        pthread_mutex_unlock(&board.lock);
+
+        sim_wait(n ? due[0] : next, &stream->stopping);
+        pthread_mutex_lock(&board.lock);
+        now = sim_now();
+        if (n == 0 || now < due[0] || stream->stopping) {
+            pthread_mutex_unlock(&board.lock);
+            continue;
+        }
+        ret = failed[0];
+        sample.time = due[0];
+        sample.latency = due[0] - sent[0];
+        memmove(sent, sent + 1, (n - 1) * sizeof(double));
+        memmove(due, due + 1, (n - 1) * sizeof(double));
+        memmove(failed, failed + 1, (n - 1) * sizeof(int));
+        n--;
+        if (ret < 0) {
+            stream->errors++;
+            sim_count_error(ret);
+            if (ret == LIBUSB_ERROR_NO_DEVICE) {
+                stream->stopping = 1;
+            }
+            pthread_mutex_unlock(&board.lock);
+            continue;
+        }
+        pmd_histogram_add(&board.stats.stream, (unsigned long long)(1e9 * sample.latency));
+        sample.value = sim_ports(sample.time);
+        sample.seqno = ++stream->seqno;
+        pthread_mutex_unlock(&board.lock);
+        stream->callback(&sample, stream->user_data);
+    }
+    return 0;
+}
+
+struct pmd_digin_stream* pmd_digin_start(libusb_device_handle* pmdhandle,
+          int depth, int interval, pmd_digin_callback callback, void* user_data) {
+    struct pmd_digin_stream* stream;
+    if (pmdhandle != SIM_HANDLE || !board.open) {
+        err("digin_start on a device not opened by pmd_find_first or pmd_find_all\n");
+        return NULL;
+    }
+    if (!callback || depth < 1 || depth > DIGIN_MAX_DEPTH || interval < 0) {
+        err("invalid digin_start argument\n");
+        return NULL;
+    }
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->depth = depth;
+    stream->interval = 1e-6 * interval;
+    stream->callback = callback;
+    stream->user_data = user_data;
+    if (pthread_create(&stream->worker, NULL, sim_digin_worker, stream)) {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+void pmd_digin_stop(struct pmd_digin_stream* stream) {
+    if (!stream) {
+        return;
+    }
+    pthread_mutex_lock(&board.lock);
+    stream->stopping = 1;
+    pthread_mutex_unlock(&board.lock);
+    pthread_join(stream->worker, NULL);
+    free(stream);
+}
+
+unsigned long pmd_digin_readings(struct pmd_digin_stream* stream) {
+    unsigned long n;
+    pthread_mutex_lock(&board.lock);
+    n = stream->seqno;
+    pthread_mutex_unlock(&board.lock);
+    return n;
+}
+
+unsigned long pmd_digin_errors(struct pmd_digin_stream* stream) {
+    unsigned long n;
+    pthread_mutex_lock(&board.lock);
+    n = stream->errors;
+    pthread_mutex_unlock(&board.lock);
+    return n;
+}
+
+int pmd_digin_active(struct pmd_digin_stream* stream) {
+    int active;
+    pthread_mutex_lock(&board.lock);
+    active = !stream->stopping;
+    pthread_mutex_unlock(&board.lock);
+    return active;
+}
+
+/* The counter input is not driven, so it only counts what crst resets */
+int pmd_crst(libusb_device_handle* pmdhandle) {
+    double when;
+    int ret = sim_exchange(pmdhandle, &when);
+    if (ret < 0) {
+        return ret;
+    }
+    pthread_mutex_lock(&board.lock);
+    board.counter = 0;
+    pthread_mutex_unlock(&board.lock);
+    return 2;
+}
+
+unsigned long pmd_cin(libusb_device_handle* pmdhandle) {
+    double when;
+    sim_exchange(pmdhandle, &when);
+    return board.counter;
+}
+
+char* pmd_version(void) {
+    return VERSION "-sim";
+}
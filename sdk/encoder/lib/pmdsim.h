@@ -0,0 +1,65 @@
+#ifndef __PMDSIM_H__
+#define __PMDSIM_H__
+/* pmdsim.h  --  Settings for the simulated PMD1208FS.
+ *
+ * pmdsim.c implements everything in pmd1208fs.h against a simulated board,
+ * so a program linked with it instead of libpmd1208fs runs without the
+ * hardware.  The encoder on digital ports A and B (11 bits, wrapping at
+ * 2048) follows an angle waveform; analogue channel 0 reads the angle and
+ * channel 1 the angular velocity.
+ *
+ * The board is set up from a string of key=value settings, taken from the
+ * PMDSIM environment variable when it is first opened, or from
+ * pmdsim_configure.  The keys are:
+ *
+ *   source=pendulum|sine|file  where the angle comes from (pendulum)
+ *   file=PATH        recording for the file source: lines of time (s) and
+ *                    raw count, '#' for comments; played in a loop
+ *   amplitude=DEG    starting angle of the pendulum, or the sine amplitude (30)
+ *   period=S         period of the sine (2)
+ *   length=M mass=KG damping=NMS maxtorque=NM
+ *                    pendulum as in the pendulum simulator (1, 1, 0.05, 0);
+ *                    aout channel 0 drives the torque, 2048 being none
+ *   offset=COUNTS    count at zero angle (0)
+ *   noise=COUNTS     sd of noise added to each reading (0)
+ *   latency=US       per transfer, request to reply (1000)
+ *   jitter=US        sd of extra latency per transfer, never negative (100)
+ *   speed=X          simulated seconds per real second (1); 0 for a clock that
+ *                    only moves with the transfers, as fast as the host can go
+ *   fail=P           probability that a transfer fails (0)
+ *   glitch=P         probability that a reading has one bit flipped (0)
+ *   stuck=P          probability that a reading repeats the last one (0)
+ *   disconnect=N     the board goes away after N transfers (0 for never)
+ *   seed=N           for the faults, noise and jitter (1)
+ *
+ * Times in the digin stream samples are on the simulated clock, so the
+ * velocity an encoder fits from them is right whatever the speed.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Angle in radians at a simulated time in seconds */
+typedef double (*pmdsim_source)(double time, void* user_data);
+
+/* Apply settings, as described above, on top of the current ones.  Returns 0,
+ * or -EINVAL for a setting not understood (the rest are still applied) */
+int pmdsim_configure(const char* settings);
+
+/* Take the angle from a function instead, e.g. a wrapper round one of the
+ * pendulum simulator's environments.  NULL goes back to the configured source */
+void pmdsim_set_source(pmdsim_source source, void* user_data);
+
+/* The simulated clock, in seconds */
+double pmdsim_time(void);
+
+/* Transfers made so far, and how many of them failed */
+unsigned long pmdsim_transfers(void);
+unsigned long pmdsim_failures(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PMDSIM_H__ */
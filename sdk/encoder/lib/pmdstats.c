@@ -0,0 +1,102 @@
+/* pmdstats.c  --  Latency histograms and USB statistics for libpmd1208fs
+ *
+ * Shared by the library and the simulated board (pmdsim.c), which each keep
+ * a struct pmd_usb_stats per device and fill it in as transfers complete.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pmd1208fs.h"
+
+/* Values below PMD_HIST_SUB_BUCKETS ns have a bucket each; above that each
+ * power of two is split into PMD_HIST_SUB_BUCKETS equal buckets */
+#define SUB_BITS 4
+#define MAX_VALUE ((1ULL << (PMD_HIST_BUCKETS / PMD_HIST_SUB_BUCKETS + SUB_BITS - 1)) - 1)
+
+static int bucket_of(unsigned long long value) {
+    int msb;
+    if (value < PMD_HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    return (msb - SUB_BITS + 1) * PMD_HIST_SUB_BUCKETS
+        + (int)((value >> (msb - SUB_BITS)) & (PMD_HIST_SUB_BUCKETS - 1));
+}
+
+/* Highest value that falls in a bucket */
+static unsigned long long bucket_top(int bucket) {
+    int shift;
+    if (bucket < PMD_HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    shift = bucket / PMD_HIST_SUB_BUCKETS - 1;
+    return ((unsigned long long)(PMD_HIST_SUB_BUCKETS + bucket % PMD_HIST_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void pmd_histogram_add(struct pmd_histogram* hist, unsigned long long value) {
+    if (value > MAX_VALUE) {
+        value = MAX_VALUE;
+    }
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[bucket_of(value)]++;
+}
+
+unsigned long long pmd_histogram_percentile(const struct pmd_histogram* hist, double percentile) {
+    unsigned long long rank, seen = 0;
+    unsigned long long top;
+    int i;
+    if (hist->count == 0) {
+        return 0;
+    }
+    if (percentile <= 0) {
+        return hist->min;
+    }
+    rank = (unsigned long long)(percentile / 100.0 * hist->count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > hist->count) {
+        rank = hist->count;
+    }
+    for (i = 0; i < PMD_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    top = bucket_top(i);
+    return top > hist->max ? hist->max : top;
+}
+
+void pmd_histogram_print(FILE* file, const char* name, const struct pmd_histogram* hist) {
+    if (hist->count == 0) {
+        fprintf(file, "%s: none\n", name);
+        return;
+    }
+    fprintf(file, "%s: %llu, mean %.1f us, min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f us\n",
+            name, hist->count, 1e-3 * hist->sum / hist->count, 1e-3 * hist->min,
+            1e-3 * pmd_histogram_percentile(hist, 50), 1e-3 * pmd_histogram_percentile(hist, 90),
+            1e-3 * pmd_histogram_percentile(hist, 99), 1e-3 * pmd_histogram_percentile(hist, 99.9),
+            1e-3 * hist->max);
+}
+
+void pmd_usb_stats_print(FILE* file, const struct pmd_usb_stats* stats) {
+    int i;
+    pmd_histogram_print(file, "transactions", &stats->transaction);
+    pmd_histogram_print(file, "digin stream", &stats->stream);
+    for (i = 1; i < PMD_USB_ERRORS; i++) {
+        if (stats->errors[i]) {
+            fprintf(file, "%s: %lu\n", usb_get_errmsg(-i), stats->errors[i]);
+        }
+    }
+    if (stats->errors[0]) {
+        fprintf(file, "%s: %lu\n", usb_get_errmsg(LIBUSB_ERROR_OTHER), stats->errors[0]);
+    }
+}
@@ -1,38 +1,93 @@
 #include "encoder.h"
+#include "EncoderRecord.h"
+#include "EncoderShared.h"
 #include <iostream>
-#include <fstream>
-#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
+// Records the encoder for 20 seconds to encoderdata.enc, in the binary format of
+// sdk-clean/machinelearning/EncoderRecord.h.  Build with
+//   g++ -I../../sdk-clean/machinelearning main.cpp encoder.cpp
+//       ../../sdk-clean/machinelearning/EncoderRecord.cpp
+//       ../../sdk-clean/machinelearning/EncoderShared.cpp libpmd1208fs.o -lusb-1.0 -lpthread -lrt
+// and turn the recording into the old "ms<TAB>degrees" text with encoderconvert.
+// If the encoder daemon (encoderd) is running, every reading it publishes is recorded
+// instead of opening the device, so the logger can run alongside the controllers.
 
-int main()
-{
-    Encoder enc;
 
-    //enc.Calibrate();
-
-    std::ofstream myfile;
-    myfile.open("encoderdata.txt");
+static long long monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
 
-    double elapsedTime;
+int main()
+{
+    // readings are written in blocks from a thread of its own, so nothing here waits on the disk
+    EncoderRecorder recorder("encoderdata.enc");
+    if (!recorder.IsOpen())
+        return 1;
 
-    timeval t;
+    EncoderSubscriber daemon;
+    const bool shared = daemon.Open() && daemon.IsAlive();
+    EncoderSharedCursor cursor;
+    if (shared){
+        daemon.Cursor(cursor);
+        std::cout << "Recording from the encoder daemon" << std::endl;
+    }
 
+    // only opened if there is no daemon, which would hold the device
+    Encoder* enc = shared ? NULL : new Encoder;
 
-    //for (int i = 0; i < 100; i++){
+    //enc->Calibrate();
 
-    timeval to;
-    gettimeofday(&to, NULL);
+    const long long start = monotonicNs();
+    long long now = start;
+    long long report = start + 1000000000LL;
+    unsigned long readings = 0, lastReadings = 0;
+    float angle = 0;
 
-    while (elapsedTime < 20000.0){
-        float temp = enc.GetAngle();
-        gettimeofday(&t, NULL);
+    while (now - start < 20000000000LL){
+        if (shared){
+            // everything published since the last time round, marking any the ring lost
+            EncoderSharedReading reading;
+            unsigned long lost = cursor.lost;
+            while (daemon.Next(cursor, reading)){
+                unsigned int flags = reading.flags;
+                if (cursor.lost != lost){
+                    flags |= EncoderRecord::GAP;
+                    lost = cursor.lost;
+                }
+                recorder.Add(static_cast<long long>(reading.time * 1e9 + 0.5), reading.raw, reading.number, flags);
+                angle = reading.raw * (360.0 / 2048.0);
+                ++readings;
+            }
+            usleep(1000);
+            now = monotonicNs();
+        }
+        else {
+            enc->GetAngle();
+            now = monotonicNs();
+            recorder.Add(now, static_cast<unsigned int>(enc->raw_angle), ++readings);
+            angle = enc->actual_angle - enc->cal;
+        }
 
-        elapsedTime = (t.tv_sec - to.tv_sec) * 1000;
-        elapsedTime += (t.tv_usec - to.tv_usec) / 1000;
-        myfile << elapsedTime << "\t" << temp << std::endl;
-        std::cout << elapsedTime << "\t" << temp << std::endl;
+        // a summary each second rather than a line per reading
+        if (now >= report){
+            std::cout << (now - start) / 1000000 << " ms\t" << angle << " deg\t"
+                      << readings - lastReadings << " readings/s" << std::endl;
+            lastReadings = readings;
+            report += 1000000000LL;
+        }
      }
 
+    recorder.Close();
+    std::cout << readings << " readings, " << recorder.GetDropped() << " dropped";
+    if (shared)
+        std::cout << ", " << cursor.lost << " missed";
+    std::cout << std::endl;
 
+    delete enc;
     return 0;
 }
@@ -0,0 +1,63 @@
+/* Flywheel swing model: a damped pendulum whose flywheel mass moves up and down it
+ * at frequency w, shared by gsltest and the sweep
+ */
+
+#ifndef FLYWHEEL_H_
+#define FLYWHEEL_H_
+
+#include <cmath>
+
+const double m = 2;		// Mass of pendulum
+const double M = 5;		// Mass of flywheel
+const double I = 2;		// Inertia of flywheel
+const double g = -9.81;		// g
+const double l = 2;		// Length of pendulum
+const int dimension = 2;	// Dimension of system 
+
+// The derivative of theta and w
+struct PrimeFunc
+{
+	double w;
+	double b;
+	void operator()(double t, const double y[], double dydt[]);
+};
+inline double phi(double t, double w);
+inline double dphi(double t, double w);
+inline double ddphi(double t, double w);
+inline double h(double t, double w);
+inline double dh(double t, double w);
+
+// Derivatives of theta and w
+inline void PrimeFunc::operator()(double t, const double y[], double dydt[])
+{
+	dydt[0] = y[1];
+	dydt[1] = (2.0 * M * y[1] * dh(t, w) * (l - h(t, w)) - I * ddphi(t, w) - g * sin(y[0]) * (m * l + M * (l - h(t, w)))) 
+		/ (m * l * l + M * pow((l - h(t, w)), 2.0) + I) - b * y[1];
+}
+
+inline double phi(double t, double w)
+{
+	return 0;
+}
+
+inline double dphi(double t, double w)
+{
+	return 0;
+}
+
+inline double ddphi(double t, double w)
+{
+	return 0;
+}
+
+inline double h(double t, double w)
+{
+	return (l / 4.0) * (1.0 + sin(w * t));
+}
+
+inline double dh(double t, double w)
+{
+	return (l * w / 4.0) * cos(w * t);
+}
+
+#endif /* FLYWHEEL_H_ */
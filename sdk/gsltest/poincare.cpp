@@ -0,0 +1,119 @@
+/* Stroboscopic map of the flywheel swing model
+ *
+ * Tabulates the state one forcing period 2 pi / w on (see PoincareMap.h), or loads it from the cache file if one
+ * was saved for the same grid and model, and checks the table against direct integration. It then steps a swing
+ * from theta0 (at rest) through the given number of periods with the table, alongside direct integration for
+ * comparison, writing one line per period: period, theta - pi and omega from the table, then from integration.
+ *
+ * Usage: poincare [-w w] [-b b] [-n thetaPoints] [-m omegaPoints] [-W omegaMax] [-i theta0] [-P periods] [-e tolerance] [-j threads] [-c cache]
+ *	e.g. poincare -w 4.5 -b 0.55 -n 512 -m 512 -P 500 > periods.txt
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <sys/time.h>
+#include <unistd.h>
+#include "DormandPrince.h"
+#include "PoincareMap.h"
+#include "flywheel.h"
+
+// Wall clock time in seconds
+double wallTime()
+{
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + 1e-6 * now.tv_usec;
+}
+
+void usage()
+{
+	std::fprintf(stderr, "Usage: poincare [-w w] [-b b] [-n thetaPoints] [-m omegaPoints] [-W omegaMax] [-i theta0] [-P periods] [-e tolerance] [-j threads] [-c cache]\n");
+	std::exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+	PrimeFunc par;
+	par.w = 4.5;
+	par.b = 0.55;
+	int thetaPoints = 256;
+	int omegaPoints = 256;
+	double omegaMax = 8;
+	double theta0 = 5.0 * M_PI / 4.0;
+	int periods = 200;
+	double tolerance = 1e-10;
+	int threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+	const char* cachePath = "poincare.bin";
+
+	int option;
+	while ((option = getopt(argc, argv, "w:b:n:m:W:i:P:e:j:c:")) != -1)
+	{
+		switch (option)
+		{
+		case 'w': par.w = std::atof(optarg); break;
+		case 'b': par.b = std::atof(optarg); break;
+		case 'n': thetaPoints = std::atoi(optarg); break;
+		case 'm': omegaPoints = std::atoi(optarg); break;
+		case 'W': omegaMax = std::atof(optarg); break;
+		case 'i': theta0 = std::atof(optarg); break;
+		case 'P': periods = std::atoi(optarg); break;
+		case 'e': tolerance = std::atof(optarg); break;
+		case 'j': threads = std::atoi(optarg); break;
+		case 'c': cachePath = optarg; break;
+		default: usage();
+		}
+	}
+	if (thetaPoints < 4 || omegaPoints < 4 || !(omegaMax > 0) || !(par.w > 0)) usage();
+
+	// The cache is only used for the same model and integration tolerance
+	std::vector<double> key;
+	key.push_back(par.w);
+	key.push_back(par.b);
+	key.push_back(tolerance);
+
+	PoincareMap<PrimeFunc> map(thetaPoints, omegaPoints, omegaMax, 2.0 * M_PI / par.w);
+	double start = wallTime();
+	if (map.load(cachePath, key))
+	{
+		std::fprintf(stderr, "Loaded %s in %.3f s\n", cachePath, wallTime() - start);
+	}
+	else
+	{
+		if (!map.build(par, tolerance, threads)) std::fprintf(stderr, "Some nodes failed to integrate\n");
+		std::fprintf(stderr, "Built %d x %d map on %d threads in %.3f s\n", thetaPoints, omegaPoints, threads, wallTime() - start);
+		if (!map.save(cachePath, key)) std::fprintf(stderr, "Could not save %s\n", cachePath);
+	}
+
+	PoincareError error = map.check(par, 1000, tolerance);
+	std::fprintf(stderr, "One period against integration: theta max %.3g rms %.3g, omega max %.3g rms %.3g\n",
+		error.maxTheta, error.rmsTheta, error.maxOmega, error.rmsOmega);
+
+	// the same swing stepped by the table and by integration
+	double theta = theta0, omega = 0;
+	double y[dimension] = {theta0, 0};
+	double tableTime = 0, directTime = 0;
+	std::printf("#period\ttheta_map\tomega_map\ttheta_direct\tomega_direct\n");
+	for (int k = 1; k <= periods; ++k)
+	{
+		start = wallTime();
+		bool onTable = map.advance(theta, omega);
+		tableTime += wallTime() - start;
+
+		start = wallTime();
+		map.integrate(par, y, tolerance);
+		directTime += wallTime() - start;
+
+		if (!onTable)
+		{
+			std::fprintf(stderr, "omega %g left the table after %d periods\n", omega, k - 1);
+			break;
+		}
+		std::printf("%d\t%.10g\t%.10g\t%.10g\t%.10g\n", k, theta - M_PI, omega, y[0] - M_PI, y[1]);
+	}
+	std::fprintf(stderr, "%d periods: table %.3g s, direct integration %.3g s\n", periods, tableTime, directTime);
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+/* Parallel resonance sweep of the flywheel swing model
+ *
+ * Every combination of forcing frequency w, damping b and initial angle is integrated to tFinal on a pool of
+ * threads. Instead of printing every step, each run keeps summary statistics of its steady state (the last part of
+ * the run, from transient * tFinal): the amplitude about the stable point, and from the upward zero crossings the
+ * period and the phase relative to the forcing sin(w t). Crossings and extremes are located on the solver's dense
+ * output, so they do not depend on its step size. One line per run is written to the results file, in grid order.
+ *
+ * Usage: sweep [-w lo:hi:n] [-b lo:hi:n] [-i theta0,theta0,...] [-T tFinal] [-s transient] [-e tolerance] [-j threads] [-o file]
+ *	e.g. sweep -w 4:5:101 -b 0.05:0.95:10 -j 8 -o resonance.txt
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "DormandPrince.h"
+#include "flywheel.h"
+
+// One point of the grid and what was found there
+struct Run
+{
+	double w;
+	double b;
+	double theta0;
+
+	double amplitude;	// Largest |theta - pi| in the steady state (pi if it goes over the top)
+	double period;		// Mean time between upward zero crossings, 0 if fewer than two
+	double phase;		// Circular mean of w t at the upward crossings, in [-pi, pi]
+	long rotations;		// Net turns over the top during the steady state, positive with theta increasing
+	long crossings;
+	unsigned long evaluations;
+	bool failed;		// The step size fell below the minimum
+};
+
+// Shared between the workers
+struct Sweep
+{
+	std::vector<Run>* runs;
+	double tFinal;
+	double transient;
+	double tolerance;
+	volatile long next;	// Next run to take, claimed with __sync_fetch_and_add
+};
+
+// Angle from the stable point (theta = pi, as g < 0), in [-pi, pi]
+double deviation(double theta)
+{
+	double d = std::fmod(theta - M_PI, 2.0 * M_PI);
+	if (d > M_PI) d -= 2.0 * M_PI;
+	else if (d < -M_PI) d += 2.0 * M_PI;
+	return d;
+}
+
+// Value of a component of the dense output, or the deviation of the angle, at time t
+double sampled(const DormandPrince<dimension>& solver, double t, int component)
+{
+	double y[dimension];
+	solver.interpolate(t, y);
+	return component == 0 ? deviation(y[0]) : y[component];
+}
+
+// Time within [ta, tb] where a component of the dense output changes sign, by bisection
+double bisect(const DormandPrince<dimension>& solver, double ta, double tb, int component)
+{
+	double fa = sampled(solver, ta, component);
+	for (int k = 0; k < 50 && tb - ta > 1e-12; ++k)
+	{
+		double tm = 0.5 * (ta + tb);
+		double fm = sampled(solver, tm, component);
+		if ((fm < 0) == (fa < 0))
+		{
+			ta = tm;
+			fa = fm;
+		}
+		else
+		{
+			tb = tm;
+		}
+	}
+	return 0.5 * (ta + tb);
+}
+
+// Integrate one run, gathering its statistics as it goes
+void integrate(Run& run, double tFinal, double transient, double tolerance)
+{
+	PrimeFunc par;
+	par.w = run.w;
+	par.b = run.b;
+	double y[dimension] = {run.theta0, 0};
+
+	DormandPrince<dimension> solver(tolerance, tolerance);
+	solver.reset(0, y);
+
+	const double tSteady = transient * tFinal;
+	double amplitude = 0;
+	double firstCrossing = 0;
+	double lastCrossing = 0;
+	double sumCos = 0;
+	double sumSin = 0;
+	long rotations = 0;
+	long crossings = 0;
+	bool steady = false;
+
+	run.failed = false;
+	while (solver.getTime() < tFinal)
+	{
+		double previousTheta = solver.getState()[0];
+		double previousOmega = solver.getState()[1];
+		if (!solver.step(par, tFinal))
+		{
+			run.failed = true;
+			break;
+		}
+		double t0 = solver.getPreviousTime();
+		double t1 = solver.getTime();
+		if (t1 < tSteady) continue;
+
+		// the steady state may start part way through this step
+		if (!steady)
+		{
+			if (t0 < tSteady)
+			{
+				t0 = tSteady;
+				double start[dimension];
+				solver.interpolate(t0, start);
+				previousTheta = start[0];
+				previousOmega = start[1];
+			}
+			steady = true;
+		}
+
+		double theta = solver.getState()[0];
+		double omega = solver.getState()[1];
+		double d0 = deviation(previousTheta);
+		double d1 = deviation(theta);
+		amplitude = std::max(amplitude, std::max(std::abs(d0), std::abs(d1)));
+
+		// an extreme within the step
+		if ((previousOmega < 0) != (omega < 0))
+		{
+			amplitude = std::max(amplitude, std::abs(sampled(solver, bisect(solver, t0, t1, 1), 0)));
+		}
+
+		// the deviation wraps round from pi to -pi going over the top with theta increasing, and back decreasing
+		if (std::abs(d1 - d0) >= M_PI) rotations += d0 > d1 ? 1 : -1;
+
+		// an upward zero crossing, not counting the jump where the deviation wraps round at the top
+		else if (d0 < 0 && d1 >= 0)
+		{
+			double tc = bisect(solver, t0, t1, 0);
+			if (crossings == 0) firstCrossing = tc;
+			lastCrossing = tc;
+			sumCos += std::cos(run.w * tc);
+			sumSin += std::sin(run.w * tc);
+			++crossings;
+		}
+	}
+
+	run.amplitude = amplitude;
+	run.crossings = crossings;
+	run.period = crossings > 1 ? (lastCrossing - firstCrossing) / (crossings - 1) : 0;
+	run.phase = crossings > 0 ? std::atan2(sumSin, sumCos) : 0;
+	run.rotations = rotations;
+	run.evaluations = solver.getEvaluations();
+}
+
+// Worker thread: takes runs from the shared counter until there are none left
+void* sweepWorker(void* arg)
+{
+	Sweep& sweep = *static_cast<Sweep*>(arg);
+	std::vector<Run>& runs = *sweep.runs;
+	for (long n = __sync_fetch_and_add(&sweep.next, 1L); n < static_cast<long>(runs.size()); n = __sync_fetch_and_add(&sweep.next, 1L))
+	{
+		integrate(runs[n], sweep.tFinal, sweep.transient, sweep.tolerance);
+	}
+	return NULL;
+}
+
+// Values from "lo:hi:n", n evenly spaced from lo to hi inclusive
+bool parseRange(const char* text, std::vector<double>& values)
+{
+	double lo, hi;
+	int n;
+	if (std::sscanf(text, "%lf:%lf:%d", &lo, &hi, &n) != 3 || n < 1) return false;
+	values.clear();
+	for (int i = 0; i < n; ++i) values.push_back(n > 1 ? lo + (hi - lo) * i / (n - 1) : lo);
+	return true;
+}
+
+// A number that takes up the whole of the text
+bool parseNumber(const std::string& text, double& value)
+{
+	char* end = NULL;
+	value = std::strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+// Values from "a,b,c"
+bool parseList(const char* text, std::vector<double>& values)
+{
+	values.clear();
+	std::string list(text);
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if (end == std::string::npos) end = list.size();
+		double value;
+		if (!parseNumber(list.substr(start, end - start), value)) return false;
+		values.push_back(value);
+		start = end + 1;
+	}
+	return !values.empty();
+}
+
+void usage()
+{
+	std::fprintf(stderr, "Usage: sweep [-w lo:hi:n] [-b lo:hi:n] [-i theta0,...] [-T tFinal] [-s transient] [-e tolerance] [-j threads] [-o file]\n");
+	std::exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+	// Defaults cover the run gsltest makes, w = 4.5 and b = 0.55 from 5 pi / 4
+	std::vector<double> ws(1, 4.5);
+	std::vector<double> bs(1, 0.55);
+	std::vector<double> theta0s(1, 5.0 * M_PI / 4.0);
+	double tFinal = 1000;
+	double transient = 0.95;
+	double tolerance = 1e-10;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char* outputPath = "sweep.txt";
+
+	int option;
+	while ((option = getopt(argc, argv, "w:b:i:T:s:e:j:o:")) != -1)
+	{
+		switch (option)
+		{
+		case 'w': if (!parseRange(optarg, ws)) usage(); break;
+		case 'b': if (!parseRange(optarg, bs)) usage(); break;
+		case 'i': if (!parseList(optarg, theta0s)) usage(); break;
+		case 'T': if (!parseNumber(optarg, tFinal)) usage(); break;
+		case 's': if (!parseNumber(optarg, transient)) usage(); break;
+		case 'e': if (!parseNumber(optarg, tolerance)) usage(); break;
+		case 'j': threads = std::atol(optarg); break;
+		case 'o': outputPath = optarg; break;
+		default: usage();
+		}
+	}
+	if (threads < 1) threads = 1;
+
+	std::vector<Run> runs;
+	for (size_t i = 0; i < bs.size(); ++i)
+	{
+		for (size_t j = 0; j < ws.size(); ++j)
+		{
+			for (size_t k = 0; k < theta0s.size(); ++k)
+			{
+				Run run = Run();
+				run.b = bs[i];
+				run.w = ws[j];
+				run.theta0 = theta0s[k];
+				runs.push_back(run);
+			}
+		}
+	}
+	if (static_cast<size_t>(threads) > runs.size()) threads = static_cast<long>(runs.size());
+
+	std::fprintf(stderr, "Running %lu configurations to t = %g on %ld threads\n", static_cast<unsigned long>(runs.size()), tFinal, threads);
+
+	Sweep sweep;
+	sweep.runs = &runs;
+	sweep.tFinal = tFinal;
+	sweep.transient = transient;
+	sweep.tolerance = tolerance;
+	sweep.next = 0;
+
+	std::vector<pthread_t> workers(threads);
+	for (long k = 0; k < threads; ++k) pthread_create(&workers[k], NULL, sweepWorker, &sweep);
+	for (long k = 0; k < threads; ++k) pthread_join(workers[k], NULL);
+
+	FILE* output = std::fopen(outputPath, "w");
+	if (!output)
+	{
+		std::perror(outputPath);
+		return 1;
+	}
+	std::fprintf(output, "#b\tw\ttheta0\tamplitude\tperiod\tphase\trotations\tcrossings\tevaluations\tfailed\n");
+	for (size_t n = 0; n < runs.size(); ++n)
+	{
+		const Run& run = runs[n];
+		std::fprintf(output, "%.6g\t%.6g\t%.6g\t%.10g\t%.10g\t%.6g\t%ld\t%ld\t%lu\t%d\n",
+			run.b, run.w, run.theta0, run.amplitude, run.period, run.phase, run.rotations, run.crossings, run.evaluations, run.failed ? 1 : 0);
+	}
+	std::fclose(output);
+
+	return 0;
+}